@@ -0,0 +1,30 @@
+#pragma once
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Replaces the global allocation functions to count every heap allocation
+// and release made by the process. Include from exactly one translation
+// unit of a benchmark binary. They are kept out of line, as they would be
+// in their own translation unit (see src/Stats.cpp): once inlined, GCC
+// sees new/delete paired with malloc/free and warns -Wmismatched-new-delete.
+namespace alloc_counter {
+    inline std::atomic<size_t> allocations{0};
+    inline std::atomic<size_t> frees{0};
+}
+
+[[gnu::noinline]] void* operator new(size_t size) {
+    alloc_counter::allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void* p) noexcept {
+    if (p) alloc_counter::frees.fetch_add(1, std::memory_order_relaxed);
+    std::free(p);
+}
+
+[[gnu::noinline]] void operator delete(void* p, size_t) noexcept {
+    if (p) alloc_counter::frees.fetch_add(1, std::memory_order_relaxed);
+    std::free(p);
+}
@@ -0,0 +1,138 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// A small repetition harness for benchmarks that track regressions: every
+// case runs a few warmup passes, then timed repetitions until both a
+// minimum count and a time budget are reached, and reports the median and
+// 99th percentile pass and the median throughput. Results print as a table
+// while running and can be written out as one JSON document.
+namespace bench {
+
+// Keeps value, and everything that produced it, from being optimized away
+template <typename T>
+inline void keep(const T& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+struct Options {
+    size_t warmup = 2;
+    size_t min_repetitions = 5;
+    size_t max_repetitions = 1000;
+    // Repetitions stop after this long past min_repetitions, untimed setup
+    // included, so cheap passes behind an expensive setup stay bounded
+    double budget_seconds = 1.0;
+};
+
+struct Result {
+    std::string name;
+    std::string shape;
+    // Processed per pass, for bytes/s
+    uint64_t bytes = 0;
+    size_t repetitions = 0;
+    double median_seconds = 0;
+    double p99_seconds = 0;
+    double min_seconds = 0;
+
+    double bytes_per_second() const {
+        return median_seconds > 0 ? bytes / median_seconds : 0;
+    }
+};
+
+class Harness {
+private:
+    Options options_m;
+    std::vector<Result> results_m;
+
+    static double percentile(const std::vector<double>& sorted, double p) {
+        // nearest rank, so p99 of fewer than 100 passes is the slowest
+        size_t rank = static_cast<size_t>(p * sorted.size() + 0.999999);
+        return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+    }
+
+    static void print_row(const Result& result) {
+        std::fprintf(stderr, "%-16s%-18s%8zu%14.3f%14.3f%14.1f\n", result.name.c_str(), result.shape.c_str(),
+                     result.repetitions, result.median_seconds * 1e3, result.p99_seconds * 1e3,
+                     result.bytes_per_second() / 1e6);
+    }
+
+public:
+    explicit Harness(Options options = {}) : options_m(options) {
+        std::fprintf(stderr, "%-16s%-18s%8s%14s%14s%14s\n", "case", "shape", "reps", "median ms", "p99 ms", "MB/s");
+    }
+
+    // Times pass(setup()) repeatedly. setup runs untimed before every pass
+    // and hands its state to pass; whatever pass returns is released only
+    // after the clock stops.
+    template <typename Setup, typename Pass>
+    const Result& run(std::string name, std::string shape, uint64_t bytes, Setup&& setup, Pass&& pass) {
+        auto first = std::chrono::steady_clock::now();
+        auto elapsed = [&] { return std::chrono::duration<double>(std::chrono::steady_clock::now() - first).count(); };
+        // one warmup pass is plenty for passes longer than the budget
+        for (size_t i = 0; i < options_m.warmup && (i == 0 || elapsed() < options_m.budget_seconds); i++) {
+            auto state = setup();
+            keep(pass(state));
+        }
+
+        std::vector<double> samples;
+        first = std::chrono::steady_clock::now();
+        while (samples.size() < options_m.max_repetitions
+               && (samples.size() < options_m.min_repetitions || elapsed() < options_m.budget_seconds)) {
+            auto state = setup();
+            auto start = std::chrono::steady_clock::now();
+            auto output = pass(state);
+            auto end = std::chrono::steady_clock::now();
+            keep(output);
+            samples.push_back(std::chrono::duration<double>(end - start).count());
+        }
+        std::sort(samples.begin(), samples.end());
+
+        Result result;
+        result.name = std::move(name);
+        result.shape = std::move(shape);
+        result.bytes = bytes;
+        result.repetitions = samples.size();
+        result.median_seconds = percentile(samples, 0.5);
+        result.p99_seconds = percentile(samples, 0.99);
+        result.min_seconds = samples.front();
+        print_row(result);
+        results_m.push_back(std::move(result));
+        return results_m.back();
+    }
+
+    // run() without per-pass state
+    template <typename Pass>
+    const Result& run(std::string name, std::string shape, uint64_t bytes, Pass&& pass) {
+        return run(std::move(name), std::move(shape), bytes, [] { return 0; }, [&](int) { return pass(); });
+    }
+
+    const std::vector<Result>& results() const {
+        return results_m;
+    }
+
+    // {"suite", "revision", "options", "results": [...]}, times in
+    // nanoseconds. Names and shapes are plain identifiers, not escaped.
+    void write_json(std::FILE* out, const std::string& suite, const std::string& revision) const {
+        std::fprintf(out, "{\n  \"suite\": \"%s\",\n  \"revision\": \"%s\",\n", suite.c_str(), revision.c_str());
+        std::fprintf(out, "  \"options\": {\"warmup\": %zu, \"min_repetitions\": %zu, \"budget_seconds\": %g},\n",
+                     options_m.warmup, options_m.min_repetitions, options_m.budget_seconds);
+        std::fprintf(out, "  \"results\": [");
+        for (size_t i = 0; i < results_m.size(); i++) {
+            const Result& result = results_m[i];
+            std::fprintf(out,
+                         "%s\n    {\"name\": \"%s\", \"shape\": \"%s\", \"bytes\": %llu, \"repetitions\": %zu, "
+                         "\"median_ns\": %.0f, \"p99_ns\": %.0f, \"min_ns\": %.0f, \"bytes_per_second\": %.0f}",
+                         i == 0 ? "" : ",", result.name.c_str(), result.shape.c_str(),
+                         static_cast<unsigned long long>(result.bytes), result.repetitions,
+                         result.median_seconds * 1e9, result.p99_seconds * 1e9, result.min_seconds * 1e9,
+                         result.bytes_per_second());
+        }
+        std::fprintf(out, "\n  ]\n}\n");
+    }
+};
+
+} // namespace bench
@@ -0,0 +1,48 @@
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include "Crc32.hpp"
+
+// Reports CRC-32 throughput in GB/s for every engine the CPU supports
+int main() {
+    const Crc32Engine engines[] = {
+        Crc32Engine::Table, Crc32Engine::Slicing8, Crc32Engine::Slicing16, Crc32Engine::Clmul
+    };
+    const size_t sizes[] = {64, 1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024};
+
+    std::vector<uint8_t> buffer(sizes[4]);
+    for (size_t i = 0; i < buffer.size(); i++) {
+        buffer[i] = static_cast<uint8_t>(i * 2654435761u >> 24);
+    }
+
+    std::printf("%-14s", "size");
+    for (auto engine : engines) {
+        if (Crc32::is_supported(engine)) std::printf("%16s", Crc32::engine_name(engine));
+    }
+    std::printf("\n");
+
+    volatile uint32_t sink = 0;
+    for (size_t size : sizes) {
+        std::printf("%-14zu", size);
+        for (auto engine : engines) {
+            if (!Crc32::is_supported(engine)) continue;
+
+            // aim for ~64 MB hashed per measurement, at least a few passes
+            size_t iterations = std::max<size_t>(4, (64u << 20) / size);
+            uint32_t crc = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < iterations; i++) {
+                crc = Crc32::update_with(engine, crc, buffer.data(), size);
+            }
+            auto end = std::chrono::steady_clock::now();
+            sink = sink ^ crc;
+
+            double seconds = std::chrono::duration<double>(end - start).count();
+            double gbps = (double(size) * iterations) / seconds / 1e9;
+            std::printf("%12.2f GB/s", gbps);
+        }
+        std::printf("\n");
+    }
+    std::printf("active engine: %s\n", Crc32::engine_name(Crc32::engine()));
+    return 0;
+}
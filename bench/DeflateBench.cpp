@@ -0,0 +1,93 @@
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include "Deflate.hpp"
+#include "ThreadPool.hpp"
+
+namespace {
+
+// Word salad over a small vocabulary, compresses roughly like prose
+std::vector<uint8_t> text_data(size_t size) {
+    const char* words[] = {"chunk", "image", "payload", "deflate", "the", "of", "and", "PNG",
+                           "stream", "window", "match", "literal", "block", "header", "crc", "data"};
+    std::mt19937 rng(42);
+    std::vector<uint8_t> data;
+    data.reserve(size);
+    while (data.size() < size) {
+        std::string word = words[rng() % 16];
+        data.insert(data.end(), word.begin(), word.end());
+        data.push_back(rng() % 12 == 0 ? '\n' : ' ');
+    }
+    data.resize(size);
+    return data;
+}
+
+// Smooth 8-bit gradient with noise, like raw image rows
+std::vector<uint8_t> image_data(size_t size) {
+    std::mt19937 rng(7);
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; i++) {
+        data[i] = static_cast<uint8_t>((i % 1024) / 4 + rng() % 8);
+    }
+    return data;
+}
+
+std::vector<uint8_t> noise_data(size_t size) {
+    std::mt19937 rng(1);
+    std::vector<uint8_t> data(size);
+    for (auto& byte : data) {
+        byte = static_cast<uint8_t>(rng());
+    }
+    return data;
+}
+
+template <typename F>
+double time_seconds(F&& f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+// Reports compression ratio against deflate and inflate MB/s for every
+// level, serial and with compress_parallel() on one worker per core
+int main() {
+    const size_t size = 8 * 1024 * 1024;
+    struct Input {
+        const char* name;
+        std::vector<uint8_t> data;
+    };
+    const Input inputs[] = {
+        {"text", text_data(size)},
+        {"image", image_data(size)},
+        {"random", noise_data(size)},
+    };
+
+    ThreadPool pool;
+    std::printf("threads: %zu, input: %zu bytes\n", pool.size(), size);
+    std::printf("%-8s%-7s%10s%14s%14s%16s\n", "input", "level", "ratio", "serial MB/s", "parallel MB/s", "inflate MB/s");
+
+    for (const auto& input : inputs) {
+        for (int level = 0; level <= 9; level++) {
+            std::vector<uint8_t> serial;
+            std::vector<uint8_t> parallel;
+            std::vector<uint8_t> inflated;
+            double serial_seconds = time_seconds([&] { serial = Deflate::compress(input.data, level); });
+            double parallel_seconds = time_seconds([&] { parallel = Deflate::compress_parallel(input.data, level, pool); });
+            double inflate_seconds = time_seconds([&] { inflated = Deflate::decompress(serial); });
+            if (inflated != input.data || Deflate::decompress(parallel) != input.data) {
+                std::printf("round trip failed at level %d\n", level);
+                return 1;
+            }
+
+            double mb = input.data.size() / 1e6;
+            std::printf("%-8s%-7d%10.3f%14.1f%14.1f%16.1f\n", input.name, level,
+                        double(serial.size()) / input.data.size(), mb / serial_seconds,
+                        mb / parallel_seconds, mb / inflate_seconds);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,149 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "PNG.hpp"
+#include "BenchHarness.hpp"
+
+#ifndef BENCH_REVISION
+#define BENCH_REVISION "unknown"
+#endif
+
+namespace {
+
+void put_be32(std::vector<uint8_t>& out, uint32_t value) {
+    out.insert(out.end(), {uint8_t(value >> 24), uint8_t(value >> 16), uint8_t(value >> 8), uint8_t(value)});
+}
+
+void put_chunk(std::vector<uint8_t>& out, const ChunkType& type, size_t size, uint32_t seed) {
+    put_be32(out, static_cast<uint32_t>(size));
+    auto type_bytes = type.bytes();
+    out.insert(out.end(), type_bytes.begin(), type_bytes.end());
+    size_t start = out.size();
+    out.resize(start + size);
+    for (size_t i = 0; i < size; i++) {
+        out[start + i] = static_cast<uint8_t>((i + seed) * 2654435761u >> 24);
+    }
+    put_be32(out, Chunk::compute_crc(type, std::span<const uint8_t>(out).subspan(start, size)));
+}
+
+// A valid 1x1 grayscale file with chunk_count IDAT chunks of chunk_size
+// bytes, written straight to bytes so even the largest shapes are only
+// held once
+std::vector<uint8_t> synthetic_png(size_t chunk_count, size_t chunk_size) {
+    std::vector<uint8_t> out(PNG::STANDARD_HEADER);
+    out.reserve(out.size() + 25 + chunk_count * (chunk_size + 12) + 12);
+
+    std::vector<uint8_t> ihdr;
+    put_be32(ihdr, 1);
+    put_be32(ihdr, 1);
+    ihdr.insert(ihdr.end(), {8, 0, 0, 0, 0});
+    put_be32(out, 13);
+    out.insert(out.end(), {'I', 'H', 'D', 'R'});
+    out.insert(out.end(), ihdr.begin(), ihdr.end());
+    put_be32(out, Chunk::compute_crc(ChunkType::fromStr("IHDR"), ihdr));
+
+    ChunkType idat = ChunkType::fromStr("IDAT");
+    for (size_t i = 0; i < chunk_count; i++) {
+        put_chunk(out, idat, chunk_size, static_cast<uint32_t>(i));
+    }
+    put_chunk(out, ChunkType::fromStr("IEND"), 0, 0);
+    return out;
+}
+
+std::string shape_name(size_t chunk_count, size_t chunk_size) {
+    std::string size;
+    if (chunk_size >= (1u << 30) && chunk_size % (1u << 30) == 0) size = std::to_string(chunk_size >> 30) + "GiB";
+    else if (chunk_size >= (1u << 20) && chunk_size % (1u << 20) == 0) size = std::to_string(chunk_size >> 20) + "MiB";
+    else if (chunk_size >= (1u << 10) && chunk_size % (1u << 10) == 0) size = std::to_string(chunk_size >> 10) + "KiB";
+    else size = std::to_string(chunk_size) + "B";
+    return std::to_string(chunk_count) + "x" + size;
+}
+
+void bench_shape(bench::Harness& harness, size_t chunk_count, size_t chunk_size) {
+    const std::string shape = shape_name(chunk_count, chunk_size);
+    const std::vector<uint8_t> bytes = synthetic_png(chunk_count, chunk_size);
+    const uint64_t data_bytes = uint64_t(chunk_count) * chunk_size;
+    auto copy = [&] { return bytes; };
+
+    // the input copy is made untimed, the constructor consumes it
+    harness.run("parse", shape, bytes.size(), copy, [](std::vector<uint8_t>& input) {
+        return PNG(std::move(input));
+    });
+    harness.run("parse_arena", shape, bytes.size(), copy, [](std::vector<uint8_t>& input) {
+        return PNG(std::move(input), ChunkStorage::Arena);
+    });
+    harness.run("parse_lazy", shape, bytes.size(), copy, [](std::vector<uint8_t>& input) {
+        return PNG(std::move(input), Validation::Lazy);
+    });
+
+    PNG png(bytes);
+    // what Chunk::calculate_crc() does for every chunk
+    harness.run("calculate_crc", shape, data_bytes, [&] {
+        uint32_t crcs = 0;
+        for (const auto& chunk : png.chunks()) {
+            crcs ^= Chunk::compute_crc(chunk.chunktype(), chunk.data());
+        }
+        return crcs;
+    });
+    harness.run("as_bytes", shape, bytes.size(), [&] {
+        return png.as_bytes();
+    });
+    {
+        std::vector<uint8_t> buffer(png.serialized_size());
+        harness.run("write_to", shape, bytes.size(), [&] {
+            return png.write_to(buffer);
+        });
+    }
+    // copies the first data chunk out
+    harness.run("chunk_by_type", shape, chunk_size, [&] {
+        return png.chunk_by_type(ChunkType::fromStr("IDAT"));
+    });
+}
+
+int usage() {
+    std::fprintf(stderr, "Usage: ./hotpath_bench [--json <path|->] [--max-size <bytes>] [--budget <seconds>]\n");
+    return 1;
+}
+
+} // namespace
+
+// Times the parse and serialize hot paths (PNG::PNG(bytes), chunk CRCs,
+// PNG::as_bytes, write_to and chunk_by_type) over synthetic files from one
+// huge chunk to many tiny ones. The table goes to stderr, the JSON document
+// to --json for comparing runs across releases. --max-size skips shapes
+// whose chunk data adds up to more, for quick runs on small machines.
+int main(int argc, char** argv) {
+    std::string json_path;
+    uint64_t max_size = UINT64_MAX;
+    bench::Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (i + 1 == argc) return usage();
+        if (arg == "--json") json_path = argv[++i];
+        else if (arg == "--max-size") max_size = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--budget") options.budget_seconds = std::strtod(argv[++i], nullptr);
+        else return usage();
+    }
+
+    const struct { size_t chunks, size; } shapes[] = {
+        {1, 64 * 1024}, {1, 16 << 20}, {1024, 64 * 1024}, {100000, 10}, {100000, 1024}, {1, size_t(1) << 30}
+    };
+
+    bench::Harness harness(options);
+    for (auto shape : shapes) {
+        if (uint64_t(shape.chunks) * shape.size > max_size) continue;
+        bench_shape(harness, shape.chunks, shape.size);
+    }
+
+    if (json_path.empty()) return 0;
+    std::FILE* out = json_path == "-" ? stdout : std::fopen(json_path.c_str(), "w");
+    if (out == nullptr) {
+        std::perror(json_path.c_str());
+        return 1;
+    }
+    harness.write_json(out, "hotpath", BENCH_REVISION);
+    if (out != stdout) std::fclose(out);
+    return 0;
+}
@@ -0,0 +1,133 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "Deflate.hpp"
+#include "LsbCodec.hpp"
+#include "PixelDecoder.hpp"
+#include "PixelEncoder.hpp"
+
+namespace {
+
+std::vector<uint8_t> be32(uint32_t value) {
+    return {uint8_t(value >> 24), uint8_t(value >> 16), uint8_t(value >> 8), uint8_t(value)};
+}
+
+// A photo-like RGBA image: smooth gradients with a little sensor noise,
+// stored with Paeth rows the way most encoders write them
+PNG synthetic_png(uint32_t width, uint32_t height) {
+    std::mt19937 rng(3);
+    const size_t row_bytes = size_t(width) * 4;
+    std::vector<uint8_t> pixels(row_bytes * height);
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            uint8_t* p = pixels.data() + y * row_bytes + x * 4;
+            p[0] = uint8_t(128 + 100 * std::sin(x / 97.0) + rng() % 4);
+            p[1] = uint8_t(128 + 100 * std::cos(y / 61.0) + rng() % 4);
+            p[2] = uint8_t((x + y) / 16 + rng() % 4);
+            p[3] = 255;
+        }
+    }
+
+    ImageHeader header;
+    header.width = width;
+    header.height = height;
+    header.bit_depth = 8;
+    header.color_type = ImageHeader::TRUECOLOR_ALPHA;
+    EncoderOptions options;
+    options.filter = FilterStrategy::Paeth;
+
+    std::vector<uint8_t> ihdr = be32(width);
+    auto h = be32(height);
+    ihdr.insert(ihdr.end(), h.begin(), h.end());
+    ihdr.insert(ihdr.end(), {8, ImageHeader::TRUECOLOR_ALPHA, 0, 0, 0});
+
+    std::vector<Chunk> chunks;
+    chunks.emplace_back(ChunkType::fromStr("IHDR"), ihdr);
+    for (auto& chunk : PixelEncoder::encode_idat(header, pixels, options)) {
+        chunks.push_back(std::move(chunk));
+    }
+    chunks.emplace_back(ChunkType::fromStr("IEND"), std::vector<uint8_t>{});
+    return PNG(std::move(chunks));
+}
+
+template <typename F>
+double best_seconds(int passes, F&& run) {
+    double best = 1e9;
+    for (int pass = 0; pass < passes; pass++) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+} // namespace
+
+// Reports the bit-scatter and gather kernels per engine, then the whole
+// encode --lsb pipeline (decode, embed, re-filter, re-deflate) per filter
+// strategy and level, in megapixels per second on one core and with the
+// re-encode striped over the shared thread pool
+int main() {
+    const uint32_t width = 2048;
+    const uint32_t height = 1024;
+    const double megapixels = double(width) * height / 1e6;
+
+    PNG png = synthetic_png(width, height);
+    PixelDecoder decoder(png);
+    const ImageHeader& header = decoder.header();
+    std::vector<uint8_t> pixels(decoder.output_size());
+    decoder.decode(pixels);
+
+    // a payload that fills the image, so every carrier is touched
+    std::mt19937 rng(6);
+    std::vector<uint8_t> payload(LsbCodec::capacity(header));
+    for (auto& byte : payload) {
+        byte = static_cast<uint8_t>(rng());
+    }
+
+    std::printf("%dx%d RGBA, payload %zu bytes\n\n", width, height, payload.size());
+    std::printf("%-9s%16s%16s\n", "engine", "scatter MP/s", "gather MP/s");
+    const LsbEngine engines[] = {LsbEngine::Scalar, LsbEngine::Sse2, LsbEngine::Avx2};
+    std::vector<uint8_t> gathered(payload.size());
+    for (auto engine : engines) {
+        if (!LsbCodec::is_supported(engine)) continue;
+        auto carriers = pixels;
+        double scatter = best_seconds(5, [&] {
+            LsbCodec::scatter_with(engine, carriers.data(), payload.data(), payload.size());
+        });
+        double gather = best_seconds(5, [&] {
+            LsbCodec::gather_with(engine, carriers.data(), gathered.data(), gathered.size());
+        });
+        std::printf("%-9s%16.0f%16.0f\n", LsbCodec::engine_name(engine), megapixels / scatter, megapixels / gather);
+    }
+
+    ThreadPool& pool = ThreadPool::shared();
+    std::printf("\nstriped encode on %zu threads\n", pool.size());
+    std::printf("%-10s%-7s%12s%12s%14s%14s\n", "filter", "level", "ratio", "MP/s", "(encode %)", "striped MP/s");
+    for (auto strategy : {FilterStrategy::None, FilterStrategy::Up, FilterStrategy::Paeth, FilterStrategy::Adaptive}) {
+        for (int level : {0, 1, 6}) {
+            EncoderOptions options;
+            options.filter = strategy;
+            options.level = level;
+            size_t encoded_size = 0;
+            std::vector<uint8_t> work(pixels.size());
+            double front_seconds = best_seconds(2, [&] {
+                decoder.decode(work);
+                LsbCodec::embed(header, work, payload);
+            });
+            double encode_seconds = best_seconds(2, [&] {
+                encoded_size = PixelEncoder::encode(header, work, options).size();
+            });
+            double striped_seconds = best_seconds(2, [&] {
+                PixelEncoder::encode(header, work, options, pool);
+            });
+            double seconds = front_seconds + encode_seconds;
+            std::printf("%-10s%-7d%12.3f%12.1f%13.0f%%%14.1f\n", PixelEncoder::strategy_name(strategy), level,
+                        double(encoded_size) / pixels.size(), megapixels / seconds, 100 * encode_seconds / seconds,
+                        megapixels / (front_seconds + striped_seconds));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,61 @@
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include "PNG.hpp"
+#include "AllocCounter.hpp"
+
+namespace {
+
+// APNG-shaped file: one fcTL + fdAT pair per frame
+std::vector<uint8_t> make_apng(size_t frames, size_t frame_size) {
+    std::vector<Chunk> chunks;
+    chunks.emplace_back(ChunkType::fromStr("IHDR"), std::vector<uint8_t>(13, 1));
+    chunks.emplace_back(ChunkType::fromStr("acTL"), std::vector<uint8_t>(8, 0));
+    for (size_t i = 0; i < frames; i++) {
+        chunks.emplace_back(ChunkType::fromStr("fcTL"), std::vector<uint8_t>(26, static_cast<uint8_t>(i)));
+        chunks.emplace_back(ChunkType::fromStr("fdAT"), std::vector<uint8_t>(frame_size, static_cast<uint8_t>(i)));
+    }
+    chunks.emplace_back(ChunkType::fromStr("IEND"), std::vector<uint8_t>());
+    return PNG(std::move(chunks)).as_bytes();
+}
+
+}
+
+// Reports heap allocations made while parsing a PNG and frees made while
+// releasing it, for per-chunk heap storage and for a single arena
+int main() {
+    const struct { size_t frames, size; } shapes[] = {
+        {100, 256}, {5000, 512}, {20000, 64}
+    };
+    const struct { ChunkStorage storage; const char* name; } modes[] = {
+        {ChunkStorage::Heap, "heap"}, {ChunkStorage::Arena, "arena"}
+    };
+
+    std::printf("%-8s%-12s%-8s%14s%14s%12s\n", "frames", "frame size", "storage", "allocs/parse", "frees/release", "parse ms");
+
+    for (auto shape : shapes) {
+        auto bytes = make_apng(shape.frames, shape.size);
+        for (auto mode : modes) {
+            const size_t iterations = 20;
+            size_t allocs = 0, frees = 0;
+            double seconds = 0;
+            for (size_t i = 0; i < iterations; i++) {
+                auto input = bytes;
+
+                size_t before = alloc_counter::allocations.load();
+                auto start = std::chrono::steady_clock::now();
+                auto png = std::make_unique<PNG>(std::move(input), mode.storage);
+                auto end = std::chrono::steady_clock::now();
+                allocs += alloc_counter::allocations.load() - before;
+                seconds += std::chrono::duration<double>(end - start).count();
+
+                before = alloc_counter::frees.load();
+                png.reset();
+                frees += alloc_counter::frees.load() - before;
+            }
+            std::printf("%-8zu%-12zu%-8s%14.1f%14.1f%12.3f\n", shape.frames, shape.size, mode.name,
+                        double(allocs) / iterations, double(frees) / iterations, seconds / iterations * 1e3);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "PNG.hpp"
+#include "AllocCounter.hpp"
+
+namespace {
+
+PNG make_png(size_t chunk_count, size_t chunk_size) {
+    std::vector<Chunk> chunks;
+    chunks.reserve(chunk_count + 2);
+    chunks.emplace_back(ChunkType::fromStr("IHDR"), std::vector<uint8_t>(13, 1));
+    for (size_t i = 0; i < chunk_count; i++) {
+        chunks.emplace_back(ChunkType::fromStr("IDAT"), std::vector<uint8_t>(chunk_size, static_cast<uint8_t>(i)));
+    }
+    chunks.emplace_back(ChunkType::fromStr("IEND"), std::vector<uint8_t>());
+    return PNG(std::move(chunks));
+}
+
+}
+
+// Reports heap allocations and throughput of PNG::as_bytes(), write_to(span)
+// and the scatter-gather write_to(fd), which writes to /dev/null
+int main() {
+    const struct { size_t chunks, size; } shapes[] = {
+        {8, 64}, {64, 8 * 1024}, {16, 1024 * 1024}
+    };
+
+    std::printf("%-10s%-12s%18s%14s%18s%16s%12s\n", "chunks", "chunk size", "allocs/as_bytes", "as_bytes MB/s",
+                "allocs/write_to", "allocs/writev", "writev MB/s");
+
+    int null_fd = open("/dev/null", O_WRONLY);
+
+    volatile size_t sink = 0;
+    for (auto shape : shapes) {
+        PNG png = make_png(shape.chunks, shape.size);
+        size_t total = png.serialized_size();
+        size_t iterations = std::max<size_t>(4, (256u << 20) / total);
+
+        size_t before = alloc_counter::allocations.load();
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++) {
+            auto bytes = png.as_bytes();
+            sink = sink + bytes[bytes.size() - 1];
+        }
+        auto end = std::chrono::steady_clock::now();
+        double as_bytes_allocs = double(alloc_counter::allocations.load() - before) / iterations;
+        double seconds = std::chrono::duration<double>(end - start).count();
+
+        std::vector<uint8_t> out(total);
+        before = alloc_counter::allocations.load();
+        for (size_t i = 0; i < iterations; i++) {
+            sink = sink + png.write_to(out);
+        }
+        double write_to_allocs = double(alloc_counter::allocations.load() - before) / iterations;
+
+        before = alloc_counter::allocations.load();
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++) {
+            sink = sink + png.write_to(null_fd);
+        }
+        end = std::chrono::steady_clock::now();
+        double writev_allocs = double(alloc_counter::allocations.load() - before) / iterations;
+        double writev_seconds = std::chrono::duration<double>(end - start).count();
+
+        std::printf("%-10zu%-12zu%18.2f%14.0f%18.2f%16.2f%12.0f\n", shape.chunks, shape.size, as_bytes_allocs,
+                    double(total) * iterations / seconds / 1e6, write_to_allocs, writev_allocs,
+                    double(total) * iterations / writev_seconds / 1e6);
+    }
+    close(null_fd);
+    return 0;
+}
@@ -0,0 +1,198 @@
+#include "AtomicFile.hpp"
+#include "Stats.hpp"
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+AtomicFile::AtomicFile(const std::string& path)
+    : path_m(path)
+    , target_m(path)
+    , start_m(std::chrono::steady_clock::now())
+{
+    if (path_m == "-") {
+        fd_m = STDOUT_FILENO;
+        direct_m = true;
+        return;
+    }
+
+    struct stat st;
+    bool exists = lstat(path_m.c_str(), &st) == 0;
+    if (exists && S_ISLNK(st.st_mode)) {
+        // replace the file the link points to, not the link
+        char* resolved = realpath(path_m.c_str(), nullptr);
+        if (resolved == nullptr) {
+            // dangling, there is nothing to keep intact so let open()
+            // create the target through the link
+            open_direct(O_CREAT | O_TRUNC);
+            return;
+        }
+        target_m = resolved;
+        free(resolved);
+        exists = stat(target_m.c_str(), &st) == 0;
+    }
+
+    if (exists && !S_ISREG(st.st_mode)) {
+        // a device or FIFO can't be renamed over, and /dev/null must stay
+        // /dev/null
+        open_direct(0);
+        return;
+    }
+
+    // same directory as the destination so rename() stays atomic
+    size_t slash = target_m.find_last_of('/');
+    std::string directory = slash == std::string::npos ? "" : target_m.substr(0, slash + 1);
+    std::string name = slash == std::string::npos ? target_m : target_m.substr(slash + 1);
+    // not mkstemp(), whose 0600 would ignore the umask for new files
+    static std::atomic<uint64_t> next_suffix{0};
+    do {
+        temp_path_m = directory + "." + name + "." + std::to_string(getpid()) + "." + std::to_string(next_suffix++);
+        fd_m = open(temp_path_m.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+    } while (fd_m < 0 && errno == EEXIST);
+    if (fd_m < 0) {
+        throw std::runtime_error("There was an issue writing the PNG file!");
+    }
+
+    // keep the permissions of the file being replaced
+    if (exists) {
+        fchmod(fd_m, st.st_mode & 07777);
+    }
+}
+
+void AtomicFile::open_direct(int flags)
+{
+    fd_m = open(path_m.c_str(), O_WRONLY | O_CLOEXEC | flags, 0666);
+    if (fd_m < 0) {
+        throw std::runtime_error("There was an issue writing the PNG file!");
+    }
+    direct_m = true;
+}
+
+AtomicFile::~AtomicFile()
+{
+    if (!committed_m) {
+        discard();
+    }
+}
+
+void AtomicFile::discard()
+{
+    if (fd_m >= 0 && fd_m != STDOUT_FILENO) {
+        close(fd_m);
+        if (!direct_m) {
+            unlink(temp_path_m.c_str());
+        }
+    }
+    fd_m = -1;
+}
+
+int AtomicFile::fd() const
+{
+    return fd_m;
+}
+
+const std::string& AtomicFile::path() const
+{
+    return path_m;
+}
+
+void AtomicFile::write(const uint8_t* data, size_t size)
+{
+    iovec piece{const_cast<uint8_t*>(data), size};
+    bytes_written_m += write_all_fd(fd_m, &piece, 1);
+}
+
+void AtomicFile::writev(const iovec* pieces, size_t count)
+{
+    bytes_written_m += write_all_fd(fd_m, pieces, count);
+}
+
+void AtomicFile::copy_range(int src_fd, uint64_t offset, uint64_t length)
+{
+    ScopedTimer timer(Phase::Write);
+    loff_t in_offset = offset;
+    while (length > 0) {
+        ssize_t count = copy_file_range(src_fd, &in_offset, fd_m, nullptr, length, 0);
+        Stats::add(Counter::Syscalls);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            break;
+        }
+        length -= count;
+        bytes_written_m += count;
+        Stats::add(Counter::BytesWritten, count);
+    }
+
+    // not supported for this pair of files (or stdout), copy in user space
+    std::vector<uint8_t> buffer(length > 0 ? 64 * 1024 : 0);
+    while (length > 0) {
+        ssize_t count = pread(src_fd, buffer.data(), std::min<uint64_t>(buffer.size(), length), in_offset);
+        Stats::add(Counter::Syscalls);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            throw std::runtime_error("There was an issue reading the PNG file!");
+        }
+        write(buffer.data(), count);
+        in_offset += count;
+        length -= count;
+    }
+}
+
+void AtomicFile::commit()
+{
+    end_m = std::chrono::steady_clock::now();
+    if (direct_m) {
+        // nothing to rename, and fsync() fails on pipes
+        if (fd_m != STDOUT_FILENO) {
+            close(fd_m);
+            fd_m = -1;
+        }
+        committed_m = true;
+        return;
+    }
+
+    // count bytes written around us through fd()
+    struct stat st;
+    if (fstat(fd_m, &st) == 0) {
+        bytes_written_m = st.st_size;
+    }
+
+    // data must be on disk before the rename makes it visible
+    ScopedTimer timer(Phase::Write);
+    Stats::add(Counter::Syscalls, 4);
+    if (fsync(fd_m) != 0 || rename(temp_path_m.c_str(), target_m.c_str()) != 0) {
+        discard();
+        throw std::runtime_error("There was an issue writing the PNG file!");
+    }
+    close(fd_m);
+    fd_m = -1;
+    committed_m = true;
+
+    // and the rename itself must survive a crash
+    size_t slash = target_m.find_last_of('/');
+    std::string directory = slash == std::string::npos ? "." : target_m.substr(0, slash + 1);
+    int dir_fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dir_fd >= 0) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+}
+
+uint64_t AtomicFile::bytes_written() const
+{
+    return bytes_written_m;
+}
+
+double AtomicFile::elapsed_seconds() const
+{
+    return std::chrono::duration<double>(end_m - start_m).count();
+}
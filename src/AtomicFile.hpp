@@ -0,0 +1,58 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include "ByteSink.hpp"
+
+// Crash-safe replacement of a file. Output goes to a uniquely named
+// temporary file in the destination's directory, which is fsynced and
+// renamed over the destination by commit(). Until then the destination is
+// untouched, and an uncommitted AtomicFile removes its temporary file.
+// A symlink is kept and the file it points to is replaced. Existing files
+// that can't be renamed over (devices, FIFOs), a dangling symlink and "-"
+// (stdout) are written to directly instead.
+class AtomicFile : public ByteSink {
+private:
+    std::string path_m;
+    // path_m with symlinks resolved, what commit() renames over
+    std::string target_m;
+    std::string temp_path_m;
+    int fd_m = -1;
+    // writing straight to the destination, no temporary file
+    bool direct_m = false;
+    bool committed_m = false;
+    uint64_t bytes_written_m = 0;
+    std::chrono::steady_clock::time_point start_m;
+    std::chrono::steady_clock::time_point end_m;
+
+    void discard();
+    void open_direct(int flags);
+
+public:
+    explicit AtomicFile(const std::string& path);
+    ~AtomicFile();
+
+    AtomicFile(const AtomicFile&) = delete;
+    AtomicFile& operator=(const AtomicFile&) = delete;
+
+    // Descriptor of the temporary file, for writers that need one. Bytes
+    // written through it directly are counted at commit(), unless the
+    // destination is written to directly.
+    int fd() const;
+    const std::string& path() const;
+
+    void write(const uint8_t* data, size_t size) override;
+    void writev(const iovec* pieces, size_t count) override;
+
+    // Appends [offset, offset + length) of src_fd. Uses copy_file_range so
+    // filesystems that support it can share (reflink) or copy the blocks
+    // in the kernel, falling back to pread/write otherwise.
+    void copy_range(int src_fd, uint64_t offset, uint64_t length);
+
+    // Makes the new contents durable and visible under path()
+    void commit();
+
+    uint64_t bytes_written() const;
+    // Seconds between construction and commit()
+    double elapsed_seconds() const;
+};
@@ -0,0 +1,213 @@
+#include "Batch.hpp"
+#include "Commands.hpp"
+#include "ThreadPool.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <sys/stat.h>
+
+std::vector<std::string> Batch::split_line(std::string_view line)
+{
+    std::vector<std::string> args;
+    std::string current;
+    bool in_token = false;
+    bool quoted = false;
+
+    for (size_t i = 0; i < line.size(); i++) {
+        char c = line[i];
+        if (c == '\\' && i + 1 < line.size()) {
+            current += line[++i];
+            in_token = true;
+        } else if (c == '"') {
+            quoted = !quoted;
+            in_token = true;
+        } else if (!quoted && (c == ' ' || c == '\t' || c == '\r')) {
+            if (in_token) {
+                args.push_back(current);
+                current.clear();
+                in_token = false;
+            }
+        } else {
+            current += c;
+            in_token = true;
+        }
+    }
+
+    if (quoted) {
+        throw std::invalid_argument("Unterminated quote in batch line!");
+    }
+    if (in_token) {
+        args.push_back(current);
+    }
+    return args;
+}
+
+BatchReport Batch::run(std::istream& manifest, const BatchOptions& options, std::ostream& out, std::ostream& err)
+{
+    struct Operation {
+        size_t line;
+        std::vector<std::string> args;
+        std::string error;
+    };
+
+    struct Result {
+        std::string out;
+        std::string err;
+        bool failed = false;
+        bool done = false;
+    };
+
+    std::vector<Operation> operations;
+    std::string line;
+    for (size_t line_number = 1; std::getline(manifest, line); line_number++) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+
+        Operation operation{line_number, {}, {}};
+        if (!options.op_template.empty()) {
+            // the whole line is a path, spaces included
+            if (line.empty()) continue;
+            operation.args = options.op_template;
+            operation.args.insert(operation.args.begin() + 1, line);
+        } else {
+            try {
+                operation.args = split_line(line);
+            } catch (const std::exception& e) {
+                operation.error = e.what();
+            }
+            if (operation.error.empty() && (operation.args.empty() || operation.args[0][0] == '#')) continue;
+        }
+        operations.push_back(std::move(operation));
+    }
+
+    std::vector<Result> results(operations.size());
+    std::mutex mutex;
+    std::condition_variable completed_cv;
+    std::deque<size_t> completed;
+    std::atomic<uint64_t> bytes{0};
+    auto start = std::chrono::steady_clock::now();
+
+    // operations sharing a file run in manifest order on one task, the
+    // groups run in parallel
+    std::vector<size_t> parent(operations.size());
+    std::unordered_map<std::string, size_t> owner;
+    auto root = [&](size_t i) {
+        while (parent[i] != i) {
+            i = parent[i] = parent[parent[i]];
+        }
+        return i;
+    };
+    for (size_t i = 0; i < operations.size(); i++) {
+        parent[i] = i;
+        if (!operations[i].error.empty()) continue;
+        for (const auto& touched : command_paths(operations[i].args)) {
+            auto [it, inserted] = owner.try_emplace(touched.path, i);
+            if (!inserted) {
+                parent[root(i)] = root(it->second);
+            }
+        }
+    }
+    std::vector<std::vector<size_t>> groups;
+    std::unordered_map<size_t, size_t> group_of_root;
+    for (size_t i = 0; i < operations.size(); i++) {
+        auto [it, inserted] = group_of_root.try_emplace(root(i), groups.size());
+        if (inserted) {
+            groups.emplace_back();
+        }
+        groups[it->second].push_back(i);
+    }
+
+    auto run_one = [&](size_t i) {
+        const Operation& operation = operations[i];
+        std::ostringstream op_out;
+        std::ostringstream op_err;
+        bool failed = false;
+
+        try {
+            if (!operation.error.empty()) {
+                throw std::invalid_argument(operation.error);
+            }
+            for (const auto& arg : operation.args) {
+                if (arg == "-") {
+                    throw std::invalid_argument("stdin/stdout can't be used in batch mode!");
+                }
+            }
+
+            // size of the image the operation reads
+            struct stat st;
+            if (operation.args.size() > 1 && stat(operation.args[1].c_str(), &st) == 0) {
+                bytes += st.st_size;
+            }
+
+            std::vector<std::string_view> input(operation.args.begin(), operation.args.end());
+            if (!run_command(input, op_out, op_err)) {
+                throw std::invalid_argument("Unknown command '" + operation.args[0] + "'");
+            }
+        } catch (const std::exception& e) {
+            failed = true;
+            op_err << "line " << operation.line << ": " << e.what() << std::endl;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            results[i].out = op_out.str();
+            results[i].err = op_err.str();
+            results[i].failed = failed;
+            results[i].done = true;
+            completed.push_back(i);
+        }
+        completed_cv.notify_one();
+    };
+
+    ThreadPool pool(options.jobs);
+    for (size_t g = 0; g < groups.size(); g++) {
+        pool.submit([&, g] {
+            for (size_t i : groups[g]) {
+                run_one(i);
+            }
+        });
+    }
+
+    // print from this thread only, each operation's output in one piece
+    BatchReport report;
+    report.operations = operations.size();
+    size_t next_in_order = 0;
+    size_t printed = 0;
+    while (printed < results.size()) {
+        std::vector<size_t> ready;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            completed_cv.wait(lock, [&] { return !completed.empty(); });
+            if (options.ordered) {
+                completed.clear();
+                while (next_in_order < results.size() && results[next_in_order].done) {
+                    ready.push_back(next_in_order++);
+                }
+            } else {
+                ready.assign(completed.begin(), completed.end());
+                completed.clear();
+            }
+        }
+
+        for (size_t i : ready) {
+            out << results[i].out;
+            err << results[i].err;
+            report.failed += results[i].failed;
+            results[i].out.clear();
+            results[i].err.clear();
+        }
+        out.flush();
+        printed += ready.size();
+    }
+    pool.wait();
+
+    report.bytes = bytes;
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return report;
+}
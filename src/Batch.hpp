@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct BatchOptions {
+    // print results in manifest order rather than as they complete
+    bool ordered = true;
+    // worker threads, 0 means one per core
+    size_t jobs = 0;
+    // when set, every manifest line is a file path inserted as the first
+    // argument of this command, e.g. {"decode", "TeSt"}
+    std::vector<std::string> op_template;
+};
+
+struct BatchReport {
+    size_t operations = 0;
+    size_t failed = 0;
+    uint64_t bytes = 0;
+    double seconds = 0;
+};
+
+// Runs many encode/decode/remove/print operations in one process across a
+// work-stealing thread pool. Each manifest line is one operation written
+// like the CLI arguments: `encode image.png TeSt "a message"`. Blank lines
+// and lines starting with # are skipped. Operations sharing a file (see
+// command_paths) run in manifest order on one worker.
+class Batch {
+public:
+    // Splits a manifest line into arguments, honouring double quotes and
+    // backslash escapes
+    static std::vector<std::string> split_line(std::string_view line);
+
+    // Output of each operation goes to out in one piece, failures are
+    // reported on err as "line N: <reason>" without stopping the others
+    static BatchReport run(std::istream& manifest, const BatchOptions& options, std::ostream& out, std::ostream& err);
+};
@@ -0,0 +1,66 @@
+#include "ByteSink.hpp"
+#include "Stats.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <stdexcept>
+#include <vector>
+#include <unistd.h>
+
+void ByteSink::writev(const iovec* pieces, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        write(static_cast<const uint8_t*>(pieces[i].iov_base), pieces[i].iov_len);
+    }
+}
+
+uint64_t write_all_fd(int fd, const iovec* pieces, size_t count) {
+    ScopedTimer timer(Phase::Write);
+    // writev() may stop part way through a piece, so work on a copy that
+    // can be advanced past whatever the kernel already took
+    std::vector<iovec> pending(pieces, pieces + count);
+    iovec* next = pending.data();
+    iovec* end = pending.data() + pending.size();
+    uint64_t total = 0;
+
+    while (next != end) {
+        if (next->iov_len == 0) {
+            next++;
+            continue;
+        }
+        int batch = static_cast<int>(std::min<ptrdiff_t>(end - next, IOV_MAX));
+        ssize_t written = ::writev(fd, next, batch);
+        Stats::add(Counter::Syscalls);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("There was an issue writing the PNG file!");
+        }
+        total += written;
+        Stats::add(Counter::BytesWritten, written);
+
+        size_t left = written;
+        while (next != end && left >= next->iov_len) {
+            left -= next->iov_len;
+            next++;
+        }
+        if (left > 0) {
+            next->iov_base = static_cast<uint8_t*>(next->iov_base) + left;
+            next->iov_len -= left;
+        }
+    }
+    return total;
+}
+
+FdSink::FdSink(int fd) : fd_m(fd) {}
+
+void FdSink::write(const uint8_t* data, size_t size) {
+    iovec piece{const_cast<uint8_t*>(data), size};
+    bytes_written_m += write_all_fd(fd_m, &piece, 1);
+}
+
+void FdSink::writev(const iovec* pieces, size_t count) {
+    bytes_written_m += write_all_fd(fd_m, pieces, count);
+}
+
+uint64_t FdSink::bytes_written() const {
+    return bytes_written_m;
+}
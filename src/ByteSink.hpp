@@ -0,0 +1,36 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <sys/uio.h>
+
+// Destination for serialized bytes. Writers describe their output as a
+// list of (pointer, length) pieces so sinks backed by a file descriptor can
+// hand them to the kernel with writev() instead of copying them together.
+class ByteSink {
+public:
+    virtual ~ByteSink() = default;
+
+    virtual void write(const uint8_t* data, size_t size) = 0;
+
+    // Writes every piece in order. The default writes them one at a time.
+    virtual void writev(const iovec* pieces, size_t count);
+};
+
+// Sink over a file descriptor the caller owns
+class FdSink : public ByteSink {
+private:
+    int fd_m;
+    uint64_t bytes_written_m = 0;
+
+public:
+    explicit FdSink(int fd);
+
+    void write(const uint8_t* data, size_t size) override;
+    void writev(const iovec* pieces, size_t count) override;
+
+    uint64_t bytes_written() const;
+};
+
+// Writes all of pieces to fd in batches of at most IOV_MAX, resuming after
+// short writes. Returns the number of bytes written, throws on error.
+uint64_t write_all_fd(int fd, const iovec* pieces, size_t count);
@@ -1,36 +1,21 @@
 #include "ChunkType.hpp"
 #include "Chunk.hpp"
+#include "Stats.hpp"
+#include <stdexcept>
+
+Crc32Hasher Chunk::crc_hasher(const ChunkType& chunktype) {
+    auto bytes = chunktype.bytes();
+    Crc32Hasher hasher;
+    hasher.update(bytes);
+    return hasher;
+}
 
-uint32_t Chunk::crc_table[256];
-bool Chunk::crc_table_computed = false;
-
-void Chunk::make_crc_table() {
-    for (uint32_t n = 0; n < 256; n++) {
-        uint32_t c = n;
-        for (int k = 0; k < 8; k++) {
-            if (c & 1)
-                c = 0xedb88320L ^ (c >> 1);
-            else
-                c = c >> 1;
-        }
-        crc_table[n] = c;
-    }
-    crc_table_computed = true;
+uint32_t Chunk::compute_crc(const ChunkType& chunktype, std::span<const uint8_t> data) {
+    return crc_hasher(chunktype).update(data).finalize();
 }
 
-uint32_t Chunk::calculate_crc() {
-    if (!crc_table_computed) {
-        make_crc_table();
-    }
-    uint32_t c = 0xffffffffL;
-    auto bytes = chunktype_m.bytes();
-    for (int n = 0; n < 4; n++) {
-        c = crc_table[(c ^ bytes[n]) & 0xff] ^ (c >> 8);
-    }
-    for (uint8_t byte : data_m) {
-        c = crc_table[(c ^ byte) & 0xff] ^ (c >> 8);
-    }
-    return c ^ 0xffffffffL;
+uint32_t Chunk::calculate_crc() const {
+    return compute_crc(chunktype_m, data_m);
 }
 
 uint32_t Chunk::length() const {
@@ -41,60 +26,176 @@ uint32_t Chunk::crc() const {
     return crc_m;
 }
 
-const std::vector<uint8_t>& Chunk::data() const {
+std::span<const uint8_t> Chunk::data() const {
+    if (crc_state_m.load(std::memory_order_acquire) == CrcState::Pending && !verify_crc()) {
+        throw std::invalid_argument("CRC mismatch");
+    }
     return data_m;
 }
 
+bool Chunk::verify_crc() const {
+    if (crc_state_m.load(std::memory_order_acquire) == CrcState::Verified) {
+        return true;
+    }
+    ScopedTimer timer(Phase::Crc);
+    if (calculate_crc() != crc_m) {
+        return false;
+    }
+    crc_state_m.store(CrcState::Verified, std::memory_order_release);
+    return true;
+}
+
+bool Chunk::crc_verified() const {
+    return crc_state_m.load(std::memory_order_acquire) == CrcState::Verified;
+}
+
+bool Chunk::borrows_data() const {
+    return !data_m.empty() && data_m.data() != owned_m.data();
+}
+
 const ChunkType& Chunk::chunktype() const {
     return chunktype_m;
 }
 
 std::string Chunk::data_as_string() const {
-    return std::string(data_m.begin(), data_m.end());
+    auto data = this->data();
+    return std::string(data.begin(), data.end());
 }
 
-// This returns a full Chunk object and returns it as bytes
+size_t Chunk::serialized_size() const {
+    // length (4) + type (4) + data + crc (4)
+    return 12 + data_m.size();
+}
+
+// Serializes the chunk into out:
 // 1. length
 // 2. Chunk Type
 // 3. Chunk Data
 // 4. CRC
-std::vector<uint8_t> Chunk::as_bytes() const {
-    std::vector<uint8_t> bytes;
-    
-    // Chunk length, uint8_t so we only push 8 bits at a time
-    bytes.push_back((length_m >> 24) & 0xFF);
-    bytes.push_back((length_m >> 16) & 0xFF);
-    bytes.push_back((length_m >> 8) & 0xFF);
-    bytes.push_back((length_m) & 0xFF);
+size_t Chunk::write_to(std::span<uint8_t> out) const {
+    size_t size = serialized_size();
+    if (out.size() < size) {
+        throw std::invalid_argument("Not enough room to serialize chunk!");
+    }
+    uint8_t* p = out.data();
+
+    // Chunk length, big endian
+    p[0] = (length_m >> 24) & 0xFF;
+    p[1] = (length_m >> 16) & 0xFF;
+    p[2] = (length_m >> 8) & 0xFF;
+    p[3] = (length_m) & 0xFF;
 
     // Chunk Type
-    auto type_bytes = chunktype_m.bytes(); 
-    bytes.push_back(type_bytes[0]);
-    bytes.push_back(type_bytes[1]);
-    bytes.push_back(type_bytes[2]);
-    bytes.push_back(type_bytes[3]);
+    auto type_bytes = chunktype_m.bytes();
+    std::copy(type_bytes.begin(), type_bytes.end(), p + 4);
 
     // Chunk Data
-    for (auto data_chunk : data_m)
-    {
-        bytes.push_back(data_chunk);
-    }
+    auto data = this->data();
+    std::copy(data.begin(), data.end(), p + 8);
 
     // CRC
-    bytes.push_back((crc_m >> 24) & 0xFF);
-    bytes.push_back((crc_m >> 16) & 0xFF);
-    bytes.push_back((crc_m >> 8) & 0xFF);
-    bytes.push_back((crc_m) & 0xFF);
+    p += 8 + data_m.size();
+    p[0] = (crc_m >> 24) & 0xFF;
+    p[1] = (crc_m >> 16) & 0xFF;
+    p[2] = (crc_m >> 8) & 0xFF;
+    p[3] = (crc_m) & 0xFF;
+
+    return size;
+}
 
+// This returns a full Chunk object as bytes, in a single allocation
+std::vector<uint8_t> Chunk::as_bytes() const {
+    std::vector<uint8_t> bytes(serialized_size());
+    write_to(bytes);
     return bytes;
 }
 
 Chunk::Chunk(ChunkType chunktype, std::vector<uint8_t> data)
+    : chunktype_m(chunktype)
+    , owned_m(std::move(data))
+    , data_m(owned_m)
+    , length_m(owned_m.size())
+{
+    crc_m = calculate_crc();
+}
+
+Chunk::Chunk(ChunkType chunktype, std::vector<uint8_t> data, uint32_t crc)
+    : chunktype_m(chunktype)
+    , owned_m(std::move(data))
+    , data_m(owned_m)
+    , length_m(owned_m.size())
+    , crc_m(crc)
+{
+}
+
+Chunk::Chunk(ChunkType chunktype, std::span<const uint8_t> data, uint32_t crc, std::pmr::memory_resource& arena)
+    : chunktype_m(chunktype)
+    , length_m(data.size())
+    , crc_m(crc)
+{
+    if (!data.empty()) {
+        auto copy = static_cast<uint8_t*>(arena.allocate(data.size(), 1));
+        std::copy(data.begin(), data.end(), copy);
+        data_m = std::span<const uint8_t>(copy, data.size());
+    }
+}
+
+Chunk::Chunk(ChunkType chunktype, std::span<const uint8_t> data, uint32_t crc, CrcState state)
     : chunktype_m(chunktype)
     , data_m(data)
     , length_m(data.size())
+    , crc_m(crc)
+    , crc_state_m(state)
 {
-    crc_m = calculate_crc();
+}
+
+Chunk::Chunk(const Chunk& other)
+    : chunktype_m(other.chunktype_m)
+    , owned_m(other.data_m.begin(), other.data_m.end())
+    , data_m(owned_m)
+    , length_m(other.length_m)
+    , crc_m(other.crc_m)
+    , crc_state_m(other.crc_state_m.load())
+{
+}
+
+// Moving a vector keeps its buffer, so data_m stays valid either way
+Chunk::Chunk(Chunk&& other) noexcept
+    : chunktype_m(other.chunktype_m)
+    , owned_m(std::move(other.owned_m))
+    , data_m(other.data_m)
+    , length_m(other.length_m)
+    , crc_m(other.crc_m)
+    , crc_state_m(other.crc_state_m.load())
+{
+    other.data_m = {};
+    other.length_m = 0;
+}
+
+Chunk& Chunk::operator=(const Chunk& other) {
+    if (this != &other) {
+        chunktype_m = other.chunktype_m;
+        owned_m.assign(other.data_m.begin(), other.data_m.end());
+        data_m = owned_m;
+        length_m = other.length_m;
+        crc_m = other.crc_m;
+        crc_state_m = other.crc_state_m.load();
+    }
+    return *this;
+}
+
+Chunk& Chunk::operator=(Chunk&& other) noexcept {
+    if (this != &other) {
+        chunktype_m = other.chunktype_m;
+        owned_m = std::move(other.owned_m);
+        data_m = other.data_m;
+        length_m = other.length_m;
+        crc_m = other.crc_m;
+        crc_state_m = other.crc_state_m.load();
+        other.data_m = {};
+        other.length_m = 0;
+    }
+    return *this;
 }
 
 Chunk::Chunk(const std::vector<uint8_t>& bytes)
@@ -110,7 +211,8 @@ Chunk::Chunk(const std::vector<uint8_t>& bytes)
 
     if (!chunktype_m.is_valid()) {throw std::invalid_argument("Invalid Chunktype!"); }
 
-    data_m.assign(bytes.begin() + 8, bytes.begin() + 8 + length_m);
+    owned_m.assign(bytes.begin() + 8, bytes.begin() + 8 + length_m);
+    data_m = owned_m;
 
     uint32_t received_crc = (bytes[8 + length_m] << 24) | 
                             (bytes[8 + length_m + 1] << 16) | 
@@ -123,10 +225,22 @@ Chunk::Chunk(const std::vector<uint8_t>& bytes)
     }
 }
 
+Chunk::Chunk(const ChunkView& view)
+    : chunktype_m(view.chunktype())
+    , owned_m(view.data().begin(), view.data().end())
+    , data_m(owned_m)
+    , length_m(view.length())
+{
+    crc_m = calculate_crc();
+    if (crc_m != view.crc()) {
+        throw std::invalid_argument("CRC mismatch");
+    }
+}
+
 std::ostream& operator<<(std::ostream& os, const Chunk& chunk) 
 {
     return os << "Chunk { length: " << chunk.length() 
               << ", type: " << chunk.chunktype().toString()
-              << ", data size: " << chunk.data().size() 
+              << ", data size: " << chunk.length()
               << ", crc: " << chunk.crc() << " }";
 }
\ No newline at end of file
@@ -1,30 +1,72 @@
 #pragma once
 #include <iostream>
+#include <atomic>
 #include <cstdint>
+#include <memory_resource>
+#include <span>
 #include <vector>
 #include <ostream>
 #include "ChunkType.hpp"
+#include "Crc32.hpp"
+#include "PNGFile.hpp"
 
 class Chunk {
 private:
+    // Whether crc_m is known to match the data. Pending chunks are checked
+    // the first time their data is read, Unchecked ones only on request.
+    enum class CrcState : uint8_t { Verified, Pending, Unchecked };
+
     ChunkType chunktype_m;
-    std::vector<uint8_t> data_m;
+    // data_m views either owned_m or memory owned by a PNG (an arena or the
+    // parsed bytes themselves). Copies always own their data, so they can
+    // outlive that PNG.
+    std::vector<uint8_t> owned_m;
+    std::span<const uint8_t> data_m;
     uint32_t length_m;
     uint32_t crc_m;
-    static uint32_t crc_table[256];
-    static bool crc_table_computed;
+    mutable std::atomic<CrcState> crc_state_m{CrcState::Verified};
+
+    uint32_t calculate_crc() const;
+    bool borrows_data() const;
 
-    static void make_crc_table();
-    uint32_t calculate_crc();
+    // For PNG, which has already verified crc against the data
+    Chunk(ChunkType chunktype, std::vector<uint8_t> data, uint32_t crc);
+    // Same, with the data copied into arena instead of its own allocation
+    Chunk(ChunkType chunktype, std::span<const uint8_t> data, uint32_t crc, std::pmr::memory_resource& arena);
+    // Views data owned by a PNG without copying or verifying it yet
+    Chunk(ChunkType chunktype, std::span<const uint8_t> data, uint32_t crc, CrcState state);
+    friend class PNG;
 
 public:
     uint32_t length() const;
     uint32_t crc() const;
     const ChunkType& chunktype() const;
-    const std::vector<uint8_t>& data() const;
+    // Verifies the CRC first if the chunk was parsed lazily, throwing on
+    // a mismatch
+    std::span<const uint8_t> data() const;
+    // A chunk's CRC covers its type and data but not its length. The hasher
+    // comes seeded with the type, ready for the data to be fed through
+    // update() in as many pieces as convenient.
+    static Crc32Hasher crc_hasher(const ChunkType& chunktype);
+    static uint32_t compute_crc(const ChunkType& chunktype, std::span<const uint8_t> data);
+    // Checks crc() against the data once and caches a match
+    bool verify_crc() const;
+    // Whether the CRC has been checked and matched
+    bool crc_verified() const;
     Chunk(ChunkType chunktype, std::vector<uint8_t> data);
+    Chunk(const Chunk& other);
+    Chunk(Chunk&& other) noexcept;
+    Chunk& operator=(const Chunk& other);
+    Chunk& operator=(Chunk&& other) noexcept;
     std::vector<uint8_t> as_bytes() const;
+    // Bytes as_bytes() / write_to() produce: length + type + data + crc
+    size_t serialized_size() const;
+    // Serializes into out, which must hold serialized_size() bytes.
+    // Returns the number of bytes written.
+    size_t write_to(std::span<uint8_t> out) const;
     std::string data_as_string() const;
     friend std::ostream& operator<<(std::ostream&, const Chunk&);
     Chunk(const std::vector<uint8_t>& bytes);
+    // Copies the view's data and verifies its CRC
+    explicit Chunk(const ChunkView& view);
 };
\ No newline at end of file
@@ -0,0 +1,100 @@
+#include "ChunkIndex.hpp"
+#include "ChunkWalker.hpp"
+#include "Stats.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+FileKey FileKey::of(int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        throw std::invalid_argument("There was an issue reading the PNG file!");
+    }
+    return {
+        static_cast<uint64_t>(st.st_dev),
+        static_cast<uint64_t>(st.st_ino),
+        static_cast<uint64_t>(st.st_size),
+        static_cast<int64_t>(st.st_mtim.tv_sec) * 1'000'000'000 + st.st_mtim.tv_nsec,
+    };
+}
+
+std::vector<IndexedChunk> ChunkIndex::build(int fd)
+{
+    std::vector<IndexedChunk> chunks;
+    ChunkWalker walker(fd);
+    while (walker.next()) {
+        chunks.push_back({walker.chunktype(), walker.offset(), walker.length(), walker.crc()});
+    }
+    return chunks;
+}
+
+namespace {
+
+void pread_all(int fd, uint8_t* out, size_t size, uint64_t offset)
+{
+    ScopedTimer timer(Phase::Read);
+    while (size > 0) {
+        ssize_t count = pread(fd, out, size, offset);
+        Stats::add(Counter::Syscalls);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            throw std::runtime_error("There was an issue reading the PNG file!");
+        }
+        out += count;
+        size -= count;
+        offset += count;
+        Stats::add(Counter::BytesRead, count);
+    }
+}
+
+// Whether the 8 bytes at header are the length and type index says
+bool header_matches(const uint8_t* header, const IndexedChunk& chunk)
+{
+    uint32_t length = (header[0] << 24) | (header[1] << 16) | (header[2] << 8) | header[3];
+    auto type = chunk.chunktype.bytes();
+    return length == chunk.length && std::equal(type.begin(), type.end(), header + 4);
+}
+
+} // namespace
+
+std::optional<Chunk> ChunkIndex::read(int fd, const IndexedChunk& chunk)
+{
+    std::vector<uint8_t> bytes(8 + uint64_t(chunk.length));
+    pread_all(fd, bytes.data(), bytes.size(), chunk.offset);
+    if (!header_matches(bytes.data(), chunk)) {
+        return std::nullopt;
+    }
+
+    bytes.erase(bytes.begin(), bytes.begin() + 8);
+    Chunk read(chunk.chunktype, std::move(bytes));
+    if (read.crc() != chunk.crc) {
+        return std::nullopt;
+    }
+    return read;
+}
+
+bool ChunkIndex::verify(int fd, const IndexedChunk& chunk)
+{
+    uint8_t header[8];
+    pread_all(fd, header, sizeof(header), chunk.offset);
+    if (!header_matches(header, chunk)) {
+        return false;
+    }
+
+    Crc32Hasher hasher = Chunk::crc_hasher(chunk.chunktype);
+    std::vector<uint8_t> buffer(std::min<size_t>(ChunkWalker::BUFFER_SIZE, chunk.length));
+    uint64_t offset = chunk.offset + 8;
+    for (uint32_t remaining = chunk.length; remaining > 0;) {
+        size_t size = std::min<size_t>(buffer.size(), remaining);
+        pread_all(fd, buffer.data(), size, offset);
+        hasher.update(buffer.data(), size);
+        offset += size;
+        remaining -= size;
+    }
+    return hasher.finalize() == chunk.crc;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include "Chunk.hpp"
+#include "ChunkType.hpp"
+
+// Where one chunk of a file is, enough to read it back with a single pread
+struct IndexedChunk {
+    ChunkType chunktype;
+    // of the chunk's length field, from the start of the file
+    uint64_t offset;
+    uint32_t length;
+    uint32_t crc;
+    // the data has been read and matched crc
+    bool verified = false;
+};
+
+// One version of a file. Rewriting the file in place changes its size or
+// mtime, replacing it changes the inode.
+struct FileKey {
+    uint64_t device = 0;
+    uint64_t inode = 0;
+    uint64_t size = 0;
+    int64_t mtime_ns = 0;
+
+    static FileKey of(int fd);
+    bool operator==(const FileKey& other) const = default;
+};
+
+class ChunkIndex {
+public:
+    // Walks every chunk header of the PNG open on fd, reading each CRC too.
+    // Nothing is verified.
+    static std::vector<IndexedChunk> build(int fd);
+
+    // Reads chunk's length, type and data from fd with one pread. nullopt
+    // when they don't match the index: the file changed without its size
+    // or mtime changing (or its data rotted), so it has to be walked.
+    static std::optional<Chunk> read(int fd, const IndexedChunk& chunk);
+    // Checks chunk's length and type, then streams its data from fd through
+    // the CRC in small reads. False on any mismatch, as for read().
+    static bool verify(int fd, const IndexedChunk& chunk);
+};
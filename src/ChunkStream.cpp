@@ -0,0 +1,473 @@
+#include "ChunkStream.hpp"
+#include "Crc32.hpp"
+#include "PNG.hpp"
+#include "Stats.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+ChunkStreamReader::ChunkStreamReader(std::istream& stream)
+    : stream_m(&stream)
+    , buffer_m(BUFFER_SIZE)
+{
+    read_signature();
+}
+
+ChunkStreamReader::ChunkStreamReader(int fd)
+    : fd_m(fd)
+    , buffer_m(BUFFER_SIZE)
+{
+    read_signature();
+}
+
+// Refills the buffer once it is drained, returns the bytes available (0 at EOF)
+size_t ChunkStreamReader::fill()
+{
+    if (buffer_pos_m < buffer_end_m) {
+        return buffer_end_m - buffer_pos_m;
+    }
+
+    ScopedTimer timer(Phase::Read);
+    buffer_pos_m = 0;
+    buffer_end_m = 0;
+    if (stream_m != nullptr) {
+        stream_m->read(reinterpret_cast<char*>(buffer_m.data()), buffer_m.size());
+        buffer_end_m = stream_m->gcount();
+    } else {
+        ssize_t count;
+        do {
+            count = ::read(fd_m, buffer_m.data(), buffer_m.size());
+            Stats::add(Counter::Syscalls);
+        } while (count < 0 && errno == EINTR);
+        if (count < 0) {
+            throw std::runtime_error("There was an issue reading the PNG file!");
+        }
+        buffer_end_m = count;
+    }
+    Stats::add(Counter::BytesRead, buffer_end_m);
+    return buffer_end_m;
+}
+
+void ChunkStreamReader::read_exact(uint8_t* out, size_t size)
+{
+    while (size > 0) {
+        size_t available = fill();
+        if (available == 0) {
+            throw std::invalid_argument("Invalid Chunk!");
+        }
+        size_t count = std::min(available, size);
+        std::copy(buffer_m.begin() + buffer_pos_m, buffer_m.begin() + buffer_pos_m + count, out);
+        buffer_pos_m += count;
+        out += count;
+        size -= count;
+    }
+}
+
+// Consumes up to size data bytes of the current chunk, copying them to out
+// unless it is null
+size_t ChunkStreamReader::consume(uint8_t* out, size_t size)
+{
+    if (remaining_m == 0) {
+        return 0;
+    }
+    size = std::min<size_t>(size, remaining_m);
+    size_t done = 0;
+    while (done < size) {
+        size_t available = fill();
+        if (available == 0) {
+            throw std::invalid_argument("Not enough bytes for chunk data and CRC!");
+        }
+        size_t count = std::min(available, size - done);
+        const uint8_t* in = buffer_m.data() + buffer_pos_m;
+        if (verify_m) {
+            crc_m.update(in, count);
+        }
+        if (out != nullptr) {
+            std::copy(in, in + count, out + done);
+        }
+        buffer_pos_m += count;
+        done += count;
+    }
+
+    remaining_m -= size;
+    if (remaining_m == 0) {
+        finish_chunk();
+    }
+    return size;
+}
+
+// Reads the CRC trailer and checks it against the data consumed
+void ChunkStreamReader::finish_chunk()
+{
+    uint8_t c[4];
+    read_exact(c, 4);
+    stored_crc_m = (c[0] << 24) | (c[1] << 16) | (c[2] << 8) | c[3];
+
+    if (verify_m && crc_m.finalize() != stored_crc_m) {
+        throw std::invalid_argument("CRC mismatch");
+    }
+}
+
+void ChunkStreamReader::read_signature()
+{
+    uint8_t header[8];
+    for (size_t i = 0; i < sizeof(header); i++) {
+        if (fill() == 0) {
+            throw std::invalid_argument("Not enough bytes for PNG header!");
+        }
+        header[i] = buffer_m[buffer_pos_m++];
+    }
+
+    for (size_t i = 0; i < sizeof(header); i++) {
+        if (PNG::STANDARD_HEADER[i] != header[i]) {
+            throw std::invalid_argument("First 8 bytes need to match standard header!");
+        }
+    }
+}
+
+bool ChunkStreamReader::next()
+{
+    if (chunktype_m.has_value() && remaining_m > 0) {
+        skip();
+    }
+
+    if (ended_m || fill() == 0) {
+        chunktype_m.reset();
+        return false;
+    }
+
+    uint8_t header[8];
+    read_exact(header, sizeof(header));
+
+    ChunkType chunktype({header[4], header[5], header[6], header[7]});
+    if (!chunktype.is_valid()) {
+        throw std::invalid_argument("Invalid Chunktype!");
+    }
+
+    // the PNG limit, so a corrupt length can't ask read_chunk() for 4 GiB
+    uint32_t length = (header[0] << 24) | (header[1] << 16) | (header[2] << 8) | header[3];
+    if (length > 0x7fffffff) {
+        throw std::invalid_argument("Invalid Chunk!");
+    }
+
+    Stats::add(Counter::ChunksParsed);
+    chunktype_m = chunktype;
+    length_m = length;
+    remaining_m = length_m;
+    verify_m = true;
+    crc_m = Chunk::crc_hasher(chunktype);
+    ended_m = chunktype == ChunkType::fromStr("IEND");
+
+    if (remaining_m == 0) {
+        finish_chunk();
+    }
+    return true;
+}
+
+const ChunkType& ChunkStreamReader::chunktype() const
+{
+    if (!chunktype_m.has_value()) {
+        throw std::logic_error("No current chunk!");
+    }
+    return chunktype_m.value();
+}
+
+uint32_t ChunkStreamReader::length() const
+{
+    return length_m;
+}
+
+uint32_t ChunkStreamReader::remaining() const
+{
+    return remaining_m;
+}
+
+uint32_t ChunkStreamReader::crc() const
+{
+    return stored_crc_m;
+}
+
+size_t ChunkStreamReader::read(uint8_t* out, size_t size)
+{
+    return consume(out, size);
+}
+
+Chunk ChunkStreamReader::read_chunk()
+{
+    if (remaining_m != length_m) {
+        throw std::logic_error("Chunk data was already partially read!");
+    }
+
+    // Chunk computes the CRC itself, so skip the running one
+    std::vector<uint8_t> data(length_m);
+    verify_m = false;
+    consume(data.data(), data.size());
+
+    Chunk chunk(chunktype(), std::move(data));
+    if (chunk.crc() != stored_crc_m) {
+        throw std::invalid_argument("CRC mismatch");
+    }
+    return chunk;
+}
+
+void ChunkStreamReader::copy_to(ChunkStreamWriter& writer)
+{
+    writer.begin_chunk(chunktype(), length_m);
+    while (remaining_m > 0) {
+        size_t available = fill();
+        if (available == 0) {
+            throw std::invalid_argument("Not enough bytes for chunk data and CRC!");
+        }
+
+        // hand the buffered bytes straight to the writer
+        size_t count = std::min<size_t>(available, remaining_m);
+        writer.write(buffer_m.data() + buffer_pos_m, count);
+        consume(nullptr, count);
+    }
+    writer.end_chunk();
+}
+
+uint64_t ChunkStreamReader::copy_data_to(ByteSink& sink)
+{
+    std::vector<uint8_t> block(std::min<size_t>(BUFFER_SIZE, remaining_m));
+    uint64_t total = 0;
+    while (remaining_m > 0) {
+        size_t count = consume(block.data(), block.size());
+        sink.write(block.data(), count);
+        total += count;
+    }
+    return total;
+}
+
+void ChunkStreamReader::skip()
+{
+    consume(nullptr, remaining_m);
+}
+
+ChunkStreamWriter::ChunkStreamWriter(std::ostream& stream)
+    : stream_m(&stream)
+    , buffer_m(BUFFER_SIZE)
+{
+    write_signature();
+}
+
+ChunkStreamWriter::ChunkStreamWriter(int fd)
+    : fd_m(fd)
+    , buffer_m(BUFFER_SIZE)
+{
+    write_signature();
+}
+
+ChunkStreamWriter::ChunkStreamWriter(int fd, bool write_signature)
+    : fd_m(fd)
+    , buffer_m(BUFFER_SIZE)
+{
+    if (write_signature) {
+        this->write_signature();
+    }
+}
+
+ChunkStreamWriter::~ChunkStreamWriter()
+{
+    try {
+        flush();
+    } catch (...) {
+        // errors surface through an explicit flush()
+    }
+}
+
+void ChunkStreamWriter::write_signature()
+{
+    put(PNG::STANDARD_HEADER.data(), PNG::STANDARD_HEADER.size());
+}
+
+void ChunkStreamWriter::write_out(const uint8_t* data, size_t size)
+{
+    if (stream_m != nullptr) {
+        stream_m->write(reinterpret_cast<const char*>(data), size);
+        if (!stream_m->good()) {
+            throw std::runtime_error("There was an issue writing the PNG file!");
+        }
+        return;
+    }
+
+    ScopedTimer timer(Phase::Write);
+    while (size > 0) {
+        ssize_t count = ::write(fd_m, data, size);
+        Stats::add(Counter::Syscalls);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("There was an issue writing the PNG file!");
+        }
+        data += count;
+        size -= count;
+        Stats::add(Counter::BytesWritten, count);
+    }
+}
+
+void ChunkStreamWriter::put(const uint8_t* data, size_t size)
+{
+    bytes_written_m += size;
+
+    if (buffer_used_m + size > buffer_m.size()) {
+        flush();
+        // large blocks skip the buffer entirely
+        if (size >= buffer_m.size()) {
+            write_out(data, size);
+            return;
+        }
+    }
+    std::copy(data, data + size, buffer_m.begin() + buffer_used_m);
+    buffer_used_m += size;
+}
+
+void ChunkStreamWriter::put_u32(uint32_t value)
+{
+    uint8_t bytes[4] = {
+        static_cast<uint8_t>(value >> 24), static_cast<uint8_t>(value >> 16),
+        static_cast<uint8_t>(value >> 8), static_cast<uint8_t>(value)
+    };
+    put(bytes, sizeof(bytes));
+}
+
+void ChunkStreamWriter::write_chunk(const Chunk& chunk)
+{
+    ScopedTimer timer(Phase::Serialize);
+    if (in_chunk_m) {
+        throw std::logic_error("Previous chunk was not finished!");
+    }
+    auto type_bytes = chunk.chunktype().bytes();
+    put_u32(chunk.length());
+    put(type_bytes.data(), type_bytes.size());
+    put(chunk.data().data(), chunk.data().size());
+    put_u32(chunk.crc());
+}
+
+void ChunkStreamWriter::begin_chunk(const ChunkType& chunktype, uint32_t length)
+{
+    if (in_chunk_m) {
+        throw std::logic_error("Previous chunk was not finished!");
+    }
+    auto type_bytes = chunktype.bytes();
+    put_u32(length);
+    put(type_bytes.data(), type_bytes.size());
+
+    in_chunk_m = true;
+    remaining_m = length;
+    crc_m = Chunk::crc_hasher(chunktype);
+}
+
+void ChunkStreamWriter::write(const uint8_t* data, size_t size)
+{
+    if (!in_chunk_m || size > remaining_m) {
+        throw std::logic_error("Data does not fit the declared chunk length!");
+    }
+    crc_m.update(data, size);
+    remaining_m -= size;
+    put(data, size);
+}
+
+void ChunkStreamWriter::end_chunk()
+{
+    if (!in_chunk_m || remaining_m != 0) {
+        throw std::logic_error("Data does not fit the declared chunk length!");
+    }
+    in_chunk_m = false;
+    put_u32(crc_m.finalize());
+}
+
+uint64_t ChunkStreamWriter::write_payload(const ChunkType& chunktype, int fd, uint32_t chunk_size, std::span<const uint8_t> prefix)
+{
+    if (chunk_size == 0 || chunk_size > 0x7fffffff - prefix.size()) {
+        throw std::invalid_argument("Chunk size must be between 1 and 2^31 - 1 bytes!");
+    }
+
+    auto read_some = [fd](uint8_t* out, size_t size) {
+        ScopedTimer timer(Phase::Read);
+        while (true) {
+            ssize_t count = ::read(fd, out, size);
+            Stats::add(Counter::Syscalls);
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count < 0) {
+                throw std::runtime_error("There was an issue reading the payload!");
+            }
+            Stats::add(Counter::BytesRead, count);
+            return static_cast<size_t>(count);
+        }
+    };
+
+    struct stat st;
+    uint64_t total = 0;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        // lengths are known up front, so data flows straight through
+        uint64_t size = st.st_size - std::min<uint64_t>(st.st_size, lseek(fd, 0, SEEK_CUR));
+        std::vector<uint8_t> block(std::min<uint64_t>(BUFFER_SIZE, std::max<uint64_t>(size, 1)));
+        do {
+            uint32_t length = std::min<uint64_t>(chunk_size, size - total);
+            begin_chunk(chunktype, prefix.size() + length);
+            write(prefix.data(), prefix.size());
+            for (uint32_t left = length; left > 0;) {
+                size_t count = read_some(block.data(), std::min<size_t>(block.size(), left));
+                if (count == 0) {
+                    throw std::runtime_error("There was an issue reading the payload!");
+                }
+                write(block.data(), count);
+                left -= count;
+            }
+            end_chunk();
+            total += length;
+        } while (total < size);
+        return total;
+    }
+
+    // unknown length, fill one chunk before writing it
+    std::vector<uint8_t> pending(std::min<uint32_t>(chunk_size, BUFFER_SIZE));
+    bool first = true;
+    while (true) {
+        size_t used = 0;
+        while (used < chunk_size) {
+            if (used == pending.size()) {
+                pending.resize(std::min<size_t>(chunk_size, pending.size() * 2));
+            }
+            size_t count = read_some(pending.data() + used, pending.size() - used);
+            if (count == 0) {
+                break;
+            }
+            used += count;
+        }
+        if (used == 0 && !first) {
+            break;
+        }
+        begin_chunk(chunktype, prefix.size() + used);
+        write(prefix.data(), prefix.size());
+        write(pending.data(), used);
+        end_chunk();
+        total += used;
+        first = false;
+        if (used < chunk_size) {
+            break;
+        }
+    }
+    return total;
+}
+
+void ChunkStreamWriter::flush()
+{
+    if (buffer_used_m > 0) {
+        size_t used = buffer_used_m;
+        buffer_used_m = 0;
+        write_out(buffer_m.data(), used);
+    }
+    if (stream_m != nullptr) {
+        stream_m->flush();
+    }
+}
+
+uint64_t ChunkStreamWriter::bytes_written() const
+{
+    return bytes_written_m;
+}
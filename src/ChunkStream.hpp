@@ -0,0 +1,119 @@
+#pragma once
+#include <cstdint>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <vector>
+#include "ByteSink.hpp"
+#include "Chunk.hpp"
+#include "ChunkType.hpp"
+
+class ChunkStreamWriter;
+
+// Pull-style chunk reader over a std::istream or a file descriptor (pipes
+// included). Input is consumed through a fixed-size buffer; only chunks
+// requested through read_chunk() are held in memory.
+class ChunkStreamReader {
+private:
+    std::istream* stream_m = nullptr;
+    int fd_m = -1;
+    std::vector<uint8_t> buffer_m;
+    size_t buffer_pos_m = 0;
+    size_t buffer_end_m = 0;
+
+    std::optional<ChunkType> chunktype_m;
+    uint32_t length_m = 0;
+    uint32_t remaining_m = 0;
+    Crc32Hasher crc_m;
+    uint32_t stored_crc_m = 0;
+    bool verify_m = true;
+    // set once IEND is read, anything after it is not part of the image
+    bool ended_m = false;
+
+    size_t fill();
+    void read_exact(uint8_t* out, size_t size);
+    size_t consume(uint8_t* out, size_t size);
+    void finish_chunk();
+    void read_signature();
+
+public:
+    static constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+    explicit ChunkStreamReader(std::istream& stream);
+    explicit ChunkStreamReader(int fd);
+
+    // Moves to the next chunk header, skipping the rest of the current chunk.
+    // Returns false after IEND or once the input is exhausted.
+    bool next();
+
+    const ChunkType& chunktype() const;
+    uint32_t length() const;
+    // Data bytes of the current chunk not read yet
+    uint32_t remaining() const;
+    // CRC stored after the current chunk, valid once its data is consumed
+    uint32_t crc() const;
+
+    // Reads up to size bytes of the current chunk's data. The CRC is
+    // checked as soon as the last byte has been read.
+    size_t read(uint8_t* out, size_t size);
+    // Reads the whole current chunk into memory
+    Chunk read_chunk();
+    // Streams the rest of the current chunk's data to sink through a small
+    // buffer, throwing once it has all gone through if the CRC mismatches
+    uint64_t copy_data_to(ByteSink& sink);
+    // Passes the current chunk through to writer without buffering it
+    void copy_to(ChunkStreamWriter& writer);
+    void skip();
+};
+
+// Push-style chunk writer over a std::ostream or a file descriptor. The PNG
+// signature is written on construction, chunks can be written whole or
+// streamed with begin_chunk()/write()/end_chunk().
+class ChunkStreamWriter {
+private:
+    std::ostream* stream_m = nullptr;
+    int fd_m = -1;
+    std::vector<uint8_t> buffer_m;
+    size_t buffer_used_m = 0;
+    uint64_t bytes_written_m = 0;
+
+    bool in_chunk_m = false;
+    uint32_t remaining_m = 0;
+    Crc32Hasher crc_m;
+
+    void put(const uint8_t* data, size_t size);
+    void put_u32(uint32_t value);
+    void write_out(const uint8_t* data, size_t size);
+    void write_signature();
+
+public:
+    static constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+    explicit ChunkStreamWriter(std::ostream& stream);
+    explicit ChunkStreamWriter(int fd);
+    // Without the signature, for chunks spliced into the middle of a file
+    ChunkStreamWriter(int fd, bool write_signature);
+    ~ChunkStreamWriter();
+
+    ChunkStreamWriter(const ChunkStreamWriter&) = delete;
+    ChunkStreamWriter& operator=(const ChunkStreamWriter&) = delete;
+
+    void write_chunk(const Chunk& chunk);
+
+    // Streams a chunk of a known length, the CRC is computed as data flows
+    void begin_chunk(const ChunkType& chunktype, uint32_t length);
+    void write(const uint8_t* data, size_t size);
+    void end_chunk();
+
+    // Streams everything readable from fd (a file or a pipe) as consecutive
+    // chunks of chunktype holding at most chunk_size bytes each, at least
+    // one chunk even for an empty payload. Regular files are streamed
+    // through a small buffer, pipes are held one chunk at a time since a
+    // chunk's length comes before its data. prefix, if any, starts every
+    // chunk ahead of its share of the payload. Returns the payload size.
+    uint64_t write_payload(const ChunkType& chunktype, int fd, uint32_t chunk_size, std::span<const uint8_t> prefix = {});
+
+    void flush();
+    uint64_t bytes_written() const;
+};
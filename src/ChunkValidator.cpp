@@ -0,0 +1,107 @@
+#include "ChunkValidator.hpp"
+#include "Chunk.hpp"
+#include "Stats.hpp"
+#include "ThreadPool.hpp"
+#include <latch>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+// Byte range [begin, end) of one chunk's data
+struct Segment {
+    size_t chunk;
+    size_t begin;
+    size_t end;
+    Crc32Hasher crc;
+};
+
+Crc32Hasher segment_crc(const ChunkView& view, const Segment& segment) {
+    auto data = view.data().subspan(segment.begin, segment.end - segment.begin);
+    // the chunk type is hashed ahead of its first segment
+    Crc32Hasher hasher = segment.begin == 0 ? Chunk::crc_hasher(view.chunktype()) : Crc32Hasher();
+    return hasher.update(data);
+}
+
+} // namespace
+
+std::vector<uint32_t> ChunkValidator::compute_crcs(const std::vector<ChunkView>& chunks, ThreadPool* pool)
+{
+    std::vector<uint32_t> crcs(chunks.size());
+
+    if (pool == nullptr || pool->size() < 2) {
+        for (size_t i = 0; i < chunks.size(); i++) {
+            crcs[i] = segment_crc(chunks[i], {i, 0, chunks[i].length(), {}}).finalize();
+        }
+        return crcs;
+    }
+
+    // split big chunks into segments...
+    std::vector<Segment> segments;
+    for (size_t i = 0; i < chunks.size(); i++) {
+        size_t length = chunks[i].length();
+        size_t begin = 0;
+        do {
+            size_t end = std::min(length, begin + SEGMENT_SIZE);
+            segments.push_back({i, begin, end, {}});
+            begin = end;
+        } while (begin < length);
+    }
+
+    // ...and group small ones, so every task hashes about SEGMENT_SIZE bytes
+    std::vector<std::pair<size_t, size_t>> tasks;
+    size_t first = 0;
+    size_t bytes = 0;
+    for (size_t s = 0; s < segments.size(); s++) {
+        bytes += segments[s].end - segments[s].begin;
+        if (bytes >= SEGMENT_SIZE || s + 1 == segments.size()) {
+            tasks.emplace_back(first, s + 1);
+            first = s + 1;
+            bytes = 0;
+        }
+    }
+
+    std::latch done(tasks.size());
+    for (auto [begin, end] : tasks) {
+        pool->submit([&, begin, end] {
+            for (size_t s = begin; s < end; s++) {
+                segments[s].crc = segment_crc(chunks[segments[s].chunk], segments[s]);
+            }
+            done.count_down();
+        });
+    }
+    done.wait();
+
+    // stitch segments back together in order
+    Crc32Hasher chunk_crc;
+    for (size_t s = 0; s < segments.size(); s++) {
+        if (segments[s].begin == 0) {
+            chunk_crc = segments[s].crc;
+        } else {
+            chunk_crc.combine(segments[s].crc);
+        }
+        if (s + 1 == segments.size() || segments[s + 1].chunk != segments[s].chunk) {
+            crcs[segments[s].chunk] = chunk_crc.finalize();
+        }
+    }
+    return crcs;
+}
+
+void ChunkValidator::verify(const std::vector<ChunkView>& chunks)
+{
+    ScopedTimer timer(Phase::Crc);
+    size_t total = 0;
+    for (const auto& chunk : chunks) {
+        total += chunk.length();
+    }
+
+    ThreadPool* pool = total >= PARALLEL_THRESHOLD ? &ThreadPool::shared() : nullptr;
+    auto crcs = compute_crcs(chunks, pool);
+
+    for (size_t i = 0; i < chunks.size(); i++) {
+        if (crcs[i] != chunks[i].crc()) {
+            throw std::invalid_argument("CRC mismatch in chunk " + std::to_string(i) +
+                                        " (" + chunks[i].chunktype().toString() + ")");
+        }
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "PNGFile.hpp"
+
+class ThreadPool;
+
+// Phase two of parsing: checks the stored CRC of chunks already indexed by
+// PNGFile::scan(). Large inputs are spread over a thread pool, and chunks
+// bigger than SEGMENT_SIZE are hashed in segments whose CRCs are combined,
+// so a single huge IDAT still uses every core.
+class ChunkValidator {
+public:
+    // Inputs with less chunk data than this are verified on the calling thread
+    static constexpr size_t PARALLEL_THRESHOLD = 4 * 1024 * 1024;
+    static constexpr size_t SEGMENT_SIZE = 1024 * 1024;
+
+    // CRC over type + data of every chunk, in parallel on pool if given
+    static std::vector<uint32_t> compute_crcs(const std::vector<ChunkView>& chunks, ThreadPool* pool = nullptr);
+
+    // Throws std::invalid_argument naming the first chunk, in file order,
+    // whose stored CRC does not match its contents
+    static void verify(const std::vector<ChunkView>& chunks);
+};
@@ -0,0 +1,170 @@
+#include "ChunkWalker.hpp"
+#include "Crc32.hpp"
+#include "PNG.hpp"
+#include "Stats.hpp"
+#include <cerrno>
+#include <stdexcept>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+ChunkWalker::ChunkWalker(int fd)
+    : fd_m(fd)
+{
+    struct stat st;
+    if (fstat(fd_m, &st) != 0 || !S_ISREG(st.st_mode)) {
+        throw std::invalid_argument("There was an issue reading the PNG file!");
+    }
+    file_size_m = st.st_size;
+
+    if (file_size_m < PNG::STANDARD_HEADER.size()) {
+        throw std::invalid_argument("Not enough bytes for PNG header!");
+    }
+    std::vector<uint8_t> signature(PNG::STANDARD_HEADER.size());
+    read_at(0, signature.data(), signature.size());
+    if (signature != PNG::STANDARD_HEADER) {
+        throw std::invalid_argument("First 8 bytes need to match standard header!");
+    }
+    next_offset_m = signature.size();
+}
+
+void ChunkWalker::read_at(uint64_t offset, uint8_t* out, size_t size)
+{
+    ScopedTimer timer(Phase::Read);
+    Stats::add(Counter::Syscalls);
+    if (lseek(fd_m, offset, SEEK_SET) < 0) {
+        throw std::runtime_error("There was an issue reading the PNG file!");
+    }
+    while (size > 0) {
+        ssize_t count = ::read(fd_m, out, size);
+        Stats::add(Counter::Syscalls);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            throw std::invalid_argument("Invalid Chunk!");
+        }
+        out += count;
+        size -= count;
+        bytes_read_m += count;
+        Stats::add(Counter::BytesRead, count);
+    }
+}
+
+bool ChunkWalker::next()
+{
+    if (next_offset_m >= file_size_m) {
+        return false;
+    }
+
+    // length (4) + type (4), then seek straight past data and crc
+    if (file_size_m - next_offset_m < 12) {
+        throw std::invalid_argument("Invalid Chunk!");
+    }
+    uint8_t header[8];
+    read_at(next_offset_m, header, sizeof(header));
+
+    uint32_t data_length = (header[0] << 24) | (header[1] << 16) | (header[2] << 8) | header[3];
+    if (file_size_m - next_offset_m - 12 < data_length) {
+        throw std::invalid_argument("Invalid Chunk!");
+    }
+
+    ChunkType chunktype({header[4], header[5], header[6], header[7]});
+    if (!chunktype.is_valid()) {
+        throw std::invalid_argument("Invalid Chunktype!");
+    }
+
+    Stats::add(Counter::ChunksParsed);
+    chunktype_m = chunktype;
+    offset_m = next_offset_m;
+    length_m = data_length;
+    crc_m.reset();
+    next_offset_m += 12 + static_cast<uint64_t>(data_length);
+    if (chunktype == ChunkType::fromStr("IEND")) {
+        // bytes after IEND are not part of the image
+        next_offset_m = file_size_m;
+    }
+    return true;
+}
+
+const ChunkType& ChunkWalker::chunktype() const
+{
+    return chunktype_m.value();
+}
+
+uint32_t ChunkWalker::length() const
+{
+    return length_m;
+}
+
+uint64_t ChunkWalker::offset() const
+{
+    return offset_m;
+}
+
+uint32_t ChunkWalker::crc()
+{
+    if (!crc_m.has_value()) {
+        uint8_t c[4];
+        read_at(offset_m + 8 + length_m, c, sizeof(c));
+        crc_m = (c[0] << 24) | (c[1] << 16) | (c[2] << 8) | c[3];
+    }
+    return crc_m.value();
+}
+
+uint32_t ChunkWalker::stream_data(ByteSink* sink, uint32_t skip)
+{
+    Crc32Hasher hasher = Chunk::crc_hasher(chunktype());
+
+    std::vector<uint8_t> buffer(std::min<size_t>(BUFFER_SIZE, length_m));
+    uint64_t offset = offset_m + 8;
+    for (uint32_t remaining = length_m; remaining > 0;) {
+        size_t size = std::min<size_t>(buffer.size(), remaining);
+        read_at(offset, buffer.data(), size);
+        hasher.update(buffer.data(), size);
+        size_t skipped = std::min<size_t>(skip, size);
+        if (sink != nullptr && skipped < size) {
+            sink->write(buffer.data() + skipped, size - skipped);
+        }
+        skip -= skipped;
+        offset += size;
+        remaining -= size;
+    }
+    return hasher.finalize();
+}
+
+size_t ChunkWalker::peek(uint8_t* out, size_t size)
+{
+    size = std::min<size_t>(size, length_m);
+    read_at(offset_m + 8, out, size);
+    return size;
+}
+
+bool ChunkWalker::verify_crc()
+{
+    return stream_data(nullptr) == crc();
+}
+
+uint64_t ChunkWalker::copy_data_to(ByteSink& sink, uint32_t skip)
+{
+    if (stream_data(&sink, skip) != crc()) {
+        throw std::invalid_argument("CRC mismatch");
+    }
+    return length_m - std::min(skip, length_m);
+}
+
+Chunk ChunkWalker::read_chunk()
+{
+    std::vector<uint8_t> data(length_m);
+    read_at(offset_m + 8, data.data(), data.size());
+    Chunk chunk(chunktype(), std::move(data));
+    if (chunk.crc() != crc()) {
+        throw std::invalid_argument("CRC mismatch");
+    }
+    return chunk;
+}
+
+uint64_t ChunkWalker::bytes_read() const
+{
+    return bytes_read_m;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include "ByteSink.hpp"
+#include "Chunk.hpp"
+#include "ChunkType.hpp"
+
+// Seek-driven chunk walker over a seekable file descriptor. Only the 8-byte
+// chunk headers are read, chunk data is skipped with lseek(), so listing the
+// chunks of a file costs a few bytes of I/O per chunk whatever their size.
+// CRCs and data are read only when asked for.
+class ChunkWalker {
+private:
+    int fd_m;
+    uint64_t file_size_m = 0;
+    uint64_t next_offset_m = 0;
+    uint64_t bytes_read_m = 0;
+
+    std::optional<ChunkType> chunktype_m;
+    uint64_t offset_m = 0;
+    uint32_t length_m = 0;
+    std::optional<uint32_t> crc_m;
+
+    void read_at(uint64_t offset, uint8_t* out, size_t size);
+    // CRC of the current chunk's data, passing the data past its first
+    // skip bytes to sink if given
+    uint32_t stream_data(ByteSink* sink, uint32_t skip = 0);
+
+public:
+    static constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+    // Checks the signature. The descriptor stays owned by the caller.
+    explicit ChunkWalker(int fd);
+
+    // Moves to the next chunk header. Returns false after IEND or at the end
+    // of the file.
+    bool next();
+
+    const ChunkType& chunktype() const;
+    uint32_t length() const;
+    // Offset of the current chunk's length field from the start of the file
+    uint64_t offset() const;
+    // CRC stored after the current chunk, read on first use
+    uint32_t crc();
+
+    // Reads up to size bytes from the start of the current chunk's data,
+    // unverified. Returns how many were read.
+    size_t peek(uint8_t* out, size_t size);
+    // Streams the current chunk's data through the CRC, without holding it
+    bool verify_crc();
+    // Streams the current chunk's data to sink through a small buffer,
+    // throwing once it has all gone through if the CRC mismatches. The first
+    // skip bytes are checked but not copied. Returns the bytes copied.
+    uint64_t copy_data_to(ByteSink& sink, uint32_t skip = 0);
+    // Reads the current chunk into memory, throws if its CRC does not match
+    Chunk read_chunk();
+
+    // Bytes actually read from the descriptor so far
+    uint64_t bytes_read() const;
+};
@@ -0,0 +1,1424 @@
+#include "Commands.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "ChunkType.hpp"
+#include "Chunk.hpp"
+#include "PNG.hpp"
+#include "PNGFile.hpp"
+#include "ChunkStream.hpp"
+#include "ChunkWalker.hpp"
+#include "ChunkIndex.hpp"
+#include "PNGPatch.hpp"
+#include "AtomicFile.hpp"
+#include "Batch.hpp"
+#include "CompressedPayload.hpp"
+#include "Deflate.hpp"
+#include "LsbCodec.hpp"
+#include "ParseCache.hpp"
+#include "PixelDecoder.hpp"
+#include "PixelEncoder.hpp"
+#include "Server.hpp"
+#include "SidecarIndex.hpp"
+#include "Stats.hpp"
+#include "ThreadPool.hpp"
+
+namespace {
+
+// Payload chunks written by encode --from-file unless --chunk-size is given
+constexpr uint32_t DEFAULT_PAYLOAD_CHUNK_SIZE = 1024 * 1024;
+
+// "-" reads from stdin so the CLI can sit at the end of a pipe
+class InputFile
+{
+public:
+    int fd;
+
+    explicit InputFile(const std::string& path)
+        : fd(path == "-" ? STDIN_FILENO : open(path.c_str(), O_RDONLY))
+    {
+        if (fd < 0)
+        {
+            throw std::invalid_argument("There was an issue reading the PNG file!");
+        }
+    }
+
+    ~InputFile()
+    {
+        if (fd != STDIN_FILENO)
+        {
+            close(fd);
+        }
+    }
+};
+
+// Rewrites report how fast the new file hit the disk
+void report_throughput(const AtomicFile& output, std::ostream& err)
+{
+    if (output.path() == "-")
+    {
+        return;
+    }
+    double seconds = output.elapsed_seconds();
+    double mb = output.bytes_written() / 1e6;
+    err << "Wrote " << output.bytes_written() << " bytes to " << output.path()
+        << " in " << seconds * 1e3 << " ms (" << (seconds > 0 ? mb / seconds : 0) << " MB/s)" << std::endl;
+}
+
+// Chunk types named on the command line. Each chunk is matched in O(1), so
+// a pass over the image costs O(chunks + types) however many are named.
+class TypeSelection
+{
+private:
+    std::unordered_map<uint32_t, size_t> index_m;
+    std::vector<size_t> wanted_m;
+
+    static uint32_t key(const ChunkType& type)
+    {
+        auto bytes = type.bytes();
+        return (bytes[0] << 24) | (bytes[1] << 16) | (bytes[2] << 8) | bytes[3];
+    }
+
+public:
+    // Distinct types, in the order first named
+    std::vector<ChunkType> types;
+    // Chunks taken so far, per type
+    std::vector<std::vector<Chunk>> taken;
+    bool all;
+
+    // Naming a type twice takes its first two chunks, unless all is set
+    TypeSelection(const std::vector<std::string_view>& names, bool all)
+        : all(all)
+    {
+        for (auto name : names)
+        {
+            auto type = ChunkType::fromStr(name);
+            if (!type.is_valid())
+            {
+                throw std::invalid_argument("Invalid ChunkType!");
+            }
+            auto [it, inserted] = index_m.emplace(key(type), types.size());
+            if (inserted)
+            {
+                types.push_back(type);
+                wanted_m.push_back(0);
+            }
+            wanted_m[it->second]++;
+        }
+        taken.resize(types.size());
+    }
+
+    // Position in types of a chunk that should be taken next, if any
+    std::optional<size_t> match(const ChunkType& type) const
+    {
+        auto it = index_m.find(key(type));
+        if (it == index_m.end() || (!all && taken[it->second].size() >= wanted_m[it->second]))
+        {
+            return std::nullopt;
+        }
+        return it->second;
+    }
+
+    // Whether nothing more can match
+    bool done() const
+    {
+        if (all)
+        {
+            return false;
+        }
+        for (size_t i = 0; i < types.size(); i++)
+        {
+            if (taken[i].size() < wanted_m[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+bool is_chunk_type(std::string_view name)
+{
+    if (name.size() != 4)
+    {
+        return false;
+    }
+    for (char c : name)
+    {
+        if (!((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Strips a flag such as --all from args, wherever it is
+bool take_flag(std::vector<std::string_view>& args, std::string_view name)
+{
+    auto it = std::find(args.begin(), args.end(), name);
+    if (it == args.end())
+    {
+        return false;
+    }
+    args.erase(it);
+    return true;
+}
+
+// Strips "name value" from args, wherever it is
+std::optional<std::string_view> take_option(std::vector<std::string_view>& args, std::string_view name)
+{
+    auto it = std::find(args.begin(), args.end(), name);
+    if (it == args.end())
+    {
+        return std::nullopt;
+    }
+    if (it + 1 == args.end())
+    {
+        throw std::invalid_argument("Missing value for " + std::string(name));
+    }
+    auto value = *(it + 1);
+    args.erase(it, it + 2);
+    return value;
+}
+
+uint32_t parse_chunk_size(std::optional<std::string_view> value)
+{
+    if (!value.has_value())
+    {
+        return DEFAULT_PAYLOAD_CHUNK_SIZE;
+    }
+    try
+    {
+        size_t used = 0;
+        unsigned long long size = std::stoull(std::string(*value), &used);
+        if (used == value->size() && size > 0 && size <= 0x7fffffff)
+        {
+            return size;
+        }
+    }
+    catch (const std::exception&) {}
+    throw std::invalid_argument("Chunk size must be between 1 and 2^31 - 1 bytes!");
+}
+
+int parse_level(std::string_view level)
+{
+    if (level.size() != 1 || level[0] < '0' || level[0] > '9')
+    {
+        throw std::invalid_argument("Compression level must be between 0 and 9!");
+    }
+    return level[0] - '0';
+}
+
+// --compress [--level <0-9>], nullopt when the payload is stored as is
+std::optional<int> take_compression(std::vector<std::string_view>& args)
+{
+    bool compress = take_flag(args, "--compress");
+    auto level = take_option(args, "--level");
+    if (!level.has_value())
+    {
+        return compress ? std::optional<int>(Deflate::DEFAULT_LEVEL) : std::nullopt;
+    }
+    if (!compress)
+    {
+        throw std::invalid_argument("--level only applies with --compress");
+    }
+    return parse_level(*level);
+}
+
+// [--filter <strategy>] [--level <0-9>] [--idat-size <bytes>] for rewriting IDAT
+EncoderOptions take_encoder_options(std::vector<std::string_view>& args)
+{
+    EncoderOptions options;
+    if (auto idat_size = take_option(args, "--idat-size"))
+    {
+        options.idat_size = parse_chunk_size(idat_size);
+    }
+    if (auto filter = take_option(args, "--filter"))
+    {
+        auto strategy = PixelEncoder::parse_strategy(*filter);
+        if (!strategy.has_value())
+        {
+            throw std::invalid_argument("Unknown filter '" + std::string(*filter) + "', use none, sub, up, average, paeth or adaptive");
+        }
+        options.filter = *strategy;
+    }
+    if (auto level = take_option(args, "--level"))
+    {
+        options.level = parse_level(*level);
+    }
+    return options;
+}
+
+// A chunk's message, inflated if encode --compress wrote it
+std::string message_text(const Chunk& chunk)
+{
+    auto payload = CompressedPayload::decode(chunk.data());
+    return std::string(payload.begin(), payload.end());
+}
+
+// message_text() for remove, which reports after the output is committed:
+// a payload that fails to inflate is shown as is instead of failing a
+// removal that already happened
+std::string removed_text(const Chunk& chunk)
+{
+    try
+    {
+        return message_text(chunk);
+    }
+    catch (const std::invalid_argument&)
+    {
+        return chunk.data_as_string();
+    }
+}
+
+// Chunk index of the PNG at path, open on fd, that saves walking its
+// headers: from the shared ParseCache, else from a fresh .pngidx sidecar.
+// With the cache on, a file found in neither is indexed and cached.
+// nullopt means walk the file.
+std::optional<std::vector<IndexedChunk>> known_index(const std::string& path, int fd, FileKey& key)
+{
+    ParseCache& cache = ParseCache::shared();
+    key = FileKey::of(fd);
+    if (cache.enabled())
+    {
+        if (auto index = cache.lookup(key))
+        {
+            return index;
+        }
+    }
+
+    auto index = SidecarIndex::load(path, key);
+    if (cache.enabled())
+    {
+        if (!index.has_value())
+        {
+            index = ChunkIndex::build(fd);
+        }
+        cache.insert(key, *index);
+    }
+    return index;
+}
+
+// Forgets an index from known_index() that a chunk read back didn't match:
+// the file changed without its size or mtime changing
+void drop_index(const std::string& path, const FileKey& key)
+{
+    ParseCache::shared().erase(key);
+    SidecarIndex::remove(path);
+}
+
+// Fills buffer from fd as far as it can, short only at end of input
+size_t read_up_to(int fd, uint8_t* buffer, size_t size)
+{
+    ScopedTimer timer(Phase::Read);
+    size_t filled = 0;
+    while (filled < size)
+    {
+        ssize_t count = read(fd, buffer + filled, size - filled);
+        Stats::add(Counter::Syscalls);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count < 0)
+        {
+            throw std::runtime_error("There was an issue reading the payload file!");
+        }
+        if (count == 0)
+        {
+            break;
+        }
+        filled += count;
+        Stats::add(Counter::BytesRead, count);
+    }
+    return filled;
+}
+
+// Everything left in fd
+std::vector<uint8_t> read_all(int fd)
+{
+    std::vector<uint8_t> data;
+    size_t filled = 0;
+    do
+    {
+        data.resize(filled + 64 * 1024);
+        filled += read_up_to(fd, data.data() + filled, data.size() - filled);
+    } while (filled == data.size());
+    data.resize(filled);
+    return data;
+}
+
+// A whole image, for the commands that work on its pixels
+PNG read_png(std::string_view path)
+{
+    if (path == "-")
+    {
+        InputFile source("-");
+        ChunkStreamReader reader(source.fd);
+        std::vector<Chunk> chunks;
+        while (reader.next())
+        {
+            chunks.push_back(reader.read_chunk());
+        }
+        return PNG(std::move(chunks));
+    }
+    // chunks view the mapping in place, checked as they are read
+    return PNG(PNGFile{std::string(path)}, Validation::Lazy);
+}
+
+// write_payload() for --compress: every chunk_size bytes of the payload are
+// deflated into a chunk of their own, so decode never has to hold more than
+// one piece. Returns the payload size before compression.
+uint64_t write_compressed_payload(ChunkStreamWriter& writer, const ChunkType& chunktype, int fd, uint32_t chunk_size, int level)
+{
+    std::vector<uint8_t> piece(chunk_size);
+    uint64_t total = 0;
+    do
+    {
+        size_t size = read_up_to(fd, piece.data(), piece.size());
+        auto payload = CompressedPayload::encode(std::span<const uint8_t>(piece.data(), size), level);
+        if (payload.size() > 0x7fffffff)
+        {
+            throw std::invalid_argument("Compressed chunk is too big, use a smaller --chunk-size!");
+        }
+        writer.write_chunk(Chunk(chunktype, std::move(payload)));
+        total += size;
+        if (size < piece.size())
+        {
+            break;
+        }
+    } while (true);
+    return total;
+}
+
+/*
+* input: encode <source_file.png> <chunktype> [output_file.png], with the
+* --from-file, --chunk-size and --compress options already taken out
+*
+* streams a payload file into consecutive chunks of one type, in one pass
+*/
+void encode_from_file(const std::vector<std::string_view>& input, std::string_view payload, uint32_t chunk_size, std::optional<int> level, std::ostream& out, std::ostream& err)
+{
+    auto write_payload = [&](ChunkStreamWriter& writer, const ChunkType& chunktype, int fd)
+    {
+        return level.has_value() ? write_compressed_payload(writer, chunktype, fd, chunk_size, *level)
+                                 : writer.write_payload(chunktype, fd, chunk_size, CompressedPayload::STORED_HEADER);
+    };
+
+    if (input.size() < 3 || input.size() > 4)
+    {
+        throw std::invalid_argument("Invalid number of arguments for encode. Usability: ./pngre encode ./<image_name>.png <chunktype> --from-file <payload> [--chunk-size <bytes>] [--compress [--level <0-9>]] [output.png]");
+    }
+    auto chunktype = ChunkType::fromStr(input[2]);
+    if (!chunktype.is_valid())
+    {
+        throw std::invalid_argument("Invalid ChunkType!");
+    }
+
+    std::string destination(input.size() > 3 ? input[3] : input[1]);
+    std::ostream& status = destination == "-" ? err : out;
+    if (payload == "-" && input[1] == "-")
+    {
+        throw std::invalid_argument("The image and the payload can't both come from stdin!");
+    }
+
+    InputFile payload_file{std::string(payload)};
+    InputFile source{std::string(input[1])};
+    AtomicFile output(destination);
+    uint64_t payload_size = 0;
+
+    if (input[1] != "-")
+    {
+        // copy everything around the new chunks in the kernel
+        PNGFile file{std::string(input[1])};
+        auto iend = file.chunk_by_type(ChunkType::fromStr("IEND"));
+        size_t split = iend.has_value() ? iend.value().offset() : file.bytes().size();
+
+        output.copy_range(source.fd, 0, split);
+        {
+            ChunkStreamWriter writer(output.fd(), false);
+            payload_size = write_payload(writer, chunktype, payload_file.fd);
+            writer.flush();
+        }
+        output.copy_range(source.fd, split, file.bytes().size() - split);
+    }
+    else
+    {
+        // pipes are rewritten in a single pass, the new chunks go before IEND
+        ChunkStreamReader reader(source.fd);
+        ChunkStreamWriter writer(output.fd());
+        const auto iend = ChunkType::fromStr("IEND");
+        bool written = false;
+
+        while (reader.next())
+        {
+            if (!written && reader.chunktype() == iend)
+            {
+                payload_size = write_payload(writer, chunktype, payload_file.fd);
+                written = true;
+            }
+            reader.copy_to(writer);
+        }
+
+        if (!written)
+        {
+            payload_size = write_payload(writer, chunktype, payload_file.fd);
+        }
+        writer.flush();
+    }
+    output.commit();
+    report_throughput(output, err);
+
+    status << "Encoded: " << payload << " (" << payload_size << " bytes) into " << input[2] << " file successfully!" << std::endl;
+}
+
+/*
+* input: decode <source_file.png> <chunktype>, with --to-file taken out
+*
+* streams the data of every chunk of a type, in file order, into one file.
+* Chunks written by encode --compress are inflated one at a time.
+*/
+void decode_to_file(const std::vector<std::string_view>& input, std::string_view destination, std::ostream& out, std::ostream& err)
+{
+    if (input.size() != 3)
+    {
+        throw std::invalid_argument("Invalid number of arguments for decode. Usability: ./pngre decode ./<image_name>.png <chunktype> --to-file <payload>");
+    }
+    auto chunktype = ChunkType::fromStr(input[2]);
+    if (!chunktype.is_valid())
+    {
+        throw std::invalid_argument("Invalid ChunkType!");
+    }
+    std::ostream& status = destination == "-" ? err : out;
+
+    InputFile source{std::string(input[1])};
+    AtomicFile output{std::string(destination)};
+    uint64_t payload_size = 0;
+    size_t chunk_count = 0;
+
+    if (input[1] == "-")
+    {
+        ChunkStreamReader reader(source.fd);
+        while (reader.next())
+        {
+            if (reader.chunktype() != chunktype)
+            {
+                continue;
+            }
+            uint8_t header[CompressedPayload::HEADER_SIZE];
+            size_t header_size = reader.read(header, sizeof(header));
+            if (CompressedPayload::is_compressed({header, header_size}))
+            {
+                // the rest of the chunk is read through the CRC like the header
+                std::vector<uint8_t> data(header, header + header_size);
+                data.resize(reader.length());
+                size_t filled = header_size;
+                while (filled < data.size())
+                {
+                    filled += reader.read(data.data() + filled, data.size() - filled);
+                }
+                auto inflated = CompressedPayload::decode(data);
+                output.write(inflated.data(), inflated.size());
+                payload_size += inflated.size();
+            }
+            else if (CompressedPayload::is_stored({header, header_size}))
+            {
+                payload_size += reader.copy_data_to(output);
+            }
+            else
+            {
+                output.write(header, header_size);
+                payload_size += header_size + reader.copy_data_to(output);
+            }
+            chunk_count++;
+        }
+    }
+    else
+    {
+        // seek from header to header, only matching chunks' data is read
+        ChunkWalker walker(source.fd);
+        while (walker.next())
+        {
+            if (walker.chunktype() != chunktype)
+            {
+                continue;
+            }
+            uint8_t header[CompressedPayload::HEADER_SIZE];
+            size_t header_size = walker.peek(header, sizeof(header));
+            if (CompressedPayload::is_compressed({header, header_size}))
+            {
+                auto inflated = CompressedPayload::decode(walker.read_chunk().data());
+                output.write(inflated.data(), inflated.size());
+                payload_size += inflated.size();
+            }
+            else if (CompressedPayload::is_stored({header, header_size}))
+            {
+                payload_size += walker.copy_data_to(output, header_size);
+            }
+            else
+            {
+                payload_size += walker.copy_data_to(output);
+            }
+            chunk_count++;
+        }
+    }
+
+    if (chunk_count == 0)
+    {
+        // leave any existing destination alone
+        status << "No message matching '" << input[2] << "' ChunkType in provided image." << std::endl;
+        return;
+    }
+    output.commit();
+    report_throughput(output, err);
+
+    status << "Decoded: " << payload_size << " bytes from " << chunk_count << " " << input[2] << " chunks into " << destination << std::endl;
+}
+
+/*
+* input: encode <source_file.png> <message> [output_file.png], or
+* encode <source_file.png> [output_file.png] with --from-file <payload>,
+* with --lsb, --filter and --level already taken out
+*
+* hides the payload in the least significant bits of the pixels, see
+* LsbCodec, and rewrites IDAT with the encoder options
+*/
+void encode_lsb(const std::vector<std::string_view>& input, std::optional<std::string_view> payload_path, const EncoderOptions& options, std::ostream& out, std::ostream& err)
+{
+    size_t arguments = payload_path.has_value() ? 2 : 3;
+    if (input.size() < arguments || input.size() > arguments + 1)
+    {
+        throw std::invalid_argument("Invalid number of arguments for encode. Usability: ./pngre encode ./<image_name>.png --lsb (<Message> | --from-file <payload>) [--filter <none|sub|up|average|paeth|adaptive>] [--level <0-9>] [--idat-size <bytes>] [output.png]");
+    }
+    std::string destination(input.size() > arguments ? input[arguments] : input[1]);
+    std::ostream& status = destination == "-" ? err : out;
+
+    std::vector<uint8_t> payload;
+    if (payload_path.has_value())
+    {
+        if (*payload_path == "-" && input[1] == "-")
+        {
+            throw std::invalid_argument("The image and the payload can't both come from stdin!");
+        }
+        InputFile payload_file{std::string(*payload_path)};
+        payload = read_all(payload_file.fd);
+    }
+    else
+    {
+        payload.assign(input[2].begin(), input[2].end());
+    }
+
+    PNG png = read_png(input[1]);
+    PixelDecoder decoder(png);
+    const ImageHeader& header = decoder.header();
+    LsbCodec::check_image(header);
+    std::vector<uint8_t> pixels(decoder.output_size());
+    decoder.decode(pixels);
+    LsbCodec::embed(header, pixels, payload);
+    // stripes of rows are filtered and deflated in parallel
+    PNG encoded = PixelEncoder::replace_idat(png, PixelEncoder::encode_idat(header, pixels, options, ThreadPool::shared()));
+
+    AtomicFile output(destination);
+    encoded.write_to(output);
+    output.commit();
+    report_throughput(output, err);
+
+    status << "Encoded: " << payload.size() << " bytes into the pixels of " << input[1] << " ("
+           << LsbCodec::capacity(header) << " bytes available) successfully!" << std::endl;
+}
+
+/*
+* input: decode <source_file.png>, with --lsb and --to-file taken out
+*
+* reads back a payload hidden by encode --lsb, printed or written to a file
+*/
+void decode_lsb(const std::vector<std::string_view>& input, std::optional<std::string_view> destination, std::ostream& out, std::ostream& err)
+{
+    if (input.size() != 2)
+    {
+        throw std::invalid_argument("Invalid number of arguments for decode. Usability: ./pngre decode ./<image_name>.png --lsb [--to-file <payload>]");
+    }
+
+    PNG png = read_png(input[1]);
+    PixelDecoder decoder(png);
+    LsbCodec::check_image(decoder.header());
+    std::vector<uint8_t> pixels(decoder.output_size());
+    decoder.decode(pixels);
+    auto payload = LsbCodec::extract(decoder.header(), pixels);
+
+    if (!destination.has_value())
+    {
+        out << "Decoded: " << std::string(payload.begin(), payload.end()) << std::endl;
+        return;
+    }
+    std::ostream& status = *destination == "-" ? err : out;
+    AtomicFile output{std::string(*destination)};
+    output.write(payload.data(), payload.size());
+    output.commit();
+    report_throughput(output, err);
+    status << "Decoded: " << payload.size() << " bytes from the pixels of " << input[1] << " into " << *destination << std::endl;
+}
+
+} // namespace
+
+/* 
+* input[0]: encode <command>
+* input[1]: <source_file.png>
+* input[2], input[3]: <chunktype> <message>
+* ...: more <chunktype> <message> pairs [OPTIONAL]
+* last: <output_file.png> [OPTIONAL]
+* --compress [--level <0-9>] [OPTIONAL]
+*
+* encodes messages into a PNG file, all written in one pass. With
+* --from-file <payload> [--chunk-size <bytes>] in place of the message, the
+* payload is streamed into as many chunks of the type as it needs.
+* --compress stores every message (or payload chunk) deflated, see
+* CompressedPayload.
+* --lsb takes no chunktype and hides a single message (or payload) in the
+* pixels instead, [--filter <strategy>] [--level <0-9>] [--idat-size <bytes>]
+* tune the rewritten IDAT, see PixelEncoder.
+*/
+void handle_encode(std::vector<std::string_view> input, std::ostream& out, std::ostream& err)
+{
+    if (take_flag(input, "--lsb"))
+    {
+        auto options = take_encoder_options(input);
+        auto payload = take_option(input, "--from-file");
+        encode_lsb(input, payload, options, out, err);
+        return;
+    }
+
+    auto level = take_compression(input);
+    if (auto payload = take_option(input, "--from-file"))
+    {
+        uint32_t chunk_size = parse_chunk_size(take_option(input, "--chunk-size"));
+        encode_from_file(input, *payload, chunk_size, level, out, err);
+        return;
+    }
+
+    if (input.size() < 4)
+    {
+        throw std::invalid_argument("Invalid number of arguments for encode. Usability: ./pngre encode ./<image_name>.png <chunktype> <Message> [<chunktype> <Message>]... [--compress [--level <0-9>]] [output.png]");
+    }
+
+    // (type, message) pairs, an odd argument left over is the output
+    size_t pair_count = (input.size() - 2) / 2;
+    std::string destination((input.size() - 2) % 2 == 1 ? input.back() : input[1]);
+    std::ostream& status = destination == "-" ? err : out;
+
+    // validate chunktypes, and build the new chunks
+    std::vector<Chunk> chunks;
+    chunks.reserve(pair_count);
+    for (size_t i = 0; i < pair_count; i++)
+    {
+        auto chunktype = ChunkType::fromStr(input[2 + 2 * i]);
+        if (!chunktype.is_valid())
+        {
+            throw std::invalid_argument("Invalid ChunkType!");
+        }
+        // todo: validate data
+        auto message = input[3 + 2 * i];
+        std::vector<uint8_t> data(message.begin(), message.end());
+        if (level.has_value())
+        {
+            data = CompressedPayload::encode(data, *level);
+        }
+        chunks.push_back(Chunk(chunktype, std::move(data)));
+    }
+
+    auto report = [&]()
+    {
+        for (size_t i = 0; i < pair_count; i++)
+        {
+            status << "Encoded: '" << input[3 + 2 * i] << "' into " << input[2 + 2 * i] << " file successfully!" << std::endl;
+        }
+    };
+
+    // fast path: patch the tail of the file in place
+    if (destination == input[1] && destination != "-" && PNGPatch::append_before_iend(destination, chunks))
+    {
+        report();
+        return;
+    }
+
+    InputFile source{std::string(input[1])};
+    AtomicFile output(destination);
+
+    if (input[1] != "-")
+    {
+        // copy everything around the new chunks in the kernel
+        PNGFile file{std::string(input[1])};
+        auto iend = file.chunk_by_type(ChunkType::fromStr("IEND"));
+        size_t split = iend.has_value() ? iend.value().offset() : file.bytes().size();
+
+        output.copy_range(source.fd, 0, split);
+        for (const auto& chunk : chunks)
+        {
+            auto bytes = chunk.as_bytes();
+            output.write(bytes.data(), bytes.size());
+        }
+        output.copy_range(source.fd, split, file.bytes().size() - split);
+    }
+    else
+    {
+        // pipes are rewritten in a single pass, the new chunks go before IEND
+        ChunkStreamReader reader(source.fd);
+        ChunkStreamWriter writer(output.fd());
+        const auto iend = ChunkType::fromStr("IEND");
+        bool written = false;
+
+        while (reader.next())
+        {
+            if (!written && reader.chunktype() == iend)
+            {
+                for (const auto& chunk : chunks)
+                {
+                    writer.write_chunk(chunk);
+                }
+                written = true;
+            }
+            reader.copy_to(writer);
+        }
+
+        if (!written)
+        {
+            for (const auto& chunk : chunks)
+            {
+                writer.write_chunk(chunk);
+            }
+        }
+        writer.flush();
+    }
+    output.commit();
+    report_throughput(output, err);
+    report();
+}
+
+/* 
+* input[0]: decode <command>
+* input[1]: <source_file.png>
+* input[2..]: <chunktype>... 
+* --all [OPTIONAL]
+*
+* decodes the first message of each chunktype (every one with --all) from a PNG file,
+* inflating messages written by encode --compress.
+* With --to-file <payload>, the data of every chunk of a single chunktype is
+* streamed into that file instead.
+* --lsb takes no chunktype and reads the payload encode --lsb hid in the pixels.
+*/
+void handle_decode(std::vector<std::string_view> input, std::ostream& out, std::ostream& err)
+{
+    bool lsb = take_flag(input, "--lsb");
+    auto destination = take_option(input, "--to-file");
+    if (lsb)
+    {
+        decode_lsb(input, destination, out, err);
+        return;
+    }
+    if (destination.has_value())
+    {
+        decode_to_file(input, *destination, out, err);
+        return;
+    }
+
+    bool all = take_flag(input, "--all");
+    if (input.size() < 3)
+    {
+        throw std::invalid_argument("Invalid number of arguments for decode. Usability: ./pngre decode ./<image_name>.png <chunktype>... [--all]");
+    }
+
+    // validate chunktypes
+    TypeSelection selection(std::vector<std::string_view>(input.begin() + 2, input.end()), all);
+
+    if (input[1] == "-")
+    {
+        // pipes can't be seeked, stream up to the last match
+        InputFile source("-");
+        ChunkStreamReader reader(source.fd);
+        while (!selection.done() && reader.next())
+        {
+            if (auto match = selection.match(reader.chunktype()))
+            {
+                selection.taken[*match].push_back(reader.read_chunk());
+            }
+        }
+    }
+    else
+    {
+        InputFile source{std::string(input[1])};
+        FileKey key;
+        bool walk = true;
+        if (auto index = known_index(std::string(input[1]), source.fd, key))
+        {
+            // one pread per matching chunk, no other headers are read
+            walk = false;
+            for (size_t i = 0; i < index->size() && !selection.done(); i++)
+            {
+                const auto& indexed = (*index)[i];
+                if (auto match = selection.match(indexed.chunktype))
+                {
+                    auto chunk = ChunkIndex::read(source.fd, indexed);
+                    if (!chunk.has_value())
+                    {
+                        // start over without the index
+                        drop_index(std::string(input[1]), key);
+                        selection.taken.assign(selection.types.size(), {});
+                        walk = true;
+                        break;
+                    }
+                    selection.taken[*match].push_back(std::move(*chunk));
+                    if (!indexed.verified)
+                    {
+                        ParseCache::shared().mark_verified(key, i);
+                    }
+                }
+            }
+        }
+        if (walk)
+        {
+            // seek from header to header, only matching chunks' data is read
+            ChunkWalker walker(source.fd);
+            while (!selection.done() && walker.next())
+            {
+                if (auto match = selection.match(walker.chunktype()))
+                {
+                    // reading the chunk verifies its CRC
+                    selection.taken[*match].push_back(walker.read_chunk());
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < selection.types.size(); i++)
+    {
+        for (const auto& chunk : selection.taken[i])
+        {
+            out << "Decoded: " << message_text(chunk) << std::endl;
+        }
+        if (selection.taken[i].empty())
+        {
+            out << "No message matching '" << selection.types[i].toString() << "' ChunkType in provided image." << std::endl;
+        }
+    }
+}
+
+/* 
+* input[0]: remove <command>
+* input[1]: <source_file.png>
+* input[2..]: <chunktype>...
+* --all [OPTIONAL]
+* last: <output_file.png> [OPTIONAL], when it isn't a chunktype
+*
+* removes the first message of each chunktype (every one with --all) from a PNG file
+*/
+void handle_remove(std::vector<std::string_view> input, std::ostream& out, std::ostream& err)
+{
+    bool all = take_flag(input, "--all");
+    if (input.size() < 3)
+    {
+        throw std::invalid_argument("Invalid number of arguments for remove. Usability: ./pngre remove ./<image_name>.png <chunktype>... [--all] [output.png]");
+    }
+
+    std::string destination(input[1]);
+    if (input.size() > 3 && !is_chunk_type(input.back()))
+    {
+        destination = input.back();
+        input.pop_back();
+    }
+    std::ostream& status = destination == "-" ? err : out;
+
+    // validate chunktypes
+    TypeSelection selection(std::vector<std::string_view>(input.begin() + 2, input.end()), all);
+    InputFile source{std::string(input[1])};
+    size_t removed = 0;
+
+    if (input[1] != "-")
+    {
+        // byte ranges of the removed chunks, in file order
+        PNGFile file{std::string(input[1])};
+        std::vector<std::pair<size_t, size_t>> ranges;
+        for (const auto& view : file.chunks())
+        {
+            if (selection.done())
+            {
+                break;
+            }
+            if (auto match = selection.match(view.chunktype()))
+            {
+                // materializing the chunk verifies its CRC
+                selection.taken[*match].push_back(Chunk(view));
+                ranges.emplace_back(view.offset(), view.offset() + 12 + view.length());
+            }
+        }
+        removed = ranges.size();
+
+        // nothing to do when rewriting the source without a match
+        if (removed > 0 || destination != input[1])
+        {
+            // copy everything around the removed chunks in the kernel
+            AtomicFile output(destination);
+            size_t kept = 0;
+            for (auto [start, end] : ranges)
+            {
+                output.copy_range(source.fd, kept, start - kept);
+                kept = end;
+            }
+            output.copy_range(source.fd, kept, file.bytes().size() - kept);
+            output.commit();
+            report_throughput(output, err);
+        }
+    }
+    else
+    {
+        // pipes are rewritten in a single pass, dropping the matches
+        AtomicFile output(destination);
+        {
+            ChunkStreamReader reader(source.fd);
+            ChunkStreamWriter writer(output.fd());
+
+            while (reader.next())
+            {
+                if (auto match = selection.match(reader.chunktype()))
+                {
+                    selection.taken[*match].push_back(reader.read_chunk());
+                    removed++;
+                    continue;
+                }
+                reader.copy_to(writer);
+            }
+            writer.flush();
+        }
+        output.commit();
+    }
+
+    for (size_t i = 0; i < selection.types.size(); i++)
+    {
+        for (const auto& chunk : selection.taken[i])
+        {
+            status << "Removed: `" << removed_text(chunk) << "` from " << input[1] << " image!" << std::endl;
+        }
+        if (selection.taken[i].empty())
+        {
+            status << "No message matching '" << selection.types[i].toString() << "' ChunkType in provided image." << std::endl;
+        }
+    }
+}
+
+/* 
+* input[0]: print <command>
+* input[1]: <source_file.png>
+* input[2]: --verify [OPTIONAL]
+*
+* prints every chunk of a PNG file, --verify also checks their CRCs
+*/
+void handle_print(std::vector<std::string_view> input, std::ostream& out, std::ostream&)
+{
+    if (input.size() < 2)
+    {
+        throw std::invalid_argument("Invalid number of arguments for print. Usability: ./pngre print ./<image_name>.png [--verify]");
+    }
+    bool verify = input.size() > 2 && input[2] == "--verify";
+    if (input.size() > 2 && !verify)
+    {
+        throw std::invalid_argument("Unknown print option: " + std::string(input[2]));
+    }
+
+    if (input[1] == "-")
+    {
+        // pipes can't be seeked, stream through every chunk (which always
+        // checks CRCs)
+        InputFile source("-");
+        ChunkStreamReader reader(source.fd);
+        for (size_t i = 0; reader.next(); i++)
+        {
+            reader.skip();
+            out << "Chunk [" << i << "]: Chunk { length: " << reader.length()
+                      << ", type: " << reader.chunktype().toString()
+                      << ", data size: " << reader.length()
+                      << ", crc: " << reader.crc() << " }" << std::endl;
+        }
+        return;
+    }
+
+    InputFile source{std::string(input[1])};
+    FileKey key;
+    if (auto index = known_index(std::string(input[1]), source.fd, key))
+    {
+        // nothing to read unless --verify, which always reads the data again
+        // so bit rot since the chunk was last verified is caught. Any
+        // mismatch is left to the walk below, which tells a changed file
+        // from a corrupt one.
+        bool matches = true;
+        for (size_t i = 0; verify && matches && i < index->size(); i++)
+        {
+            matches = ChunkIndex::verify(source.fd, (*index)[i]);
+            if (matches)
+            {
+                ParseCache::shared().mark_verified(key, i);
+            }
+        }
+        if (matches)
+        {
+            for (size_t i = 0; i < index->size(); i++)
+            {
+                const auto& indexed = (*index)[i];
+                out << "Chunk [" << i << "]: Chunk { length: " << indexed.length
+                          << ", type: " << indexed.chunktype.toString()
+                          << ", data size: " << indexed.length
+                          << ", crc: " << indexed.crc << " }" << std::endl;
+            }
+            return;
+        }
+        drop_index(std::string(input[1]), key);
+    }
+
+    // seek from header to header, chunk data is only read by --verify
+    ChunkWalker walker(source.fd);
+    for (size_t i = 0; walker.next(); i++)
+    {
+        if (verify && !walker.verify_crc())
+        {
+            throw std::invalid_argument("CRC mismatch in chunk " + std::to_string(i) + " (" + walker.chunktype().toString() + ")");
+        }
+        out << "Chunk [" << i << "]: Chunk { length: " << walker.length()
+                  << ", type: " << walker.chunktype().toString()
+                  << ", data size: " << walker.length()
+                  << ", crc: " << walker.crc() << " }" << std::endl;
+    }
+}
+
+/* 
+* input[0]: index <command>
+* input[1]: <source_file.png>
+* input[2]: --verify [OPTIONAL]
+*
+* writes <source_file.png>.pngidx, the chunk index decode and print use
+* instead of walking the file until it changes. --verify also checks every
+* chunk's CRC, so print --verify can skip them later.
+*/
+void handle_index(std::vector<std::string_view> input, std::ostream& out, std::ostream&)
+{
+    bool verify = take_flag(input, "--verify");
+    if (input.size() != 2)
+    {
+        throw std::invalid_argument("Invalid number of arguments for index. Usability: ./pngre index ./<image_name>.png [--verify]");
+    }
+    if (input[1] == "-")
+    {
+        throw std::invalid_argument("Only files on disk can be indexed!");
+    }
+
+    std::string path(input[1]);
+    InputFile source{path};
+    FileKey key = FileKey::of(source.fd);
+    auto index = ChunkIndex::build(source.fd);
+    if (verify)
+    {
+        for (size_t i = 0; i < index.size(); i++)
+        {
+            if (!ChunkIndex::verify(source.fd, index[i]))
+            {
+                throw std::invalid_argument("CRC mismatch in chunk " + std::to_string(i) + " (" + index[i].chunktype.toString() + ")");
+            }
+            index[i].verified = true;
+        }
+    }
+
+    SidecarIndex::write(path, key, index);
+    out << "Indexed " << index.size() << " chunks of " << path << " into " << SidecarIndex::path_for(path) << std::endl;
+}
+
+/* 
+* input[0]: batch <command>
+* input[1]: <manifest.txt> or - for stdin
+* input[2..]: --op "<command> [args]", --unordered, --jobs <n> [OPTIONAL]
+* --cache-size <bytes> [OPTIONAL]
+*
+* runs many operations in one process, see Batch. --cache-size keeps the
+* chunk index of decoded files in a ParseCache.
+*/
+void handle_batch(std::vector<std::string_view> input, std::ostream& out, std::ostream& err)
+{
+    if (input.size() < 2)
+    {
+        throw std::invalid_argument("Invalid number of arguments for batch. Usability: ./pngre batch <manifest.txt|-> [--op \"<command> [args]\"] [--unordered] [--jobs <n>] [--cache-size <bytes>]");
+    }
+
+    BatchOptions options;
+    for (size_t i = 2; i < input.size(); i++)
+    {
+        if (input[i] == "--unordered")
+        {
+            options.ordered = false;
+        }
+        else if (input[i] == "--ordered")
+        {
+            options.ordered = true;
+        }
+        else if (input[i] == "--jobs" && i + 1 < input.size())
+        {
+            options.jobs = std::stoul(std::string(input[++i]));
+        }
+        else if (input[i] == "--op" && i + 1 < input.size())
+        {
+            options.op_template = Batch::split_line(input[++i]);
+        }
+        else if (input[i] == "--cache-size" && i + 1 < input.size())
+        {
+            ParseCache::shared().set_capacity(std::stoull(std::string(input[++i])));
+        }
+        else
+        {
+            throw std::invalid_argument("Unknown batch option '" + std::string(input[i]) + "'");
+        }
+    }
+
+    BatchReport report;
+    if (input[1] == "-")
+    {
+        report = Batch::run(std::cin, options, out, err);
+    }
+    else
+    {
+        std::ifstream manifest{std::string(input[1])};
+        if (!manifest.good())
+        {
+            throw std::invalid_argument("There was an issue reading the batch manifest!");
+        }
+        report = Batch::run(manifest, options, out, err);
+    }
+
+    double seconds = report.seconds > 0 ? report.seconds : 1e-9;
+    err << "Batch: " << report.operations << " operations (" << report.failed << " failed) in "
+        << report.seconds << " s, " << report.operations / seconds << " files/s, "
+        << report.bytes / 1e6 / seconds << " MB/s" << std::endl;
+    if (ParseCache::shared().enabled())
+    {
+        err << "Parse cache: " << ParseCache::shared().hits() << " hits, " << ParseCache::shared().misses() << " misses" << std::endl;
+    }
+
+    if (report.failed > 0)
+    {
+        throw std::runtime_error(std::to_string(report.failed) + " batch operations failed");
+    }
+}
+
+namespace {
+
+// for the signal handler, stop() only writes to an eventfd
+std::atomic<Server*> serving{nullptr};
+
+void stop_serving(int)
+{
+    if (Server* server = serving.load())
+    {
+        server->stop();
+    }
+}
+
+} // namespace
+
+/* 
+* input[0]: serve <command>
+* input[1]: <socket path>
+* input[2..]: --jobs <n>, --queue <n>, --cache-size <bytes> [OPTIONAL]
+*
+* serves encode/decode/remove/print requests on a Unix domain socket until
+* SIGINT or SIGTERM, see Server. --cache-size keeps the chunk index of
+* decoded files in a ParseCache.
+*/
+void handle_serve(std::vector<std::string_view> input, std::ostream&, std::ostream& err)
+{
+    if (input.size() < 2)
+    {
+        throw std::invalid_argument("Invalid number of arguments for serve. Usability: ./pngre serve <socket> [--jobs <n>] [--queue <n>] [--cache-size <bytes>]");
+    }
+
+    ServerOptions options;
+    for (size_t i = 2; i < input.size(); i++)
+    {
+        if (input[i] == "--jobs" && i + 1 < input.size())
+        {
+            options.jobs = std::stoul(std::string(input[++i]));
+        }
+        else if (input[i] == "--queue" && i + 1 < input.size())
+        {
+            options.queue_limit = std::stoul(std::string(input[++i]));
+        }
+        else if (input[i] == "--cache-size" && i + 1 < input.size())
+        {
+            ParseCache::shared().set_capacity(std::stoull(std::string(input[++i])));
+        }
+        else
+        {
+            throw std::invalid_argument("Unknown serve option '" + std::string(input[i]) + "'");
+        }
+    }
+
+    Server server{std::string(input[1]), options};
+    serving = &server;
+    struct sigaction action{};
+    action.sa_handler = stop_serving;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    err << "Serving on " << input[1] << std::endl;
+    try
+    {
+        server.run();
+    }
+    catch (...)
+    {
+        serving = nullptr;
+        throw;
+    }
+    serving = nullptr;
+}
+
+bool run_command(std::vector<std::string_view> input, std::ostream& out, std::ostream& err)
+{
+    std::string_view command = input.empty() ? "" : input[0];
+
+    if (command == "encode")
+    {
+        handle_encode(input, out, err);
+    }
+    else if (command == "decode")
+    {
+        handle_decode(input, out, err);
+    }
+    else if (command == "remove")
+    {
+        handle_remove(input, out, err);
+    }
+    else if (command == "print")
+    {
+        handle_print(input, out, err);
+    }
+    else if (command == "index")
+    {
+        handle_index(input, out, err);
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+std::vector<CommandPath> command_paths(const std::vector<std::string>& args)
+{
+    std::vector<CommandPath> paths;
+    auto add = [&](std::string_view path, bool writes)
+    {
+        std::error_code error;
+        auto resolved = std::filesystem::weakly_canonical(path, error);
+        paths.push_back({error ? std::string(path) : resolved.string(), writes});
+    };
+
+    // strip options the way the handlers do, so what is left is positional
+    std::vector<std::string_view> input(args.begin(), args.end());
+    std::string_view command = input.empty() ? "" : input[0];
+    std::optional<std::string_view> from_file;
+    std::optional<std::string_view> to_file;
+    bool lsb = false;
+    try
+    {
+        from_file = take_option(input, "--from-file");
+        to_file = take_option(input, "--to-file");
+        lsb = take_flag(input, "--lsb");
+        for (std::string_view flag : {"--compress", "--all", "--verify"})
+        {
+            take_flag(input, flag);
+        }
+        for (std::string_view option : {"--level", "--chunk-size", "--filter", "--idat-size"})
+        {
+            take_option(input, option);
+        }
+    }
+    catch (const std::invalid_argument&)
+    {
+        // the command fails the same way when it runs
+    }
+    if (from_file.has_value())
+    {
+        add(*from_file, false);
+    }
+    if (to_file.has_value())
+    {
+        add(*to_file, true);
+    }
+
+    // the output of encode and remove, whether or not it exists yet
+    std::optional<std::string_view> output;
+    if (command == "encode" && input.size() > 2)
+    {
+        size_t positional = input.size() - 1;
+        if (lsb)
+        {
+            size_t without_output = from_file.has_value() ? 1 : 2;
+            if (positional > without_output)
+            {
+                output = input.back();
+            }
+        }
+        else if (from_file.has_value() ? positional > 2 : positional % 2 == 0)
+        {
+            output = input.back();
+        }
+    }
+    else if (command == "remove" && input.size() > 3 && !is_chunk_type(input.back()))
+    {
+        output = input.back();
+    }
+
+    if (input.size() > 1)
+    {
+        bool edits = command == "encode" || command == "remove";
+        add(input[1], edits && !output.has_value());
+    }
+    if (output.has_value())
+    {
+        add(*output, true);
+    }
+
+    // one entry per file, writing if any mention of it does
+    std::sort(paths.begin(), paths.end(), [](const CommandPath& a, const CommandPath& b) {
+        return a.path < b.path || (a.path == b.path && a.writes > b.writes);
+    });
+    paths.erase(std::unique(paths.begin(), paths.end(), [](const CommandPath& a, const CommandPath& b) {
+        return a.path == b.path;
+    }), paths.end());
+    return paths;
+}
+
+std::optional<StatsFormat> take_stats(std::vector<std::string_view>& input)
+{
+    auto it = std::find_if(input.begin(), input.end(), [](std::string_view arg) {
+        return arg == "--stats" || arg.starts_with("--stats=");
+    });
+    if (it == input.end())
+    {
+        return std::nullopt;
+    }
+    std::string_view name = *it == "--stats" ? "text" : it->substr(8);
+    input.erase(it);
+
+    auto format = Stats::parse_format(name);
+    if (!format.has_value())
+    {
+        throw std::invalid_argument("Unknown stats format '" + std::string(name) + "', use text, json or prometheus");
+    }
+    return format;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Stats.hpp"
+
+// Command handlers behind the CLI. input[0] is the command name followed by
+// its arguments, exactly as given on the command line. Results are written
+// to out, diagnostics to err (status lines too when PNG data goes to stdout).
+void handle_encode(std::vector<std::string_view> input, std::ostream& out, std::ostream& err);
+void handle_decode(std::vector<std::string_view> input, std::ostream& out, std::ostream& err);
+void handle_remove(std::vector<std::string_view> input, std::ostream& out, std::ostream& err);
+void handle_print(std::vector<std::string_view> input, std::ostream& out, std::ostream& err);
+// Writes the .pngidx sidecar decode and print look for, see SidecarIndex
+void handle_index(std::vector<std::string_view> input, std::ostream& out, std::ostream& err);
+// Runs a manifest of the commands above on a thread pool, see Batch
+void handle_batch(std::vector<std::string_view> input, std::ostream& out, std::ostream& err);
+// Serves the commands above on a Unix domain socket until SIGINT or SIGTERM,
+// see Server
+void handle_serve(std::vector<std::string_view> input, std::ostream& out, std::ostream& err);
+
+// Runs input[0] through its handler, returns false for unknown commands
+bool run_command(std::vector<std::string_view> input, std::ostream& out, std::ostream& err);
+
+// A file a command line touches, resolved through symlinks and ".."
+struct CommandPath
+{
+    std::string path;
+    // encode and remove write their output (the image itself without one),
+    // decode writes its --to-file payload
+    bool writes;
+};
+
+// Files a command line touches, sorted by path: the image, the output of
+// encode and remove and the --from-file and --to-file payloads, whether or
+// not they exist yet. Batch runs the commands sharing a file in order,
+// Server locks them.
+std::vector<CommandPath> command_paths(const std::vector<std::string>& args);
+
+// Strips --stats or --stats=<text|json|prometheus> from input, wherever it
+// is, and returns the format asked for
+std::optional<StatsFormat> take_stats(std::vector<std::string_view>& input);
@@ -0,0 +1,61 @@
+#include "CompressedPayload.hpp"
+#include "Deflate.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+bool has_method(std::span<const uint8_t> data, uint8_t method)
+{
+    return data.size() >= CompressedPayload::HEADER_SIZE &&
+           std::equal(CompressedPayload::MAGIC.begin(), CompressedPayload::MAGIC.end(), data.begin()) &&
+           data[CompressedPayload::MAGIC.size()] == method;
+}
+
+} // namespace
+
+std::vector<uint8_t> CompressedPayload::encode(std::span<const uint8_t> data, int level)
+{
+    auto stream = data.size() > Deflate::PARALLEL_BLOCK_SIZE
+                      ? Deflate::compress_parallel(data, level, ThreadPool::shared())
+                      : Deflate::compress(data, level);
+
+    std::vector<uint8_t> payload;
+    payload.reserve(HEADER_SIZE + stream.size());
+    payload.insert(payload.end(), MAGIC.begin(), MAGIC.end());
+    payload.push_back(METHOD_DEFLATE);
+    payload.insert(payload.end(), stream.begin(), stream.end());
+    return payload;
+}
+
+bool CompressedPayload::is_compressed(std::span<const uint8_t> data)
+{
+    return has_method(data, METHOD_DEFLATE);
+}
+
+bool CompressedPayload::is_stored(std::span<const uint8_t> data)
+{
+    return has_method(data, METHOD_STORED);
+}
+
+std::vector<uint8_t> CompressedPayload::decode(std::span<const uint8_t> data, size_t max_size)
+{
+    if (is_stored(data)) {
+        return std::vector<uint8_t>(data.begin() + HEADER_SIZE, data.end());
+    }
+    if (!is_compressed(data)) {
+        return std::vector<uint8_t>(data.begin(), data.end());
+    }
+
+    // through a sink, so inflating stops at the limit
+    std::vector<uint8_t> payload;
+    std::span<const uint8_t> segments[] = {data.subspan(HEADER_SIZE)};
+    Deflate::decompress_to(segments, [&](std::span<const uint8_t> piece) {
+        if (piece.size() > max_size - payload.size()) {
+            throw std::invalid_argument("Payload inflates past the size limit!");
+        }
+        payload.insert(payload.end(), piece.begin(), piece.end());
+    });
+    return payload;
+}
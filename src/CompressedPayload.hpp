@@ -0,0 +1,40 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Chunk data written by encode --compress or --from-file starts with a
+// header: the magic "\0pngre" and a method byte, deflate (0) followed by a
+// zlib stream, or stored (1) followed by the data as is. Messages given on
+// the command line are written bare and can't start with a NUL byte, and
+// other chunks (IHDR, gAMA and the like) may start with one but are very
+// unlikely to spell the magic, so decode goes by the header alone and never
+// guesses from the data.
+class CompressedPayload {
+public:
+    static constexpr std::array<uint8_t, 6> MAGIC = {0x00, 'p', 'n', 'g', 'r', 'e'};
+    static constexpr uint8_t METHOD_DEFLATE = 0x00;
+    static constexpr uint8_t METHOD_STORED = 0x01;
+    static constexpr size_t HEADER_SIZE = MAGIC.size() + 1;
+    // Goes ahead of each piece of a --from-file payload written uncompressed
+    static constexpr std::array<uint8_t, HEADER_SIZE> STORED_HEADER = {0x00, 'p', 'n', 'g', 'r', 'e', METHOD_STORED};
+    // No piece encode writes inflates past a chunk's largest length
+    static constexpr size_t MAX_DECODED_SIZE = 0x7fffffff;
+
+    // Payloads spanning several Deflate::PARALLEL_BLOCK_SIZE blocks are
+    // deflated on ThreadPool::shared()
+    static std::vector<uint8_t> encode(std::span<const uint8_t> data, int level);
+
+    // Whether data (or just its first HEADER_SIZE bytes) is encode() output
+    static bool is_compressed(std::span<const uint8_t> data);
+    // Whether data (or just its first HEADER_SIZE bytes) is stored
+    static bool is_stored(std::span<const uint8_t> data);
+
+    // The payload held in chunk data: inflated when compressed, without
+    // its header when stored, else a copy of the data as is. Throws
+    // std::invalid_argument on a corrupt zlib stream or one that inflates
+    // past max_size, which stops a zlib bomb before it exhausts memory.
+    static std::vector<uint8_t> decode(std::span<const uint8_t> data, size_t max_size = MAX_DECODED_SIZE);
+};
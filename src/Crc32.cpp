@@ -0,0 +1,371 @@
+#include "Crc32.hpp"
+#include "Stats.hpp"
+#include <atomic>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define PNGRE_HAVE_CLMUL 1
+#else
+#define PNGRE_HAVE_CLMUL 0
+#endif
+
+namespace {
+
+// t[0] is the classic byte-at-a-time table, t[k][n] is the CRC of byte n
+// followed by k zero bytes, which lets slicing kernels consume k+1 bytes
+// with independent lookups
+struct CrcTables {
+    uint32_t t[16][256];
+
+    CrcTables() {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) {
+                if (c & 1)
+                    c = 0xedb88320L ^ (c >> 1);
+                else
+                    c = c >> 1;
+            }
+            t[0][n] = c;
+        }
+        for (uint32_t n = 0; n < 256; n++) {
+            for (int k = 1; k < 16; k++) {
+                t[k][n] = (t[k - 1][n] >> 8) ^ t[0][t[k - 1][n] & 0xff];
+            }
+        }
+    }
+};
+
+const CrcTables& tables() {
+    static const CrcTables instance;
+    return instance;
+}
+
+inline uint32_t load_le32(const uint8_t* p) {
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+// All kernels below work on the raw (non-inverted) CRC register
+
+uint32_t crc_table(uint32_t c, const uint8_t* data, size_t length) {
+    const auto& t = tables().t;
+    for (size_t i = 0; i < length; i++) {
+        c = t[0][(c ^ data[i]) & 0xff] ^ (c >> 8);
+    }
+    return c;
+}
+
+uint32_t crc_slicing8(uint32_t c, const uint8_t* data, size_t length) {
+    const auto& t = tables().t;
+    while (length >= 8) {
+        uint32_t one = load_le32(data) ^ c;
+        uint32_t two = load_le32(data + 4);
+        c = t[7][one & 0xff] ^ t[6][(one >> 8) & 0xff] ^
+            t[5][(one >> 16) & 0xff] ^ t[4][one >> 24] ^
+            t[3][two & 0xff] ^ t[2][(two >> 8) & 0xff] ^
+            t[1][(two >> 16) & 0xff] ^ t[0][two >> 24];
+        data += 8;
+        length -= 8;
+    }
+    return crc_table(c, data, length);
+}
+
+uint32_t crc_slicing16(uint32_t c, const uint8_t* data, size_t length) {
+    const auto& t = tables().t;
+    while (length >= 16) {
+        uint32_t one = load_le32(data) ^ c;
+        uint32_t two = load_le32(data + 4);
+        uint32_t three = load_le32(data + 8);
+        uint32_t four = load_le32(data + 12);
+        c = t[15][one & 0xff] ^ t[14][(one >> 8) & 0xff] ^
+            t[13][(one >> 16) & 0xff] ^ t[12][one >> 24] ^
+            t[11][two & 0xff] ^ t[10][(two >> 8) & 0xff] ^
+            t[9][(two >> 16) & 0xff] ^ t[8][two >> 24] ^
+            t[7][three & 0xff] ^ t[6][(three >> 8) & 0xff] ^
+            t[5][(three >> 16) & 0xff] ^ t[4][three >> 24] ^
+            t[3][four & 0xff] ^ t[2][(four >> 8) & 0xff] ^
+            t[1][(four >> 16) & 0xff] ^ t[0][four >> 24];
+        data += 16;
+        length -= 16;
+    }
+    return crc_slicing8(c, data, length);
+}
+
+#if PNGRE_HAVE_CLMUL
+// Folds 64 bytes per iteration with PCLMULQDQ, then reduces the 128-bit
+// remainder with a Barrett reduction. Follows Intel's "Fast CRC Computation
+// for Generic Polynomials Using PCLMULQDQ" with the bit-reflected constants
+// for 0xedb88320. Requires length >= 64 and a multiple of 16.
+__attribute__((target("pclmul,sse4.1")))
+uint32_t crc_clmul_blocks(uint32_t c, const uint8_t* data, size_t length) {
+    alignas(16) static const uint64_t k1k2[] = {0x0154442bd4, 0x01c6e41596};
+    alignas(16) static const uint64_t k3k4[] = {0x01751997d0, 0x00ccaa009e};
+    alignas(16) static const uint64_t k5k0[] = {0x0163cd6124, 0x0000000000};
+    alignas(16) static const uint64_t poly[] = {0x01db710641, 0x01f7011641};
+
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x00));
+    x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x10));
+    x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x20));
+    x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x30));
+
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(c)));
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k1k2));
+
+    data += 64;
+    length -= 64;
+
+    // fold four lanes in parallel, 64 bytes at a time
+    while (length >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+        y5 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x00));
+        y6 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x10));
+        y7 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x20));
+        y8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x30));
+
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+        data += 64;
+        length -= 64;
+    }
+
+    // fold the four lanes into one
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k3k4));
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // remaining 16 byte blocks
+    while (length >= 16) {
+        x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+        data += 16;
+        length -= 16;
+    }
+
+    // 128 -> 64 bits
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+
+    x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(k5k0));
+
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction 64 -> 32 bits
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(poly));
+
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+}
+
+uint32_t crc_clmul(uint32_t c, const uint8_t* data, size_t length) {
+    if (length >= 64) {
+        size_t blocks = length & ~size_t(15);
+        c = crc_clmul_blocks(c, data, blocks);
+        data += blocks;
+        length -= blocks;
+    }
+    return crc_slicing16(c, data, length);
+}
+
+bool cpu_has_clmul() {
+    static const bool supported = [] {
+        unsigned int eax, ebx, ecx, edx;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+            return false;
+        }
+        return (ecx & bit_PCLMUL) && (ecx & bit_SSE4_1);
+    }();
+    return supported;
+}
+#else
+bool cpu_has_clmul() {
+    return false;
+}
+#endif
+
+// a * b modulo the CRC polynomial, both reflected
+uint32_t multmodp(uint32_t a, uint32_t b) {
+    uint32_t m = 1u << 31;
+    uint32_t p = 0;
+    while (true) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0) {
+                break;
+            }
+        }
+        m >>= 1;
+        b = b & 1 ? (b >> 1) ^ 0xedb88320 : b >> 1;
+    }
+    return p;
+}
+
+// x^(2^k) modulo the CRC polynomial for k = 0..31
+struct PowerTable {
+    uint32_t x2n[32];
+
+    PowerTable() {
+        uint32_t p = 1u << 30;  // x^1
+        x2n[0] = p;
+        for (int n = 1; n < 32; n++) {
+            x2n[n] = p = multmodp(p, p);
+        }
+    }
+};
+
+// x^(n * 2^k) modulo the CRC polynomial
+uint32_t x2nmodp(uint64_t n, unsigned k) {
+    static const PowerTable powers;
+    uint32_t p = 1u << 31;  // x^0
+    while (n) {
+        if (n & 1) {
+            p = multmodp(powers.x2n[k & 31], p);
+        }
+        n >>= 1;
+        k++;
+    }
+    return p;
+}
+
+using Kernel = uint32_t (*)(uint32_t, const uint8_t*, size_t);
+
+Kernel kernel_for(Crc32Engine engine) {
+    switch (engine) {
+        case Crc32Engine::Table: return crc_table;
+        case Crc32Engine::Slicing8: return crc_slicing8;
+        case Crc32Engine::Slicing16: return crc_slicing16;
+#if PNGRE_HAVE_CLMUL
+        case Crc32Engine::Clmul: if (cpu_has_clmul()) return crc_clmul; break;
+#else
+        case Crc32Engine::Clmul: break;
+#endif
+    }
+    throw std::invalid_argument("CRC-32 engine not supported on this CPU!");
+}
+
+Crc32Engine detect_engine() {
+    return cpu_has_clmul() ? Crc32Engine::Clmul : Crc32Engine::Slicing16;
+}
+
+std::atomic<Crc32Engine>& active_engine() {
+    static std::atomic<Crc32Engine> engine{detect_engine()};
+    return engine;
+}
+
+std::atomic<Kernel>& active_kernel() {
+    static std::atomic<Kernel> kernel{kernel_for(active_engine().load())};
+    return kernel;
+}
+
+} // namespace
+
+uint32_t Crc32::compute(const uint8_t* data, size_t length) {
+    return update(0, data, length);
+}
+
+uint32_t Crc32::update(uint32_t crc, const uint8_t* data, size_t length) {
+    Stats::add(Counter::CrcBytes, length);
+    Kernel kernel = active_kernel().load(std::memory_order_relaxed);
+    return kernel(crc ^ 0xffffffffL, data, length) ^ 0xffffffffL;
+}
+
+// Shifting crc1 past length2 zero bytes is a multiplication by x^(8 * length2)
+uint32_t Crc32::combine(uint32_t crc1, uint32_t crc2, uint64_t length2) {
+    return multmodp(x2nmodp(length2, 3), crc1) ^ crc2;
+}
+
+uint32_t Crc32::update_with(Crc32Engine engine, uint32_t crc, const uint8_t* data, size_t length) {
+    return kernel_for(engine)(crc ^ 0xffffffffL, data, length) ^ 0xffffffffL;
+}
+
+Crc32Engine Crc32::engine() {
+    return active_engine().load();
+}
+
+void Crc32::set_engine(Crc32Engine engine) {
+    Kernel kernel = kernel_for(engine);
+    active_engine().store(engine);
+    active_kernel().store(kernel);
+}
+
+bool Crc32::is_supported(Crc32Engine engine) {
+    return engine != Crc32Engine::Clmul || cpu_has_clmul();
+}
+
+const char* Crc32::engine_name(Crc32Engine engine) {
+    switch (engine) {
+        case Crc32Engine::Table: return "table";
+        case Crc32Engine::Slicing8: return "slicing-by-8";
+        case Crc32Engine::Slicing16: return "slicing-by-16";
+        case Crc32Engine::Clmul: return "pclmulqdq";
+    }
+    return "unknown";
+}
+
+void Crc32Hasher::init() {
+    crc_m = 0;
+    length_m = 0;
+}
+
+Crc32Hasher& Crc32Hasher::update(std::span<const uint8_t> data) {
+    return update(data.data(), data.size());
+}
+
+Crc32Hasher& Crc32Hasher::update(const uint8_t* data, size_t length) {
+    crc_m = Crc32::update(crc_m, data, length);
+    length_m += length;
+    return *this;
+}
+
+Crc32Hasher& Crc32Hasher::combine(const Crc32Hasher& other) {
+    crc_m = Crc32::combine(crc_m, other.crc_m, other.length_m);
+    length_m += other.length_m;
+    return *this;
+}
+
+uint32_t Crc32Hasher::finalize() const {
+    return crc_m;
+}
+
+uint64_t Crc32Hasher::length() const {
+    return length_m;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// CRC-32 kernels. Every engine computes the same PNG/zlib CRC-32
+// (reflected polynomial 0xedb88320), they only differ in speed.
+enum class Crc32Engine {
+    Table,      // one byte per step through a single 256-entry table
+    Slicing8,   // 8 bytes per step through 8 tables
+    Slicing16,  // 16 bytes per step through 16 tables
+    Clmul       // carry-less multiply folding (x86 PCLMULQDQ + SSE4.1)
+};
+
+class Crc32 {
+public:
+    // CRC of a whole buffer
+    static uint32_t compute(const uint8_t* data, size_t length);
+
+    // Continues a CRC returned by compute()/update() over more bytes,
+    // so update(compute(a), b) == compute(a + b)
+    static uint32_t update(uint32_t crc, const uint8_t* data, size_t length);
+
+    // CRC of a + b from crc1 = CRC(a), crc2 = CRC(b) and the length of b,
+    // in O(log length2). Lets independent segments be hashed in parallel.
+    static uint32_t combine(uint32_t crc1, uint32_t crc2, uint64_t length2);
+
+    // Same as update(), but forces a specific engine
+    static uint32_t update_with(Crc32Engine engine, uint32_t crc, const uint8_t* data, size_t length);
+
+    // Engine used by compute()/update(). Picked once at startup from CPUID,
+    // falling back to slicing-by-16 when carry-less multiply is unavailable.
+    static Crc32Engine engine();
+
+    // Overrides the active engine, throws if the CPU does not support it
+    static void set_engine(Crc32Engine engine);
+
+    static bool is_supported(Crc32Engine engine);
+    static const char* engine_name(Crc32Engine engine);
+};
+
+// Incremental CRC-32: init(), update() over any number of pieces, then
+// finalize(). Adjacent pieces can be hashed by separate hashers (on
+// separate threads, say) and joined with combine().
+class Crc32Hasher {
+private:
+    uint32_t crc_m = 0;
+    uint64_t length_m = 0;
+
+public:
+    Crc32Hasher() = default;
+
+    // Forgets everything hashed so far
+    void init();
+    Crc32Hasher& update(std::span<const uint8_t> data);
+    Crc32Hasher& update(const uint8_t* data, size_t length);
+    // Appends other's input after this hasher's, as if it had been fed here
+    Crc32Hasher& combine(const Crc32Hasher& other);
+
+    // CRC of everything hashed so far. Hashing can carry on afterwards.
+    uint32_t finalize() const;
+    // Bytes hashed so far
+    uint64_t length() const;
+};
@@ -0,0 +1,1257 @@
+#include "Deflate.hpp"
+#include "Stats.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <latch>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+
+namespace {
+
+constexpr int MIN_MATCH = 3;
+constexpr int MAX_MATCH = 258;
+constexpr int END_OF_BLOCK = 256;
+constexpr int LITLEN_CODES = 286;
+constexpr int DIST_CODES = 30;
+constexpr int CODELEN_CODES = 19;
+constexpr int MAX_BITS = 15;
+constexpr int MAX_CODELEN_BITS = 7;
+
+// Matches may not reach further back than this, which keeps every position
+// on a hash chain inside the ring of previous positions
+constexpr size_t MAX_DIST = Deflate::WINDOW_SIZE - MAX_MATCH - MIN_MATCH - 1;
+constexpr size_t HASH_BITS = 15;
+constexpr size_t HASH_SIZE = size_t(1) << HASH_BITS;
+constexpr size_t MAX_BLOCK_SYMBOLS = 16 * 1024;
+constexpr size_t MAX_STORED = 65535;
+
+constexpr uint8_t CODELEN_ORDER[CODELEN_CODES] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+// Base value and extra bits of every length (257..285) and distance code
+constexpr uint16_t LENGTH_BASE[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                      35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+constexpr uint8_t LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                      3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr uint16_t DIST_BASE[DIST_CODES] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129,
+                                            193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+                                            4097, 6145, 8193, 12289, 16385, 24577};
+constexpr uint8_t DIST_EXTRA[DIST_CODES] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+                                            6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// Per-level matcher tuning, as in zlib: stop searching once a match is
+// good_length long (searching a quarter as far), skip the lazy search past
+// lazy_length (0 means greedy), accept nice_length outright and follow at
+// most chain_length candidates
+struct LevelConfig {
+    int good_length;
+    int lazy_length;
+    int nice_length;
+    int chain_length;
+};
+
+constexpr LevelConfig LEVELS[10] = {
+    {0, 0, 0, 0},
+    {4, 0, 8, 4},
+    {4, 0, 16, 8},
+    {4, 0, 32, 32},
+    {4, 4, 16, 16},
+    {8, 16, 32, 32},
+    {8, 16, 128, 128},
+    {8, 32, 128, 256},
+    {32, 128, 258, 1024},
+    {32, 258, 258, 4096},
+};
+
+[[noreturn]] void invalid() {
+    throw std::invalid_argument("Invalid compressed data!");
+}
+
+uint32_t reverse_bits(uint32_t code, int length) {
+    uint32_t reversed = 0;
+    for (int i = 0; i < length; i++) {
+        reversed = (reversed << 1) | (code & 1);
+        code >>= 1;
+    }
+    return reversed;
+}
+
+// Static lookups from match length/distance to their codes
+struct SymbolTables {
+    uint8_t length_code[MAX_MATCH + 1];
+    uint8_t dist_code_low[512];
+    uint8_t dist_code_high[256];
+
+    SymbolTables() {
+        for (int code = 0; code < 29; code++) {
+            int count = 1 << LENGTH_EXTRA[code];
+            for (int i = 0; i < count && LENGTH_BASE[code] + i <= MAX_MATCH; i++) {
+                length_code[LENGTH_BASE[code] + i] = uint8_t(code);
+            }
+        }
+        // 258 has a code of its own even though 284 could also express it
+        length_code[MAX_MATCH] = 28;
+        for (int code = 0; code < DIST_CODES; code++) {
+            int count = 1 << DIST_EXTRA[code];
+            for (int i = 0; i < count; i++) {
+                int dist = DIST_BASE[code] + i - 1;
+                if (dist < 512) {
+                    dist_code_low[dist] = uint8_t(code);
+                } else {
+                    dist_code_high[dist >> 7] = uint8_t(code);
+                }
+            }
+        }
+    }
+
+    int dist_code(int dist) const {
+        return dist <= 512 ? dist_code_low[dist - 1] : dist_code_high[(dist - 1) >> 7];
+    }
+};
+
+const SymbolTables& symbols() {
+    static const SymbolTables instance;
+    return instance;
+}
+
+// Code lengths of the fixed Huffman codes of RFC 1951 3.2.6
+struct FixedLengths {
+    uint8_t litlen[288];
+    uint8_t dist[32];
+
+    FixedLengths() {
+        for (int i = 0; i < 288; i++) {
+            litlen[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+        }
+        std::fill(std::begin(dist), std::end(dist), 5);
+    }
+};
+
+const FixedLengths& fixed_lengths() {
+    static const FixedLengths instance;
+    return instance;
+}
+
+// ---------------------------------------------------------------- encoder
+
+class BitWriter {
+private:
+    std::vector<uint8_t>& out_m;
+    uint64_t bits_m = 0;
+    int count_m = 0;
+
+public:
+    explicit BitWriter(std::vector<uint8_t>& out) : out_m(out) {}
+
+    void put(uint32_t value, int length) {
+        bits_m |= uint64_t(value) << count_m;
+        count_m += length;
+        if (count_m >= 32) {
+            for (int i = 0; i < 4; i++) {
+                out_m.push_back(uint8_t(bits_m));
+                bits_m >>= 8;
+            }
+            count_m -= 32;
+        }
+    }
+
+    void align() {
+        while (count_m > 0) {
+            out_m.push_back(uint8_t(bits_m));
+            bits_m >>= 8;
+            count_m -= 8;
+        }
+        bits_m = 0;
+        count_m = 0;
+    }
+
+    void bytes(const uint8_t* data, size_t length) {
+        out_m.insert(out_m.end(), data, data + length);
+    }
+};
+
+// Fills lengths[0..n) with Huffman code lengths of at most limit bits for
+// the given frequencies. Unused symbols get length 0. Frequencies are
+// halved until the tree fits, which costs little for the few codes that hit
+// the limit.
+void build_lengths(const uint32_t* freqs, int n, int limit, uint8_t* lengths) {
+    std::vector<uint32_t> scaled(freqs, freqs + n);
+
+    // at least two codes keep every tree complete, which all inflaters accept
+    int used = 0;
+    for (int i = 0; i < n; i++) {
+        used += scaled[i] != 0;
+    }
+    for (int i = 0; i < n && used < 2; i++) {
+        if (scaled[i] == 0) {
+            scaled[i] = 1;
+            used++;
+        }
+    }
+
+    std::vector<int> parent(2 * n);
+    while (true) {
+        using Node = std::pair<uint64_t, int>;
+        std::priority_queue<Node, std::vector<Node>, std::greater<Node>> heap;
+        for (int i = 0; i < n; i++) {
+            if (scaled[i] != 0) {
+                heap.push({scaled[i], i});
+            }
+        }
+        int next = n;
+        while (heap.size() > 1) {
+            auto [weight_a, a] = heap.top();
+            heap.pop();
+            auto [weight_b, b] = heap.top();
+            heap.pop();
+            parent[a] = next;
+            parent[b] = next;
+            heap.push({weight_a + weight_b, next++});
+        }
+        int root = next - 1;
+
+        // parents are always created after their children, so walk down
+        std::vector<int> depth(next, 0);
+        for (int node = root - 1; node >= 0; node--) {
+            if (node >= n || scaled[node] != 0) {
+                depth[node] = depth[parent[node]] + 1;
+            }
+        }
+
+        int longest = 0;
+        for (int i = 0; i < n; i++) {
+            lengths[i] = scaled[i] != 0 ? uint8_t(depth[i]) : 0;
+            longest = std::max(longest, int(lengths[i]));
+        }
+        if (longest <= limit) {
+            return;
+        }
+        for (int i = 0; i < n; i++) {
+            if (scaled[i] != 0) {
+                scaled[i] = std::max<uint32_t>(1, scaled[i] >> 1);
+            }
+        }
+    }
+}
+
+// Canonical codes for the given lengths, bit-reversed for LSB-first output
+void build_codes(const uint8_t* lengths, int n, uint16_t* codes) {
+    int counts[MAX_BITS + 1] = {};
+    for (int i = 0; i < n; i++) {
+        counts[lengths[i]]++;
+    }
+    counts[0] = 0;
+    int next[MAX_BITS + 2] = {};
+    int code = 0;
+    for (int bits = 1; bits <= MAX_BITS; bits++) {
+        code = (code + counts[bits - 1]) << 1;
+        next[bits] = code;
+    }
+    for (int i = 0; i < n; i++) {
+        if (lengths[i] != 0) {
+            codes[i] = uint16_t(reverse_bits(next[lengths[i]]++, lengths[i]));
+        }
+    }
+}
+
+// A literal (dist == 0) or a match
+struct Symbol {
+    uint16_t litlen;
+    uint16_t dist;
+};
+
+// Run-length encoded code lengths of a dynamic block header
+struct CodeLengthRun {
+    uint8_t symbol;
+    uint8_t extra;
+};
+
+std::vector<CodeLengthRun> encode_code_lengths(const uint8_t* lengths, int n) {
+    std::vector<CodeLengthRun> runs;
+    int i = 0;
+    while (i < n) {
+        uint8_t length = lengths[i];
+        int run = 1;
+        while (i + run < n && lengths[i + run] == length) {
+            run++;
+        }
+        i += run;
+        if (length == 0) {
+            while (run >= 11) {
+                int take = std::min(run, 138);
+                runs.push_back({18, uint8_t(take - 11)});
+                run -= take;
+            }
+            if (run >= 3) {
+                runs.push_back({17, uint8_t(run - 3)});
+                run = 0;
+            }
+        } else {
+            runs.push_back({length, 0});
+            run--;
+            while (run >= 3) {
+                int take = std::min(run, 6);
+                runs.push_back({16, uint8_t(take - 3)});
+                run -= take;
+            }
+        }
+        while (run-- > 0) {
+            runs.push_back({length, 0});
+        }
+    }
+    return runs;
+}
+
+int code_length_extra_bits(uint8_t symbol) {
+    return symbol == 16 ? 2 : symbol == 17 ? 3 : symbol == 18 ? 7 : 0;
+}
+
+class BlockWriter {
+private:
+    BitWriter& bits_m;
+    const SymbolTables& tables_m = symbols();
+
+    void write_symbols(const std::vector<Symbol>& block, const uint8_t* litlen_lengths, const uint16_t* litlen_codes,
+                       const uint8_t* dist_lengths, const uint16_t* dist_codes) {
+        for (const Symbol& symbol : block) {
+            if (symbol.dist == 0) {
+                bits_m.put(litlen_codes[symbol.litlen], litlen_lengths[symbol.litlen]);
+                continue;
+            }
+            int length_code = tables_m.length_code[symbol.litlen];
+            bits_m.put(litlen_codes[257 + length_code], litlen_lengths[257 + length_code]);
+            bits_m.put(symbol.litlen - LENGTH_BASE[length_code], LENGTH_EXTRA[length_code]);
+            int dist_code = tables_m.dist_code(symbol.dist);
+            bits_m.put(dist_codes[dist_code], dist_lengths[dist_code]);
+            bits_m.put(symbol.dist - DIST_BASE[dist_code], DIST_EXTRA[dist_code]);
+        }
+        bits_m.put(litlen_codes[END_OF_BLOCK], litlen_lengths[END_OF_BLOCK]);
+    }
+
+public:
+    explicit BlockWriter(BitWriter& bits) : bits_m(bits) {}
+
+    void write_stored(std::span<const uint8_t> raw, bool final) {
+        do {
+            size_t take = std::min(raw.size(), MAX_STORED);
+            bool last_piece = take == raw.size();
+            bits_m.put(final && last_piece ? 1 : 0, 1);
+            bits_m.put(0, 2);
+            bits_m.align();
+            uint8_t header[4] = {uint8_t(take), uint8_t(take >> 8), uint8_t(~take), uint8_t(~take >> 8)};
+            bits_m.bytes(header, 4);
+            bits_m.bytes(raw.data(), take);
+            raw = raw.subspan(take);
+        } while (!raw.empty());
+    }
+
+    // Writes block as whichever of a dynamic, fixed or stored block is
+    // smallest. raw is the input the symbols stand for.
+    void write(const std::vector<Symbol>& block, std::span<const uint8_t> raw, bool final) {
+        uint32_t litlen_freqs[LITLEN_CODES] = {};
+        uint32_t dist_freqs[DIST_CODES] = {};
+        for (const Symbol& symbol : block) {
+            if (symbol.dist == 0) {
+                litlen_freqs[symbol.litlen]++;
+            } else {
+                litlen_freqs[257 + tables_m.length_code[symbol.litlen]]++;
+                dist_freqs[tables_m.dist_code(symbol.dist)]++;
+            }
+        }
+        litlen_freqs[END_OF_BLOCK] = 1;
+
+        // bits every symbol spends on extra bits, whatever the code
+        uint64_t extra_bits = 0;
+        for (int code = 0; code < 29; code++) {
+            extra_bits += uint64_t(litlen_freqs[257 + code]) * LENGTH_EXTRA[code];
+        }
+        for (int code = 0; code < DIST_CODES; code++) {
+            extra_bits += uint64_t(dist_freqs[code]) * DIST_EXTRA[code];
+        }
+
+        uint8_t litlen_lengths[LITLEN_CODES];
+        uint8_t dist_lengths[DIST_CODES];
+        build_lengths(litlen_freqs, LITLEN_CODES, MAX_BITS, litlen_lengths);
+        build_lengths(dist_freqs, DIST_CODES, MAX_BITS, dist_lengths);
+
+        int hlit = LITLEN_CODES;
+        while (hlit > 257 && litlen_lengths[hlit - 1] == 0) {
+            hlit--;
+        }
+        int hdist = DIST_CODES;
+        while (hdist > 1 && dist_lengths[hdist - 1] == 0) {
+            hdist--;
+        }
+
+        // litlen and distance lengths are run-length encoded as one sequence
+        uint8_t all_lengths[LITLEN_CODES + DIST_CODES];
+        std::copy(litlen_lengths, litlen_lengths + hlit, all_lengths);
+        std::copy(dist_lengths, dist_lengths + hdist, all_lengths + hlit);
+        auto runs = encode_code_lengths(all_lengths, hlit + hdist);
+
+        uint32_t codelen_freqs[CODELEN_CODES] = {};
+        for (const auto& run : runs) {
+            codelen_freqs[run.symbol]++;
+        }
+        uint8_t codelen_lengths[CODELEN_CODES];
+        build_lengths(codelen_freqs, CODELEN_CODES, MAX_CODELEN_BITS, codelen_lengths);
+        int hclen = CODELEN_CODES;
+        while (hclen > 4 && codelen_lengths[CODELEN_ORDER[hclen - 1]] == 0) {
+            hclen--;
+        }
+
+        uint64_t dynamic_bits = 3 + 5 + 5 + 4 + 3 * uint64_t(hclen) + extra_bits;
+        for (const auto& run : runs) {
+            dynamic_bits += codelen_lengths[run.symbol] + code_length_extra_bits(run.symbol);
+        }
+        uint64_t fixed_bits = 3 + extra_bits;
+        const auto& fixed = fixed_lengths();
+        for (int i = 0; i < LITLEN_CODES; i++) {
+            dynamic_bits += uint64_t(litlen_freqs[i]) * litlen_lengths[i];
+            fixed_bits += uint64_t(litlen_freqs[i]) * fixed.litlen[i];
+        }
+        for (int i = 0; i < DIST_CODES; i++) {
+            dynamic_bits += uint64_t(dist_freqs[i]) * dist_lengths[i];
+            fixed_bits += uint64_t(dist_freqs[i]) * fixed.dist[i];
+        }
+        // header, alignment and LEN/NLEN per stored block
+        uint64_t stored_bits = (raw.size() / MAX_STORED + 1) * (3 + 7 + 32) + 8 * uint64_t(raw.size());
+
+        if (stored_bits <= std::min(dynamic_bits, fixed_bits)) {
+            write_stored(raw, final);
+            return;
+        }
+
+        bits_m.put(final ? 1 : 0, 1);
+        if (fixed_bits <= dynamic_bits) {
+            static const auto fixed_codes = [] {
+                std::pair<std::array<uint16_t, 288>, std::array<uint16_t, 32>> codes{};
+                build_codes(fixed_lengths().litlen, 288, codes.first.data());
+                build_codes(fixed_lengths().dist, 32, codes.second.data());
+                return codes;
+            }();
+            bits_m.put(1, 2);
+            write_symbols(block, fixed.litlen, fixed_codes.first.data(), fixed.dist, fixed_codes.second.data());
+            return;
+        }
+
+        uint16_t litlen_codes[LITLEN_CODES] = {};
+        uint16_t dist_codes[DIST_CODES] = {};
+        uint16_t codelen_codes[CODELEN_CODES] = {};
+        build_codes(litlen_lengths, LITLEN_CODES, litlen_codes);
+        build_codes(dist_lengths, DIST_CODES, dist_codes);
+        build_codes(codelen_lengths, CODELEN_CODES, codelen_codes);
+
+        bits_m.put(2, 2);
+        bits_m.put(hlit - 257, 5);
+        bits_m.put(hdist - 1, 5);
+        bits_m.put(hclen - 4, 4);
+        for (int i = 0; i < hclen; i++) {
+            bits_m.put(codelen_lengths[CODELEN_ORDER[i]], 3);
+        }
+        for (const auto& run : runs) {
+            bits_m.put(codelen_codes[run.symbol], codelen_lengths[run.symbol]);
+            bits_m.put(run.extra, code_length_extra_bits(run.symbol));
+        }
+        write_symbols(block, litlen_lengths, litlen_codes, dist_lengths, dist_codes);
+    }
+};
+
+// LZ77 over buffer, emitting symbols for buffer[start..) only. Everything
+// before start is dictionary.
+class Matcher {
+private:
+    const uint8_t* buffer_m;
+    size_t end_m;
+    LevelConfig config_m;
+    std::vector<int32_t> head_m;
+    std::vector<int32_t> prev_m;
+
+    static uint32_t hash(const uint8_t* p) {
+        uint32_t v = uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16);
+        return (v * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    static size_t common_length(const uint8_t* a, const uint8_t* b, size_t limit) {
+        size_t n = 0;
+        while (n + 8 <= limit) {
+            uint64_t x;
+            uint64_t y;
+            std::memcpy(&x, a + n, 8);
+            std::memcpy(&y, b + n, 8);
+            if (x != y) {
+                return n + (__builtin_ctzll(x ^ y) >> 3);
+            }
+            n += 8;
+        }
+        while (n < limit && a[n] == b[n]) {
+            n++;
+        }
+        return n;
+    }
+
+public:
+    Matcher(const uint8_t* buffer, size_t end, int level)
+        : buffer_m(buffer), end_m(end), config_m(LEVELS[level]), head_m(HASH_SIZE, -1), prev_m(Deflate::WINDOW_SIZE, -1) {}
+
+    // Adds pos to its hash chain and returns the previous chain head
+    int32_t insert(size_t pos) {
+        if (pos + MIN_MATCH > end_m) {
+            return -1;
+        }
+        uint32_t h = hash(buffer_m + pos);
+        int32_t candidate = head_m[h];
+        prev_m[pos & (Deflate::WINDOW_SIZE - 1)] = candidate;
+        head_m[h] = int32_t(pos);
+        return candidate;
+    }
+
+    // Longest match for pos starting from chain head candidate that beats
+    // best. Returns its length, or 0, with the distance in dist.
+    int longest_match(size_t pos, int32_t candidate, int best, int& dist) const {
+        size_t limit = std::min<size_t>(MAX_MATCH, end_m - pos);
+        if (limit < size_t(MIN_MATCH)) {
+            return 0;
+        }
+        int chain = config_m.chain_length;
+        if (best >= config_m.good_length) {
+            chain >>= 2;
+        }
+        size_t lowest = pos > MAX_DIST ? pos - MAX_DIST : 0;
+        int found = 0;
+        const uint8_t* here = buffer_m + pos;
+        while (candidate >= 0 && size_t(candidate) >= lowest && chain-- > 0) {
+            const uint8_t* there = buffer_m + candidate;
+            if (size_t(best) < limit && there[best] == here[best] && there[0] == here[0]) {
+                int length = int(common_length(here, there, limit));
+                if (length > best) {
+                    best = length;
+                    found = length;
+                    dist = int(pos - candidate);
+                    if (length >= config_m.nice_length || size_t(length) == limit) {
+                        break;
+                    }
+                }
+            }
+            int32_t next = prev_m[candidate & (Deflate::WINDOW_SIZE - 1)];
+            if (next >= candidate) {
+                break;
+            }
+            candidate = next;
+        }
+        // a three byte match far away costs more than three literals
+        if (found == MIN_MATCH && dist > 4096) {
+            return 0;
+        }
+        return found;
+    }
+
+    const LevelConfig& config() const {
+        return config_m;
+    }
+};
+
+void deflate_blocks(const uint8_t* buffer, size_t start, size_t end, int level, bool last, BitWriter& bits) {
+    BlockWriter writer(bits);
+    Matcher matcher(buffer, end, level);
+    const LevelConfig& config = matcher.config();
+
+    for (size_t pos = start > Deflate::WINDOW_SIZE ? start - Deflate::WINDOW_SIZE : 0; pos < start; pos++) {
+        matcher.insert(pos);
+    }
+
+    std::vector<Symbol> block;
+    block.reserve(MAX_BLOCK_SYMBOLS);
+    size_t block_start = start;
+    auto flush = [&](size_t block_end, bool final) {
+        writer.write(block, std::span<const uint8_t>(buffer + block_start, block_end - block_start), final);
+        block.clear();
+        block_start = block_end;
+    };
+    auto literal = [&](size_t pos) {
+        block.push_back({buffer[pos], 0});
+    };
+    auto match = [&](int length, int dist) {
+        block.push_back({uint16_t(length), uint16_t(dist)});
+    };
+
+    size_t pos = start;
+    if (config.lazy_length == 0) {
+        while (pos < end) {
+            int32_t candidate = matcher.insert(pos);
+            int dist = 0;
+            int length = candidate >= 0 ? matcher.longest_match(pos, candidate, MIN_MATCH - 1, dist) : 0;
+            if (length >= MIN_MATCH) {
+                match(length, dist);
+                for (size_t p = pos + 1; p < pos + length; p++) {
+                    matcher.insert(p);
+                }
+                pos += length;
+            } else {
+                literal(pos++);
+            }
+            if (block.size() >= MAX_BLOCK_SYMBOLS && pos < end) {
+                flush(pos, false);
+            }
+        }
+    } else {
+        // a match found at pos - 1 is only taken if pos has no longer one
+        int prev_length = 0;
+        int prev_dist = 0;
+        bool pending = false;
+        while (pos < end) {
+            int32_t candidate = matcher.insert(pos);
+            int dist = 0;
+            int length = 0;
+            if (candidate >= 0 && prev_length < config.lazy_length) {
+                length = matcher.longest_match(pos, candidate, std::max(prev_length, MIN_MATCH - 1), dist);
+            }
+            if (prev_length >= MIN_MATCH && length <= prev_length) {
+                match(prev_length, prev_dist);
+                size_t match_end = pos - 1 + prev_length;
+                for (size_t p = pos + 1; p < match_end; p++) {
+                    matcher.insert(p);
+                }
+                pos = match_end;
+                prev_length = 0;
+                pending = false;
+            } else {
+                if (pending) {
+                    literal(pos - 1);
+                }
+                pending = true;
+                prev_length = length;
+                prev_dist = dist;
+                pos++;
+            }
+            // a pending literal belongs to the next block
+            if (block.size() >= MAX_BLOCK_SYMBOLS && pos < end) {
+                flush(pending ? pos - 1 : pos, false);
+            }
+        }
+        if (pending) {
+            literal(pos - 1);
+        }
+    }
+
+    flush(end, last);
+}
+
+void append_zlib_header(std::vector<uint8_t>& out, int level) {
+    uint8_t cmf = 0x78;
+    uint8_t flevel = level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+    uint8_t flg = uint8_t(flevel << 6);
+    flg = uint8_t(flg + 31 - (cmf * 256 + flg) % 31);
+    out.push_back(cmf);
+    out.push_back(flg);
+}
+
+void append_be32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back(uint8_t(value >> shift));
+    }
+}
+
+// ---------------------------------------------------------------- decoder
+
+// LSB-first bit reader over input split into any number of segments, such
+// as the data of consecutive IDAT chunks, read in place
+class BitReader {
+private:
+    std::span<const std::span<const uint8_t>> segments_m;
+    size_t segment_m = 0;
+    const uint8_t* start_m = nullptr;
+    const uint8_t* next_m = nullptr;
+    const uint8_t* end_m = nullptr;
+    // bytes of the segments before the current one
+    size_t passed_m = 0;
+    uint64_t bits_m = 0;
+    int count_m = 0;
+    // zero bytes shifted in past the end, which must never be consumed
+    size_t overrun_m = 0;
+
+    // Moves to the next non-empty segment, false at the end of the input
+    bool advance() {
+        while (next_m == end_m) {
+            if (segment_m >= segments_m.size()) {
+                return false;
+            }
+            passed_m += end_m - start_m;
+            start_m = next_m = segments_m[segment_m].data();
+            end_m = start_m + segments_m[segment_m].size();
+            segment_m++;
+        }
+        return true;
+    }
+
+public:
+    explicit BitReader(std::span<const std::span<const uint8_t>> segments) : segments_m(segments) {}
+
+    // Makes sure at least 32 bits are buffered
+    void refill() {
+        if (count_m >= 32) {
+            return;
+        }
+        if (end_m - next_m >= 8) {
+            uint64_t word;
+            std::memcpy(&word, next_m, 8);
+            bits_m |= word << count_m;
+            int taken = (63 - count_m) >> 3;
+            next_m += taken;
+            count_m += taken * 8;
+            return;
+        }
+        while (count_m <= 56) {
+            if (advance()) {
+                bits_m |= uint64_t(*next_m++) << count_m;
+            } else {
+                overrun_m++;
+            }
+            count_m += 8;
+        }
+    }
+
+    uint32_t peek(int length) const {
+        return uint32_t(bits_m & ((uint64_t(1) << length) - 1));
+    }
+
+    void consume(int length) {
+        bits_m >>= length;
+        count_m -= length;
+        if (overrun_m > 0 && size_t(count_m) < overrun_m * 8) {
+            invalid();
+        }
+    }
+
+    uint32_t get(int length) {
+        refill();
+        uint32_t value = peek(length);
+        consume(length);
+        return value;
+    }
+
+    void align() {
+        consume(count_m & 7);
+    }
+
+    // Input bytes consumed so far, once aligned
+    size_t position() const {
+        return passed_m + (next_m - start_m) + overrun_m - size_t(count_m) / 8;
+    }
+
+    // Copies the next length whole bytes, which must be aligned
+    void copy_bytes(uint8_t* out, size_t length) {
+        while (length > 0 && count_m > 0) {
+            *out++ = uint8_t(peek(8));
+            consume(8);
+            length--;
+        }
+        // the buffer may hold bits read ahead of next_m, which are now stale
+        if (count_m == 0) {
+            bits_m = 0;
+        }
+        while (length > 0) {
+            if (!advance()) {
+                invalid();
+            }
+            size_t take = std::min<size_t>(length, end_m - next_m);
+            std::memcpy(out, next_m, take);
+            next_m += take;
+            out += take;
+            length -= take;
+        }
+    }
+};
+
+// Table-driven Huffman decoder: codes up to FAST_BITS long resolve with one
+// lookup, longer ones fall back to walking the canonical code
+class HuffmanDecoder {
+private:
+    static constexpr int FAST_BITS = 10;
+    // symbol in the low 9 bits, code length above, 0 for no code
+    uint16_t fast_m[1 << FAST_BITS];
+    uint16_t counts_m[MAX_BITS + 1];
+    uint16_t symbols_m[288];
+
+public:
+    void build(const uint8_t* lengths, int n) {
+        std::fill(std::begin(fast_m), std::end(fast_m), 0);
+        std::fill(std::begin(counts_m), std::end(counts_m), 0);
+        for (int i = 0; i < n; i++) {
+            counts_m[lengths[i]]++;
+        }
+        counts_m[0] = 0;
+
+        int left = 1;
+        for (int bits = 1; bits <= MAX_BITS; bits++) {
+            left = (left << 1) - counts_m[bits];
+            if (left < 0) {
+                invalid();
+            }
+        }
+
+        uint16_t offsets[MAX_BITS + 2] = {};
+        for (int bits = 1; bits <= MAX_BITS; bits++) {
+            offsets[bits + 1] = offsets[bits] + counts_m[bits];
+        }
+        for (int i = 0; i < n; i++) {
+            if (lengths[i] != 0) {
+                symbols_m[offsets[lengths[i]]++] = uint16_t(i);
+            }
+        }
+
+        int code = 0;
+        int index = 0;
+        for (int bits = 1; bits <= FAST_BITS; bits++) {
+            for (int k = 0; k < counts_m[bits]; k++, code++, index++) {
+                uint32_t reversed = reverse_bits(code, bits);
+                uint16_t entry = uint16_t(symbols_m[index] | (bits << 9));
+                for (uint32_t fill = reversed; fill < (1u << FAST_BITS); fill += 1u << bits) {
+                    fast_m[fill] = entry;
+                }
+            }
+            code <<= 1;
+        }
+    }
+
+    int decode(BitReader& bits) const {
+        bits.refill();
+        uint16_t entry = fast_m[bits.peek(FAST_BITS)];
+        if (entry != 0) {
+            bits.consume(entry >> 9);
+            return entry & 0x1ff;
+        }
+        uint32_t window = bits.peek(MAX_BITS);
+        int code = 0;
+        int first = 0;
+        int index = 0;
+        for (int length = 1; length <= MAX_BITS; length++) {
+            code |= (window >> (length - 1)) & 1;
+            int count = counts_m[length];
+            if (code - count < first) {
+                bits.consume(length);
+                return symbols_m[index + (code - first)];
+            }
+            index += count;
+            first += count;
+            first <<= 1;
+            code <<= 1;
+        }
+        invalid();
+    }
+};
+
+void read_dynamic_tables(BitReader& bits, HuffmanDecoder& litlen, HuffmanDecoder& dist) {
+    int hlit = int(bits.get(5)) + 257;
+    int hdist = int(bits.get(5)) + 1;
+    int hclen = int(bits.get(4)) + 4;
+    if (hlit > LITLEN_CODES || hdist > DIST_CODES) {
+        invalid();
+    }
+
+    uint8_t codelen_lengths[CODELEN_CODES] = {};
+    for (int i = 0; i < hclen; i++) {
+        codelen_lengths[CODELEN_ORDER[i]] = uint8_t(bits.get(3));
+    }
+    HuffmanDecoder codelen;
+    codelen.build(codelen_lengths, CODELEN_CODES);
+
+    uint8_t lengths[LITLEN_CODES + DIST_CODES] = {};
+    int i = 0;
+    while (i < hlit + hdist) {
+        int symbol = codelen.decode(bits);
+        if (symbol < 16) {
+            lengths[i++] = uint8_t(symbol);
+            continue;
+        }
+        int repeat;
+        uint8_t value = 0;
+        if (symbol == 16) {
+            if (i == 0) {
+                invalid();
+            }
+            value = lengths[i - 1];
+            repeat = 3 + int(bits.get(2));
+        } else if (symbol == 17) {
+            repeat = 3 + int(bits.get(3));
+        } else {
+            repeat = 11 + int(bits.get(7));
+        }
+        if (i + repeat > hlit + hdist) {
+            invalid();
+        }
+        std::fill(lengths + i, lengths + i + repeat, value);
+        i += repeat;
+    }
+    if (lengths[END_OF_BLOCK] == 0) {
+        invalid();
+    }
+    litlen.build(lengths, hlit);
+    dist.build(lengths + hlit, hdist);
+}
+
+// Inflated output. Without a sink it all accumulates in buffer. With one,
+// buffer is a fixed-size window: whenever it fills up, the bytes not yet
+// delivered go to the sink and only the last WINDOW_SIZE bytes are kept
+// for matches to refer back to. Either way the Adler-32 of the output is
+// kept up to date as bytes are delivered.
+class OutputWindow {
+private:
+    static constexpr size_t FLUSH_SIZE = 256 * 1024;
+
+    std::vector<uint8_t>& buffer_m;
+    const Deflate::Sink* sink_m;
+    // bytes already in buffer on entry are dictionary, not output
+    size_t delivered_m;
+    uint32_t adler_m = 1;
+
+    void deliver() {
+        std::span<const uint8_t> fresh(buffer_m.data() + delivered_m, size - delivered_m);
+        adler_m = Deflate::adler32(adler_m, fresh.data(), fresh.size());
+        if (sink_m != nullptr && !fresh.empty()) {
+            (*sink_m)(fresh);
+        }
+        delivered_m = size;
+    }
+
+public:
+    // Bytes in buffer, buffer itself may be larger
+    size_t size;
+
+    OutputWindow(std::vector<uint8_t>& buffer, const Deflate::Sink* sink)
+        : buffer_m(buffer), sink_m(sink), delivered_m(buffer.size()), size(buffer.size()) {
+        if (sink_m != nullptr) {
+            buffer_m.resize(Deflate::WINDOW_SIZE + FLUSH_SIZE);
+        }
+    }
+
+    // Makes room for more bytes at data() + size
+    void reserve(size_t more) {
+        if (size + more <= buffer_m.size()) {
+            return;
+        }
+        if (sink_m != nullptr && size > Deflate::WINDOW_SIZE) {
+            deliver();
+            std::memmove(buffer_m.data(), buffer_m.data() + size - Deflate::WINDOW_SIZE, Deflate::WINDOW_SIZE);
+            size = Deflate::WINDOW_SIZE;
+            delivered_m = size;
+            if (size + more <= buffer_m.size()) {
+                return;
+            }
+        }
+        buffer_m.resize(std::max(size + more, buffer_m.size() * 2 + 1024));
+    }
+
+    uint8_t* data() {
+        return buffer_m.data();
+    }
+
+    // Delivers what is left, or trims buffer to size without a sink
+    void finish() {
+        deliver();
+        if (sink_m == nullptr) {
+            buffer_m.resize(size);
+        }
+    }
+
+    // Leaves buffer holding what was inflated before an error, if unsinked
+    void discard() {
+        if (sink_m == nullptr) {
+            buffer_m.resize(size);
+        }
+    }
+
+    // Adler-32 of everything delivered so far
+    uint32_t adler() const {
+        return adler_m;
+    }
+};
+
+void inflate_blocks(BitReader& bits, OutputWindow& out) {
+    static const auto fixed_decoders = [] {
+        auto decoders = std::make_unique<std::pair<HuffmanDecoder, HuffmanDecoder>>();
+        decoders->first.build(fixed_lengths().litlen, 288);
+        decoders->second.build(fixed_lengths().dist, 32);
+        return decoders;
+    }();
+    HuffmanDecoder litlen;
+    HuffmanDecoder dist;
+
+    bool final = false;
+    try {
+        do {
+            final = bits.get(1) != 0;
+            uint32_t type = bits.get(2);
+
+            if (type == 0) {
+                bits.align();
+                uint8_t header[4];
+                bits.copy_bytes(header, 4);
+                size_t length = header[0] | (header[1] << 8);
+                size_t check = header[2] | (header[3] << 8);
+                if ((length ^ 0xffff) != check) {
+                    invalid();
+                }
+                out.reserve(length);
+                bits.copy_bytes(out.data() + out.size, length);
+                out.size += length;
+                continue;
+            }
+
+            const HuffmanDecoder* litlen_decoder = &fixed_decoders->first;
+            const HuffmanDecoder* dist_decoder = &fixed_decoders->second;
+            if (type == 2) {
+                read_dynamic_tables(bits, litlen, dist);
+                litlen_decoder = &litlen;
+                dist_decoder = &dist;
+            } else if (type != 1) {
+                invalid();
+            }
+
+            while (true) {
+                int symbol = litlen_decoder->decode(bits);
+                if (symbol < 256) {
+                    out.reserve(1);
+                    out.data()[out.size++] = uint8_t(symbol);
+                    continue;
+                }
+                if (symbol == END_OF_BLOCK) {
+                    break;
+                }
+                symbol -= 257;
+                if (symbol >= 29) {
+                    invalid();
+                }
+                size_t length = LENGTH_BASE[symbol] + bits.get(LENGTH_EXTRA[symbol]);
+                int dist_symbol = dist_decoder->decode(bits);
+                if (dist_symbol >= DIST_CODES) {
+                    invalid();
+                }
+                size_t distance = DIST_BASE[dist_symbol] + bits.get(DIST_EXTRA[dist_symbol]);
+                if (distance > out.size) {
+                    invalid();
+                }
+
+                out.reserve(length);
+                uint8_t* to = out.data() + out.size;
+                const uint8_t* from = to - distance;
+                if (distance >= length) {
+                    std::memcpy(to, from, length);
+                } else {
+                    for (size_t k = 0; k < length; k++) {
+                        to[k] = from[k];
+                    }
+                }
+                out.size += length;
+            }
+        } while (!final);
+    } catch (...) {
+        out.discard();
+        throw;
+    }
+}
+
+// Header, raw deflate stream and Adler-32 trailer
+void inflate_zlib(BitReader& bits, OutputWindow& out) {
+    uint8_t header[2];
+    bits.refill();
+    header[0] = uint8_t(bits.get(8));
+    header[1] = uint8_t(bits.get(8));
+    uint8_t cmf = header[0];
+    uint8_t flg = header[1];
+    if ((cmf & 0x0f) != 8 || (cmf >> 4) > 7 || (cmf * 256 + flg) % 31 != 0) {
+        invalid();
+    }
+    if (flg & 0x20) {
+        throw std::invalid_argument("Preset dictionaries are not supported!");
+    }
+
+    inflate_blocks(bits, out);
+    out.finish();
+
+    bits.align();
+    uint8_t trailer[4];
+    bits.copy_bytes(trailer, 4);
+    uint32_t expected = (uint32_t(trailer[0]) << 24) | (uint32_t(trailer[1]) << 16) |
+                        (uint32_t(trailer[2]) << 8) | uint32_t(trailer[3]);
+    if (out.adler() != expected) {
+        throw std::invalid_argument("Adler-32 mismatch in compressed data!");
+    }
+}
+
+} // namespace
+
+std::vector<uint8_t> Deflate::compress(std::span<const uint8_t> data, int level)
+{
+    ScopedTimer timer(Phase::Deflate);
+    if (level < 0 || level > 9) {
+        throw std::invalid_argument("Compression level must be between 0 and 9!");
+    }
+    std::vector<uint8_t> out;
+    out.reserve(data.size() / 2 + 64);
+
+    append_zlib_header(out, level);
+    deflate_raw({}, data, level, true, out);
+    append_be32(out, adler32(1, data.data(), data.size()));
+    return out;
+}
+
+std::vector<uint8_t> Deflate::compress_parallel(std::span<const uint8_t> data, int level, ThreadPool& pool)
+{
+    ScopedTimer timer(Phase::Deflate);
+    if (level < 1 || data.size() <= PARALLEL_BLOCK_SIZE || pool.size() < 2) {
+        return compress(data, level);
+    }
+
+    size_t count = (data.size() + PARALLEL_BLOCK_SIZE - 1) / PARALLEL_BLOCK_SIZE;
+    std::vector<Piece> pieces(count);
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    std::latch done(count);
+    for (size_t i = 0; i < count; i++) {
+        pool.submit([&, i] {
+            try {
+                size_t begin = i * PARALLEL_BLOCK_SIZE;
+                size_t length = std::min(PARALLEL_BLOCK_SIZE, data.size() - begin);
+                size_t dictionary = std::min(begin, WINDOW_SIZE);
+                deflate_raw(data.subspan(begin - dictionary, dictionary), data.subspan(begin, length), level,
+                            i + 1 == count, pieces[i].deflated);
+                pieces[i].adler = adler32(1, data.data() + begin, length);
+                pieces[i].length = length;
+            } catch (...) {
+                std::lock_guard lock(error_mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+            done.count_down();
+        });
+    }
+    done.wait();
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    std::vector<uint8_t> out;
+    assemble(level, pieces, [&](std::span<const uint8_t> bytes) {
+        out.insert(out.end(), bytes.begin(), bytes.end());
+    });
+    return out;
+}
+
+void Deflate::assemble(int level, std::span<const Piece> pieces, const Sink& sink)
+{
+    std::vector<uint8_t> header;
+    append_zlib_header(header, level);
+    sink(header);
+    uint32_t adler = 1;
+    for (const Piece& piece : pieces) {
+        sink(piece.deflated);
+        adler = adler32_combine(adler, piece.adler, piece.length);
+    }
+    std::vector<uint8_t> trailer;
+    append_be32(trailer, adler);
+    sink(trailer);
+}
+
+std::vector<uint8_t> Deflate::decompress(std::span<const uint8_t> data)
+{
+    ScopedTimer timer(Phase::Deflate);
+    std::vector<uint8_t> out;
+    std::span<const uint8_t> segments[] = {data};
+    BitReader bits(segments);
+    OutputWindow window(out, nullptr);
+    inflate_zlib(bits, window);
+    return out;
+}
+
+void Deflate::decompress_to(std::span<const std::span<const uint8_t>> segments, const Sink& sink)
+{
+    ScopedTimer timer(Phase::Deflate);
+    std::vector<uint8_t> buffer;
+    BitReader bits(segments);
+    OutputWindow window(buffer, &sink);
+    inflate_zlib(bits, window);
+}
+
+void Deflate::deflate_raw(std::span<const uint8_t> dictionary, std::span<const uint8_t> data, int level, bool last, std::vector<uint8_t>& out)
+{
+    if (level < 0 || level > 9) {
+        throw std::invalid_argument("Compression level must be between 0 and 9!");
+    }
+    BitWriter bits(out);
+
+    if (level == 0) {
+        BlockWriter(bits).write_stored(data, last);
+    } else if (dictionary.empty()) {
+        deflate_blocks(data.data(), 0, data.size(), level, last, bits);
+    } else {
+        // matches may run from the dictionary into the data, so both have
+        // to sit in one buffer
+        dictionary = dictionary.last(std::min(dictionary.size(), WINDOW_SIZE));
+        std::vector<uint8_t> buffer(dictionary.begin(), dictionary.end());
+        buffer.insert(buffer.end(), data.begin(), data.end());
+        deflate_blocks(buffer.data(), dictionary.size(), buffer.size(), level, last, bits);
+    }
+
+    if (!last) {
+        // sync flush: an empty stored block leaves the stream byte aligned
+        BlockWriter(bits).write_stored({}, false);
+    }
+    bits.align();
+}
+
+size_t Deflate::inflate_raw(std::span<const uint8_t> data, std::vector<uint8_t>& out)
+{
+    std::span<const uint8_t> segments[] = {data};
+    BitReader bits(segments);
+    OutputWindow window(out, nullptr);
+    inflate_blocks(bits, window);
+    window.finish();
+    bits.align();
+    return bits.position();
+}
+
+uint32_t Deflate::adler32(uint32_t adler, const uint8_t* data, size_t length)
+{
+    constexpr uint32_t BASE = 65521;
+    // largest n such that 255n(n+1)/2 + (n+1)(BASE-1) fits in 32 bits
+    constexpr size_t NMAX = 5552;
+
+    uint32_t a = adler & 0xffff;
+    uint32_t b = adler >> 16;
+    while (length > 0) {
+        size_t n = std::min(length, NMAX);
+        length -= n;
+        for (size_t i = 0; i < n; i++) {
+            a += data[i];
+            b += a;
+        }
+        data += n;
+        a %= BASE;
+        b %= BASE;
+    }
+    return (b << 16) | a;
+}
+
+uint32_t Deflate::adler32_combine(uint32_t adler1, uint32_t adler2, uint64_t length2)
+{
+    constexpr uint32_t BASE = 65521;
+
+    uint32_t remainder = uint32_t(length2 % BASE);
+    uint32_t a = adler1 & 0xffff;
+    uint32_t b = uint32_t((uint64_t(remainder) * a) % BASE);
+    a += (adler2 & 0xffff) + BASE - 1;
+    b += (adler1 >> 16) + (adler2 >> 16) + BASE - remainder;
+    if (a >= BASE) a -= BASE;
+    if (a >= BASE) a -= BASE;
+    if (b >= 2 * BASE) b -= 2 * BASE;
+    if (b >= BASE) b -= BASE;
+    return (b << 16) | a;
+}
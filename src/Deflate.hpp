@@ -0,0 +1,74 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <vector>
+
+class ThreadPool;
+
+// Self-contained zlib (RFC 1950) / deflate (RFC 1951) codec. Streams it
+// writes can be read by any zlib, and it reads any zlib stream without a
+// preset dictionary.
+class Deflate {
+public:
+    static constexpr int DEFAULT_LEVEL = 6;
+    // Largest distance a match may reach back
+    static constexpr size_t WINDOW_SIZE = 32 * 1024;
+    // Input deflated per task by compress_parallel()
+    static constexpr size_t PARALLEL_BLOCK_SIZE = 128 * 1024;
+
+    // Levels 0 (stored) to 9 (smallest), as in zlib
+    static std::vector<uint8_t> compress(std::span<const uint8_t> data, int level = DEFAULT_LEVEL);
+
+    // pigz-style: PARALLEL_BLOCK_SIZE pieces are deflated on pool, each
+    // primed with the WINDOW_SIZE bytes before it and ended on a byte
+    // boundary, then concatenated into one zlib stream. The pieces' Adler-32
+    // checksums are combined, so the result is an ordinary zlib stream that
+    // compresses almost as well as compress(). Callers must not be tasks of
+    // pool themselves.
+    static std::vector<uint8_t> compress_parallel(std::span<const uint8_t> data, int level, ThreadPool& pool);
+
+    using Sink = std::function<void(std::span<const uint8_t>)>;
+
+    // Throws std::invalid_argument on malformed input or a checksum mismatch
+    static std::vector<uint8_t> decompress(std::span<const uint8_t> data);
+
+    // Inflates a zlib stream split over several segments (the data of
+    // consecutive IDAT chunks, say) without joining them. Output is passed
+    // to sink in pieces as it is produced, so memory stays bounded however
+    // large the stream inflates. Throws like decompress(), possibly after
+    // some output has already been passed on.
+    static void decompress_to(std::span<const std::span<const uint8_t>> segments, const Sink& sink);
+
+    // Raw deflate, for assembling streams piece by piece. Matches may reach
+    // back into up to WINDOW_SIZE bytes of dictionary, which is not itself
+    // emitted. Unless last is set the output ends with a sync flush (an
+    // empty stored block), so independently deflated pieces can be
+    // concatenated.
+    static void deflate_raw(std::span<const uint8_t> dictionary, std::span<const uint8_t> data, int level, bool last, std::vector<uint8_t>& out);
+
+    // A piece of a stream put together by assemble(): deflate_raw() output
+    // and the Adler-32 and length of the input it stands for
+    struct Piece {
+        std::vector<uint8_t> deflated;
+        uint32_t adler = 1;
+        uint64_t length = 0;
+    };
+
+    // Passes the zlib header, every piece in order and the combined Adler-32
+    // to sink, making one zlib stream of pieces deflated independently. Only
+    // the last piece may be final.
+    static void assemble(int level, std::span<const Piece> pieces, const Sink& sink);
+
+    // Inflates one raw deflate stream onto the end of out. Bytes already in
+    // out act as the dictionary. Returns how many input bytes the stream
+    // took up.
+    static size_t inflate_raw(std::span<const uint8_t> data, std::vector<uint8_t>& out);
+
+    // Running Adler-32, starting from 1
+    static uint32_t adler32(uint32_t adler, const uint8_t* data, size_t length);
+    // Adler-32 of a + b from adler1 = Adler-32(a), adler2 = Adler-32(b) and
+    // the length of b
+    static uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, uint64_t length2);
+};
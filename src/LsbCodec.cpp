@@ -0,0 +1,373 @@
+#include "LsbCodec.hpp"
+#include "Crc32.hpp"
+#include "Stats.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PNGRE_HAVE_X86_SIMD 1
+#else
+#define PNGRE_HAVE_X86_SIMD 0
+#endif
+
+namespace {
+
+// ----------------------------------------------------------------- scalar
+
+// SPREAD[b] has bit i of b in the low bit of byte i
+constexpr std::array<uint64_t, 256> SPREAD = [] {
+    std::array<uint64_t, 256> table{};
+    for (int b = 0; b < 256; b++) {
+        for (int i = 0; i < 8; i++) {
+            table[b] |= uint64_t((b >> i) & 1) << (8 * i);
+        }
+    }
+    return table;
+}();
+
+constexpr uint64_t LOW_BITS = 0x0101010101010101;
+
+void scatter_scalar(uint8_t* carriers, const uint8_t* bits, size_t count) {
+    if constexpr (std::endian::native == std::endian::little) {
+        for (size_t i = 0; i < count; i++) {
+            uint64_t word;
+            std::memcpy(&word, carriers + 8 * i, 8);
+            word = (word & ~LOW_BITS) | SPREAD[bits[i]];
+            std::memcpy(carriers + 8 * i, &word, 8);
+        }
+    } else {
+        for (size_t i = 0; i < 8 * count; i++) {
+            carriers[i] = uint8_t((carriers[i] & 0xfe) | ((bits[i / 8] >> (i % 8)) & 1));
+        }
+    }
+}
+
+void gather_scalar(const uint8_t* carriers, uint8_t* bits, size_t count) {
+    if constexpr (std::endian::native == std::endian::little) {
+        for (size_t i = 0; i < count; i++) {
+            uint64_t word;
+            std::memcpy(&word, carriers + 8 * i, 8);
+            // the multiply lines the low bit of byte i up at bit 56 + i
+            bits[i] = uint8_t(((word & LOW_BITS) * 0x0102040810204080) >> 56);
+        }
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            uint8_t byte = 0;
+            for (int bit = 0; bit < 8; bit++) {
+                byte = uint8_t(byte | ((carriers[8 * i + bit] & 1) << bit));
+            }
+            bits[i] = byte;
+        }
+    }
+}
+
+struct Kernels {
+    void (*scatter)(uint8_t* carriers, const uint8_t* bits, size_t count);
+    void (*gather)(const uint8_t* carriers, uint8_t* bits, size_t count);
+};
+
+constexpr Kernels SCALAR_KERNELS = {scatter_scalar, gather_scalar};
+
+#if PNGRE_HAVE_X86_SIMD
+
+// ------------------------------------------------------------------ x86
+//
+// Scatter repeats each payload byte across 8 lanes, tests lane i against
+// bit i and merges the 0/1 result into the carriers' low bits. Gather
+// shifts every carrier's low bit up to the sign bit and collects the sign
+// bits with movemask, which already is the payload in order.
+
+void scatter_sse2(uint8_t* carriers, const uint8_t* bits, size_t count) {
+    const __m128i select = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    const __m128i keep = _mm_set1_epi8(char(0xfe));
+    const __m128i one = _mm_set1_epi8(1);
+    auto merge = [&](uint8_t* p, __m128i spread) {
+        __m128i set = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(spread, select), select), one);
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm_or_si128(_mm_and_si128(c, keep), set));
+    };
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        uint32_t quad;
+        std::memcpy(&quad, bits + i, 4);
+        // b0 b0 b1 b1 .. then b0 x4 b1 x4 .. then 8 copies of each byte
+        __m128i v = _mm_cvtsi32_si128(int(quad));
+        v = _mm_unpacklo_epi8(v, v);
+        v = _mm_unpacklo_epi16(v, v);
+        merge(carriers + 8 * i, _mm_unpacklo_epi32(v, v));
+        merge(carriers + 8 * i + 16, _mm_unpackhi_epi32(v, v));
+    }
+    scatter_scalar(carriers + 8 * i, bits + i, count - i);
+}
+
+void gather_sse2(const uint8_t* carriers, uint8_t* bits, size_t count) {
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(carriers + 8 * i));
+        uint16_t pair = uint16_t(_mm_movemask_epi8(_mm_slli_epi16(c, 7)));
+        std::memcpy(bits + i, &pair, 2);
+    }
+    gather_scalar(carriers + 8 * i, bits + i, count - i);
+}
+
+constexpr Kernels SSE2_KERNELS = {scatter_sse2, gather_sse2};
+
+// Scatters 4 payload bytes into 32 carriers
+__attribute__((target("avx2")))
+inline void scatter_quad_avx2(uint8_t* carriers, const uint8_t* bits) {
+    // shuffles stay within 128-bit lanes, and both lanes hold all 4 bytes
+    const __m256i spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                            2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i select = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+                                            1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    uint32_t quad;
+    std::memcpy(&quad, bits, 4);
+    __m256i v = _mm256_shuffle_epi8(_mm256_set1_epi32(int(quad)), spread);
+    __m256i set = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(v, select), select), _mm256_set1_epi8(1));
+    __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(carriers));
+    c = _mm256_and_si256(c, _mm256_set1_epi8(char(0xfe)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(carriers), _mm256_or_si256(c, set));
+}
+
+__attribute__((target("avx2")))
+void scatter_avx2(uint8_t* carriers, const uint8_t* bits, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        scatter_quad_avx2(carriers + 8 * i, bits + i);
+        scatter_quad_avx2(carriers + 8 * i + 32, bits + i + 4);
+    }
+    scatter_sse2(carriers + 8 * i, bits + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void gather_avx2(const uint8_t* carriers, uint8_t* bits, size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(carriers + 8 * i));
+        uint32_t quad = uint32_t(_mm256_movemask_epi8(_mm256_slli_epi16(c, 7)));
+        std::memcpy(bits + i, &quad, 4);
+    }
+    gather_sse2(carriers + 8 * i, bits + i, count - i);
+}
+
+constexpr Kernels AVX2_KERNELS = {scatter_avx2, gather_avx2};
+
+bool cpu_has_avx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+#else
+bool cpu_has_avx2() {
+    return false;
+}
+#endif
+
+const Kernels& kernels_for(LsbEngine engine) {
+    switch (engine) {
+        case LsbEngine::Scalar: return SCALAR_KERNELS;
+#if PNGRE_HAVE_X86_SIMD
+        case LsbEngine::Sse2: return SSE2_KERNELS;
+        case LsbEngine::Avx2: if (cpu_has_avx2()) return AVX2_KERNELS; break;
+#else
+        case LsbEngine::Sse2: break;
+        case LsbEngine::Avx2: break;
+#endif
+    }
+    throw std::invalid_argument("LSB engine not supported on this CPU!");
+}
+
+LsbEngine detect_engine() {
+    if (cpu_has_avx2()) {
+        return LsbEngine::Avx2;
+    }
+    return PNGRE_HAVE_X86_SIMD ? LsbEngine::Sse2 : LsbEngine::Scalar;
+}
+
+const Kernels& active_kernels() {
+    static const Kernels& kernels = kernels_for(LsbCodec::engine());
+    return kernels;
+}
+
+// 16-bit images are staged through a buffer this many payload bytes at a
+// time, so the kernels always see contiguous carriers
+constexpr size_t STAGE_BYTES = 512;
+
+size_t carrier_stride(const ImageHeader& header) {
+    return header.bit_depth == 16 ? 2 : 1;
+}
+
+size_t carrier_count(const ImageHeader& header) {
+    return size_t(header.height) * header.row_bytes() / carrier_stride(header);
+}
+
+// Scatters bits into the carriers from carrier number first on
+void scatter_at(const ImageHeader& header, std::span<uint8_t> pixels, size_t first, std::span<const uint8_t> bits) {
+    if (carrier_stride(header) == 1) {
+        LsbCodec::scatter(pixels.data() + first, bits.data(), bits.size());
+        return;
+    }
+    // the low byte of each big-endian sample is the second one
+    uint8_t stage[8 * STAGE_BYTES];
+    uint8_t* low = pixels.data() + 2 * first + 1;
+    while (!bits.empty()) {
+        size_t take = std::min(bits.size(), STAGE_BYTES);
+        for (size_t i = 0; i < 8 * take; i++) {
+            stage[i] = low[2 * i];
+        }
+        LsbCodec::scatter(stage, bits.data(), take);
+        for (size_t i = 0; i < 8 * take; i++) {
+            low[2 * i] = stage[i];
+        }
+        low += 16 * take;
+        bits = bits.subspan(take);
+    }
+}
+
+void gather_at(const ImageHeader& header, std::span<const uint8_t> pixels, size_t first, std::span<uint8_t> bits) {
+    if (carrier_stride(header) == 1) {
+        LsbCodec::gather(pixels.data() + first, bits.data(), bits.size());
+        return;
+    }
+    uint8_t stage[8 * STAGE_BYTES];
+    const uint8_t* low = pixels.data() + 2 * first + 1;
+    while (!bits.empty()) {
+        size_t take = std::min(bits.size(), STAGE_BYTES);
+        for (size_t i = 0; i < 8 * take; i++) {
+            stage[i] = low[2 * i];
+        }
+        LsbCodec::gather(stage, bits.data(), take);
+        low += 16 * take;
+        bits = bits.subspan(take);
+    }
+}
+
+void check_pixels(const ImageHeader& header, size_t size) {
+    if (size < size_t(header.height) * header.row_bytes()) {
+        throw std::invalid_argument("Pixel buffer is too small for the image!");
+    }
+}
+
+uint32_t read_be32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+void write_be32(uint8_t* p, uint32_t value) {
+    p[0] = uint8_t(value >> 24);
+    p[1] = uint8_t(value >> 16);
+    p[2] = uint8_t(value >> 8);
+    p[3] = uint8_t(value);
+}
+
+// Covers the length too: carriers that are all zeros, as in a blank
+// image, would otherwise read as a valid empty payload
+uint32_t payload_crc(const uint8_t* length, std::span<const uint8_t> payload) {
+    return Crc32::update(Crc32::compute(length, 4), payload.data(), payload.size());
+}
+
+} // namespace
+
+void LsbCodec::check_image(const ImageHeader& header)
+{
+    if (header.color_type == ImageHeader::INDEXED || (header.bit_depth != 8 && header.bit_depth != 16)) {
+        throw std::invalid_argument("LSB payloads need an 8 or 16-bit grayscale or truecolor image!");
+    }
+}
+
+size_t LsbCodec::capacity(const ImageHeader& header)
+{
+    check_image(header);
+    // the header is capped at 32-bit lengths
+    size_t bytes = std::min<size_t>(carrier_count(header) / 8, HEADER_SIZE + 0xffffffffu);
+    return bytes > HEADER_SIZE ? bytes - HEADER_SIZE : 0;
+}
+
+void LsbCodec::embed(const ImageHeader& header, std::span<uint8_t> pixels, std::span<const uint8_t> payload)
+{
+    ScopedTimer timer(Phase::Pixels);
+    check_pixels(header, pixels.size());
+    size_t available = capacity(header);
+    if (payload.size() > available) {
+        throw std::invalid_argument("Payload does not fit in the image, it holds " + std::to_string(available) + " bytes!");
+    }
+
+    uint8_t prefix[HEADER_SIZE];
+    write_be32(prefix, uint32_t(payload.size()));
+    write_be32(prefix + 4, payload_crc(prefix, payload));
+    scatter_at(header, pixels, 0, prefix);
+    scatter_at(header, pixels, 8 * HEADER_SIZE, payload);
+}
+
+std::vector<uint8_t> LsbCodec::extract(const ImageHeader& header, std::span<const uint8_t> pixels)
+{
+    ScopedTimer timer(Phase::Pixels);
+    check_pixels(header, pixels.size());
+    size_t available = capacity(header);
+    if (available == 0) {
+        throw std::invalid_argument("No LSB payload in the image!");
+    }
+
+    uint8_t prefix[HEADER_SIZE];
+    gather_at(header, pixels, 0, prefix);
+    uint32_t size = read_be32(prefix);
+    if (size > available) {
+        throw std::invalid_argument("No LSB payload in the image!");
+    }
+    std::vector<uint8_t> payload(size);
+    gather_at(header, pixels, 8 * HEADER_SIZE, payload);
+    if (payload_crc(prefix, payload) != read_be32(prefix + 4)) {
+        throw std::invalid_argument("No LSB payload in the image!");
+    }
+    return payload;
+}
+
+void LsbCodec::scatter(uint8_t* carriers, const uint8_t* bits, size_t count)
+{
+    active_kernels().scatter(carriers, bits, count);
+}
+
+void LsbCodec::gather(const uint8_t* carriers, uint8_t* bits, size_t count)
+{
+    active_kernels().gather(carriers, bits, count);
+}
+
+void LsbCodec::scatter_with(LsbEngine engine, uint8_t* carriers, const uint8_t* bits, size_t count)
+{
+    kernels_for(engine).scatter(carriers, bits, count);
+}
+
+void LsbCodec::gather_with(LsbEngine engine, const uint8_t* carriers, uint8_t* bits, size_t count)
+{
+    kernels_for(engine).gather(carriers, bits, count);
+}
+
+LsbEngine LsbCodec::engine()
+{
+    static const LsbEngine engine = detect_engine();
+    return engine;
+}
+
+bool LsbCodec::is_supported(LsbEngine engine)
+{
+    switch (engine) {
+        case LsbEngine::Scalar: return true;
+        case LsbEngine::Sse2: return PNGRE_HAVE_X86_SIMD;
+        case LsbEngine::Avx2: return cpu_has_avx2();
+    }
+    return false;
+}
+
+const char* LsbCodec::engine_name(LsbEngine engine)
+{
+    switch (engine) {
+        case LsbEngine::Scalar: return "scalar";
+        case LsbEngine::Sse2: return "sse2";
+        case LsbEngine::Avx2: return "avx2";
+    }
+    return "unknown";
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "PixelDecoder.hpp"
+
+// Bit-scatter kernels behind LsbCodec. Every engine produces the same
+// bytes, they only differ in speed.
+enum class LsbEngine {
+    Scalar,  // 8 carriers per step through a lookup table
+    Sse2,    // 32 carriers per step
+    Avx2     // 64 carriers per step
+};
+
+// Hides a payload in the least significant bits of an image's samples.
+// Carriers are the sample bytes of decoded pixels (see PixelDecoder): every
+// byte of 8-bit images, the low byte of every 16-bit sample. Each carrier
+// holds one bit, least significant bit of a byte first, and the payload is
+// preceded by its length and a CRC-32 of length and payload, both
+// big-endian, so extract() can tell an image holding a payload from one
+// that doesn't. Palette indices and sub-byte samples are not carriers:
+// flipping their low bit changes the color entirely.
+class LsbCodec {
+public:
+    // Length and CRC-32 in front of the payload
+    static constexpr size_t HEADER_SIZE = 8;
+
+    // Throws std::invalid_argument unless the image has carriers
+    static void check_image(const ImageHeader& header);
+    // Largest payload the image holds, in bytes
+    static size_t capacity(const ImageHeader& header);
+
+    // Writes the header and payload into the first carriers of pixels,
+    // leaving the rest of the image as it is. Throws std::invalid_argument
+    // when the payload does not fit.
+    static void embed(const ImageHeader& header, std::span<uint8_t> pixels, std::span<const uint8_t> payload);
+    // Reads back a payload written by embed(). Throws std::invalid_argument
+    // when the pixels hold none.
+    static std::vector<uint8_t> extract(const ImageHeader& header, std::span<const uint8_t> pixels);
+
+    // Moves the bits of count bytes into the low bits of the 8 * count
+    // carriers that follow, keeping the other carrier bits
+    static void scatter(uint8_t* carriers, const uint8_t* bits, size_t count);
+    // Collects the low bits of 8 * count carriers into count bytes
+    static void gather(const uint8_t* carriers, uint8_t* bits, size_t count);
+
+    // Same as scatter() and gather(), but force a specific engine
+    static void scatter_with(LsbEngine engine, uint8_t* carriers, const uint8_t* bits, size_t count);
+    static void gather_with(LsbEngine engine, const uint8_t* carriers, uint8_t* bits, size_t count);
+
+    // Engine used by scatter() and gather(). Picked once at startup from CPUID.
+    static LsbEngine engine();
+    static bool is_supported(LsbEngine engine);
+    static const char* engine_name(LsbEngine engine);
+};
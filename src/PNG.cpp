@@ -1,88 +1,265 @@
 #include "PNG.hpp"
+#include "ChunkValidator.hpp"
+#include "Stats.hpp"
+#include <array>
 
 const std::vector<uint8_t> PNG::STANDARD_HEADER {137, 80, 78, 71, 13, 10, 26, 10};
 
-// Creates a PNG object from a vector of bytes
-PNG::PNG(std::vector<uint8_t> bytes)
+// Creates a PNG object from a vector of bytes. Chunks are indexed first,
+// then all CRCs are verified (in parallel for large images), and only then
+// is chunk data copied out.
+PNG::PNG(std::vector<uint8_t> bytes, ChunkStorage storage)
 {
-    if (bytes.size() < 8) {
-        throw std::invalid_argument("Not enough bytes for PNG header!");
+    load(PNGFile::scan(bytes), storage);
+}
+
+PNG::PNG(std::vector<Chunk> chunks)
+{
+    if (chunks.empty()) {
+        throw std::invalid_argument("PNG must contain at least one chunk");
     }
 
-    for (int i = 0; i < 8; i++)
+    chunks_m = std::move(chunks);
+    rebuild_index();
+}
+
+PNG::PNG(const PNGFile& file, ChunkStorage storage)
+{
+    load(file.chunks(), storage);
+}
+
+PNG::PNG(std::vector<uint8_t> bytes, Validation validation)
+{
+    auto source = std::make_shared<const std::vector<uint8_t>>(std::move(bytes));
+    source_m = source;
+    load(PNGFile::scan(*source), validation);
+}
+
+PNG::PNG(PNGFile&& file, Validation validation)
+{
+    auto source = std::make_shared<const PNGFile>(std::move(file));
+    source_m = source;
+    load(source->chunks(), validation);
+}
+
+void PNG::load(const std::vector<ChunkView>& views, Validation validation)
+{
+    ScopedTimer timer(Phase::Parse);
+    if (validation == Validation::Eager)
+    {
+        // nothing is viewed in place, the bytes can go
+        load(views, ChunkStorage::Heap);
+        source_m.reset();
+        return;
+    }
+
+    Chunk::CrcState state = validation == Validation::Lazy ? Chunk::CrcState::Pending : Chunk::CrcState::Unchecked;
+    chunks_m.reserve(views.size());
+    for (const auto& view : views)
     {
-        if (STANDARD_HEADER[i] != bytes[i])
+        chunks_m.push_back(Chunk(view.chunktype(), view.data(), view.crc(), state));
+    }
+    rebuild_index();
+}
+
+void PNG::load(const std::vector<ChunkView>& views, ChunkStorage storage)
+{
+    ScopedTimer timer(Phase::Parse);
+    ChunkValidator::verify(views);
+
+    chunks_m.reserve(views.size());
+    if (storage == ChunkStorage::Arena)
+    {
+        // sized up front so all chunk data lands in a single upstream block
+        size_t total_size = 0;
+        for (const auto& view : views)
         {
-            throw std::invalid_argument("First 8 bytes need to match standard header!");
+            total_size += view.length();
+        }
+        arena_m = std::make_shared<std::pmr::monotonic_buffer_resource>(std::max<size_t>(total_size, 1));
+        for (const auto& view : views)
+        {
+            chunks_m.push_back(Chunk(view.chunktype(), view.data(), view.crc(), *arena_m));
         }
     }
+    else
+    {
+        for (const auto& view : views)
+        {
+            chunks_m.push_back(Chunk(view.chunktype(), std::vector<uint8_t>(view.data().begin(), view.data().end()), view.crc()));
+        }
+    }
+    rebuild_index();
+}
 
-    std::vector<Chunk> chunks;
+uint32_t PNG::type_key(const ChunkType& type)
+{
+    auto bytes = type.bytes();
+    return (bytes[0] << 24) | (bytes[1] << 16) | (bytes[2] << 8) | bytes[3];
+}
 
-    // parse chunks 
-    size_t i = 8; // skip header
-    while (i < bytes.size())
+void PNG::rebuild_index()
+{
+    index_m.clear();
+    removed_m.assign(chunks_m.size(), false);
+    removed_count_m = 0;
+    for (size_t i = 0; i < chunks_m.size(); i++)
     {
-        uint32_t data_length = (bytes[i] << 24) | (bytes[i+1] << 16) | (bytes[i+2] << 8) | bytes[i+3];
+        index_m[type_key(chunks_m[i].chunktype())].positions.push_back(i);
+    }
+}
 
-        if (i + REMAINDER + data_length > bytes.size()) 
+// Drops tombstones in one pass and reindexes
+void PNG::compact()
+{
+    if (removed_count_m == 0)
+    {
+        return;
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < chunks_m.size(); i++)
+    {
+        if (!removed_m[i])
         {
-            throw std::invalid_argument("Invalid Chunk!");
+            if (kept != i)
+            {
+                chunks_m[kept] = std::move(chunks_m[i]);
+            }
+            kept++;
         }
+    }
+    chunks_m.erase(chunks_m.begin() + kept, chunks_m.end());
+    rebuild_index();
+}
 
-        std::vector<uint8_t> chunk_bytes;
+const PNG::TypeIndex* PNG::find_index(const ChunkType& type) const
+{
+    auto it = index_m.find(type_key(type));
+    if (it == index_m.end() || it->second.first == it->second.positions.size())
+    {
+        return nullptr;
+    }
+    return &it->second;
+}
 
-        // length + type + data + crc
-        size_t total_chunk_size = 4 + 4 + data_length + 4;
+void PNG::append_chunk(Chunk chunk)
+{
+    index_m[type_key(chunk.chunktype())].positions.push_back(chunks_m.size());
+    removed_m.push_back(false);
+    chunks_m.push_back(std::move(chunk));
+}
 
-        chunk_bytes.insert(chunk_bytes.end(), 
-                  bytes.begin() + i, 
-                  bytes.begin() + i + total_chunk_size);
+std::optional<Chunk> PNG::chunk_by_type(const ChunkType& type) const
+{
+    return nth_chunk_by_type(type, 0);
+}
 
-        chunks.push_back(Chunk(chunk_bytes));
+size_t PNG::count_by_type(const ChunkType& type) const
+{
+    const TypeIndex* index = find_index(type);
+    return index == nullptr ? 0 : index->positions.size() - index->first;
+}
 
-        i += REMAINDER + data_length; 
+std::optional<Chunk> PNG::nth_chunk_by_type(const ChunkType& type, size_t n) const
+{
+    if (n >= count_by_type(type))
+    {
+        // not found
+        return std::nullopt;
     }
+    const TypeIndex* index = find_index(type);
+    return chunks_m[index->positions[index->first + n]];
+}
 
-    chunks_m = chunks;
+std::vector<const Chunk*> PNG::chunks_by_type(const ChunkType& type) const
+{
+    std::vector<const Chunk*> result;
+    if (const TypeIndex* index = find_index(type))
+    {
+        for (size_t i = index->first; i < index->positions.size(); i++)
+        {
+            result.push_back(&chunks_m[index->positions[i]]);
+        }
+    }
+    return result;
 }
 
-PNG::PNG(std::vector<Chunk> chunks)
+// Leaves a tombstone, the vector is only compacted when it is next needed whole
+Chunk PNG::remove_first_chunk(ChunkType type) 
 {
-    if (chunks.empty()) {
-        throw std::invalid_argument("PNG must contain at least one chunk");
+    auto it = index_m.find(type_key(type));
+    if (it == index_m.end() || it->second.first == it->second.positions.size())
+    {
+        throw std::runtime_error("Chunk not found");
     }
 
-    chunks_m = chunks;
+    size_t position = it->second.positions[it->second.first++];
+    removed_m[position] = true;
+    removed_count_m++;
+    if (chunks_m[position].borrows_data())
+    {
+        // the arena or source bytes go away with this PNG, so hand back
+        // an owning copy
+        return Chunk(chunks_m[position]);
+    }
+    return std::move(chunks_m[position]);
 }
 
-void PNG::append_chunk(Chunk chunk)
+void PNG::insert_before_iend(std::vector<Chunk> chunks)
 {
-    chunks_m.push_back(chunk);
+    compact();
+    size_t position = chunks_m.size();
+    if (const TypeIndex* iend = find_index(ChunkType::fromStr("IEND")))
+    {
+        position = iend->positions[iend->first];
+    }
+    chunks_m.insert(chunks_m.begin() + position, std::make_move_iterator(chunks.begin()), std::make_move_iterator(chunks.end()));
+    rebuild_index();
 }
 
-std::optional<Chunk> PNG::chunk_by_type(const ChunkType& type) const
+std::vector<Chunk> PNG::remove_chunks(const std::vector<ChunkType>& types, bool all)
 {
-    for (size_t i = 0; i < chunks_m.size(); i++) {
-        if (chunks_m[i].chunktype() == type) {
-            return chunks_m[i];
+    // tombstone through the index, then collect in one pass in file order
+    std::vector<bool> selected(chunks_m.size(), false);
+    size_t selected_count = 0;
+    for (const auto& type : types)
+    {
+        auto it = index_m.find(type_key(type));
+        if (it == index_m.end())
+        {
+            continue;
+        }
+        TypeIndex& index = it->second;
+        size_t end = all ? index.positions.size() : std::min(index.first + 1, index.positions.size());
+        for (; index.first < end; index.first++)
+        {
+            size_t position = index.positions[index.first];
+            selected[position] = true;
+            removed_m[position] = true;
+            selected_count++;
         }
     }
+    removed_count_m += selected_count;
 
-    // not found
-    return std::nullopt;
-}
-
-Chunk PNG::remove_first_chunk(ChunkType type) 
-{
-    for (size_t i = 0; i < chunks_m.size(); i++) {
-        if (chunks_m[i].chunktype() == type) {
-            Chunk chunk_to_remove = chunks_m[i];
-            chunks_m.erase(chunks_m.begin() + i);
-            return chunk_to_remove;
+    std::vector<Chunk> removed;
+    removed.reserve(selected_count);
+    for (size_t i = 0; i < chunks_m.size() && removed.size() < selected_count; i++)
+    {
+        if (selected[i])
+        {
+            // same ownership rule as remove_first_chunk
+            if (chunks_m[i].borrows_data())
+            {
+                removed.push_back(Chunk(chunks_m[i]));
+            }
+            else
+            {
+                removed.push_back(std::move(chunks_m[i]));
+            }
         }
     }
-    throw std::runtime_error("Chunk not found");
+    return removed;
 }
 
 const std::vector<uint8_t>& PNG::header() const
@@ -90,44 +267,128 @@ const std::vector<uint8_t>& PNG::header() const
     return STANDARD_HEADER;
 }
 
-const std::vector<Chunk>& PNG::chunks() const 
+const std::vector<Chunk>& PNG::chunks()
 {
+    compact();
     return chunks_m;
 }
 
+// Sizes the output once, then serializes every chunk straight into it
 const std::vector<uint8_t> PNG::as_bytes() const
 {
-    std::vector<uint8_t> bytes;
+    ScopedTimer timer(Phase::Serialize);
+    size_t total_size = serialized_size();
+    std::vector<uint8_t> bytes(total_size);
+    write_to(bytes);
+    return bytes;
+}
+
+size_t PNG::serialized_size() const
+{
     size_t total_size = STANDARD_HEADER.size();
+    for (size_t i = 0; i < chunks_m.size(); i++)
+    {
+        if (!removed_m[i])
+        {
+            total_size += chunks_m[i].serialized_size();
+        }
+    }
+    return total_size;
+}
 
-    for (const auto& chunk : chunks_m) {
-        total_size += chunk.as_bytes().size(); 
+size_t PNG::write_to(std::span<uint8_t> out) const
+{
+    ScopedTimer timer(Phase::Serialize);
+    if (out.size() < serialized_size())
+    {
+        throw std::invalid_argument("Not enough room to serialize PNG!");
     }
-    bytes.reserve(total_size);
 
-    bytes.insert(bytes.end(), STANDARD_HEADER.begin(), STANDARD_HEADER.end());
-    
-    for (const auto& chunk : chunks_m)
+    std::copy(STANDARD_HEADER.begin(), STANDARD_HEADER.end(), out.begin());
+    size_t offset = STANDARD_HEADER.size();
+    for (size_t i = 0; i < chunks_m.size(); i++)
     {
-        const auto chunk_bytes = chunk.as_bytes();
-        bytes.insert(bytes.end(), chunk_bytes.begin(), chunk_bytes.end());
+        if (!removed_m[i])
+        {
+            offset += chunks_m[i].write_to(out.subspan(offset));
+        }
     }
+    return offset;
+}
 
-    return bytes;
+size_t PNG::write_to(ByteSink& sink) const
+{
+    ScopedTimer timer(Phase::Serialize);
+    size_t live = chunks_m.size() - removed_count_m;
+
+    // length + type ahead of each chunk's data, CRC after it
+    std::vector<std::array<uint8_t, 8>> headers(live);
+    std::vector<std::array<uint8_t, 4>> trailers(live);
+    std::vector<iovec> pieces;
+    pieces.reserve(1 + 3 * live);
+    pieces.push_back({const_cast<uint8_t*>(STANDARD_HEADER.data()), STANDARD_HEADER.size()});
+
+    size_t total_size = STANDARD_HEADER.size();
+    size_t next = 0;
+    for (size_t i = 0; i < chunks_m.size(); i++)
+    {
+        if (removed_m[i])
+        {
+            continue;
+        }
+        const Chunk& chunk = chunks_m[i];
+        uint32_t length = chunk.length();
+        uint32_t crc = chunk.crc();
+        auto type_bytes = chunk.chunktype().bytes();
+
+        auto& header = headers[next];
+        header[0] = (length >> 24) & 0xFF;
+        header[1] = (length >> 16) & 0xFF;
+        header[2] = (length >> 8) & 0xFF;
+        header[3] = length & 0xFF;
+        std::copy(type_bytes.begin(), type_bytes.end(), header.begin() + 4);
+
+        auto& trailer = trailers[next++];
+        trailer[0] = (crc >> 24) & 0xFF;
+        trailer[1] = (crc >> 16) & 0xFF;
+        trailer[2] = (crc >> 8) & 0xFF;
+        trailer[3] = crc & 0xFF;
+
+        pieces.push_back({header.data(), header.size()});
+        if (length > 0)
+        {
+            pieces.push_back({const_cast<uint8_t*>(chunk.data().data()), length});
+        }
+        pieces.push_back({trailer.data(), trailer.size()});
+        total_size += chunk.serialized_size();
+    }
+
+    sink.writev(pieces.data(), pieces.size());
+    return total_size;
+}
+
+size_t PNG::write_to(int fd) const
+{
+    FdSink sink(fd);
+    return write_to(sink);
 }
 
 std::ostream& operator<<(std::ostream& os, const PNG& png)
 {
-    os << "PNG { length: " << png.chunks_m.size() << ", chunks: [";
+    os << "PNG { length: " << png.chunks_m.size() - png.removed_count_m << ", chunks: [";
 
     bool first = true;
-    for (const auto& chunk : png.chunks())
+    for (size_t i = 0; i < png.chunks_m.size(); i++)
     {
+        if (png.removed_m[i])
+        {
+            continue;
+        }
         if (!first) 
         {
             os << ", ";
         }
-        os <<  chunk;
+        os <<  png.chunks_m[i];
         first = false;
     }
 
@@ -1,27 +1,103 @@
 #pragma once
 #include <vector>
 #include <cstdint>
+#include <memory>
+#include <memory_resource>
 #include <optional>
+#include <unordered_map>
+#include "ByteSink.hpp"
 #include "Chunk.hpp"
 
+// Where a parsed PNG keeps its chunk data
+enum class ChunkStorage {
+    Heap,   // one allocation per chunk
+    Arena   // every chunk in one monotonic buffer, released in one free
+};
+
+// When a parsed PNG checks chunk CRCs
+enum class Validation {
+    Eager,  // every chunk before the constructor returns
+    Lazy,   // each chunk the first time its data is read
+    Off     // never, unless Chunk::verify_crc() is called
+};
+
 class PNG {
 private:
+    // Positions in chunks_m of every chunk of one type, in file order.
+    // Removal always takes the first live entry, so the live positions are
+    // exactly positions[first..].
+    struct TypeIndex {
+        std::vector<size_t> positions;
+        size_t first = 0;
+    };
+
+    // Removed chunks stay in place as tombstones, so removal never shifts
+    // the vector. Const calls skip them without rewriting storage (they are
+    // safe to make from several threads); chunks() and insertions compact
+    // them away in one pass.
     std::vector<Chunk> chunks_m;
-    // header (4) + data (4) + crc (4)
-    const size_t REMAINDER = 12;
-    
+    std::vector<bool> removed_m;
+    size_t removed_count_m = 0;
+    std::unordered_map<uint32_t, TypeIndex> index_m;
+    // Backs chunk data in ChunkStorage::Arena mode. Shared so copies of
+    // the PNG stay cheap, copied chunks own their data anyway.
+    std::shared_ptr<std::pmr::monotonic_buffer_resource> arena_m;
+    // Keeps the parsed bytes (a vector or a PNGFile mapping) alive when
+    // chunks view them in place instead of copying
+    std::shared_ptr<const void> source_m;
+
+    void load(const std::vector<ChunkView>& views, ChunkStorage storage);
+    void load(const std::vector<ChunkView>& views, Validation validation);
+    static uint32_t type_key(const ChunkType& type);
+    void rebuild_index();
+    void compact();
+    const TypeIndex* find_index(const ChunkType& type) const;
+
 public:
     static const std::vector<uint8_t> STANDARD_HEADER;
     
-    PNG(std::vector<uint8_t>);
+    PNG(std::vector<uint8_t>, ChunkStorage storage = ChunkStorage::Heap);
     PNG(std::vector<Chunk>);
+    // Materializes every chunk of a mapped file
+    explicit PNG(const PNGFile&, ChunkStorage storage = ChunkStorage::Heap);
+    // Lazy and Off keep the bytes (or the mapping) and only walk the chunk
+    // headers: chunks view their data in place until copied out. Eager is
+    // the same as ChunkStorage::Heap.
+    PNG(std::vector<uint8_t>, Validation validation);
+    PNG(PNGFile&&, Validation validation);
 
-    const std::vector<Chunk>& chunks() const;
+    // Compacts removed chunks away first, which moves the remaining ones
+    const std::vector<Chunk>& chunks();
     const std::vector<uint8_t>& header() const;
     void append_chunk(Chunk);
+    // The removed chunk owns its data, whatever the storage mode
     Chunk remove_first_chunk(ChunkType);
+
+    // Bulk edits, each a single O(n + k) pass however many chunks they touch.
+    // Inserts chunks in order before the first IEND (at the end without one).
+    void insert_before_iend(std::vector<Chunk> chunks);
+    // Removes the first chunk of each listed type (a type listed twice
+    // removes two), or every chunk of those types when all is set. Returns
+    // the removed chunks in file order, owning their data.
+    std::vector<Chunk> remove_chunks(const std::vector<ChunkType>& types, bool all = false);
     const std::vector<uint8_t> as_bytes() const;
+    // Signature plus every serialized chunk
+    size_t serialized_size() const;
+    // Serializes into out, which must hold serialized_size() bytes.
+    // Returns the number of bytes written.
+    size_t write_to(std::span<uint8_t> out) const;
+    // Scatter-gather serialization: chunk data is handed to the sink in
+    // place, only the 8-byte headers and 4-byte CRCs are built on the side,
+    // so the file is never materialized in memory. Returns bytes written.
+    size_t write_to(ByteSink& sink) const;
+    size_t write_to(int fd) const;
     std::optional<Chunk> chunk_by_type(const ChunkType& type) const;
 
+    // O(1) lookups through the per-type index. Pointers stay valid across
+    // removals, until chunks() or an insertion compacts the PNG.
+    size_t count_by_type(const ChunkType& type) const;
+    std::optional<Chunk> nth_chunk_by_type(const ChunkType& type, size_t n) const;
+    std::vector<const Chunk*> chunks_by_type(const ChunkType& type) const;
+
     friend std::ostream& operator<<(std::ostream&, const PNG&);
 };
\ No newline at end of file
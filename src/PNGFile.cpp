@@ -0,0 +1,195 @@
+#include "PNGFile.hpp"
+#include "PNG.hpp"
+#include "Stats.hpp"
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+ChunkView::ChunkView(ChunkType chunktype, uint32_t crc, size_t offset, std::span<const uint8_t> data)
+    : chunktype_m(chunktype)
+    , length_m(data.size())
+    , crc_m(crc)
+    , offset_m(offset)
+    , data_m(data)
+{
+}
+
+uint32_t ChunkView::length() const {
+    return length_m;
+}
+
+uint32_t ChunkView::crc() const {
+    return crc_m;
+}
+
+const ChunkType& ChunkView::chunktype() const {
+    return chunktype_m;
+}
+
+size_t ChunkView::offset() const {
+    return offset_m;
+}
+
+std::span<const uint8_t> ChunkView::data() const {
+    return data_m;
+}
+
+std::string ChunkView::data_as_string() const {
+    return std::string(data_m.begin(), data_m.end());
+}
+
+bool ChunkView::verify_crc() const {
+    return Chunk::compute_crc(chunktype_m, data_m) == crc_m;
+}
+
+std::ostream& operator<<(std::ostream& os, const ChunkView& chunk)
+{
+    return os << "Chunk { length: " << chunk.length()
+              << ", type: " << chunk.chunktype().toString()
+              << ", data size: " << chunk.data().size()
+              << ", crc: " << chunk.crc() << " }";
+}
+
+PNGFile::PNGFile(const std::string& path)
+{
+    // pages are read in as the mapping is touched, by parse and CRC
+    ScopedTimer timer(Phase::Read);
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::invalid_argument("There was an issue reading the PNG file!");
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::invalid_argument("There was an issue reading the PNG file!");
+    }
+    size_m = st.st_size;
+
+    if (size_m < PNG::STANDARD_HEADER.size()) {
+        close(fd);
+        throw std::invalid_argument("Not enough bytes for PNG header!");
+    }
+
+    void* mapping = mmap(nullptr, size_m, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Failed to map the PNG file!");
+    }
+    data_m = static_cast<const uint8_t*>(mapping);
+    Stats::add(Counter::Syscalls, 3);
+    Stats::add(Counter::BytesRead, size_m);
+
+    try {
+        chunks_m = scan(bytes());
+    } catch (...) {
+        unmap();
+        throw;
+    }
+}
+
+std::vector<ChunkView> PNGFile::scan(std::span<const uint8_t> bytes)
+{
+    ScopedTimer timer(Phase::Parse);
+    if (bytes.size() < PNG::STANDARD_HEADER.size()) {
+        throw std::invalid_argument("Not enough bytes for PNG header!");
+    }
+
+    for (size_t i = 0; i < PNG::STANDARD_HEADER.size(); i++) {
+        if (PNG::STANDARD_HEADER[i] != bytes[i]) {
+            throw std::invalid_argument("First 8 bytes need to match standard header!");
+        }
+    }
+
+    // walk chunk headers only: length (4) + type (4), data, crc (4)
+    std::vector<ChunkView> chunks;
+    size_t size = bytes.size();
+    size_t i = PNG::STANDARD_HEADER.size();
+    while (i < size) {
+        if (size - i < 12) {
+            throw std::invalid_argument("Invalid Chunk!");
+        }
+
+        const uint8_t* p = bytes.data() + i;
+        uint32_t data_length = (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+        if (size - i - 12 < data_length) {
+            throw std::invalid_argument("Invalid Chunk!");
+        }
+
+        ChunkType chunktype({p[4], p[5], p[6], p[7]});
+        if (!chunktype.is_valid()) {
+            throw std::invalid_argument("Invalid Chunktype!");
+        }
+
+        const uint8_t* c = p + 8 + data_length;
+        uint32_t crc = (c[0] << 24) | (c[1] << 16) | (c[2] << 8) | c[3];
+
+        chunks.emplace_back(chunktype, crc, i, std::span<const uint8_t>(p + 8, data_length));
+        i += 12 + data_length;
+        // bytes after IEND are not part of the image, like other decoders
+        // skip them
+        if (chunktype == ChunkType::fromStr("IEND")) {
+            break;
+        }
+    }
+    Stats::add(Counter::ChunksParsed, chunks.size());
+    return chunks;
+}
+
+PNGFile::~PNGFile()
+{
+    unmap();
+}
+
+PNGFile::PNGFile(PNGFile&& other) noexcept
+    : data_m(other.data_m)
+    , size_m(other.size_m)
+    , chunks_m(std::move(other.chunks_m))
+{
+    other.data_m = nullptr;
+    other.size_m = 0;
+}
+
+PNGFile& PNGFile::operator=(PNGFile&& other) noexcept
+{
+    if (this != &other) {
+        unmap();
+        data_m = other.data_m;
+        size_m = other.size_m;
+        chunks_m = std::move(other.chunks_m);
+        other.data_m = nullptr;
+        other.size_m = 0;
+    }
+    return *this;
+}
+
+void PNGFile::unmap()
+{
+    if (data_m != nullptr) {
+        munmap(const_cast<uint8_t*>(data_m), size_m);
+        data_m = nullptr;
+    }
+    chunks_m.clear();
+}
+
+std::span<const uint8_t> PNGFile::bytes() const
+{
+    return std::span<const uint8_t>(data_m, size_m);
+}
+
+const std::vector<ChunkView>& PNGFile::chunks() const
+{
+    return chunks_m;
+}
+
+std::optional<ChunkView> PNGFile::chunk_by_type(const ChunkType& type) const
+{
+    for (const auto& chunk : chunks_m) {
+        if (chunk.chunktype() == type) {
+            return chunk;
+        }
+    }
+    return std::nullopt;
+}
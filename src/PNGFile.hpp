@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <vector>
+#include "ChunkType.hpp"
+
+// Non-owning view of a chunk inside a PNGFile mapping. Nothing is copied
+// or checked until asked for, so the data pages are only touched by
+// data()/verify_crc().
+class ChunkView {
+private:
+    ChunkType chunktype_m;
+    uint32_t length_m;
+    uint32_t crc_m;
+    size_t offset_m;
+    std::span<const uint8_t> data_m;
+
+public:
+    ChunkView(ChunkType chunktype, uint32_t crc, size_t offset, std::span<const uint8_t> data);
+
+    uint32_t length() const;
+    // CRC stored in the file, see verify_crc()
+    uint32_t crc() const;
+    const ChunkType& chunktype() const;
+    // Offset of the chunk's length field from the start of the file
+    size_t offset() const;
+    std::span<const uint8_t> data() const;
+    std::string data_as_string() const;
+    bool verify_crc() const;
+    friend std::ostream& operator<<(std::ostream&, const ChunkView&);
+};
+
+// Read-only memory mapped PNG. Opening only walks the chunk headers,
+// chunk data stays on disk until a view's data is read.
+class PNGFile {
+private:
+    const uint8_t* data_m = nullptr;
+    size_t size_m = 0;
+    std::vector<ChunkView> chunks_m;
+
+    void unmap();
+
+public:
+    explicit PNGFile(const std::string& path);
+    ~PNGFile();
+
+    PNGFile(const PNGFile&) = delete;
+    PNGFile& operator=(const PNGFile&) = delete;
+    PNGFile(PNGFile&& other) noexcept;
+    PNGFile& operator=(PNGFile&& other) noexcept;
+
+    // Validates the signature and indexes the chunk headers of an in-memory
+    // PNG up to IEND, without looking at chunk data or CRCs
+    static std::vector<ChunkView> scan(std::span<const uint8_t> bytes);
+
+    std::span<const uint8_t> bytes() const;
+    const std::vector<ChunkView>& chunks() const;
+    std::optional<ChunkView> chunk_by_type(const ChunkType& type) const;
+};
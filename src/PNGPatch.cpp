@@ -0,0 +1,107 @@
+#include "PNGPatch.hpp"
+#include "PNGFile.hpp"
+#include "Stats.hpp"
+#include <cerrno>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+void pwrite_all(int fd, const uint8_t* data, size_t size, off_t offset) {
+    ScopedTimer timer(Phase::Write);
+    while (size > 0) {
+        ssize_t count = pwrite(fd, data, size, offset);
+        Stats::add(Counter::Syscalls);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("There was an issue writing the PNG file!");
+        }
+        data += count;
+        size -= count;
+        offset += count;
+        Stats::add(Counter::BytesWritten, count);
+    }
+}
+
+void sync(int fd) {
+    ScopedTimer timer(Phase::Write);
+    Stats::add(Counter::Syscalls);
+    if (fdatasync(fd) != 0) {
+        throw std::runtime_error("There was an issue writing the PNG file!");
+    }
+}
+
+} // namespace
+
+bool PNGPatch::append_before_iend(const std::string& path, const Chunk& chunk)
+{
+    return append_before_iend(path, std::span<const Chunk>(&chunk, 1));
+}
+
+bool PNGPatch::append_before_iend(const std::string& path, std::span<const Chunk> chunks)
+{
+    if (chunks.empty()) {
+        return true;
+    }
+
+    size_t iend_offset;
+    size_t file_size;
+    {
+        // only chunk headers are read to locate IEND
+        PNGFile file(path);
+        if (file.chunks().empty()) {
+            return false;
+        }
+        const auto& last = file.chunks().back();
+        file_size = file.bytes().size();
+        iend_offset = last.offset();
+        if (!(last.chunktype() == ChunkType::fromStr("IEND")) || last.length() != 0 || iend_offset + 12 != file_size) {
+            return false;
+        }
+    }
+
+    auto iend = Chunk(ChunkType::fromStr("IEND"), {}).as_bytes();
+    size_t tail_size = iend.size();
+    for (const auto& chunk : chunks) {
+        tail_size += chunk.serialized_size();
+    }
+    std::vector<uint8_t> tail(tail_size);
+    {
+        ScopedTimer timer(Phase::Serialize);
+        size_t offset = 0;
+        for (const auto& chunk : chunks) {
+            offset += chunk.write_to(std::span<uint8_t>(tail).subspan(offset));
+        }
+        std::copy(iend.begin(), iend.end(), tail.begin() + offset);
+    }
+
+    int fd = open(path.c_str(), O_WRONLY);
+    Stats::add(Counter::Syscalls);
+    if (fd < 0) {
+        throw std::runtime_error("There was an issue writing the PNG file!");
+    }
+
+    try {
+        // 1. everything past the old IEND, the image is still valid meanwhile
+        pwrite_all(fd, tail.data() + 12, tail.size() - 12, iend_offset + 12);
+        sync(fd);
+
+        // 2. replace the old IEND with the start of the new chunk. This is
+        // the commit point, and it is only crash safe because a 12-byte
+        // write within one sector can't tear
+        pwrite_all(fd, tail.data(), 12, iend_offset);
+        sync(fd);
+    } catch (...) {
+        // best effort roll back to the original image
+        if (pwrite(fd, iend.data(), iend.size(), iend_offset) == static_cast<ssize_t>(iend.size()) &&
+            ftruncate(fd, file_size) == 0) {
+            fdatasync(fd);
+        }
+        close(fd);
+        throw;
+    }
+
+    close(fd);
+    return true;
+}
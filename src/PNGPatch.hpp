@@ -0,0 +1,24 @@
+#pragma once
+#include <span>
+#include <string>
+#include "Chunk.hpp"
+
+// Edits of a PNG on disk that only rewrite its tail instead of the whole file
+class PNGPatch {
+public:
+    // Writes chunk where IEND currently is, followed by a fresh IEND, so the
+    // cost grows with the chunk and not the image. Returns false without
+    // touching the file when IEND is not the last chunk or is followed by
+    // trailing bytes; callers should then fall back to a full rewrite.
+    //
+    // The tail is written past the old IEND and synced before the old IEND
+    // is overwritten, so a crash leaves either the original image (with
+    // trailing bytes after IEND, which pngre and other decoders ignore) or
+    // the new one. That relies on the 12-byte overwrite of the old IEND not
+    // tearing: all of its fields change at once, so no write order keeps a
+    // valid IEND through a partial write. Disks write a sector atomically,
+    // which covers it unless those 12 bytes straddle a sector boundary.
+    static bool append_before_iend(const std::string& path, const Chunk& chunk);
+    // Same for several chunks, written in order in one patch
+    static bool append_before_iend(const std::string& path, std::span<const Chunk> chunks);
+};
@@ -0,0 +1,144 @@
+#include "ParseCache.hpp"
+
+size_t ParseCache::KeyHash::operator()(const FileKey& key) const
+{
+    // inodes are unique per device and rarely collide across them
+    uint64_t h = key.inode * 0x9e3779b97f4a7c15ULL;
+    h ^= key.device + (h << 6) + (h >> 2);
+    h ^= key.size + (h << 6) + (h >> 2);
+    h ^= static_cast<uint64_t>(key.mtime_ns) + (h << 6) + (h >> 2);
+    return h;
+}
+
+ParseCache::ParseCache(size_t capacity)
+    : capacity_m(capacity)
+{
+}
+
+// Index entries plus a rough allowance for the map node and LRU node
+size_t ParseCache::cost(const Entry& entry)
+{
+    return entry.chunks.size() * sizeof(IndexedChunk) + sizeof(Entry) + sizeof(FileKey) * 2 + 64;
+}
+
+void ParseCache::evict_to(size_t capacity)
+{
+    while (bytes_m > capacity && !lru_m.empty()) {
+        auto it = entries_m.find(lru_m.back());
+        bytes_m -= cost(it->second);
+        entries_m.erase(it);
+        lru_m.pop_back();
+        evictions_m.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+bool ParseCache::enabled() const
+{
+    std::lock_guard<std::mutex> lock(mutex_m);
+    return capacity_m > 0;
+}
+
+void ParseCache::set_capacity(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex_m);
+    capacity_m = bytes;
+    evict_to(capacity_m);
+}
+
+std::optional<std::vector<IndexedChunk>> ParseCache::lookup(const FileKey& key)
+{
+    std::lock_guard<std::mutex> lock(mutex_m);
+    auto it = entries_m.find(key);
+    if (it == entries_m.end()) {
+        misses_m.fetch_add(1, std::memory_order_relaxed);
+        return std::nullopt;
+    }
+    hits_m.fetch_add(1, std::memory_order_relaxed);
+    lru_m.splice(lru_m.begin(), lru_m, it->second.lru);
+    return it->second.chunks;
+}
+
+void ParseCache::insert(const FileKey& key, std::vector<IndexedChunk> index)
+{
+    std::lock_guard<std::mutex> lock(mutex_m);
+    if (capacity_m == 0) {
+        return;
+    }
+
+    auto it = entries_m.find(key);
+    if (it != entries_m.end()) {
+        // another thread indexed the same file first
+        bytes_m -= cost(it->second);
+        it->second.chunks = std::move(index);
+        lru_m.splice(lru_m.begin(), lru_m, it->second.lru);
+    } else {
+        lru_m.push_front(key);
+        it = entries_m.emplace(key, Entry{std::move(index), lru_m.begin()}).first;
+    }
+    bytes_m += cost(it->second);
+    evict_to(capacity_m);
+}
+
+void ParseCache::mark_verified(const FileKey& key, size_t position)
+{
+    std::lock_guard<std::mutex> lock(mutex_m);
+    auto it = entries_m.find(key);
+    if (it != entries_m.end() && position < it->second.chunks.size()) {
+        it->second.chunks[position].verified = true;
+    }
+}
+
+void ParseCache::erase(const FileKey& key)
+{
+    std::lock_guard<std::mutex> lock(mutex_m);
+    auto it = entries_m.find(key);
+    if (it != entries_m.end()) {
+        bytes_m -= cost(it->second);
+        lru_m.erase(it->second.lru);
+        entries_m.erase(it);
+    }
+}
+
+uint64_t ParseCache::hits() const
+{
+    return hits_m.load(std::memory_order_relaxed);
+}
+
+uint64_t ParseCache::misses() const
+{
+    return misses_m.load(std::memory_order_relaxed);
+}
+
+uint64_t ParseCache::evictions() const
+{
+    return evictions_m.load(std::memory_order_relaxed);
+}
+
+size_t ParseCache::entries() const
+{
+    std::lock_guard<std::mutex> lock(mutex_m);
+    return entries_m.size();
+}
+
+size_t ParseCache::bytes() const
+{
+    std::lock_guard<std::mutex> lock(mutex_m);
+    return bytes_m;
+}
+
+void ParseCache::write_json(std::ostream& out) const
+{
+    std::lock_guard<std::mutex> lock(mutex_m);
+    out << "{\"capacity\": " << capacity_m
+        << ", \"bytes\": " << bytes_m
+        << ", \"entries\": " << entries_m.size()
+        << ", \"hits\": " << hits()
+        << ", \"misses\": " << misses()
+        << ", \"evictions\": " << evictions() << "}";
+}
+
+ParseCache& ParseCache::shared()
+{
+    static ParseCache cache;
+    return cache;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+#include "ChunkIndex.hpp"
+
+// Chunk indexes of recently decoded files, keyed by FileKey, so decoding a
+// hot image again is one lookup plus one pread per wanted chunk instead of
+// a walk over its headers. Lives as long as the process: it pays off in
+// `serve` and `batch`. Least recently used files are evicted to stay under
+// a byte capacity. Thread-safe.
+class ParseCache {
+private:
+    struct Entry {
+        std::vector<IndexedChunk> chunks;
+        std::list<FileKey>::iterator lru;
+    };
+
+    struct KeyHash {
+        size_t operator()(const FileKey& key) const;
+    };
+
+    mutable std::mutex mutex_m;
+    size_t capacity_m;
+    size_t bytes_m = 0;
+    // most recently used first
+    std::list<FileKey> lru_m;
+    std::unordered_map<FileKey, Entry, KeyHash> entries_m;
+
+    std::atomic<uint64_t> hits_m{0};
+    std::atomic<uint64_t> misses_m{0};
+    std::atomic<uint64_t> evictions_m{0};
+
+    static size_t cost(const Entry& entry);
+    void evict_to(size_t capacity);
+
+public:
+    // 0 bytes disables the cache
+    explicit ParseCache(size_t capacity = 0);
+
+    bool enabled() const;
+    // Evicts down to a smaller capacity, 0 disables and empties the cache
+    void set_capacity(size_t bytes);
+
+    // Copy of the cached index of key, counting a hit or a miss
+    std::optional<std::vector<IndexedChunk>> lookup(const FileKey& key);
+    // Caches index, dropped at once if it alone is over capacity
+    void insert(const FileKey& key, std::vector<IndexedChunk> index);
+    // Records that chunk position of key's index matched its CRC
+    void mark_verified(const FileKey& key, size_t position);
+    // Forgets key's index, found not to describe the file after all
+    void erase(const FileKey& key);
+
+    uint64_t hits() const;
+    uint64_t misses() const;
+    uint64_t evictions() const;
+    size_t entries() const;
+    // Approximate memory held, what the capacity is compared against
+    size_t bytes() const;
+
+    // {"capacity": ..., "bytes": ..., "entries": ..., "hits": ...,
+    //  "misses": ..., "evictions": ...}
+    void write_json(std::ostream& out) const;
+
+    // Process-wide cache used by decode and print, disabled until given a
+    // capacity
+    static ParseCache& shared();
+};
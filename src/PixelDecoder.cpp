@@ -0,0 +1,148 @@
+#include "PixelDecoder.hpp"
+#include "Deflate.hpp"
+#include "Stats.hpp"
+#include "Unfilter.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+uint32_t read_u32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+bool valid_bit_depth(uint8_t color_type, uint8_t bit_depth) {
+    switch (color_type) {
+        case ImageHeader::GRAYSCALE:
+            return bit_depth == 1 || bit_depth == 2 || bit_depth == 4 || bit_depth == 8 || bit_depth == 16;
+        case ImageHeader::INDEXED:
+            return bit_depth == 1 || bit_depth == 2 || bit_depth == 4 || bit_depth == 8;
+        case ImageHeader::TRUECOLOR:
+        case ImageHeader::GRAYSCALE_ALPHA:
+        case ImageHeader::TRUECOLOR_ALPHA:
+            return bit_depth == 8 || bit_depth == 16;
+    }
+    return false;
+}
+
+} // namespace
+
+ImageHeader ImageHeader::parse(std::span<const uint8_t> data)
+{
+    if (data.size() != 13) {
+        throw std::invalid_argument("Invalid IHDR!");
+    }
+    ImageHeader header;
+    header.width = read_u32(data.data());
+    header.height = read_u32(data.data() + 4);
+    header.bit_depth = data[8];
+    header.color_type = data[9];
+    header.compression = data[10];
+    header.filter = data[11];
+    header.interlace = data[12];
+
+    if (header.width == 0 || header.height == 0 || header.width > 0x7fffffff || header.height > 0x7fffffff ||
+        !valid_bit_depth(header.color_type, header.bit_depth) || header.compression != 0 ||
+        header.filter != 0 || header.interlace > 1) {
+        throw std::invalid_argument("Invalid IHDR!");
+    }
+    return header;
+}
+
+size_t ImageHeader::channels() const
+{
+    switch (color_type) {
+        case TRUECOLOR: return 3;
+        case GRAYSCALE_ALPHA: return 2;
+        case TRUECOLOR_ALPHA: return 4;
+        default: return 1;
+    }
+}
+
+size_t ImageHeader::bytes_per_pixel() const
+{
+    return std::max<size_t>(1, channels() * bit_depth / 8);
+}
+
+size_t ImageHeader::row_bytes() const
+{
+    return (uint64_t(width) * channels() * bit_depth + 7) / 8;
+}
+
+PixelDecoder::PixelDecoder(const PNG& png)
+{
+    auto ihdr = png.chunk_by_type(ChunkType::fromStr("IHDR"));
+    if (!ihdr.has_value()) {
+        throw std::invalid_argument("Missing IHDR!");
+    }
+    header_m = ImageHeader::parse(ihdr->data());
+    if (header_m.interlace != 0) {
+        throw std::invalid_argument("Interlaced images are not supported!");
+    }
+
+    for (const Chunk* chunk : png.chunks_by_type(ChunkType::fromStr("IDAT"))) {
+        idat_m.push_back(chunk->data());
+    }
+    if (idat_m.empty()) {
+        throw std::invalid_argument("Missing IDAT!");
+    }
+}
+
+const ImageHeader& PixelDecoder::header() const
+{
+    return header_m;
+}
+
+size_t PixelDecoder::output_size() const
+{
+    return size_t(header_m.height) * header_m.row_bytes();
+}
+
+void PixelDecoder::decode(std::span<uint8_t> out) const
+{
+    if (out.size() < output_size()) {
+        throw std::invalid_argument("Output buffer is too small for the image!");
+    }
+    const size_t row_bytes = header_m.row_bytes();
+    const size_t bpp = header_m.bytes_per_pixel();
+
+    // every row is a filter byte followed by row_bytes of filtered data,
+    // which is copied into place and unfiltered there once complete
+    uint32_t y = 0;
+    size_t filled = 0;
+    bool have_filter = false;
+    uint8_t filter = 0;
+
+    Deflate::decompress_to(idat_m, [&](std::span<const uint8_t> piece) {
+        // unfiltering is timed apart from the inflate around it
+        ScopedTimer timer(Phase::Pixels);
+        while (!piece.empty()) {
+            if (y == header_m.height) {
+                throw std::invalid_argument("Too much image data!");
+            }
+            if (!have_filter) {
+                filter = piece[0];
+                piece = piece.subspan(1);
+                have_filter = true;
+                continue;
+            }
+            uint8_t* row = out.data() + size_t(y) * row_bytes;
+            size_t take = std::min(piece.size(), row_bytes - filled);
+            std::memcpy(row + filled, piece.data(), take);
+            piece = piece.subspan(take);
+            filled += take;
+
+            if (filled == row_bytes) {
+                Unfilter::row(filter, row, y == 0 ? nullptr : row - row_bytes, row_bytes, bpp);
+                y++;
+                filled = 0;
+                have_filter = false;
+            }
+        }
+    });
+
+    if (y != header_m.height) {
+        throw std::invalid_argument("Not enough image data!");
+    }
+}
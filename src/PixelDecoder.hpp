@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "PNG.hpp"
+
+// The fields of an IHDR chunk
+struct ImageHeader {
+    static constexpr uint8_t GRAYSCALE = 0;
+    static constexpr uint8_t TRUECOLOR = 2;
+    static constexpr uint8_t INDEXED = 3;
+    static constexpr uint8_t GRAYSCALE_ALPHA = 4;
+    static constexpr uint8_t TRUECOLOR_ALPHA = 6;
+
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint8_t bit_depth = 0;
+    uint8_t color_type = 0;
+    uint8_t compression = 0;
+    uint8_t filter = 0;
+    uint8_t interlace = 0;
+
+    // Throws std::invalid_argument unless data is a valid 13-byte IHDR
+    static ImageHeader parse(std::span<const uint8_t> data);
+
+    size_t channels() const;
+    // Bytes in a complete pixel, rounded up to 1 for sub-byte depths. This
+    // is the distance filters look back.
+    size_t bytes_per_pixel() const;
+    // Bytes in one unfiltered row
+    size_t row_bytes() const;
+};
+
+// IDAT decoding pipeline: the IDAT chunks' data is read in place as one
+// zlib stream, inflated in pieces and unfiltered row by row straight into
+// the caller's buffer, so memory use beyond the output is a fixed window
+// however big the image is. Pixels come out as stored: rows top to bottom,
+// row_bytes() each, 16-bit samples big-endian, sub-byte samples packed and
+// palette indices not expanded.
+class PixelDecoder {
+private:
+    ImageHeader header_m;
+    std::vector<std::span<const uint8_t>> idat_m;
+
+public:
+    // The PNG must outlive the decoder. Throws std::invalid_argument on a
+    // missing or invalid IHDR, missing IDAT or an interlaced image.
+    explicit PixelDecoder(const PNG& png);
+
+    const ImageHeader& header() const;
+    // Bytes decode() writes
+    size_t output_size() const;
+
+    // Throws std::invalid_argument when out is smaller than output_size(),
+    // or the image data is corrupt or of the wrong size
+    void decode(std::span<uint8_t> out) const;
+};
@@ -0,0 +1,424 @@
+#include "PixelEncoder.hpp"
+#include "Stats.hpp"
+#include "Unfilter.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <latch>
+#include <mutex>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PNGRE_HAVE_X86_SIMD 1
+#else
+#define PNGRE_HAVE_X86_SIMD 0
+#endif
+
+namespace {
+
+// Filtering has no dependency between output bytes, so unlike unfiltering
+// every filter runs 16 bytes per step. SSE2 is part of x86-64, the scalar
+// loops handle the tails and other architectures.
+
+#if PNGRE_HAVE_X86_SIMD
+inline __m128i load(const uint8_t* p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+inline void store(uint8_t* p, __m128i v) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v);
+}
+
+inline __m128i abs16(__m128i v) {
+    return _mm_max_epi16(v, _mm_sub_epi16(_mm_setzero_si128(), v));
+}
+
+// Paeth predictor of 8 pixels' bytes widened to 16 bits
+inline __m128i paeth16(__m128i a, __m128i b, __m128i c) {
+    __m128i pa = abs16(_mm_sub_epi16(b, c));
+    __m128i pb = abs16(_mm_sub_epi16(a, c));
+    __m128i pc = abs16(_mm_add_epi16(_mm_sub_epi16(a, c), _mm_sub_epi16(b, c)));
+    __m128i not_a = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+    __m128i not_b = _mm_cmpgt_epi16(pb, pc);
+    __m128i b_or_c = _mm_or_si128(_mm_andnot_si128(not_b, b), _mm_and_si128(not_b, c));
+    return _mm_or_si128(_mm_andnot_si128(not_a, a), _mm_and_si128(not_a, b_or_c));
+}
+#endif
+
+inline uint8_t paeth_predictor(int a, int b, int c) {
+    int pa = std::abs(b - c);
+    int pb = std::abs(a - c);
+    int pc = std::abs(a + b - 2 * c);
+    if (pa <= pb && pa <= pc) {
+        return uint8_t(a);
+    }
+    return uint8_t(pb <= pc ? b : c);
+}
+
+void sub_filter(const uint8_t* row, size_t length, size_t bpp, uint8_t* out) {
+    size_t i = std::min(bpp, length);
+    std::memcpy(out, row, i);
+#if PNGRE_HAVE_X86_SIMD
+    for (; i + 16 <= length; i += 16) {
+        store(out + i, _mm_sub_epi8(load(row + i), load(row + i - bpp)));
+    }
+#endif
+    for (; i < length; i++) {
+        out[i] = uint8_t(row[i] - row[i - bpp]);
+    }
+}
+
+void up_filter(const uint8_t* row, const uint8_t* prev, size_t length, uint8_t* out) {
+    size_t i = 0;
+#if PNGRE_HAVE_X86_SIMD
+    for (; i + 16 <= length; i += 16) {
+        store(out + i, _mm_sub_epi8(load(row + i), load(prev + i)));
+    }
+#endif
+    for (; i < length; i++) {
+        out[i] = uint8_t(row[i] - prev[i]);
+    }
+}
+
+void average_filter(const uint8_t* row, const uint8_t* prev, size_t length, size_t bpp, uint8_t* out) {
+    size_t i = 0;
+    for (; i < bpp && i < length; i++) {
+        out[i] = uint8_t(row[i] - (prev[i] >> 1));
+    }
+#if PNGRE_HAVE_X86_SIMD
+    const __m128i one = _mm_set1_epi8(1);
+    for (; i + 16 <= length; i += 16) {
+        __m128i a = load(row + i - bpp);
+        __m128i b = load(prev + i);
+        // pavgb rounds up, (a + b) >> 1 rounds down when a + b is odd
+        __m128i average = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+        store(out + i, _mm_sub_epi8(load(row + i), average));
+    }
+#endif
+    for (; i < length; i++) {
+        out[i] = uint8_t(row[i] - ((row[i - bpp] + prev[i]) >> 1));
+    }
+}
+
+void paeth_filter(const uint8_t* row, const uint8_t* prev, size_t length, size_t bpp, uint8_t* out) {
+    size_t i = 0;
+    // nothing to the left, the predictor is always the byte above
+    for (; i < bpp && i < length; i++) {
+        out[i] = uint8_t(row[i] - prev[i]);
+    }
+#if PNGRE_HAVE_X86_SIMD
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= length; i += 16) {
+        __m128i a = load(row + i - bpp);
+        __m128i b = load(prev + i);
+        __m128i c = load(prev + i - bpp);
+        __m128i low = paeth16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero));
+        __m128i high = paeth16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero));
+        store(out + i, _mm_sub_epi8(load(row + i), _mm_packus_epi16(low, high)));
+    }
+#endif
+    for (; i < length; i++) {
+        out[i] = uint8_t(row[i] - paeth_predictor(row[i - bpp], prev[i], prev[i - bpp]));
+    }
+}
+
+// Sum of the bytes' absolute values as signed bytes
+uint64_t filter_cost(const uint8_t* data, size_t length) {
+    uint64_t sum = 0;
+    size_t i = 0;
+#if PNGRE_HAVE_X86_SIMD
+    const __m128i zero = _mm_setzero_si128();
+    __m128i total = zero;
+    for (; i + 16 <= length; i += 16) {
+        __m128i v = load(data + i);
+        __m128i magnitude = _mm_min_epu8(v, _mm_sub_epi8(zero, v));
+        total = _mm_add_epi64(total, _mm_sad_epu8(magnitude, zero));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), total);
+    sum = lanes[0] + lanes[1];
+#endif
+    for (; i < length; i++) {
+        sum += data[i] < 128 ? data[i] : 256 - data[i];
+    }
+    return sum;
+}
+
+uint8_t fixed_filter(FilterStrategy strategy) {
+    switch (strategy) {
+        case FilterStrategy::None: return Unfilter::NONE;
+        case FilterStrategy::Sub: return Unfilter::SUB;
+        case FilterStrategy::Up: return Unfilter::UP;
+        case FilterStrategy::Average: return Unfilter::AVERAGE;
+        case FilterStrategy::Paeth: return Unfilter::PAETH;
+        case FilterStrategy::Adaptive: break;
+    }
+    throw std::invalid_argument("Unknown filter strategy!");
+}
+
+void check_options(const ImageHeader& header, std::span<const uint8_t> pixels, const EncoderOptions& options) {
+    if (pixels.size() < size_t(header.height) * header.row_bytes()) {
+        throw std::invalid_argument("Pixel buffer is too small for the image!");
+    }
+    if (options.level < 0 || options.level > 9) {
+        throw std::invalid_argument("Compression level must be between 0 and 9!");
+    }
+    if (options.idat_size == 0 || options.idat_size > 0x7fffffff) {
+        throw std::invalid_argument("IDAT size must be between 1 and 2^31 - 1 bytes!");
+    }
+}
+
+// Filter byte and filtered data of rows [first, last), one after another
+void filter_rows(const ImageHeader& header, std::span<const uint8_t> pixels, FilterStrategy strategy,
+                 uint32_t first, uint32_t last, uint8_t* out) {
+    const size_t row_bytes = header.row_bytes();
+    const size_t bpp = header.bytes_per_pixel();
+    for (uint32_t y = first; y < last; y++) {
+        const uint8_t* row = pixels.data() + size_t(y) * row_bytes;
+        PixelEncoder::encode_row(strategy, row, y == 0 ? nullptr : row - row_bytes, row_bytes, bpp, out);
+        out += row_bytes + 1;
+    }
+}
+
+void encode_serial(const ImageHeader& header, std::span<const uint8_t> pixels, const EncoderOptions& options,
+                   const Deflate::Sink& sink) {
+    std::vector<uint8_t> filtered(size_t(header.height) * (header.row_bytes() + 1));
+    filter_rows(header, pixels, options.filter, 0, header.height, filtered.data());
+    sink(Deflate::compress(filtered, options.level));
+}
+
+void encode_striped(const ImageHeader& header, std::span<const uint8_t> pixels, const EncoderOptions& options,
+                    ThreadPool& pool, const Deflate::Sink& sink) {
+    const size_t filtered_row = header.row_bytes() + 1;
+    const uint32_t stripe_rows = uint32_t(std::clamp<size_t>(options.stripe_size / filtered_row, 1, header.height));
+    const size_t count = (header.height + stripe_rows - 1) / stripe_rows;
+    if (count < 2 || pool.size() < 2) {
+        encode_serial(header, pixels, options, sink);
+        return;
+    }
+    // rows before a stripe whose filtered bytes cover the deflate window
+    const uint32_t dictionary_rows = uint32_t((Deflate::WINDOW_SIZE + filtered_row - 1) / filtered_row);
+
+    std::vector<Deflate::Piece> pieces(count);
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    std::latch done(count);
+    for (size_t i = 0; i < count; i++) {
+        pool.submit([&, i] {
+            try {
+                uint32_t first = uint32_t(i * stripe_rows);
+                uint32_t last = std::min(header.height, first + stripe_rows);
+                uint32_t primed = first - std::min(first, dictionary_rows);
+
+                std::vector<uint8_t> filtered(size_t(last - primed) * filtered_row);
+                filter_rows(header, pixels, options.filter, primed, last, filtered.data());
+                std::span<const uint8_t> all(filtered);
+                size_t dictionary = size_t(first - primed) * filtered_row;
+                auto data = all.subspan(dictionary);
+
+                Deflate::deflate_raw(all.first(dictionary), data, options.level, i + 1 == count, pieces[i].deflated);
+                pieces[i].adler = Deflate::adler32(1, data.data(), data.size());
+                pieces[i].length = data.size();
+            } catch (...) {
+                std::lock_guard lock(error_mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+            done.count_down();
+        });
+    }
+    done.wait();
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    Deflate::assemble(options.level, pieces, sink);
+}
+
+// Cuts a stream passed in pieces into IDAT chunks of a fixed size
+class IdatCutter {
+private:
+    size_t size_m;
+    std::vector<uint8_t> pending_m;
+
+public:
+    std::vector<Chunk> chunks;
+
+    explicit IdatCutter(size_t size) : size_m(size) {}
+
+    void write(std::span<const uint8_t> bytes) {
+        while (!bytes.empty()) {
+            size_t take = std::min(bytes.size(), size_m - pending_m.size());
+            pending_m.insert(pending_m.end(), bytes.begin(), bytes.begin() + take);
+            bytes = bytes.subspan(take);
+            if (pending_m.size() == size_m) {
+                finish();
+            }
+        }
+    }
+
+    void finish() {
+        if (!pending_m.empty()) {
+            chunks.emplace_back(ChunkType::fromStr("IDAT"), std::move(pending_m));
+            pending_m = {};
+        }
+    }
+};
+
+} // namespace
+
+void PixelEncoder::filter_row(uint8_t filter, const uint8_t* row, const uint8_t* prev, size_t length, size_t bpp, uint8_t* out)
+{
+    switch (filter) {
+        case Unfilter::NONE:
+            std::memcpy(out, row, length);
+            return;
+        case Unfilter::SUB:
+            sub_filter(row, length, bpp, out);
+            return;
+        case Unfilter::UP:
+            // the first row is filtered against zeros
+            if (prev != nullptr) {
+                up_filter(row, prev, length, out);
+            } else {
+                std::memcpy(out, row, length);
+            }
+            return;
+        case Unfilter::AVERAGE:
+            if (prev != nullptr) {
+                average_filter(row, prev, length, bpp, out);
+            } else {
+                size_t i = std::min(bpp, length);
+                std::memcpy(out, row, i);
+                for (; i < length; i++) {
+                    out[i] = uint8_t(row[i] - (row[i - bpp] >> 1));
+                }
+            }
+            return;
+        case Unfilter::PAETH:
+            // with zeros above, Paeth always predicts the left byte
+            if (prev != nullptr) {
+                paeth_filter(row, prev, length, bpp, out);
+            } else {
+                sub_filter(row, length, bpp, out);
+            }
+            return;
+    }
+    throw std::invalid_argument("Invalid filter type!");
+}
+
+uint8_t PixelEncoder::encode_row(FilterStrategy strategy, const uint8_t* row, const uint8_t* prev, size_t length, size_t bpp, uint8_t* out)
+{
+    if (strategy != FilterStrategy::Adaptive) {
+        uint8_t filter = fixed_filter(strategy);
+        out[0] = filter;
+        filter_row(filter, row, prev, length, bpp, out + 1);
+        return filter;
+    }
+
+    // filters every way into a scratch row and keeps the cheapest so far
+    // in out
+    thread_local std::vector<uint8_t> scratch;
+    scratch.resize(length);
+    uint8_t best = Unfilter::NONE;
+    uint64_t best_cost = filter_cost(row, length);
+    std::memcpy(out + 1, row, length);
+    for (uint8_t filter = Unfilter::SUB; filter <= Unfilter::PAETH; filter++) {
+        filter_row(filter, row, prev, length, bpp, scratch.data());
+        uint64_t cost = filter_cost(scratch.data(), length);
+        if (cost < best_cost) {
+            best_cost = cost;
+            best = filter;
+            std::memcpy(out + 1, scratch.data(), length);
+        }
+    }
+    out[0] = best;
+    return best;
+}
+
+std::vector<uint8_t> PixelEncoder::encode(const ImageHeader& header, std::span<const uint8_t> pixels, const EncoderOptions& options)
+{
+    ScopedTimer timer(Phase::Pixels);
+    check_options(header, pixels, options);
+    std::vector<uint8_t> stream;
+    encode_serial(header, pixels, options, [&](std::span<const uint8_t> bytes) {
+        stream.insert(stream.end(), bytes.begin(), bytes.end());
+    });
+    return stream;
+}
+
+std::vector<uint8_t> PixelEncoder::encode(const ImageHeader& header, std::span<const uint8_t> pixels, const EncoderOptions& options, ThreadPool& pool)
+{
+    ScopedTimer timer(Phase::Pixels);
+    check_options(header, pixels, options);
+    std::vector<uint8_t> stream;
+    encode_striped(header, pixels, options, pool, [&](std::span<const uint8_t> bytes) {
+        stream.insert(stream.end(), bytes.begin(), bytes.end());
+    });
+    return stream;
+}
+
+std::vector<Chunk> PixelEncoder::encode_idat(const ImageHeader& header, std::span<const uint8_t> pixels, const EncoderOptions& options)
+{
+    ScopedTimer timer(Phase::Pixels);
+    check_options(header, pixels, options);
+    IdatCutter cutter(options.idat_size);
+    encode_serial(header, pixels, options, [&](std::span<const uint8_t> bytes) { cutter.write(bytes); });
+    cutter.finish();
+    return std::move(cutter.chunks);
+}
+
+std::vector<Chunk> PixelEncoder::encode_idat(const ImageHeader& header, std::span<const uint8_t> pixels, const EncoderOptions& options, ThreadPool& pool)
+{
+    ScopedTimer timer(Phase::Pixels);
+    check_options(header, pixels, options);
+    IdatCutter cutter(options.idat_size);
+    encode_striped(header, pixels, options, pool, [&](std::span<const uint8_t> bytes) { cutter.write(bytes); });
+    cutter.finish();
+    return std::move(cutter.chunks);
+}
+
+PNG PixelEncoder::replace_idat(PNG& png, std::vector<Chunk> idat)
+{
+    const auto idat_type = ChunkType::fromStr("IDAT");
+    std::vector<Chunk> chunks;
+    bool placed = false;
+    for (const auto& chunk : png.chunks()) {
+        if (chunk.chunktype() != idat_type) {
+            chunks.push_back(chunk);
+        } else if (!placed) {
+            chunks.insert(chunks.end(), std::make_move_iterator(idat.begin()), std::make_move_iterator(idat.end()));
+            placed = true;
+        }
+    }
+    if (!placed) {
+        throw std::invalid_argument("Missing IDAT!");
+    }
+    return PNG(std::move(chunks));
+}
+
+std::optional<FilterStrategy> PixelEncoder::parse_strategy(std::string_view name)
+{
+    for (auto strategy : {FilterStrategy::None, FilterStrategy::Sub, FilterStrategy::Up, FilterStrategy::Average,
+                          FilterStrategy::Paeth, FilterStrategy::Adaptive}) {
+        if (name == strategy_name(strategy)) {
+            return strategy;
+        }
+    }
+    return std::nullopt;
+}
+
+const char* PixelEncoder::strategy_name(FilterStrategy strategy)
+{
+    switch (strategy) {
+        case FilterStrategy::None: return "none";
+        case FilterStrategy::Sub: return "sub";
+        case FilterStrategy::Up: return "up";
+        case FilterStrategy::Average: return "average";
+        case FilterStrategy::Paeth: return "paeth";
+        case FilterStrategy::Adaptive: return "adaptive";
+    }
+    return "unknown";
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+#include "Chunk.hpp"
+#include "Deflate.hpp"
+#include "PNG.hpp"
+#include "PixelDecoder.hpp"
+#include "ThreadPool.hpp"
+
+// How PixelEncoder picks the filter of each row
+enum class FilterStrategy {
+    None,     // the fixed strategies filter every row the same way
+    Sub,
+    Up,
+    Average,
+    Paeth,
+    Adaptive  // per row, the filter whose output has the smallest sum of
+              // absolute values as signed bytes, the heuristic the PNG
+              // specification suggests
+};
+
+struct EncoderOptions {
+    // Trades speed for size: None is cheapest, Adaptive usually smallest
+    FilterStrategy filter = FilterStrategy::Adaptive;
+    // Filtered rows gain little from deeper match searches: level 1 is
+    // about ten times faster than 6 for output a tenth larger
+    int level = 1;
+    // Largest IDAT chunk written
+    size_t idat_size = 1024 * 1024;
+    // Filtered bytes per stripe when encoding on a thread pool, rounded
+    // down to whole rows
+    size_t stripe_size = 256 * 1024;
+};
+
+// IDAT encoding, the reverse of PixelDecoder: pixels laid out as
+// PixelDecoder writes them are filtered row by row and deflated into one
+// zlib stream, cut into IDAT chunks.
+//
+// With a thread pool the rows are split into stripes, each filtered and
+// deflated by its own task. A stripe is primed with the filtered tail of
+// the stripe before it as a preset dictionary (re-filtering those rows
+// itself, so stripes never wait on each other) and ends on a sync flush.
+// The pieces and their combined Adler-32 form one ordinary zlib stream,
+// a little larger than the serial one.
+class PixelEncoder {
+public:
+    // Throws std::invalid_argument when pixels is smaller than the image,
+    // or the options are out of range
+    static std::vector<uint8_t> encode(const ImageHeader& header, std::span<const uint8_t> pixels, const EncoderOptions& options);
+    // Stripes on pool, which the caller must not be a task of
+    static std::vector<uint8_t> encode(const ImageHeader& header, std::span<const uint8_t> pixels, const EncoderOptions& options, ThreadPool& pool);
+    // encode() as IDAT chunks of at most options.idat_size bytes, cut as
+    // the stream is assembled
+    static std::vector<Chunk> encode_idat(const ImageHeader& header, std::span<const uint8_t> pixels, const EncoderOptions& options);
+    static std::vector<Chunk> encode_idat(const ImageHeader& header, std::span<const uint8_t> pixels, const EncoderOptions& options, ThreadPool& pool);
+    // Copy of png with its IDAT chunks replaced by idat, where the first
+    // one was
+    static PNG replace_idat(PNG& png, std::vector<Chunk> idat);
+
+    // Applies filter to length bytes of row into out. prev is the row above
+    // or nullptr for the first row, bpp as in Unfilter::row(). Throws
+    // std::invalid_argument on an unknown filter type.
+    static void filter_row(uint8_t filter, const uint8_t* row, const uint8_t* prev, size_t length, size_t bpp, uint8_t* out);
+    // Writes the filter type picked by strategy and the filtered row, so
+    // length + 1 bytes, to out. Returns the filter type.
+    static uint8_t encode_row(FilterStrategy strategy, const uint8_t* row, const uint8_t* prev, size_t length, size_t bpp, uint8_t* out);
+
+    // "none", "sub", "up", "average", "paeth" or "adaptive"
+    static std::optional<FilterStrategy> parse_strategy(std::string_view name);
+    static const char* strategy_name(FilterStrategy strategy);
+};
@@ -0,0 +1,565 @@
+#include "Server.hpp"
+#include "Commands.hpp"
+#include "ParseCache.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+// epoll tags for the two descriptors that aren't connections
+constexpr uint64_t LISTEN_ID = 0;
+constexpr uint64_t EVENT_ID = 1;
+
+constexpr size_t READ_SIZE = 64 * 1024;
+
+constexpr const char* COMMANDS[] = {"encode", "decode", "remove", "print", "other"};
+
+size_t command_index(const std::vector<std::string>& args)
+{
+    for (size_t i = 0; i + 1 < std::size(COMMANDS); i++) {
+        if (!args.empty() && args[0] == COMMANDS[i]) {
+            return i;
+        }
+    }
+    return std::size(COMMANDS) - 1;
+}
+
+sockaddr_un socket_address(const std::string& path)
+{
+    sockaddr_un address{};
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        throw std::invalid_argument("Socket path must be between 1 and " + std::to_string(sizeof(address.sun_path) - 1) + " bytes!");
+    }
+    address.sun_family = AF_UNIX;
+    path.copy(address.sun_path, path.size());
+    return address;
+}
+
+// A socket file nobody accepts on is left over from a server that died
+void remove_stale_socket(const std::string& path, const sockaddr_un& address)
+{
+    struct stat st;
+    if (lstat(path.c_str(), &st) != 0 || !S_ISSOCK(st.st_mode)) {
+        return;
+    }
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    bool live = probe >= 0 && connect(probe, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+    if (probe >= 0) {
+        ::close(probe);
+    }
+    if (live) {
+        throw std::runtime_error("Another server is already listening on " + path);
+    }
+    unlink(path.c_str());
+}
+
+void watch(int epoll_fd, int fd, uint32_t events, uint64_t id)
+{
+    epoll_event event{};
+    event.events = events;
+    event.data.u64 = id;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        throw std::runtime_error("There was an issue starting the server!");
+    }
+}
+
+} // namespace
+
+struct Server::Connection {
+    uint64_t id;
+    int fd;
+    std::vector<uint8_t> input;
+    std::vector<uint8_t> output;
+    size_t output_pos = 0;
+    // a request of this connection is queued or running
+    bool busy = false;
+    // its next request is waiting for room in the queue
+    bool paused = false;
+    // no more requests: the peer shut down its side or sent garbage
+    bool closing = false;
+    uint32_t events = EPOLLIN;
+};
+
+void LatencyHistogram::record(uint64_t microseconds)
+{
+    size_t bucket = std::min<size_t>(std::bit_width(microseconds), BUCKETS - 1);
+    buckets_m[bucket].fetch_add(1, std::memory_order_relaxed);
+    count_m.fetch_add(1, std::memory_order_relaxed);
+    total_us_m.fetch_add(microseconds, std::memory_order_relaxed);
+
+    uint64_t max = max_us_m.load(std::memory_order_relaxed);
+    while (microseconds > max && !max_us_m.compare_exchange_weak(max, microseconds, std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t LatencyHistogram::count() const
+{
+    return count_m.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::quantile_us(double q) const
+{
+    uint64_t total = count();
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t rank = std::clamp<uint64_t>(static_cast<uint64_t>(q * total + 0.999999), 1, total);
+    uint64_t max = max_us_m.load(std::memory_order_relaxed);
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        seen += buckets_m[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            // the maximum is exact, bucket bounds only approximate
+            return std::min<uint64_t>(uint64_t(1) << i, max);
+        }
+    }
+    return max;
+}
+
+void LatencyHistogram::write_json(std::ostream& out) const
+{
+    uint64_t total = count();
+    out << "{\"count\": " << total
+        << ", \"mean_us\": " << (total > 0 ? total_us_m.load(std::memory_order_relaxed) / total : 0)
+        << ", \"p50_us\": " << quantile_us(0.5)
+        << ", \"p90_us\": " << quantile_us(0.9)
+        << ", \"p99_us\": " << quantile_us(0.99)
+        << ", \"max_us\": " << max_us_m.load(std::memory_order_relaxed)
+        << ", \"buckets\": [";
+
+    // trailing empty buckets say nothing
+    size_t used = BUCKETS;
+    while (used > 0 && buckets_m[used - 1].load(std::memory_order_relaxed) == 0) {
+        used--;
+    }
+    for (size_t i = 0; i < used; i++) {
+        out << (i > 0 ? ", " : "") << buckets_m[i].load(std::memory_order_relaxed);
+    }
+    out << "]}";
+}
+
+Server::Server(const std::string& path, const ServerOptions& options)
+    : path_m(path), options_m(options)
+{
+    if (options_m.queue_limit == 0) {
+        throw std::invalid_argument("Server queue limit must be at least 1!");
+    }
+    sockaddr_un address = socket_address(path);
+    remove_stale_socket(path, address);
+
+    try {
+        listen_fd_m = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listen_fd_m < 0 || bind(listen_fd_m, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+            if (listen_fd_m >= 0) {
+                ::close(listen_fd_m);
+                listen_fd_m = -1;
+            }
+            throw std::runtime_error("There was an issue binding " + path);
+        }
+        epoll_fd_m = epoll_create1(EPOLL_CLOEXEC);
+        event_fd_m = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (listen(listen_fd_m, SOMAXCONN) != 0 || epoll_fd_m < 0 || event_fd_m < 0) {
+            throw std::runtime_error("There was an issue starting the server!");
+        }
+        watch(epoll_fd_m, listen_fd_m, EPOLLIN, LISTEN_ID);
+        watch(epoll_fd_m, event_fd_m, EPOLLIN, EVENT_ID);
+    } catch (...) {
+        release();
+        throw;
+    }
+}
+
+Server::~Server()
+{
+    release();
+}
+
+void Server::release()
+{
+    for (auto& [id, connection] : connections_m) {
+        ::close(connection->fd);
+    }
+    connections_m.clear();
+    if (event_fd_m >= 0) {
+        ::close(event_fd_m);
+        event_fd_m = -1;
+    }
+    if (epoll_fd_m >= 0) {
+        ::close(epoll_fd_m);
+        epoll_fd_m = -1;
+    }
+    if (listen_fd_m >= 0) {
+        ::close(listen_fd_m);
+        listen_fd_m = -1;
+        unlink(path_m.c_str());
+    }
+}
+
+void Server::run()
+{
+    ThreadPool pool(options_m.jobs);
+    pool_m = &pool;
+    workers_m = pool.size();
+
+    std::array<epoll_event, 64> events;
+    while (!stopping_m.load()) {
+        int count = epoll_wait(epoll_fd_m, events.data(), events.size(), -1);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("There was an issue waiting for server events!");
+        }
+
+        for (int i = 0; i < count; i++) {
+            uint64_t id = events[i].data.u64;
+            if (id == LISTEN_ID) {
+                accept_all();
+                continue;
+            }
+            if (id == EVENT_ID) {
+                uint64_t value;
+                while (read(event_fd_m, &value, sizeof(value)) > 0) {
+                }
+                finish_completed();
+                continue;
+            }
+
+            // closed earlier in this batch of events
+            auto it = connections_m.find(id);
+            if (it == connections_m.end()) {
+                continue;
+            }
+            Connection& connection = *it->second;
+            uint32_t ready = events[i].events;
+            if ((ready & EPOLLERR) || ((ready & EPOLLHUP) && !(ready & EPOLLIN))) {
+                close(id);
+                continue;
+            }
+            if ((ready & EPOLLIN) && !read_from(connection)) {
+                continue;
+            }
+            progress(connection);
+        }
+    }
+
+    // requests still running finish before the pool goes, their responses
+    // are dropped with the connections
+    pool.wait();
+    pool_m = nullptr;
+}
+
+void Server::stop()
+{
+    stopping_m.store(true);
+    uint64_t one = 1;
+    ssize_t ignored = write(event_fd_m, &one, sizeof(one));
+    (void)ignored;
+}
+
+void Server::accept_all()
+{
+    while (true) {
+        int fd = accept4(listen_fd_m, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            // EAGAIN once the backlog is empty. Out of descriptors the
+            // connection stays in the backlog until one is closed.
+            return;
+        }
+
+        uint64_t id = next_id_m++;
+        auto connection = std::make_unique<Connection>();
+        connection->id = id;
+        connection->fd = fd;
+        try {
+            watch(epoll_fd_m, fd, connection->events, id);
+        } catch (const std::exception&) {
+            ::close(fd);
+            continue;
+        }
+        connections_m.emplace(id, std::move(connection));
+        accepted_m++;
+    }
+}
+
+bool Server::read_from(Connection& connection)
+{
+    // one block per wakeup: epoll is level-triggered, and reading stops as
+    // soon as a whole request is buffered, which bounds the buffer
+    size_t used = connection.input.size();
+    connection.input.resize(used + READ_SIZE);
+    ssize_t count = read(connection.fd, connection.input.data() + used, READ_SIZE);
+    connection.input.resize(used + std::max<ssize_t>(count, 0));
+
+    if (count == 0) {
+        connection.closing = true;
+    } else if (count < 0 && errno != EAGAIN && errno != EINTR) {
+        close(connection.id);
+        return false;
+    }
+    return true;
+}
+
+bool Server::write_to(Connection& connection)
+{
+    while (connection.output_pos < connection.output.size()) {
+        ssize_t count = send(connection.fd, connection.output.data() + connection.output_pos,
+                             connection.output.size() - connection.output_pos, MSG_NOSIGNAL);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) return true;
+            close(connection.id);
+            return false;
+        }
+        connection.output_pos += count;
+    }
+    connection.output.clear();
+    connection.output_pos = 0;
+    return true;
+}
+
+void Server::respond(Connection& connection, const ServerResponse& response)
+{
+    std::vector<uint8_t> frame;
+    try {
+        frame = ServerProtocol::encode_response(response);
+    } catch (const std::exception& e) {
+        frame = ServerProtocol::encode_response({false, "", std::string("Error: ") + e.what() + "\n"});
+    }
+    connection.output.insert(connection.output.end(), frame.begin(), frame.end());
+}
+
+bool Server::dispatch(Connection& connection)
+{
+    auto length = ServerProtocol::frame_length(connection.input);
+    if (!length.has_value()) {
+        return false;
+    }
+    if (*length > ServerProtocol::MAX_FRAME_SIZE) {
+        // the rest of the stream can't be trusted to be framed
+        connection.input.clear();
+        connection.closing = true;
+        respond(connection, {false, "", "Error: Server request is too large!\n"});
+        return true;
+    }
+    size_t frame_size = ServerProtocol::HEADER_SIZE + *length;
+    if (connection.input.size() < frame_size) {
+        return false;
+    }
+
+    std::vector<std::string> args;
+    try {
+        args = ServerProtocol::decode_request(
+            std::span<const uint8_t>(connection.input).subspan(ServerProtocol::HEADER_SIZE, *length));
+    } catch (const std::exception& e) {
+        connection.input.erase(connection.input.begin(), connection.input.begin() + frame_size);
+        respond(connection, {false, "", std::string("Error: ") + e.what() + "\n"});
+        return true;
+    }
+
+    // answered here, so it still gets through when the queue is full
+    if (args.size() == 1 && args[0] == "stats") {
+        connection.input.erase(connection.input.begin(), connection.input.begin() + frame_size);
+        respond(connection, {true, stats_json(), ""});
+        return true;
+    }
+
+    if (in_flight_m >= options_m.queue_limit) {
+        connection.paused = true;
+        paused_m.push_back(connection.id);
+        pauses_m++;
+        return false;
+    }
+
+    connection.input.erase(connection.input.begin(), connection.input.begin() + frame_size);
+    connection.busy = true;
+    in_flight_m++;
+
+    auto start = std::chrono::steady_clock::now();
+    pool_m->submit([this, id = connection.id, args = std::move(args), start] {
+        auto paths = command_paths(args);
+        lock_paths(paths);
+        ServerResponse response = execute(args);
+        unlock_paths(paths);
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        latency_m[command_index(args)].record(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+        {
+            std::lock_guard<std::mutex> lock(completed_mutex_m);
+            completed_m.push_back({id, std::move(response)});
+        }
+        uint64_t one = 1;
+        ssize_t ignored = write(event_fd_m, &one, sizeof(one));
+        (void)ignored;
+    });
+    return false;
+}
+
+void Server::progress(Connection& connection)
+{
+    if (!write_to(connection)) {
+        return;
+    }
+    // requests answered on the spot may follow each other in the buffer,
+    // but only once the previous response has gone out
+    while (!connection.busy && !connection.paused && connection.output.empty() && dispatch(connection)) {
+        if (!write_to(connection)) {
+            return;
+        }
+    }
+
+    if (connection.closing && !connection.busy && !connection.paused && connection.output.empty()) {
+        close(connection.id);
+        return;
+    }
+
+    uint32_t events = 0;
+    if (!connection.busy && !connection.paused && !connection.closing && connection.output.empty()) {
+        events |= EPOLLIN;
+    }
+    if (!connection.output.empty()) {
+        events |= EPOLLOUT;
+    }
+    if (events != connection.events) {
+        epoll_event event{};
+        event.events = events;
+        event.data.u64 = connection.id;
+        epoll_ctl(epoll_fd_m, EPOLL_CTL_MOD, connection.fd, &event);
+        connection.events = events;
+    }
+}
+
+void Server::finish_completed()
+{
+    std::vector<Completion> completed;
+    {
+        std::lock_guard<std::mutex> lock(completed_mutex_m);
+        completed.swap(completed_m);
+    }
+
+    for (auto& completion : completed) {
+        in_flight_m--;
+        auto it = connections_m.find(completion.connection);
+        if (it == connections_m.end()) {
+            // the client hung up while its request ran
+            continue;
+        }
+        it->second->busy = false;
+        respond(*it->second, completion.response);
+        progress(*it->second);
+    }
+
+    while (in_flight_m < options_m.queue_limit && !paused_m.empty()) {
+        auto it = connections_m.find(paused_m.front());
+        paused_m.pop_front();
+        if (it != connections_m.end()) {
+            it->second->paused = false;
+            progress(*it->second);
+        }
+    }
+}
+
+void Server::close(uint64_t id)
+{
+    auto it = connections_m.find(id);
+    if (it == connections_m.end()) {
+        return;
+    }
+    // closing the descriptor also removes it from the epoll set
+    ::close(it->second->fd);
+    connections_m.erase(it);
+}
+
+void Server::lock_paths(const std::vector<CommandPath>& paths)
+{
+    for (const auto& touched : paths) {
+        PathLock* lock;
+        {
+            std::lock_guard<std::mutex> guard(path_locks_mutex_m);
+            lock = &path_locks_m[touched.path];
+            lock->users++;
+        }
+        if (touched.writes) {
+            lock->mutex.lock();
+        } else {
+            lock->mutex.lock_shared();
+        }
+    }
+}
+
+void Server::unlock_paths(const std::vector<CommandPath>& paths)
+{
+    std::lock_guard<std::mutex> guard(path_locks_mutex_m);
+    for (const auto& touched : paths) {
+        auto it = path_locks_m.find(touched.path);
+        if (touched.writes) {
+            it->second.mutex.unlock();
+        } else {
+            it->second.mutex.unlock_shared();
+        }
+        if (--it->second.users == 0) {
+            path_locks_m.erase(it);
+        }
+    }
+}
+
+ServerResponse Server::execute(const std::vector<std::string>& args)
+{
+    std::ostringstream out;
+    std::ostringstream err;
+    ServerResponse response;
+
+    try {
+        if (args.empty()) {
+            throw std::invalid_argument("Empty server request!");
+        }
+        for (const auto& arg : args) {
+            if (arg == "-") {
+                throw std::invalid_argument("stdin/stdout can't be used through the server!");
+            }
+        }
+
+        std::vector<std::string_view> input(args.begin(), args.end());
+        if (!run_command(input, out, err)) {
+            throw std::invalid_argument("Unknown command '" + args[0] + "'");
+        }
+    } catch (const std::exception& e) {
+        response.ok = false;
+        err << "Error: " << e.what() << std::endl;
+    }
+
+    response.out = out.str();
+    response.err = err.str();
+    return response;
+}
+
+std::string Server::stats_json() const
+{
+    std::ostringstream out;
+    out << "{\"connections\": " << connections_m.size()
+        << ", \"accepted\": " << accepted_m
+        << ", \"workers\": " << workers_m
+        << ", \"in_flight\": " << in_flight_m
+        << ", \"queue_limit\": " << options_m.queue_limit
+        << ", \"paused\": " << paused_m.size()
+        << ", \"pauses\": " << pauses_m
+        << ", \"latency\": {";
+    for (size_t i = 0; i < latency_m.size(); i++) {
+        out << (i > 0 ? ", " : "") << "\"" << COMMANDS[i] << "\": ";
+        latency_m[i].write_json(out);
+    }
+    out << "}, \"parse_cache\": ";
+    ParseCache::shared().write_json(out);
+    out << "}\n";
+    return out.str();
+}
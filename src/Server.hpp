@@ -0,0 +1,144 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Commands.hpp"
+#include "ServerProtocol.hpp"
+
+class ThreadPool;
+
+struct ServerOptions {
+    // worker threads, 0 means one per core
+    size_t jobs = 0;
+    // requests queued or running at once. Past it the server stops reading
+    // requests until one finishes, so clients block in write() instead of
+    // the queue growing.
+    size_t queue_limit = 256;
+};
+
+// Request latencies in power-of-two buckets: bucket i counts requests that
+// took less than 2^i microseconds (and at least 2^(i-1)). Recorded lock-free
+// from any worker.
+class LatencyHistogram {
+public:
+    static constexpr size_t BUCKETS = 32;
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKETS> buckets_m{};
+    std::atomic<uint64_t> count_m{0};
+    std::atomic<uint64_t> total_us_m{0};
+    std::atomic<uint64_t> max_us_m{0};
+
+public:
+    void record(uint64_t microseconds);
+
+    uint64_t count() const;
+    // Upper bound of the bucket holding quantile q (0.5 for the median), 0
+    // when nothing was recorded
+    uint64_t quantile_us(double q) const;
+
+    // {"count": ..., "mean_us": ..., "p50_us": ..., "p90_us": ...,
+    //  "p99_us": ..., "max_us": ..., "buckets": [...]}
+    void write_json(std::ostream& out) const;
+};
+
+// `pngre serve`: runs encode/decode/remove/print requests from a Unix domain
+// socket, so callers skip process startup. One epoll thread accepts
+// connections, reads request frames (see ServerProtocol) and writes
+// responses; the commands themselves run on a thread pool. A connection has
+// one request in flight at a time, pipelined ones wait in its buffer.
+// Requests touching the same file (see command_paths) hold a lock on it
+// while they run: shared to read it, exclusive to write it. The request
+// `stats` is answered by the event loop with latency histograms per command
+// and the shared ParseCache's counters as JSON.
+class Server {
+private:
+    struct Connection;
+
+    struct Completion {
+        uint64_t connection;
+        ServerResponse response;
+    };
+
+    // dropped once no request holds or waits for it
+    struct PathLock {
+        std::shared_mutex mutex;
+        size_t users = 0;
+    };
+
+    std::string path_m;
+    ServerOptions options_m;
+    int listen_fd_m = -1;
+    int epoll_fd_m = -1;
+    // wakes the event loop for finished requests and stop()
+    int event_fd_m = -1;
+    std::atomic<bool> stopping_m{false};
+    ThreadPool* pool_m = nullptr;
+    size_t workers_m = 0;
+
+    // only touched by the event loop
+    std::unordered_map<uint64_t, std::unique_ptr<Connection>> connections_m;
+    uint64_t next_id_m = 2;
+    size_t in_flight_m = 0;
+    // connections holding a request that found the queue full, oldest first
+    std::deque<uint64_t> paused_m;
+    uint64_t pauses_m = 0;
+    uint64_t accepted_m = 0;
+
+    std::mutex completed_mutex_m;
+    std::vector<Completion> completed_m;
+
+    std::mutex path_locks_mutex_m;
+    std::unordered_map<std::string, PathLock> path_locks_m;
+
+    // encode, decode, remove, print, then anything else
+    std::array<LatencyHistogram, 5> latency_m;
+
+    void accept_all();
+    // Both return false when they had to close the connection
+    bool read_from(Connection& connection);
+    bool write_to(Connection& connection);
+    void respond(Connection& connection, const ServerResponse& response);
+    // Takes the next buffered request of connection. Returns true when it
+    // was answered on the spot, false when it went to the pool, has to wait
+    // for room in the queue or hasn't fully arrived.
+    bool dispatch(Connection& connection);
+    // Sends what it can, starts what it can and updates what epoll watches
+    // for. May close the connection.
+    void progress(Connection& connection);
+    void finish_completed();
+    void close(uint64_t id);
+    void release();
+
+    // Take and drop the locks on every file of a request, in path order so
+    // requests sharing several files can't deadlock
+    void lock_paths(const std::vector<CommandPath>& paths);
+    void unlock_paths(const std::vector<CommandPath>& paths);
+    ServerResponse execute(const std::vector<std::string>& args);
+    std::string stats_json() const;
+
+public:
+    // Binds and listens on path, replacing a stale socket left there. Clients
+    // can connect as soon as this returns.
+    explicit Server(const std::string& path, const ServerOptions& options = {});
+    // Closes every connection and removes the socket
+    ~Server();
+
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    // Serves until stop(), then waits for running requests to finish
+    void run();
+    // Safe from any thread and from signal handlers
+    void stop();
+};
@@ -0,0 +1,78 @@
+#include "ServerClient.hpp"
+#include <cerrno>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+ServerClient::ServerClient(const std::string& path)
+{
+    sockaddr_un address{};
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        throw std::invalid_argument("Socket path must be between 1 and " + std::to_string(sizeof(address.sun_path) - 1) + " bytes!");
+    }
+    address.sun_family = AF_UNIX;
+    path.copy(address.sun_path, path.size());
+
+    fd_m = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd_m < 0 || connect(fd_m, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        if (fd_m >= 0) {
+            close(fd_m);
+        }
+        throw std::runtime_error("There was an issue connecting to the server at " + path);
+    }
+}
+
+ServerClient::~ServerClient()
+{
+    close(fd_m);
+}
+
+void ServerClient::send_all(const std::vector<uint8_t>& bytes)
+{
+    size_t sent = 0;
+    while (sent < bytes.size()) {
+        ssize_t count = send(fd_m, bytes.data() + sent, bytes.size() - sent, MSG_NOSIGNAL);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("There was an issue sending the server request!");
+        }
+        sent += count;
+    }
+}
+
+void ServerClient::receive(uint8_t* out, size_t size)
+{
+    while (size > 0) {
+        ssize_t count = read(fd_m, out, size);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            throw std::runtime_error("There was an issue reading the server response!");
+        }
+        out += count;
+        size -= count;
+    }
+}
+
+ServerResponse ServerClient::call(const std::vector<std::string>& args)
+{
+    send_all(ServerProtocol::encode_request(args));
+
+    uint8_t header[ServerProtocol::HEADER_SIZE];
+    receive(header, sizeof(header));
+    uint32_t length = *ServerProtocol::frame_length(header);
+    if (length > ServerProtocol::MAX_FRAME_SIZE) {
+        throw std::runtime_error("Server response is too large!");
+    }
+
+    std::vector<uint8_t> body(length);
+    receive(body.data(), body.size());
+    return ServerProtocol::decode_response(body);
+}
+
+std::string ServerClient::stats()
+{
+    return call({"stats"}).out;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "ServerProtocol.hpp"
+
+// Blocking client for `pngre serve`, one connection per client. Paths in
+// requests are resolved by the server, so they should be absolute.
+class ServerClient {
+private:
+    int fd_m = -1;
+
+    void send_all(const std::vector<uint8_t>& bytes);
+    void receive(uint8_t* out, size_t size);
+
+public:
+    explicit ServerClient(const std::string& path);
+    ~ServerClient();
+
+    ServerClient(const ServerClient&) = delete;
+    ServerClient& operator=(const ServerClient&) = delete;
+
+    // Runs one command, written like its CLI arguments, and waits for it:
+    // call({"decode", "/abs/image.png", "TeSt"})
+    ServerResponse call(const std::vector<std::string>& args);
+
+    // Per-command latency histograms and queue state, as JSON
+    std::string stats();
+};
@@ -0,0 +1,98 @@
+#include "ServerProtocol.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+void put_u32(std::vector<uint8_t>& out, uint32_t value)
+{
+    out.push_back(value >> 24);
+    out.push_back(value >> 16);
+    out.push_back(value >> 8);
+    out.push_back(value);
+}
+
+uint32_t get_u32(const uint8_t* p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+// Frame for a body of size bytes, with room reserved for the body
+std::vector<uint8_t> frame(size_t size)
+{
+    if (size > ServerProtocol::MAX_FRAME_SIZE) {
+        throw std::invalid_argument("Server message is too large!");
+    }
+    std::vector<uint8_t> out;
+    out.reserve(ServerProtocol::HEADER_SIZE + size);
+    put_u32(out, size);
+    return out;
+}
+
+} // namespace
+
+std::vector<uint8_t> ServerProtocol::encode_request(const std::vector<std::string>& args)
+{
+    size_t size = 0;
+    for (const auto& arg : args) {
+        if (arg.find('\0') != std::string::npos) {
+            throw std::invalid_argument("Server request arguments can't contain NUL bytes!");
+        }
+        size += arg.size() + 1;
+    }
+
+    auto out = frame(size);
+    for (const auto& arg : args) {
+        out.insert(out.end(), arg.begin(), arg.end());
+        out.push_back(0);
+    }
+    return out;
+}
+
+std::vector<std::string> ServerProtocol::decode_request(std::span<const uint8_t> body)
+{
+    if (!body.empty() && body.back() != 0) {
+        throw std::invalid_argument("Malformed server request!");
+    }
+
+    std::vector<std::string> args;
+    auto start = body.begin();
+    while (start != body.end()) {
+        auto end = std::find(start, body.end(), 0);
+        args.emplace_back(start, end);
+        start = end + 1;
+    }
+    return args;
+}
+
+std::vector<uint8_t> ServerProtocol::encode_response(const ServerResponse& response)
+{
+    auto out = frame(1 + 4 + response.out.size() + response.err.size());
+    out.push_back(response.ok ? 0 : 1);
+    put_u32(out, response.out.size());
+    out.insert(out.end(), response.out.begin(), response.out.end());
+    out.insert(out.end(), response.err.begin(), response.err.end());
+    return out;
+}
+
+ServerResponse ServerProtocol::decode_response(std::span<const uint8_t> body)
+{
+    if (body.size() < 5 || get_u32(body.data() + 1) > body.size() - 5) {
+        throw std::invalid_argument("Malformed server response!");
+    }
+
+    size_t out_size = get_u32(body.data() + 1);
+    ServerResponse response;
+    response.ok = body[0] == 0;
+    response.out.assign(body.begin() + 5, body.begin() + 5 + out_size);
+    response.err.assign(body.begin() + 5 + out_size, body.end());
+    return response;
+}
+
+std::optional<uint32_t> ServerProtocol::frame_length(std::span<const uint8_t> bytes)
+{
+    if (bytes.size() < HEADER_SIZE) {
+        return std::nullopt;
+    }
+    return get_u32(bytes.data());
+}
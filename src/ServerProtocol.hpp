@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+struct ServerResponse {
+    bool ok = true;
+    // what the command wrote to out and err
+    std::string out;
+    std::string err;
+};
+
+// Wire format of `pngre serve`. Every message is a frame: a 4-byte
+// big-endian body length, then the body. A request body is the command's
+// arguments, each followed by a NUL byte, written like the CLI arguments:
+// `decode\0/abs/image.png\0TeSt\0`. A response body is a status byte (0 for
+// success), the 4-byte big-endian length of the output, the output, and the
+// diagnostics up to the end of the frame.
+class ServerProtocol {
+public:
+    static constexpr size_t HEADER_SIZE = 4;
+    // Larger frames are refused as soon as their header arrives
+    static constexpr uint32_t MAX_FRAME_SIZE = 64 * 1024 * 1024;
+
+    static std::vector<uint8_t> encode_request(const std::vector<std::string>& args);
+    static std::vector<std::string> decode_request(std::span<const uint8_t> body);
+    static std::vector<uint8_t> encode_response(const ServerResponse& response);
+    static ServerResponse decode_response(std::span<const uint8_t> body);
+
+    // Body length of the frame at the start of bytes, nullopt until its
+    // header is complete
+    static std::optional<uint32_t> frame_length(std::span<const uint8_t> bytes);
+};
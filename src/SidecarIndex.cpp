@@ -0,0 +1,146 @@
+#include "SidecarIndex.hpp"
+#include "AtomicFile.hpp"
+#include "Crc32.hpp"
+#include "Stats.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr uint8_t MAGIC[] = {'P', 'N', 'G', 'I', 'D', 'X'};
+constexpr uint8_t FLAG_VERIFIED = 0x01;
+
+void put(std::vector<uint8_t>& out, uint64_t value, int bytes)
+{
+    for (int shift = (bytes - 1) * 8; shift >= 0; shift -= 8) {
+        out.push_back(value >> shift);
+    }
+}
+
+uint64_t get(const uint8_t*& p, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value = (value << 8) | *p++;
+    }
+    return value;
+}
+
+} // namespace
+
+std::string SidecarIndex::path_for(const std::string& image_path)
+{
+    return image_path + ".pngidx";
+}
+
+std::vector<uint8_t> SidecarIndex::encode(const FileKey& key, std::span<const IndexedChunk> chunks)
+{
+    std::vector<uint8_t> out;
+    out.reserve(HEADER_SIZE + chunks.size() * ENTRY_SIZE + 4);
+    out.insert(out.end(), std::begin(MAGIC), std::end(MAGIC));
+    put(out, VERSION, 2);
+    put(out, key.size, 8);
+    put(out, static_cast<uint64_t>(key.mtime_ns), 8);
+    put(out, chunks.size(), 4);
+
+    for (const auto& chunk : chunks) {
+        auto type = chunk.chunktype.bytes();
+        out.insert(out.end(), type.begin(), type.end());
+        put(out, chunk.offset, 8);
+        put(out, chunk.length, 4);
+        put(out, chunk.crc, 4);
+        out.push_back(chunk.verified ? FLAG_VERIFIED : 0);
+    }
+    put(out, Crc32::compute(out.data(), out.size()), 4);
+    return out;
+}
+
+std::optional<std::vector<IndexedChunk>> SidecarIndex::decode(std::span<const uint8_t> bytes, const FileKey& key)
+{
+    if (bytes.size() < HEADER_SIZE + 4 || !std::equal(std::begin(MAGIC), std::end(MAGIC), bytes.begin())) {
+        return std::nullopt;
+    }
+
+    const uint8_t* p = bytes.data() + sizeof(MAGIC);
+    uint64_t version = get(p, 2);
+    uint64_t size = get(p, 8);
+    int64_t mtime_ns = static_cast<int64_t>(get(p, 8));
+    uint64_t count = get(p, 4);
+    if (version != VERSION || size != key.size || mtime_ns != key.mtime_ns
+        || bytes.size() != HEADER_SIZE + count * ENTRY_SIZE + 4) {
+        return std::nullopt;
+    }
+
+    const uint8_t* end = bytes.data() + bytes.size() - 4;
+    if (Crc32::compute(bytes.data(), bytes.size() - 4) != get(end, 4)) {
+        return std::nullopt;
+    }
+
+    std::vector<IndexedChunk> chunks;
+    chunks.reserve(count);
+    for (uint64_t i = 0; i < count; i++) {
+        ChunkType chunktype({p[0], p[1], p[2], p[3]});
+        p += 4;
+        uint64_t offset = get(p, 8);
+        uint32_t length = get(p, 4);
+        uint32_t crc = get(p, 4);
+        bool verified = *p++ & FLAG_VERIFIED;
+        // an index pointing past the image can't be trusted either
+        if (!chunktype.is_valid() || offset > size || size - offset < 12 + uint64_t(length)) {
+            return std::nullopt;
+        }
+        chunks.push_back({chunktype, offset, length, crc, verified});
+    }
+    return chunks;
+}
+
+std::optional<std::vector<IndexedChunk>> SidecarIndex::load(const std::string& image_path, const FileKey& key)
+{
+    ScopedTimer timer(Phase::Read);
+    int fd = open(path_for(image_path).c_str(), O_RDONLY | O_CLOEXEC);
+    Stats::add(Counter::Syscalls);
+    if (fd < 0) {
+        return std::nullopt;
+    }
+
+    // decode() checks the size against the chunk count, so a truncated
+    // sidecar is caught there
+    std::vector<uint8_t> bytes;
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        bytes.resize(st.st_size);
+        size_t filled = 0;
+        while (filled < bytes.size()) {
+            ssize_t count = read(fd, bytes.data() + filled, bytes.size() - filled);
+            Stats::add(Counter::Syscalls);
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count <= 0) {
+                break;
+            }
+            filled += count;
+            Stats::add(Counter::BytesRead, count);
+        }
+        bytes.resize(filled);
+    }
+    close(fd);
+    return decode(bytes, key);
+}
+
+void SidecarIndex::remove(const std::string& image_path)
+{
+    unlink(path_for(image_path).c_str());
+    Stats::add(Counter::Syscalls);
+}
+
+void SidecarIndex::write(const std::string& image_path, const FileKey& key, std::span<const IndexedChunk> chunks)
+{
+    auto bytes = encode(key, chunks);
+    AtomicFile output(path_for(image_path));
+    output.write(bytes.data(), bytes.size());
+    output.commit();
+}
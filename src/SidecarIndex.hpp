@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+#include "ChunkIndex.hpp"
+
+// `<image>.pngidx`, written by `pngre index`: the chunk index of an image,
+// so decode and print can go straight to the chunks of a huge file instead
+// of seeking through every header. Big-endian throughout:
+//
+//   magic "PNGIDX", version (2 bytes)
+//   image size (8), image mtime in ns (8), chunk count (4)
+//   per chunk: type (4), offset (8), length (4), CRC (4), flags (1, bit 0
+//              set when the data was verified against the CRC)
+//   CRC-32 of everything above (4)
+//
+// A sidecar whose size or mtime no longer matches the image is stale and
+// ignored. One that matches but points at the wrong chunks (the image was
+// rewritten within the mtime granularity, or its mtime restored) is caught
+// when a chunk's header is read back, and removed.
+class SidecarIndex {
+public:
+    static constexpr uint16_t VERSION = 1;
+    static constexpr size_t HEADER_SIZE = 6 + 2 + 8 + 8 + 4;
+    static constexpr size_t ENTRY_SIZE = 4 + 8 + 4 + 4 + 1;
+
+    static std::string path_for(const std::string& image_path);
+
+    static std::vector<uint8_t> encode(const FileKey& key, std::span<const IndexedChunk> chunks);
+    // The index in bytes if it was written for key, nullopt when it is
+    // stale, truncated or corrupt
+    static std::optional<std::vector<IndexedChunk>> decode(std::span<const uint8_t> bytes, const FileKey& key);
+
+    // Sidecar of image_path, if there is one and it matches key
+    static std::optional<std::vector<IndexedChunk>> load(const std::string& image_path, const FileKey& key);
+    // Deletes the sidecar of image_path, if there is one
+    static void remove(const std::string& image_path);
+    // Replaces the sidecar of image_path atomically
+    static void write(const std::string& image_path, const FileKey& key, std::span<const IndexedChunk> chunks);
+};
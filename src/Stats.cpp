@@ -0,0 +1,193 @@
+#include "Stats.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+// Counts allocations for Stats. Replacing the global allocation functions
+// is the only way to see every one, the disabled cost is the same single
+// load as any other counter.
+void* operator new(size_t size) {
+    Stats::add(Counter::Allocations);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+constexpr Phase PHASES[] = {
+    Phase::Read, Phase::Parse, Phase::Crc, Phase::Deflate, Phase::Pixels, Phase::Serialize, Phase::Write
+};
+constexpr Counter COUNTERS[] = {
+    Counter::BytesRead, Counter::BytesWritten, Counter::ChunksParsed, Counter::CrcBytes, Counter::Allocations,
+    Counter::Syscalls
+};
+
+// printf-style formatting of a double, which ostreams make verbose
+std::string number(double value) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.9g", value);
+    return buffer;
+}
+
+// Command names come from the command line, keep them valid JSON strings
+// and Prometheus label values
+std::string quoted(std::string_view text) {
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += c;
+    }
+    return out + "\"";
+}
+
+void report_text(std::ostream& out, std::string_view command, double wall_seconds) {
+    out << "Stats: " << command << " in " << number(wall_seconds) << " s\n";
+    char line[96];
+    std::snprintf(line, sizeof(line), "  %-14s%14s%10s\n", "phase", "seconds", "calls");
+    out << line;
+    for (auto phase : PHASES) {
+        std::snprintf(line, sizeof(line), "  %-14s%14.6f%10llu\n", Stats::phase_name(phase),
+                      Stats::nanoseconds(phase) / 1e9, static_cast<unsigned long long>(Stats::calls(phase)));
+        out << line;
+    }
+    for (auto counter : COUNTERS) {
+        std::snprintf(line, sizeof(line), "  %-14s%24llu\n", Stats::counter_name(counter),
+                      static_cast<unsigned long long>(Stats::count(counter)));
+        out << line;
+    }
+}
+
+void report_json(std::ostream& out, std::string_view command, double wall_seconds) {
+    out << "{\"command\": " << quoted(command) << ", \"wall_seconds\": " << number(wall_seconds) << ", \"phases\": {";
+    const char* separator = "";
+    for (auto phase : PHASES) {
+        out << separator << "\"" << Stats::phase_name(phase) << "\": {\"seconds\": "
+            << number(Stats::nanoseconds(phase) / 1e9) << ", \"calls\": " << Stats::calls(phase) << "}";
+        separator = ", ";
+    }
+    out << "}, \"counters\": {";
+    separator = "";
+    for (auto counter : COUNTERS) {
+        out << separator << "\"" << Stats::counter_name(counter) << "\": " << Stats::count(counter);
+        separator = ", ";
+    }
+    out << "}}\n";
+}
+
+void report_prometheus(std::ostream& out, std::string_view command, double wall_seconds) {
+    std::string label = "command=" + quoted(command);
+    out << "# HELP pngre_run_seconds Wall time of the run.\n"
+        << "# TYPE pngre_run_seconds gauge\n"
+        << "pngre_run_seconds{" << label << "} " << number(wall_seconds) << "\n";
+    out << "# HELP pngre_phase_seconds_total Time spent in each phase, excluding nested phases.\n"
+        << "# TYPE pngre_phase_seconds_total counter\n";
+    for (auto phase : PHASES) {
+        out << "pngre_phase_seconds_total{" << label << ",phase=\"" << Stats::phase_name(phase) << "\"} "
+            << number(Stats::nanoseconds(phase) / 1e9) << "\n";
+    }
+    out << "# HELP pngre_phase_calls_total Timed sections entered per phase.\n"
+        << "# TYPE pngre_phase_calls_total counter\n";
+    for (auto phase : PHASES) {
+        out << "pngre_phase_calls_total{" << label << ",phase=\"" << Stats::phase_name(phase) << "\"} "
+            << Stats::calls(phase) << "\n";
+    }
+    for (auto counter : COUNTERS) {
+        std::string name = std::string("pngre_") + Stats::counter_name(counter) + "_total";
+        out << "# TYPE " << name << " counter\n" << name << "{" << label << "} " << Stats::count(counter) << "\n";
+    }
+}
+
+} // namespace
+
+void Stats::enable(bool on)
+{
+    enabled_m.store(on, std::memory_order_relaxed);
+}
+
+void Stats::reset()
+{
+    for (size_t i = 0; i < PHASE_COUNT; i++) {
+        phase_ns_m[i].store(0, std::memory_order_relaxed);
+        phase_calls_m[i].store(0, std::memory_order_relaxed);
+    }
+    for (auto& counter : counters_m) {
+        counter.store(0, std::memory_order_relaxed);
+    }
+}
+
+uint64_t Stats::count(Counter counter)
+{
+    return counters_m[static_cast<size_t>(counter)].load(std::memory_order_relaxed);
+}
+
+uint64_t Stats::nanoseconds(Phase phase)
+{
+    return phase_ns_m[static_cast<size_t>(phase)].load(std::memory_order_relaxed);
+}
+
+uint64_t Stats::calls(Phase phase)
+{
+    return phase_calls_m[static_cast<size_t>(phase)].load(std::memory_order_relaxed);
+}
+
+void Stats::report(std::ostream& out, StatsFormat format, std::string_view command, double wall_seconds)
+{
+    switch (format) {
+        case StatsFormat::Text:
+            report_text(out, command, wall_seconds);
+            break;
+        case StatsFormat::Json:
+            report_json(out, command, wall_seconds);
+            break;
+        case StatsFormat::Prometheus:
+            report_prometheus(out, command, wall_seconds);
+            break;
+    }
+    out.flush();
+}
+
+std::optional<StatsFormat> Stats::parse_format(std::string_view name)
+{
+    if (name == "text") return StatsFormat::Text;
+    if (name == "json") return StatsFormat::Json;
+    if (name == "prometheus") return StatsFormat::Prometheus;
+    return std::nullopt;
+}
+
+const char* Stats::phase_name(Phase phase)
+{
+    switch (phase) {
+        case Phase::Read: return "read";
+        case Phase::Parse: return "parse";
+        case Phase::Crc: return "crc";
+        case Phase::Deflate: return "deflate";
+        case Phase::Pixels: return "pixels";
+        case Phase::Serialize: return "serialize";
+        case Phase::Write: return "write";
+    }
+    return "unknown";
+}
+
+const char* Stats::counter_name(Counter counter)
+{
+    switch (counter) {
+        case Counter::BytesRead: return "bytes_read";
+        case Counter::BytesWritten: return "bytes_written";
+        case Counter::ChunksParsed: return "chunks_parsed";
+        case Counter::CrcBytes: return "crc_bytes";
+        case Counter::Allocations: return "allocations";
+        case Counter::Syscalls: return "syscalls";
+    }
+    return "unknown";
+}
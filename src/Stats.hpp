@@ -0,0 +1,123 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string_view>
+
+// Where the time of a run goes. Phases are exclusive: time spent in a
+// phase nested inside another on the same thread (CRC checks while
+// parsing, writes while serializing) only counts for the inner one.
+enum class Phase {
+    Read,       // read() of inputs and payloads, mapping files
+    Parse,      // splitting bytes into chunks
+    Crc,        // verifying chunk CRCs
+    Deflate,    // compressing and inflating, payloads and IDAT alike
+    Pixels,     // filtering and unfiltering rows, LSB payloads
+    Serialize,  // laying chunks out as bytes
+    Write       // write()/writev() of outputs, fsync and rename
+};
+
+enum class Counter {
+    BytesRead,
+    BytesWritten,
+    ChunksParsed,
+    CrcBytes,     // bytes fed through Crc32
+    Allocations,  // operator new calls
+    Syscalls      // reads, writes, maps, syncs and renames made for I/O
+};
+
+enum class StatsFormat {
+    Text,
+    Json,
+    Prometheus  // text exposition format, for a node exporter textfile
+};
+
+// Process-wide instrumentation behind --stats. Everything is compiled in
+// but disabled until enable(true): a disabled counter or timer costs one
+// relaxed atomic load. Counters and phase times add up across threads, so
+// a batch run reports the sum over its workers.
+class Stats {
+private:
+    static constexpr size_t PHASE_COUNT = 7;
+    static constexpr size_t COUNTER_COUNT = 6;
+
+    inline static std::atomic<bool> enabled_m{false};
+    inline static std::array<std::atomic<uint64_t>, PHASE_COUNT> phase_ns_m{};
+    inline static std::array<std::atomic<uint64_t>, PHASE_COUNT> phase_calls_m{};
+    inline static std::array<std::atomic<uint64_t>, COUNTER_COUNT> counters_m{};
+
+public:
+    static bool enabled() {
+        return enabled_m.load(std::memory_order_relaxed);
+    }
+    static void enable(bool on);
+    // Zeroes every counter and phase
+    static void reset();
+
+    static void add(Counter counter, uint64_t amount = 1) {
+        if (enabled()) {
+            counters_m[static_cast<size_t>(counter)].fetch_add(amount, std::memory_order_relaxed);
+        }
+    }
+    static void add_time(Phase phase, uint64_t nanoseconds) {
+        phase_ns_m[static_cast<size_t>(phase)].fetch_add(nanoseconds, std::memory_order_relaxed);
+        phase_calls_m[static_cast<size_t>(phase)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static uint64_t count(Counter counter);
+    static uint64_t nanoseconds(Phase phase);
+    static uint64_t calls(Phase phase);
+
+    // Writes every phase and counter for a run of command that took
+    // wall_seconds
+    static void report(std::ostream& out, StatsFormat format, std::string_view command, double wall_seconds);
+
+    // "text", "json" or "prometheus"
+    static std::optional<StatsFormat> parse_format(std::string_view name);
+    static const char* phase_name(Phase phase);
+    static const char* counter_name(Counter counter);
+};
+
+// Adds the time between construction and destruction to a phase, less the
+// time of timers nested inside it on the same thread. Does nothing when
+// Stats are disabled at construction.
+class ScopedTimer {
+private:
+    inline static thread_local ScopedTimer* current_m = nullptr;
+
+    Phase phase_m;
+    bool active_m;
+    ScopedTimer* parent_m = nullptr;
+    uint64_t nested_ns_m = 0;
+    std::chrono::steady_clock::time_point start_m;
+
+public:
+    explicit ScopedTimer(Phase phase) : phase_m(phase), active_m(Stats::enabled()) {
+        if (active_m) {
+            parent_m = current_m;
+            current_m = this;
+            start_m = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~ScopedTimer() {
+        if (!active_m) {
+            return;
+        }
+        uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start_m).count();
+        Stats::add_time(phase_m, elapsed - std::min(nested_ns_m, elapsed));
+        if (parent_m != nullptr) {
+            parent_m->nested_ns_m += elapsed;
+        }
+        current_m = parent_m;
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+};
@@ -0,0 +1,127 @@
+#include "ThreadPool.hpp"
+
+namespace {
+
+// lets submit() find the deque of the worker it is called from
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_index = 0;
+
+} // namespace
+
+ThreadPool::ThreadPool(size_t threads)
+{
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (size_t i = 0; i < threads; i++) {
+        workers_m.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < threads; i++) {
+        threads_m.emplace_back([this, i] { run(i); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_m);
+        stopping_m = true;
+    }
+    wake_m.notify_all();
+    for (auto& thread : threads_m) {
+        thread.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    size_t index = current_pool == this ? current_index : next_m++ % workers_m.size();
+
+    pending_m++;
+    {
+        std::lock_guard<std::mutex> lock(workers_m[index]->mutex);
+        workers_m[index]->tasks.push_back(std::move(task));
+        queued_m++;
+    }
+    {
+        // pairs with the predicate check in run(), so the wakeup can't be lost
+        std::lock_guard<std::mutex> lock(mutex_m);
+    }
+    wake_m.notify_one();
+}
+
+// Own deque from the front, then steal from the back of the others
+bool ThreadPool::pop(size_t index, std::function<void()>& task)
+{
+    for (size_t i = 0; i < workers_m.size(); i++) {
+        Worker& worker = *workers_m[(index + i) % workers_m.size()];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (worker.tasks.empty()) {
+            continue;
+        }
+        if (i == 0) {
+            task = std::move(worker.tasks.front());
+            worker.tasks.pop_front();
+        } else {
+            task = std::move(worker.tasks.back());
+            worker.tasks.pop_back();
+        }
+        queued_m--;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::run(size_t index)
+{
+    current_pool = this;
+    current_index = index;
+
+    while (true) {
+        std::function<void()> task;
+        if (pop(index, task)) {
+            try {
+                task();
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex_m);
+                if (!error_m) {
+                    error_m = std::current_exception();
+                }
+            }
+            if (--pending_m == 0) {
+                std::lock_guard<std::mutex> lock(mutex_m);
+                idle_m.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_m);
+        wake_m.wait(lock, [this] { return stopping_m || queued_m > 0; });
+        if (stopping_m && queued_m == 0) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex_m);
+    idle_m.wait(lock, [this] { return pending_m == 0; });
+    if (error_m) {
+        auto error = error_m;
+        error_m = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+size_t ThreadPool::size() const
+{
+    return workers_m.size();
+}
+
+ThreadPool& ThreadPool::shared()
+{
+    static ThreadPool pool;
+    return pool;
+}
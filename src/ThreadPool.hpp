@@ -0,0 +1,58 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool. Tasks are spread round-robin over per-worker
+// deques (tasks submitted from a worker stay on its own deque). A worker
+// runs its own tasks oldest first, so work roughly follows submission
+// order, and steals the newest task of another worker when it runs dry.
+class ThreadPool {
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers_m;
+    std::vector<std::thread> threads_m;
+
+    std::mutex mutex_m;
+    std::condition_variable wake_m;
+    std::condition_variable idle_m;
+    std::atomic<size_t> queued_m{0};
+    std::atomic<size_t> pending_m{0};
+    std::atomic<size_t> next_m{0};
+    bool stopping_m = false;
+    std::exception_ptr error_m;
+
+    bool pop(size_t index, std::function<void()>& task);
+    void run(size_t index);
+
+public:
+    // 0 threads means one per core
+    explicit ThreadPool(size_t threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(std::function<void()> task);
+
+    // Blocks until every submitted task has finished, rethrowing the first
+    // exception a task let escape
+    void wait();
+
+    size_t size() const;
+
+    // Process-wide pool with one worker per core, created on first use.
+    // Callers must not block on it from inside one of its own tasks.
+    static ThreadPool& shared();
+};
@@ -0,0 +1,384 @@
+#include "Unfilter.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PNGRE_HAVE_X86_SIMD 1
+#else
+#define PNGRE_HAVE_X86_SIMD 0
+#endif
+
+namespace {
+
+// ----------------------------------------------------------------- scalar
+
+void sub_scalar(uint8_t* row, size_t length, size_t bpp) {
+    for (size_t i = bpp; i < length; i++) {
+        row[i] = uint8_t(row[i] + row[i - bpp]);
+    }
+}
+
+void up_scalar(uint8_t* row, const uint8_t* prev, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        row[i] = uint8_t(row[i] + prev[i]);
+    }
+}
+
+void average_scalar(uint8_t* row, const uint8_t* prev, size_t length, size_t bpp) {
+    size_t i = 0;
+    for (; i < bpp && i < length; i++) {
+        row[i] = uint8_t(row[i] + (prev[i] >> 1));
+    }
+    for (; i < length; i++) {
+        row[i] = uint8_t(row[i] + ((row[i - bpp] + prev[i]) >> 1));
+    }
+}
+
+// Average with an all-zero row above
+void average_first_row(uint8_t* row, size_t length, size_t bpp) {
+    for (size_t i = bpp; i < length; i++) {
+        row[i] = uint8_t(row[i] + (row[i - bpp] >> 1));
+    }
+}
+
+inline uint8_t paeth_predictor(int a, int b, int c) {
+    int pa = std::abs(b - c);
+    int pb = std::abs(a - c);
+    int pc = std::abs(a + b - 2 * c);
+    if (pa <= pb && pa <= pc) {
+        return uint8_t(a);
+    }
+    return uint8_t(pb <= pc ? b : c);
+}
+
+void paeth_scalar(uint8_t* row, const uint8_t* prev, size_t length, size_t bpp) {
+    size_t i = 0;
+    // nothing to the left, the predictor is always the byte above
+    for (; i < bpp && i < length; i++) {
+        row[i] = uint8_t(row[i] + prev[i]);
+    }
+    for (; i < length; i++) {
+        row[i] = uint8_t(row[i] + paeth_predictor(row[i - bpp], prev[i], prev[i - bpp]));
+    }
+}
+
+struct Kernels {
+    void (*sub)(uint8_t* row, size_t length, size_t bpp);
+    void (*up)(uint8_t* row, const uint8_t* prev, size_t length);
+    void (*average)(uint8_t* row, const uint8_t* prev, size_t length, size_t bpp);
+    void (*paeth)(uint8_t* row, const uint8_t* prev, size_t length, size_t bpp);
+};
+
+constexpr Kernels SCALAR_KERNELS = {sub_scalar, up_scalar, average_scalar, paeth_scalar};
+
+#if PNGRE_HAVE_X86_SIMD
+
+// ------------------------------------------------------------------ x86
+//
+// Pixels of BPP bytes sit in the low lanes of a vector. Loads and stores
+// only touch the pixel's own bytes, so no row needs padding, and go
+// straight between memory and registers: a round trip through a stack
+// buffer would stall store forwarding on every pixel.
+
+template <size_t BPP>
+inline __m128i load_pixel(const uint8_t* p) {
+    if constexpr (BPP == 8) {
+        return _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+    }
+    uint32_t low;
+    if constexpr (BPP == 3) {
+        uint16_t pair;
+        std::memcpy(&pair, p, 2);
+        low = pair | (uint32_t(p[2]) << 16);
+    } else {
+        std::memcpy(&low, p, 4);
+    }
+    if constexpr (BPP == 6) {
+        uint16_t high;
+        std::memcpy(&high, p + 4, 2);
+        return _mm_unpacklo_epi32(_mm_cvtsi32_si128(int(low)), _mm_cvtsi32_si128(high));
+    }
+    return _mm_cvtsi32_si128(int(low));
+}
+
+template <size_t BPP>
+inline void store_pixel(uint8_t* p, __m128i v) {
+    if constexpr (BPP == 8) {
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(p), v);
+        return;
+    }
+    uint32_t low = uint32_t(_mm_cvtsi128_si32(v));
+    if constexpr (BPP == 3) {
+        std::memcpy(p, &low, 2);
+        p[2] = uint8_t(low >> 16);
+    } else {
+        std::memcpy(p, &low, 4);
+    }
+    if constexpr (BPP == 6) {
+        uint16_t high = uint16_t(_mm_cvtsi128_si32(_mm_srli_si128(v, 4)));
+        std::memcpy(p + 4, &high, 2);
+    }
+}
+
+// Runs kernel<BPP> for the pixel sizes the vector code handles, and the
+// scalar fallback for 1 and 2 byte pixels
+#define PNGRE_DISPATCH_BPP(kernel, fallback, ...)            \
+    switch (bpp) {                                           \
+        case 3: kernel<3>(__VA_ARGS__); break;               \
+        case 4: kernel<4>(__VA_ARGS__); break;               \
+        case 6: kernel<6>(__VA_ARGS__); break;               \
+        case 8: kernel<8>(__VA_ARGS__); break;               \
+        default: fallback; break;                            \
+    }
+
+template <size_t BPP>
+void sub_sse2_bpp(uint8_t* row, size_t length) {
+    __m128i a = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + BPP <= length; i += BPP) {
+        a = _mm_add_epi8(load_pixel<BPP>(row + i), a);
+        store_pixel<BPP>(row + i, a);
+    }
+    for (; i < length; i++) {
+        row[i] = uint8_t(row[i] + row[i - BPP]);
+    }
+}
+
+void sub_sse2(uint8_t* row, size_t length, size_t bpp) {
+    PNGRE_DISPATCH_BPP(sub_sse2_bpp, sub_scalar(row, length, bpp), row, length)
+}
+
+void up_sse2(uint8_t* row, const uint8_t* prev, size_t length) {
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(row + i), _mm_add_epi8(x, b));
+    }
+    up_scalar(row + i, prev + i, length - i);
+}
+
+// floor((a + b) / 2) per byte: pavgb rounds up, so take the odd bit back
+inline __m128i average_bytes(__m128i a, __m128i b) {
+    __m128i odd = _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1));
+    return _mm_sub_epi8(_mm_avg_epu8(a, b), odd);
+}
+
+template <size_t BPP>
+void average_sse2_bpp(uint8_t* row, const uint8_t* prev, size_t length) {
+    __m128i a = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + BPP <= length; i += BPP) {
+        __m128i b = load_pixel<BPP>(prev + i);
+        a = _mm_add_epi8(load_pixel<BPP>(row + i), average_bytes(a, b));
+        store_pixel<BPP>(row + i, a);
+    }
+    for (; i < length; i++) {
+        row[i] = uint8_t(row[i] + ((row[i - BPP] + prev[i]) >> 1));
+    }
+}
+
+void average_sse2(uint8_t* row, const uint8_t* prev, size_t length, size_t bpp) {
+    PNGRE_DISPATCH_BPP(average_sse2_bpp, average_scalar(row, prev, length, bpp), row, prev, length)
+}
+
+// Paeth on 16-bit lanes: a is left, b above, c above left. The predictor is
+// a where |b - c| is smallest, else b where |a - c| is, else c. With
+// SSE2 only, abs is max(x, -x) and the selects are and/andnot/or.
+inline __m128i abs_epi16_sse2(__m128i x) {
+    return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+inline __m128i select_sse2(__m128i mask, __m128i yes, __m128i no) {
+    return _mm_or_si128(_mm_and_si128(mask, yes), _mm_andnot_si128(mask, no));
+}
+
+template <size_t BPP>
+void paeth_sse2_bpp(uint8_t* row, const uint8_t* prev, size_t length) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a = zero;
+    __m128i c = zero;
+    size_t i = 0;
+    for (; i + BPP <= length; i += BPP) {
+        __m128i b = _mm_unpacklo_epi8(load_pixel<BPP>(prev + i), zero);
+        __m128i b_minus_c = _mm_sub_epi16(b, c);
+        __m128i a_minus_c = _mm_sub_epi16(a, c);
+        __m128i pa = abs_epi16_sse2(b_minus_c);
+        __m128i pb = abs_epi16_sse2(a_minus_c);
+        __m128i pc = abs_epi16_sse2(_mm_add_epi16(b_minus_c, a_minus_c));
+        __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+        __m128i predictor = select_sse2(_mm_cmpeq_epi16(smallest, pa), a,
+                                        select_sse2(_mm_cmpeq_epi16(smallest, pb), b, c));
+        __m128i x = _mm_add_epi8(load_pixel<BPP>(row + i), _mm_packus_epi16(predictor, predictor));
+        store_pixel<BPP>(row + i, x);
+        a = _mm_unpacklo_epi8(x, zero);
+        c = b;
+    }
+    for (; i < length; i++) {
+        row[i] = uint8_t(row[i] + paeth_predictor(row[i - BPP], prev[i], prev[i - BPP]));
+    }
+}
+
+void paeth_sse2(uint8_t* row, const uint8_t* prev, size_t length, size_t bpp) {
+    PNGRE_DISPATCH_BPP(paeth_sse2_bpp, paeth_scalar(row, prev, length, bpp), row, prev, length)
+}
+
+constexpr Kernels SSE2_KERNELS = {sub_sse2, up_sse2, average_sse2, paeth_sse2};
+
+// AVX2 machines also have SSSE3 pabsw and SSE4.1 pblendvb, which take the
+// emulation out of the Paeth loop
+
+__attribute__((target("avx2")))
+void up_avx2(uint8_t* row, const uint8_t* prev, size_t length) {
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prev + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(row + i), _mm256_add_epi8(x, b));
+    }
+    up_sse2(row + i, prev + i, length - i);
+}
+
+template <size_t BPP>
+__attribute__((target("avx2")))
+void paeth_avx2_bpp(uint8_t* row, const uint8_t* prev, size_t length) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a = zero;
+    __m128i c = zero;
+    size_t i = 0;
+    for (; i + BPP <= length; i += BPP) {
+        __m128i b = _mm_cvtepu8_epi16(load_pixel<BPP>(prev + i));
+        __m128i b_minus_c = _mm_sub_epi16(b, c);
+        __m128i a_minus_c = _mm_sub_epi16(a, c);
+        __m128i pa = _mm_abs_epi16(b_minus_c);
+        __m128i pb = _mm_abs_epi16(a_minus_c);
+        __m128i pc = _mm_abs_epi16(_mm_add_epi16(b_minus_c, a_minus_c));
+        __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+        __m128i predictor = _mm_blendv_epi8(_mm_blendv_epi8(c, b, _mm_cmpeq_epi16(smallest, pb)), a,
+                                            _mm_cmpeq_epi16(smallest, pa));
+        __m128i x = _mm_add_epi8(load_pixel<BPP>(row + i), _mm_packus_epi16(predictor, predictor));
+        store_pixel<BPP>(row + i, x);
+        a = _mm_cvtepu8_epi16(x);
+        c = b;
+    }
+    for (; i < length; i++) {
+        row[i] = uint8_t(row[i] + paeth_predictor(row[i - BPP], prev[i], prev[i - BPP]));
+    }
+}
+
+__attribute__((target("avx2")))
+void paeth_avx2(uint8_t* row, const uint8_t* prev, size_t length, size_t bpp) {
+    PNGRE_DISPATCH_BPP(paeth_avx2_bpp, paeth_scalar(row, prev, length, bpp), row, prev, length)
+}
+
+constexpr Kernels AVX2_KERNELS = {sub_sse2, up_avx2, average_sse2, paeth_avx2};
+
+#undef PNGRE_DISPATCH_BPP
+
+bool cpu_has_avx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+#else
+bool cpu_has_avx2() {
+    return false;
+}
+#endif
+
+const Kernels& kernels_for(UnfilterEngine engine) {
+    switch (engine) {
+        case UnfilterEngine::Scalar: return SCALAR_KERNELS;
+#if PNGRE_HAVE_X86_SIMD
+        case UnfilterEngine::Sse2: return SSE2_KERNELS;
+        case UnfilterEngine::Avx2: if (cpu_has_avx2()) return AVX2_KERNELS; break;
+#else
+        case UnfilterEngine::Sse2: break;
+        case UnfilterEngine::Avx2: break;
+#endif
+    }
+    throw std::invalid_argument("Unfilter engine not supported on this CPU!");
+}
+
+UnfilterEngine detect_engine() {
+    if (cpu_has_avx2()) {
+        return UnfilterEngine::Avx2;
+    }
+    return PNGRE_HAVE_X86_SIMD ? UnfilterEngine::Sse2 : UnfilterEngine::Scalar;
+}
+
+std::atomic<UnfilterEngine>& active_engine() {
+    static std::atomic<UnfilterEngine> engine{detect_engine()};
+    return engine;
+}
+
+void unfilter_with(const Kernels& kernels, uint8_t filter, uint8_t* row, const uint8_t* prev, size_t length, size_t bpp) {
+    switch (filter) {
+        case Unfilter::NONE:
+            return;
+        case Unfilter::SUB:
+            kernels.sub(row, length, bpp);
+            return;
+        case Unfilter::UP:
+            // the first row is filtered against zeros
+            if (prev != nullptr) {
+                kernels.up(row, prev, length);
+            }
+            return;
+        case Unfilter::AVERAGE:
+            if (prev != nullptr) {
+                kernels.average(row, prev, length, bpp);
+            } else {
+                average_first_row(row, length, bpp);
+            }
+            return;
+        case Unfilter::PAETH:
+            // with zeros above, Paeth always predicts the left byte
+            if (prev != nullptr) {
+                kernels.paeth(row, prev, length, bpp);
+            } else {
+                kernels.sub(row, length, bpp);
+            }
+            return;
+    }
+    throw std::invalid_argument("Invalid filter type!");
+}
+
+} // namespace
+
+void Unfilter::row(uint8_t filter, uint8_t* row, const uint8_t* prev, size_t length, size_t bpp) {
+    unfilter_with(kernels_for(engine()), filter, row, prev, length, bpp);
+}
+
+void Unfilter::row_with(UnfilterEngine engine, uint8_t filter, uint8_t* row, const uint8_t* prev, size_t length, size_t bpp) {
+    unfilter_with(kernels_for(engine), filter, row, prev, length, bpp);
+}
+
+UnfilterEngine Unfilter::engine() {
+    return active_engine().load(std::memory_order_relaxed);
+}
+
+void Unfilter::set_engine(UnfilterEngine engine) {
+    kernels_for(engine);
+    active_engine().store(engine);
+}
+
+bool Unfilter::is_supported(UnfilterEngine engine) {
+    switch (engine) {
+        case UnfilterEngine::Scalar: return true;
+        case UnfilterEngine::Sse2: return PNGRE_HAVE_X86_SIMD;
+        case UnfilterEngine::Avx2: return cpu_has_avx2();
+    }
+    return false;
+}
+
+const char* Unfilter::engine_name(UnfilterEngine engine) {
+    switch (engine) {
+        case UnfilterEngine::Scalar: return "scalar";
+        case UnfilterEngine::Sse2: return "sse2";
+        case UnfilterEngine::Avx2: return "avx2";
+    }
+    return "unknown";
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// PNG row unfiltering kernels. Every engine reverses the same five filters
+// (None, Sub, Up, Average, Paeth), they only differ in speed. Sub, Average
+// and Paeth depend on the pixel to the left, so the vector engines work a
+// whole pixel (3 to 8 bytes) per step; images with 1 or 2 byte pixels use
+// the scalar code for those filters.
+enum class UnfilterEngine {
+    Scalar,  // one byte per step
+    Sse2,    // one pixel per step in SSE2, 16 bytes per step for Up
+    Avx2     // one pixel per step with SSSE3/SSE4.1 abs and blend (VEX
+             // encoded), 32 bytes per step for Up
+};
+
+class Unfilter {
+public:
+    static constexpr uint8_t NONE = 0;
+    static constexpr uint8_t SUB = 1;
+    static constexpr uint8_t UP = 2;
+    static constexpr uint8_t AVERAGE = 3;
+    static constexpr uint8_t PAETH = 4;
+
+    // Reverses filter on length bytes of row in place. prev is the row
+    // above, already unfiltered, or nullptr for the first row of an image.
+    // bpp is the number of bytes in a complete pixel, at least 1. Throws
+    // std::invalid_argument on an unknown filter type.
+    static void row(uint8_t filter, uint8_t* row, const uint8_t* prev, size_t length, size_t bpp);
+
+    // Same as row(), but forces a specific engine
+    static void row_with(UnfilterEngine engine, uint8_t filter, uint8_t* row, const uint8_t* prev, size_t length, size_t bpp);
+
+    // Engine used by row(). Picked once at startup from CPUID.
+    static UnfilterEngine engine();
+
+    // Overrides the active engine, throws if the CPU does not support it
+    static void set_engine(UnfilterEngine engine);
+
+    static bool is_supported(UnfilterEngine engine);
+    static const char* engine_name(UnfilterEngine engine);
+};
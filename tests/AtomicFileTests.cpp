@@ -0,0 +1,142 @@
+#include "test_macro.hpp"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// AtomicFile tests
+std::vector<uint8_t> read_temp_file(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+size_t count_temp_siblings(const std::string& path) {
+    auto name = "." + std::filesystem::path(path).filename().string() + ".";
+    size_t count = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(std::filesystem::path(path).parent_path())) {
+        if (entry.path().filename().string().rfind(name, 0) == 0) count++;
+    }
+    return count;
+}
+
+void test_atomic_file_commit() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    auto source = write_temp_file("atomic_source.png", png_data);
+    auto path = write_temp_file("atomic_commit.png", {1, 2, 3});
+
+    int fd = open(source.c_str(), O_RDONLY);
+    {
+        AtomicFile output(path);
+        output.copy_range(fd, 0, 100);
+        output.write(png_data.data() + 100, 50);
+        output.copy_range(fd, 150, png_data.size() - 150);
+
+        // nothing is visible before commit
+        assert(read_temp_file(path) == std::vector<uint8_t>({1, 2, 3}));
+        output.commit();
+        assert(output.bytes_written() == png_data.size());
+    }
+    close(fd);
+
+    assert(read_temp_file(path) == png_data);
+    assert(count_temp_siblings(path) == 0);
+    std::filesystem::remove(source);
+    std::filesystem::remove(path);
+}
+
+void test_atomic_file_permissions() {
+    auto path = (std::filesystem::temp_directory_path() / "pngre_atomic_mode.png").string();
+    std::filesystem::remove(path);
+    uint8_t data[] = {4, 5, 6, 7};
+
+    // a new file gets 0666 minus the umask
+    mode_t old_umask = umask(077);
+    {
+        AtomicFile output(path);
+        output.write(data, sizeof(data));
+        output.commit();
+    }
+    umask(old_umask);
+    struct stat st;
+    assert(stat(path.c_str(), &st) == 0 && (st.st_mode & 07777) == 0600);
+
+    // a replaced file keeps its mode
+    chmod(path.c_str(), 0640);
+    {
+        AtomicFile output(path);
+        output.write(data, sizeof(data));
+        output.commit();
+    }
+    assert(stat(path.c_str(), &st) == 0 && (st.st_mode & 07777) == 0640);
+    std::filesystem::remove(path);
+}
+
+void test_atomic_file_discard() {
+    auto path = write_temp_file("atomic_discard.png", {1, 2, 3});
+    {
+        AtomicFile output(path);
+        uint8_t data[] = {4, 5, 6, 7};
+        output.write(data, sizeof(data));
+        // destroyed without commit, e.g. by an exception
+    }
+    assert(read_temp_file(path) == std::vector<uint8_t>({1, 2, 3}));
+    assert(count_temp_siblings(path) == 0);
+    std::filesystem::remove(path);
+}
+
+void test_atomic_file_through_symlink() {
+    auto directory = std::filesystem::temp_directory_path() / "pngre_atomic_target";
+    std::filesystem::create_directories(directory);
+    auto target = (directory / "target.png").string();
+    {
+        std::ofstream file(target, std::ios::binary);
+        file.write("old", 3);
+    }
+    auto link = (std::filesystem::temp_directory_path() / "pngre_atomic_link.png").string();
+    std::filesystem::remove(link);
+    std::filesystem::create_symlink(target, link);
+
+    {
+        AtomicFile output(link);
+        uint8_t data[] = {4, 5, 6, 7};
+        output.write(data, sizeof(data));
+        // the temporary file sits next to the target, not the link
+        assert(count_temp_siblings(target) == 1);
+        output.commit();
+    }
+
+    assert(std::filesystem::is_symlink(link));
+    assert(read_temp_file(target) == std::vector<uint8_t>({4, 5, 6, 7}));
+    assert(count_temp_siblings(target) == 0);
+    std::filesystem::remove(link);
+    std::filesystem::remove_all(directory);
+}
+
+void test_atomic_file_non_regular() {
+    auto path = (std::filesystem::temp_directory_path() / "pngre_atomic_fifo").string();
+    std::filesystem::remove(path);
+    assert(mkfifo(path.c_str(), 0600) == 0);
+    // a reader has to be there for the writer to open without blocking
+    int reader = open(path.c_str(), O_RDONLY | O_NONBLOCK);
+    assert(reader >= 0);
+
+    uint8_t data[] = {4, 5, 6, 7};
+    {
+        AtomicFile output(path);
+        output.write(data, sizeof(data));
+        output.commit();
+    }
+    uint8_t read_back[sizeof(data)];
+    assert(read(reader, read_back, sizeof(read_back)) == sizeof(read_back));
+    assert(std::equal(std::begin(data), std::end(data), std::begin(read_back)));
+    close(reader);
+    assert(std::filesystem::is_fifo(path));
+    assert(count_temp_siblings(path) == 0);
+    std::filesystem::remove(path);
+
+    {
+        AtomicFile output("/dev/null");
+        output.write(data, sizeof(data));
+        output.commit();
+    }
+    assert(std::filesystem::is_character_file("/dev/null"));
+}
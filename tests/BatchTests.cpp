@@ -0,0 +1,120 @@
+#include "test_macro.hpp"
+
+// Batch tests
+void test_batch_split_line() {
+    auto args = Batch::split_line("encode  image.png TeSt \"a secret \\\"message\\\"\"");
+    assert(args.size() == 4);
+    assert(args[0] == "encode");
+    assert(args[1] == "image.png");
+    assert(args[3] == "a secret \"message\"");
+    assert(Batch::split_line("   ").empty());
+}
+
+void test_batch_run_ordered() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    std::vector<std::string> paths;
+    std::string manifest = "# comment\n";
+    for (int i = 0; i < 8; i++) {
+        paths.push_back(write_temp_file("batch_" + std::to_string(i) + ".png", png_data));
+        manifest += "decode " + paths.back() + " RuSt\n";
+    }
+    manifest += "decode /nonexistent/file.png RuSt\n";
+
+    BatchOptions options;
+    options.jobs = 4;
+    std::istringstream in(manifest);
+    std::ostringstream out;
+    std::ostringstream err;
+    BatchReport report = Batch::run(in, options, out, err);
+
+    assert(report.operations == 9);
+    assert(report.failed == 1);
+    assert(report.bytes == 8 * png_data.size());
+    assert(err.str().rfind("line 10: ", 0) == 0);
+
+    std::string expected;
+    for (int i = 0; i < 8; i++) {
+        expected += "Decoded: hey\n";
+    }
+    assert(out.str() == expected);
+
+    for (const auto& path : paths) {
+        std::filesystem::remove(path);
+    }
+}
+
+void test_batch_op_template() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    auto path = write_temp_file("batch template.png", png_data);
+
+    BatchOptions options;
+    options.op_template = {"decode", "RuSt"};
+    std::istringstream in(path + "\n" + path + "\n");
+    std::ostringstream out;
+    std::ostringstream err;
+    BatchReport report = Batch::run(in, options, out, err);
+
+    assert(report.operations == 2);
+    assert(report.failed == 0);
+    assert(out.str() == "Decoded: hey\nDecoded: hey\n");
+    std::filesystem::remove(path);
+}
+
+void test_batch_same_file_in_order() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    auto path = write_temp_file("batch_same_file.png", png_data);
+    auto other = write_temp_file("batch_other_file.png", png_data);
+
+    std::string manifest;
+    for (int i = 0; i < 40; i++) {
+        manifest += "encode " + path + " TeSt message" + std::to_string(i) + "\n";
+        manifest += "decode " + other + " RuSt\n";
+    }
+
+    BatchOptions options;
+    options.jobs = 8;
+    std::istringstream in(manifest);
+    std::ostringstream out;
+    std::ostringstream err;
+    BatchReport report = Batch::run(in, options, out, err);
+
+    assert(report.failed == 0);
+    assert(err.str().empty());
+    // every encode landed, in manifest order
+    PNG png{PNGFile(path)};
+    auto chunks = png.chunks_by_type(ChunkType::fromStr("TeSt"));
+    assert(chunks.size() == 40);
+    for (size_t i = 0; i < chunks.size(); i++) {
+        assert(chunks[i]->data_as_string() == "message" + std::to_string(i));
+    }
+    std::filesystem::remove(path);
+    std::filesystem::remove(other);
+}
+
+void test_batch_new_output_in_order() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    auto path = write_temp_file("batch_source.png", png_data);
+    auto output = (std::filesystem::temp_directory_path() / "pngre_batch_new.png").string();
+    std::filesystem::remove(output);
+
+    // the output doesn't exist when the manifest is grouped, the decode
+    // reading it must still wait for the encode
+    std::string manifest;
+    for (int i = 0; i < 200; i++) {
+        manifest += "print " + path + "\n";
+    }
+    manifest += "encode " + path + " ruSt hello " + output + "\n";
+    manifest += "decode " + output + " ruSt\n";
+
+    BatchOptions options;
+    options.jobs = 4;
+    std::istringstream in(manifest);
+    std::ostringstream out;
+    std::ostringstream err;
+    BatchReport report = Batch::run(in, options, out, err);
+
+    assert(report.failed == 0);
+    assert(out.str().ends_with("Decoded: hello\n"));
+    std::filesystem::remove(path);
+    std::filesystem::remove(output);
+}
@@ -0,0 +1,56 @@
+#include "test_macro.hpp"
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+
+// ByteSink tests
+void test_fd_sink_batches_pieces() {
+    // more pieces than a single writev() accepts
+    size_t count = IOV_MAX * 2 + 7;
+    std::vector<uint8_t> bytes(count * 3);
+    for (size_t i = 0; i < bytes.size(); i++) {
+        bytes[i] = static_cast<uint8_t>(i * 31);
+    }
+    std::vector<iovec> pieces;
+    for (size_t i = 0; i < count; i++) {
+        // include empty pieces, which must simply be skipped
+        pieces.push_back({bytes.data() + i * 3, 3});
+        pieces.push_back({bytes.data(), 0});
+    }
+
+    auto path = write_temp_file("byte_sink.bin", {});
+    int fd = open(path.c_str(), O_WRONLY | O_TRUNC);
+    FdSink sink(fd);
+    sink.writev(pieces.data(), pieces.size());
+    sink.write(bytes.data(), 5);
+    close(fd);
+
+    assert(sink.bytes_written() == bytes.size() + 5);
+    auto written = read_temp_file(path);
+    assert(std::equal(bytes.begin(), bytes.end(), written.begin()));
+    assert(std::equal(bytes.begin(), bytes.begin() + 5, written.begin() + bytes.size()));
+    std::filesystem::remove(path);
+}
+
+void test_png_write_to_fd() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    PNG png(png_data);
+    png.append_chunk(Chunk(ChunkType::fromStr("ruSt"), {}));
+
+    auto path = write_temp_file("png_write_to_fd.png", {});
+    int fd = open(path.c_str(), O_WRONLY | O_TRUNC);
+    assert(png.write_to(fd) == png.serialized_size());
+    close(fd);
+    assert(read_temp_file(path) == png.as_bytes());
+
+    // AtomicFile is a sink too
+    {
+        AtomicFile output(path);
+        png.remove_first_chunk(ChunkType::fromStr("RuSt"));
+        png.write_to(output);
+        output.commit();
+        assert(output.bytes_written() == png.serialized_size());
+    }
+    assert(read_temp_file(path) == png.as_bytes());
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,180 @@
+#include "test_macro.hpp"
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+
+// ChunkStream tests
+void test_stream_round_trip() {
+    std::string png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    std::istringstream in(png_data);
+    std::ostringstream out;
+    {
+        ChunkStreamReader reader(in);
+        ChunkStreamWriter writer(out);
+        while (reader.next()) {
+            reader.copy_to(writer);
+        }
+    }
+    assert(out.str() == png_data);
+}
+
+void test_stream_read_chunk() {
+    std::string png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    std::istringstream in(png_data);
+    ChunkStreamReader reader(in);
+
+    std::vector<std::string> types;
+    std::optional<Chunk> message;
+    while (reader.next()) {
+        types.push_back(reader.chunktype().toString());
+        if (reader.chunktype() == ChunkType::fromStr("RuSt")) {
+            message = reader.read_chunk();
+        }
+    }
+    assert(types.size() == 7);
+    assert(types.front() == "IHDR" && types.back() == "IEND");
+    assert(message.has_value());
+    assert(message.value().data_as_string() == "hey");
+}
+
+void test_stream_large_chunk() {
+    // larger than the reader buffer, so data crosses refills
+    std::vector<uint8_t> data(3 * ChunkStreamReader::BUFFER_SIZE + 17);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = static_cast<uint8_t>(i * 7);
+    }
+    Chunk chunk(ChunkType::fromStr("LaRg"), data);
+
+    std::ostringstream out;
+    {
+        ChunkStreamWriter writer(out);
+        writer.begin_chunk(chunk.chunktype(), data.size());
+        writer.write(data.data(), 1000);
+        writer.write(data.data() + 1000, data.size() - 1000);
+        writer.end_chunk();
+    }
+
+    std::vector<uint8_t> expected(PNG::STANDARD_HEADER);
+    auto chunk_bytes = chunk.as_bytes();
+    expected.insert(expected.end(), chunk_bytes.begin(), chunk_bytes.end());
+    assert(out.str() == std::string(expected.begin(), expected.end()));
+
+    std::istringstream in(out.str());
+    ChunkStreamReader reader(in);
+    assert(reader.next());
+    std::vector<uint8_t> read_back(data.size());
+    size_t done = 0;
+    while (reader.remaining() > 0) {
+        done += reader.read(read_back.data() + done, 5000);
+    }
+    assert(read_back == data);
+    assert(reader.crc() == chunk.crc());
+    assert(!reader.next());
+}
+
+void test_stream_crc_mismatch() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    png_data[41] ^= 0xff; // sRGB data byte
+    std::istringstream in(std::string(png_data.begin(), png_data.end()));
+
+    bool exception_thrown = false;
+    try {
+        ChunkStreamReader reader(in);
+        while (reader.next()) {
+            reader.skip();
+        }
+    } catch (...) {
+        exception_thrown = true;
+    }
+    assert(exception_thrown);
+}
+
+void test_stream_rejects_oversized_length() {
+    std::vector<uint8_t> png_data(PNG::STANDARD_HEADER);
+    std::vector<uint8_t> header = {0xff, 0xff, 0xff, 0xff, 'R', 'u', 'S', 't'};
+    png_data.insert(png_data.end(), header.begin(), header.end());
+    std::istringstream in(std::string(png_data.begin(), png_data.end()));
+
+    ChunkStreamReader reader(in);
+    bool exception_thrown = false;
+    try {
+        reader.next();
+    } catch (const std::invalid_argument&) {
+        exception_thrown = true;
+    }
+    assert(exception_thrown);
+}
+
+// Collects everything written to it
+class VectorSink : public ByteSink {
+public:
+    std::vector<uint8_t> bytes;
+
+    void write(const uint8_t* data, size_t size) override {
+        bytes.insert(bytes.end(), data, data + size);
+    }
+};
+
+// Reads back every chunk of type from a stream written by write_payload
+std::vector<uint8_t> reassemble_payload(const std::string& png, const ChunkType& type, std::vector<uint32_t>& lengths) {
+    std::istringstream in(png);
+    ChunkStreamReader reader(in);
+    VectorSink sink;
+    while (reader.next()) {
+        assert(reader.chunktype() == type);
+        lengths.push_back(reader.length());
+        reader.copy_data_to(sink);
+    }
+    return sink.bytes;
+}
+
+void test_stream_write_payload() {
+    std::vector<uint8_t> payload(2 * ChunkStreamWriter::BUFFER_SIZE + 100);
+    for (size_t i = 0; i < payload.size(); i++) {
+        payload[i] = static_cast<uint8_t>(i * 13);
+    }
+    auto type = ChunkType::fromStr("PaYl");
+    uint32_t chunk_size = ChunkStreamWriter::BUFFER_SIZE;
+
+    // a regular file streams, a pipe is gathered one chunk at a time
+    auto path = write_temp_file("payload.bin", payload);
+    int pipe_fds[2];
+    assert(pipe(pipe_fds) == 0);
+    std::thread feeder([&]() {
+        for (size_t done = 0; done < payload.size();) {
+            done += ::write(pipe_fds[1], payload.data() + done, std::min<size_t>(1000, payload.size() - done));
+        }
+        close(pipe_fds[1]);
+    });
+
+    for (bool from_pipe : {false, true}) {
+        int fd = from_pipe ? pipe_fds[0] : open(path.c_str(), O_RDONLY);
+        std::ostringstream out;
+        {
+            ChunkStreamWriter writer(out);
+            assert(writer.write_payload(type, fd, chunk_size) == payload.size());
+        }
+        close(fd);
+
+        std::vector<uint32_t> lengths;
+        assert(reassemble_payload(out.str(), type, lengths) == payload);
+        assert(lengths == std::vector<uint32_t>({chunk_size, chunk_size, 100}));
+    }
+    feeder.join();
+
+    // an empty payload still leaves one chunk to find
+    auto empty = write_temp_file("payload_empty.bin", {});
+    int fd = open(empty.c_str(), O_RDONLY);
+    std::ostringstream out;
+    {
+        ChunkStreamWriter writer(out);
+        assert(writer.write_payload(type, fd, chunk_size) == 0);
+    }
+    close(fd);
+    std::vector<uint32_t> lengths;
+    assert(reassemble_payload(out.str(), type, lengths).empty());
+    assert(lengths.size() == 1);
+
+    std::filesystem::remove(path);
+    std::filesystem::remove(empty);
+}
@@ -106,4 +106,47 @@ void test_invalid_chunk_from_bytes() {
     
     uint32_t actual_crc = chunk.crc();
     assert(actual_crc != incorrect_crc);
-}
\ No newline at end of file
+}
+
+void test_chunk_write_to() {
+    std::string message = "This is where your secret message will be!";
+    std::vector<uint8_t> data(message.begin(), message.end());
+    Chunk chunk(ChunkType::fromStr("RuSt"), data);
+    assert(chunk.serialized_size() == 12 + message.length());
+
+    std::vector<uint8_t> out(chunk.serialized_size() + 4, 0xAA);
+    size_t written = chunk.write_to(out);
+    assert(written == chunk.serialized_size());
+    assert(std::vector<uint8_t>(out.begin(), out.begin() + written) == chunk.as_bytes());
+    assert(out[written] == 0xAA);
+
+    // Too small a buffer is rejected before anything is written
+    std::vector<uint8_t> small(chunk.serialized_size() - 1);
+    bool threw = false;
+    try {
+        chunk.write_to(small);
+    } catch (const std::invalid_argument&) {
+        threw = true;
+    }
+    assert(threw);
+}
+
+void test_chunk_copy_and_move() {
+    std::string message = "This is where your secret message will be!";
+    Chunk chunk(ChunkType::fromStr("RuSt"), std::vector<uint8_t>(message.begin(), message.end()));
+
+    Chunk copy(chunk);
+    assert(copy.data().data() != chunk.data().data());
+    assert(copy.data_as_string() == message);
+
+    Chunk moved(std::move(copy));
+    assert(moved.data_as_string() == message);
+    assert(moved.crc() == chunk.crc());
+
+    Chunk assigned(ChunkType::fromStr("RuSt"), {});
+    assigned = chunk;
+    assert(assigned.data_as_string() == message);
+    assigned = std::move(moved);
+    assert(assigned.data_as_string() == message);
+    assert(assigned.length() == 42);
+}
@@ -0,0 +1,47 @@
+#include "test_macro.hpp"
+
+// ChunkValidator tests
+std::vector<uint8_t> synthetic_png(size_t chunks, size_t chunk_size) {
+    std::vector<uint8_t> bytes(PNG::STANDARD_HEADER);
+    for (size_t i = 0; i < chunks; i++) {
+        std::vector<uint8_t> data(chunk_size);
+        for (size_t j = 0; j < data.size(); j++) {
+            data[j] = static_cast<uint8_t>(i * 13 + j * 7);
+        }
+        auto chunk_bytes = Chunk(ChunkType::fromStr("IDAT"), data).as_bytes();
+        bytes.insert(bytes.end(), chunk_bytes.begin(), chunk_bytes.end());
+    }
+    return bytes;
+}
+
+void test_validator_parallel_matches_serial() {
+    // one chunk spanning several segments plus many small ones
+    auto bytes = synthetic_png(1, 3 * ChunkValidator::SEGMENT_SIZE + 123);
+    auto small = synthetic_png(300, 1000);
+    bytes.insert(bytes.end(), small.begin() + 8, small.end());
+
+    auto views = PNGFile::scan(bytes);
+    ThreadPool pool(4);
+    auto serial = ChunkValidator::compute_crcs(views);
+    auto parallel = ChunkValidator::compute_crcs(views, &pool);
+    assert(serial == parallel);
+    for (size_t i = 0; i < views.size(); i++) {
+        assert(parallel[i] == views[i].crc());
+    }
+}
+
+void test_validator_reports_first_failure() {
+    auto bytes = synthetic_png(10, ChunkValidator::SEGMENT_SIZE);
+    size_t chunk_size = 12 + ChunkValidator::SEGMENT_SIZE;
+    // corrupt data of chunks 7 and 3
+    bytes[8 + 7 * chunk_size + 100] ^= 1;
+    bytes[8 + 3 * chunk_size + 100] ^= 1;
+
+    std::string message;
+    try {
+        PNG png(bytes);
+    } catch (const std::invalid_argument& e) {
+        message = e.what();
+    }
+    assert(message == "CRC mismatch in chunk 3 (IDAT)");
+}
@@ -0,0 +1,84 @@
+#include "test_macro.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+
+// ChunkWalker tests
+void test_chunk_walker_matches_scan() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    auto path = write_temp_file("walker.png", png_data);
+    auto views = PNGFile::scan(png_data);
+
+    int fd = open(path.c_str(), O_RDONLY);
+    ChunkWalker walker(fd);
+    size_t i = 0;
+    while (walker.next()) {
+        assert(i < views.size());
+        assert(walker.chunktype() == views[i].chunktype());
+        assert(walker.length() == views[i].length());
+        assert(walker.offset() == views[i].offset());
+        assert(walker.crc() == views[i].crc());
+        i++;
+    }
+    assert(i == views.size());
+
+    // headers and CRCs only, the 4681-byte IDAT is never read
+    assert(walker.bytes_read() == 8 + views.size() * 12);
+    close(fd);
+    std::filesystem::remove(path);
+}
+
+void test_chunk_walker_reads_and_verifies() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    png_data[41] ^= 0xff; // sRGB data byte
+    auto path = write_temp_file("walker_corrupt.png", png_data);
+
+    int fd = open(path.c_str(), O_RDONLY);
+    ChunkWalker walker(fd);
+    while (walker.next()) {
+        bool corrupt = walker.chunktype() == ChunkType::fromStr("sRGB");
+        assert(walker.verify_crc() == !corrupt);
+        if (walker.chunktype() == ChunkType::fromStr("RuSt")) {
+            assert(walker.read_chunk().data_as_string() == "hey");
+            VectorSink sink;
+            assert(walker.copy_data_to(sink) == 3);
+            assert(std::string(sink.bytes.begin(), sink.bytes.end()) == "hey");
+        }
+        if (corrupt) {
+            bool threw = false;
+            try {
+                walker.read_chunk();
+            } catch (const std::invalid_argument&) {
+                threw = true;
+            }
+            assert(threw);
+
+            threw = false;
+            VectorSink sink;
+            try {
+                walker.copy_data_to(sink);
+            } catch (const std::invalid_argument&) {
+                threw = true;
+            }
+            assert(threw);
+        }
+    }
+    close(fd);
+    std::filesystem::remove(path);
+}
+
+void test_chunk_walker_truncated() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE) - 20);
+    auto path = write_temp_file("walker_truncated.png", png_data);
+
+    int fd = open(path.c_str(), O_RDONLY);
+    bool threw = false;
+    try {
+        ChunkWalker walker(fd);
+        while (walker.next()) {}
+    } catch (const std::invalid_argument&) {
+        threw = true;
+    }
+    assert(threw);
+    close(fd);
+    std::filesystem::remove(path);
+}
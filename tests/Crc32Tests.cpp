@@ -0,0 +1,122 @@
+#include "test_macro.hpp"
+#include <thread>
+
+// Crc32 tests
+const Crc32Engine ALL_CRC_ENGINES[] = {
+    Crc32Engine::Table, Crc32Engine::Slicing8, Crc32Engine::Slicing16, Crc32Engine::Clmul
+};
+
+void test_crc_check_value() {
+    std::string input = "123456789";
+    auto data = reinterpret_cast<const uint8_t*>(input.data());
+    for (auto engine : ALL_CRC_ENGINES) {
+        if (!Crc32::is_supported(engine)) continue;
+        assert(Crc32::update_with(engine, 0, data, input.size()) == 0xCBF43926);
+    }
+}
+
+void test_crc_engines_match_table() {
+    // covers the tails of every kernel plus misaligned starts
+    std::vector<uint8_t> data(4096 + 64);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = static_cast<uint8_t>(i * 131 + (i >> 7));
+    }
+    for (size_t offset = 0; offset < 16; offset += 3) {
+        for (size_t length = 0; length < 4096; length += (length < 300 ? 1 : 97)) {
+            uint32_t expected = Crc32::update_with(Crc32Engine::Table, 0, data.data() + offset, length);
+            for (auto engine : ALL_CRC_ENGINES) {
+                if (!Crc32::is_supported(engine)) continue;
+                assert(Crc32::update_with(engine, 0, data.data() + offset, length) == expected);
+            }
+        }
+    }
+}
+
+void test_crc_update_continues() {
+    std::string input = "This is where your secret message will be!";
+    auto data = reinterpret_cast<const uint8_t*>(input.data());
+    uint32_t whole = Crc32::compute(data, input.size());
+    uint32_t split = Crc32::update(Crc32::compute(data, 10), data + 10, input.size() - 10);
+    assert(whole == split);
+}
+
+void test_crc_set_engine() {
+    Crc32Engine original = Crc32::engine();
+    ChunkType chunk_type = ChunkType::fromStr("RuSt");
+    std::string message = "This is where your secret message will be!";
+    std::vector<uint8_t> data(message.begin(), message.end());
+    for (auto engine : ALL_CRC_ENGINES) {
+        if (!Crc32::is_supported(engine)) continue;
+        Crc32::set_engine(engine);
+        assert(Crc32::engine() == engine);
+        assert(Chunk(chunk_type, data).crc() == 2882656334);
+    }
+    Crc32::set_engine(original);
+}
+
+void test_crc_combine() {
+    std::vector<uint8_t> data(100000);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = static_cast<uint8_t>(i * 31 + 7);
+    }
+    uint32_t whole = Crc32::compute(data.data(), data.size());
+    for (size_t split : {size_t(0), size_t(1), size_t(4096), size_t(99999), data.size()}) {
+        uint32_t first = Crc32::compute(data.data(), split);
+        uint32_t second = Crc32::compute(data.data() + split, data.size() - split);
+        assert(Crc32::combine(first, second, data.size() - split) == whole);
+    }
+}
+
+void test_crc_hasher_pieces() {
+    std::string input = "123456789";
+    auto data = reinterpret_cast<const uint8_t*>(input.data());
+    Crc32Hasher hasher;
+    hasher.update(data, 2).update(data + 2, 0).update(std::span<const uint8_t>(data + 2, 7));
+    assert(hasher.finalize() == 0xCBF43926);
+    assert(hasher.length() == 9);
+
+    hasher.init();
+    assert(hasher.finalize() == 0 && hasher.length() == 0);
+
+    // a chunk's CRC is its type then its data
+    std::string message = "This is where your secret message will be!";
+    std::vector<uint8_t> bytes(message.begin(), message.end());
+    auto type = ChunkType::fromStr("RuSt");
+    assert(Chunk::compute_crc(type, bytes) == 2882656334);
+    assert(Chunk::crc_hasher(type).update(bytes.data(), 5).update(bytes.data() + 5, bytes.size() - 5).finalize() == 2882656334);
+}
+
+void test_crc_hasher_threads() {
+    std::vector<uint8_t> data(1000003);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = static_cast<uint8_t>(i * 2654435761u >> 13);
+    }
+    uint32_t serial = Crc32Hasher().update(data).finalize();
+
+    for (size_t threads : {1, 2, 3, 7, 16}) {
+        // uneven pieces, including empty ones
+        std::vector<size_t> bounds = {0};
+        for (size_t t = 1; t < threads; t++) {
+            bounds.push_back(t % 3 == 0 ? bounds.back() : data.size() * t * t / (threads * threads));
+        }
+        bounds.push_back(data.size());
+
+        std::vector<Crc32Hasher> pieces(threads);
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < threads; t++) {
+            workers.emplace_back([&, t]() {
+                pieces[t].update(data.data() + bounds[t], bounds[t + 1] - bounds[t]);
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        Crc32Hasher combined;
+        for (const auto& piece : pieces) {
+            combined.combine(piece);
+        }
+        assert(combined.finalize() == serial);
+        assert(combined.length() == data.size());
+    }
+}
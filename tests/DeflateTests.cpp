@@ -0,0 +1,206 @@
+#include "test_macro.hpp"
+#include <random>
+#include <string>
+
+// Deflate tests
+std::vector<uint8_t> deflate_test_input(size_t size) {
+    // runs, repeats at every distance and bytes that never match
+    std::mt19937 rng(3);
+    std::vector<uint8_t> data;
+    while (data.size() < size) {
+        switch (rng() % 3) {
+        case 0:
+            data.insert(data.end(), 1 + rng() % 300, static_cast<uint8_t>(rng()));
+            break;
+        case 1:
+            if (!data.empty()) {
+                size_t from = rng() % data.size();
+                size_t length = std::min<size_t>(1 + rng() % 400, data.size() - from);
+                for (size_t i = 0; i < length; i++) {
+                    data.push_back(data[from + i]);
+                }
+            }
+            break;
+        default:
+            for (int i = 0; i < 50; i++) {
+                data.push_back(static_cast<uint8_t>(rng()));
+            }
+        }
+    }
+    data.resize(size);
+    return data;
+}
+
+void test_deflate_round_trip_all_levels() {
+    std::string text = "hello hello hello hello";
+    const std::vector<std::vector<uint8_t>> inputs = {
+        {},
+        {'a'},
+        std::vector<uint8_t>(text.begin(), text.end()),
+        std::vector<uint8_t>(100000, 0),
+        deflate_test_input(300000),
+    };
+    for (const auto& input : inputs) {
+        for (int level = 0; level <= 9; level++) {
+            auto compressed = Deflate::compress(input, level);
+            assert(Deflate::decompress(compressed) == input);
+        }
+    }
+    // repetitive input has to actually shrink
+    assert(Deflate::compress(inputs[3]).size() < 1000);
+}
+
+void test_inflate_zlib_stream() {
+    // zlib.compress(b"hello hello hello hello", 9)
+    const std::vector<uint8_t> stream = {120, 218, 203, 72, 205, 201, 201, 87, 200, 64, 39, 1, 104, 3, 8, 177};
+    auto inflated = Deflate::decompress(stream);
+    assert(std::string(inflated.begin(), inflated.end()) == "hello hello hello hello");
+}
+
+void test_deflate_parallel_matches_serial() {
+    auto input = deflate_test_input(Deflate::PARALLEL_BLOCK_SIZE * 5 + 123);
+    ThreadPool pool(4);
+    for (int level : {1, 6, 9}) {
+        auto parallel = Deflate::compress_parallel(input, level, pool);
+        assert(Deflate::decompress(parallel) == input);
+        // priming each block with the previous window keeps most of the ratio
+        assert(parallel.size() < Deflate::compress(input, level).size() * 11 / 10);
+    }
+}
+
+void test_adler32_combine() {
+    std::string text = "Wikipedia";
+    auto data = reinterpret_cast<const uint8_t*>(text.data());
+    assert(Deflate::adler32(1, data, text.size()) == 0x11E60398);
+
+    auto input = deflate_test_input(20000);
+    uint32_t whole = Deflate::adler32(1, input.data(), input.size());
+    for (size_t split : {size_t(0), size_t(1), size_t(6000), input.size()}) {
+        uint32_t first = Deflate::adler32(1, input.data(), split);
+        uint32_t second = Deflate::adler32(1, input.data() + split, input.size() - split);
+        assert(Deflate::adler32_combine(first, second, input.size() - split) == whole);
+    }
+}
+
+void test_inflate_rejects_corrupt_input() {
+    auto input = deflate_test_input(5000);
+    auto compressed = Deflate::compress(input);
+
+    auto expect_invalid = [](const std::vector<uint8_t>& data) {
+        try {
+            Deflate::decompress(data);
+            assert(false);
+        } catch (const std::invalid_argument&) {
+        }
+    };
+
+    auto truncated = compressed;
+    truncated.resize(compressed.size() / 2);
+    expect_invalid(truncated);
+
+    auto bad_checksum = compressed;
+    bad_checksum.back() ^= 1;
+    expect_invalid(bad_checksum);
+
+    auto bad_header = compressed;
+    bad_header[1] ^= 1;
+    expect_invalid(bad_header);
+
+    // a reserved block type
+    expect_invalid({0x78, 0x9c, 0x07, 0x00, 0x00, 0x00, 0x00, 0x01});
+}
+
+void test_compressed_payload() {
+    std::string message = "a message that says a message that says a message";
+    std::vector<uint8_t> plain(message.begin(), message.end());
+
+    auto payload = CompressedPayload::encode(plain, 9);
+    assert(CompressedPayload::is_compressed(payload));
+    assert(payload.size() < plain.size());
+    assert(CompressedPayload::decode(payload) == plain);
+
+    // stored data loses its header, whatever it looks like
+    std::vector<uint8_t> zlib_like = {0x00, 0x00, 0x78, 0x9c, 0x03, 0x00};
+    std::vector<uint8_t> stored(CompressedPayload::STORED_HEADER.begin(), CompressedPayload::STORED_HEADER.end());
+    stored.insert(stored.end(), zlib_like.begin(), zlib_like.end());
+    assert(CompressedPayload::is_stored(stored) && !CompressedPayload::is_compressed(stored));
+    assert(CompressedPayload::decode(stored) == zlib_like);
+
+    // bare messages and other chunks' data pass through untouched, even
+    // when they start with a NUL or most of the magic
+    assert(!CompressedPayload::is_compressed(plain) && !CompressedPayload::is_stored(plain));
+    assert(CompressedPayload::decode(plain) == plain);
+    assert(CompressedPayload::decode({}).empty());
+    std::vector<uint8_t> unknown_method(CompressedPayload::MAGIC.begin(), CompressedPayload::MAGIC.end());
+    unknown_method.push_back(0x07);
+    for (const auto& foreign : {std::vector<uint8_t>{0x00}, std::vector<uint8_t>{0x00, 0x00, 0x00, 0x32},
+                                std::vector<uint8_t>{0x00, 0x07, 'x'}, unknown_method}) {
+        assert(CompressedPayload::decode(foreign) == foreign);
+    }
+
+    auto expect_invalid = [](std::span<const uint8_t> data, size_t max_size) {
+        bool threw = false;
+        try {
+            CompressedPayload::decode(data, max_size);
+        } catch (const std::invalid_argument&) {
+            threw = true;
+        }
+        assert(threw);
+    };
+    auto corrupt = payload;
+    corrupt.back() ^= 1;
+    expect_invalid(corrupt, CompressedPayload::MAX_DECODED_SIZE);
+
+    // inflating stops at the limit
+    std::vector<uint8_t> zeros(1024 * 1024);
+    auto bomb = CompressedPayload::encode(zeros, 9);
+    assert(CompressedPayload::decode(bomb, zeros.size()) == zeros);
+    expect_invalid(bomb, zeros.size() - 1);
+}
+
+void test_from_file_payload_round_trip() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    auto image = write_temp_file("from_file.png", png_data);
+    // starts like a compressed payload
+    std::vector<uint8_t> payload = {0x00, 0x00, 0x78, 0x9c, 0x4b, 0x04, 0x00, 0x00, 0x62, 0x00, 0x62};
+    auto source = write_temp_file("from_file_payload.bin", payload);
+    auto destination = std::filesystem::temp_directory_path() / "pngre_from_file_out.bin";
+
+    std::ostringstream out;
+    std::ostringstream err;
+    assert(run_command({"encode", image, "PaYl", "--from-file", source, "--chunk-size", "4"}, out, err));
+    assert(run_command({"decode", image, "PaYl", "--to-file", destination.string()}, out, err));
+    assert(read_temp_file(destination.string()) == payload);
+    std::filesystem::remove(image);
+    std::filesystem::remove(source);
+    std::filesystem::remove(destination);
+}
+
+void test_foreign_chunks_pass_through() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    auto image = write_temp_file("foreign.png", png_data);
+    auto output = std::filesystem::temp_directory_path() / "pngre_foreign_out.png";
+
+    // IHDR and gAMA data start with a NUL byte but carry no header
+    std::ostringstream out;
+    std::ostringstream err;
+    assert(run_command({"decode", image, "IHDR"}, out, err));
+    assert(run_command({"remove", image, "gAMA", output.string()}, out, err));
+    assert(out.str().find("Removed: `") != std::string::npos);
+
+    // a corrupt compressed chunk is still removed, and reported as is
+    std::vector<uint8_t> corrupt(CompressedPayload::MAGIC.begin(), CompressedPayload::MAGIC.end());
+    corrupt.push_back(CompressedPayload::METHOD_DEFLATE);
+    corrupt.push_back('x');
+    PNG png(png_data);
+    png.insert_before_iend({Chunk(ChunkType::fromStr("BaDz"), corrupt)});
+    auto bad = write_temp_file("foreign_bad.png", png.as_bytes());
+    out.str("");
+    assert(run_command({"remove", bad, "BaDz", output.string()}, out, err));
+    assert(out.str().find("Removed: `") != std::string::npos);
+    assert(PNG(read_temp_file(output.string())).count_by_type(ChunkType::fromStr("BaDz")) == 0);
+
+    std::filesystem::remove(image);
+    std::filesystem::remove(bad);
+    std::filesystem::remove(output);
+}
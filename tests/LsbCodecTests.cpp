@@ -0,0 +1,161 @@
+#include "test_macro.hpp"
+#include <random>
+
+// LsbCodec tests
+void test_lsb_engines_match_reference() {
+    std::mt19937 rng(31);
+    const LsbEngine engines[] = {LsbEngine::Scalar, LsbEngine::Sse2, LsbEngine::Avx2};
+
+    // counts around the 2, 4 and 8 byte steps exercise every tail
+    for (size_t count = 0; count < 40; count++) {
+        std::vector<uint8_t> bits(count);
+        std::vector<uint8_t> carriers(8 * count + 3);
+        for (auto& byte : bits) byte = uint8_t(rng());
+        for (auto& byte : carriers) byte = uint8_t(rng());
+
+        // bit i of every byte goes to the low bit of carrier i
+        std::vector<uint8_t> expected = carriers;
+        for (size_t i = 0; i < 8 * count; i++) {
+            expected[i] = uint8_t((expected[i] & 0xfe) | ((bits[i / 8] >> (i % 8)) & 1));
+        }
+
+        for (auto engine : engines) {
+            if (!LsbCodec::is_supported(engine)) {
+                continue;
+            }
+            auto scattered = carriers;
+            LsbCodec::scatter_with(engine, scattered.data(), bits.data(), count);
+            assert(scattered == expected);
+
+            std::vector<uint8_t> gathered(count);
+            LsbCodec::gather_with(engine, scattered.data(), gathered.data(), count);
+            assert(gathered == bits);
+        }
+    }
+}
+
+void test_lsb_embed_extract() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    PNG png(png_data);
+    PixelDecoder decoder(png);
+    std::vector<uint8_t> pixels(decoder.output_size());
+    decoder.decode(pixels);
+    const ImageHeader& header = decoder.header();
+
+    // one bit per byte of 50x50 RGBA, less the length and CRC
+    assert(LsbCodec::capacity(header) == 50 * 50 * 4 / 8 - LsbCodec::HEADER_SIZE);
+
+    for (size_t size : {size_t(0), size_t(1), size_t(37), LsbCodec::capacity(header)}) {
+        std::vector<uint8_t> payload(size);
+        for (size_t i = 0; i < size; i++) {
+            payload[i] = uint8_t(i * 7 + 3);
+        }
+        auto carrier = pixels;
+        LsbCodec::embed(header, carrier, payload);
+        for (size_t i = 0; i < pixels.size(); i++) {
+            assert((carrier[i] ^ pixels[i]) <= 1);
+        }
+        assert(LsbCodec::extract(header, carrier) == payload);
+    }
+
+    std::vector<uint8_t> too_big(LsbCodec::capacity(header) + 1);
+    try {
+        LsbCodec::embed(header, pixels, too_big);
+        assert(false);
+    } catch (const std::invalid_argument&) {
+    }
+    // a flipped bit anywhere in the payload fails the CRC
+    auto carrier = pixels;
+    LsbCodec::embed(header, carrier, std::vector<uint8_t>{'h', 'e', 'y'});
+    carrier[8 * LsbCodec::HEADER_SIZE + 5] ^= 1;
+    try {
+        LsbCodec::extract(header, carrier);
+        assert(false);
+    } catch (const std::invalid_argument&) {
+    }
+}
+
+void test_lsb_16_bit() {
+    ImageHeader header;
+    header.width = 9;
+    header.height = 7;
+    header.bit_depth = 16;
+    header.color_type = ImageHeader::TRUECOLOR;
+    std::mt19937 rng(8);
+    std::vector<uint8_t> pixels(header.height * header.row_bytes());
+    for (auto& byte : pixels) byte = uint8_t(rng());
+
+    // only the low byte of each sample carries a bit
+    assert(LsbCodec::capacity(header) == 9 * 7 * 3 / 8 - LsbCodec::HEADER_SIZE);
+    std::vector<uint8_t> payload = {'s', 'i', 'x', 't', 'e', 'e', 'n'};
+    auto carrier = pixels;
+    LsbCodec::embed(header, carrier, payload);
+    for (size_t i = 0; i < pixels.size(); i++) {
+        assert(i % 2 == 0 ? carrier[i] == pixels[i] : (carrier[i] ^ pixels[i]) <= 1);
+    }
+    assert(LsbCodec::extract(header, carrier) == payload);
+}
+
+void test_lsb_rejects_unsupported_images() {
+    ImageHeader header;
+    header.width = 64;
+    header.height = 64;
+    std::vector<uint8_t> pixels(64 * 64 * 8);
+    auto expect_invalid = [&](uint8_t bit_depth, uint8_t color_type) {
+        header.bit_depth = bit_depth;
+        header.color_type = color_type;
+        try {
+            LsbCodec::embed(header, pixels, std::vector<uint8_t>{1});
+            assert(false);
+        } catch (const std::invalid_argument&) {
+        }
+    };
+    expect_invalid(8, ImageHeader::INDEXED);
+    expect_invalid(4, ImageHeader::GRAYSCALE);
+
+    // too small to hold even the header
+    header.width = 2;
+    header.height = 2;
+    header.bit_depth = 8;
+    header.color_type = ImageHeader::GRAYSCALE;
+    assert(LsbCodec::capacity(header) == 0);
+    try {
+        LsbCodec::extract(header, pixels);
+        assert(false);
+    } catch (const std::invalid_argument&) {
+    }
+}
+
+void test_encode_lsb_command() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    auto source = write_temp_file("lsb_source.png", png_data);
+    auto output = source + ".out.png";
+    std::ostringstream out;
+    std::ostringstream err;
+
+    assert(run_command({"encode", source, "--lsb", "hidden in plain sight", "--filter", "paeth", "--level", "1", output}, out, err));
+    assert(read_temp_file(source) == png_data);
+
+    out.str("");
+    assert(run_command({"decode", output, "--lsb"}, out, err));
+    assert(out.str() == "Decoded: hidden in plain sight\n");
+
+    // the other chunks survive the rewrite
+    out.str("");
+    assert(run_command({"decode", output, "RuSt"}, out, err));
+    assert(out.str() == "Decoded: hey\n");
+
+    // the original image has no payload
+    try {
+        run_command({"decode", source, "--lsb"}, out, err);
+        assert(false);
+    } catch (const std::invalid_argument&) {
+    }
+    try {
+        run_command({"encode", source, "--lsb", "message", "--filter", "fastest"}, out, err);
+        assert(false);
+    } catch (const std::invalid_argument&) {
+    }
+    std::filesystem::remove(source);
+    std::filesystem::remove(output);
+}
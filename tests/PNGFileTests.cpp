@@ -0,0 +1,98 @@
+#include "test_macro.hpp"
+#include <filesystem>
+#include <fstream>
+
+// PNGFile tests
+std::string write_temp_file(const std::string& name, const std::vector<uint8_t>& bytes) {
+    auto path = (std::filesystem::temp_directory_path() / ("pngre_" + name)).string();
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    return path;
+}
+
+void test_png_file_chunks_match_png() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    auto path = write_temp_file("png_file_chunks.png", png_data);
+
+    PNGFile file(path);
+    PNG png(png_data);
+    assert(file.chunks().size() == png.chunks().size());
+    for (size_t i = 0; i < png.chunks().size(); i++) {
+        const auto& view = file.chunks()[i];
+        const auto& chunk = png.chunks()[i];
+        assert(view.chunktype() == chunk.chunktype());
+        assert(view.length() == chunk.length());
+        assert(view.crc() == chunk.crc());
+        assert(view.verify_crc());
+        assert(std::equal(view.data().begin(), view.data().end(), chunk.data().begin(), chunk.data().end()));
+    }
+    std::filesystem::remove(path);
+}
+
+void test_png_file_views_are_zero_copy() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    auto path = write_temp_file("png_file_views.png", png_data);
+
+    PNGFile file(path);
+    auto bytes = file.bytes();
+    for (const auto& view : file.chunks()) {
+        assert(view.data().data() == bytes.data() + view.offset() + 8);
+    }
+    std::filesystem::remove(path);
+}
+
+void test_png_from_png_file() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    auto path = write_temp_file("png_from_file.png", png_data);
+
+    PNGFile file(path);
+    PNG png(file);
+    assert(png.as_bytes() == png_data);
+
+    auto view = file.chunk_by_type(ChunkType::fromStr("RuSt"));
+    assert(view.has_value());
+    assert(Chunk(view.value()).data_as_string() == "hey");
+    std::filesystem::remove(path);
+}
+
+void test_png_file_invalid() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    png_data[0] = 13;
+    auto path = write_temp_file("png_file_invalid.png", png_data);
+
+    bool exception_thrown = false;
+    try {
+        PNGFile file(path);
+    } catch (...) {
+        exception_thrown = true;
+    }
+    assert(exception_thrown);
+
+    // truncated inside the last chunk
+    png_data[0] = 137;
+    png_data.resize(png_data.size() - 6);
+    path = write_temp_file("png_file_invalid.png", png_data);
+
+    exception_thrown = false;
+    try {
+        PNGFile file(path);
+    } catch (...) {
+        exception_thrown = true;
+    }
+    assert(exception_thrown);
+    std::filesystem::remove(path);
+}
+
+void test_png_lazy_from_file() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    auto path = write_temp_file("png_lazy.png", png_data);
+    std::optional<Chunk> removed;
+    {
+        PNG png(PNGFile(path), Validation::Lazy);
+        std::filesystem::remove(path);
+        assert(png.as_bytes() == png_data);
+        removed = png.remove_first_chunk(ChunkType::fromStr("RuSt"));
+    }
+    // copied out before the mapping went away
+    assert(removed->data_as_string() == "hey");
+}
@@ -0,0 +1,87 @@
+#include "test_macro.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+
+// PNGPatch tests
+void test_append_before_iend_in_place() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    auto path = write_temp_file("patch_in_place.png", png_data);
+
+    Chunk chunk = chunk_from_strings("TeSt", "Hidden message");
+    assert(PNGPatch::append_before_iend(path, chunk));
+
+    // original chunks, then the new one, then IEND
+    std::vector<uint8_t> expected(png_data.begin(), png_data.end() - 12);
+    auto chunk_bytes = chunk.as_bytes();
+    expected.insert(expected.end(), chunk_bytes.begin(), chunk_bytes.end());
+    expected.insert(expected.end(), png_data.end() - 12, png_data.end());
+
+    PNGFile file(path);
+    assert(std::equal(file.bytes().begin(), file.bytes().end(), expected.begin(), expected.end()));
+    std::filesystem::remove(path);
+}
+
+void test_append_before_iend_trailing_bytes() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    auto extra = chunk_from_strings("TaIl", "after IEND").as_bytes();
+    png_data.insert(png_data.end(), extra.begin(), extra.end());
+    auto path = write_temp_file("patch_trailing.png", png_data);
+
+    assert(!PNGPatch::append_before_iend(path, chunk_from_strings("TeSt", "Hidden message")));
+
+    PNGFile file(path);
+    assert(std::equal(file.bytes().begin(), file.bytes().end(), png_data.begin(), png_data.end()));
+    std::filesystem::remove(path);
+}
+
+void test_state_after_tail_write_parses() {
+    // what a crash between the two writes of a patch leaves behind: the
+    // original image with the new chunk's data and IEND after it
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    auto tail = chunk_from_strings("TeSt", "Hidden message").as_bytes();
+    auto iend = chunk_from_strings("IEND", "").as_bytes();
+    tail.insert(tail.end(), iend.begin(), iend.end());
+    std::vector<uint8_t> crashed = png_data;
+    crashed.insert(crashed.end(), tail.begin() + 12, tail.end());
+    auto path = write_temp_file("patch_crashed.png", crashed);
+
+    PNG original(png_data);
+    PNG parsed{PNGFile(path)};
+    assert(parsed.as_bytes() == original.as_bytes());
+
+    int fd = open(path.c_str(), O_RDONLY);
+    size_t walked = 0;
+    ChunkWalker walker(fd);
+    while (walker.next()) {
+        walked++;
+    }
+    assert(walked == original.chunks().size());
+
+    lseek(fd, 0, SEEK_SET);
+    size_t streamed = 0;
+    ChunkStreamReader reader(fd);
+    while (reader.next()) {
+        streamed++;
+    }
+    assert(streamed == original.chunks().size());
+    close(fd);
+
+    // the next patch refuses the trailing bytes and leaves them be
+    assert(!PNGPatch::append_before_iend(path, chunk_from_strings("TeSt", "again")));
+    std::filesystem::remove(path);
+}
+
+void test_append_many_before_iend() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    auto path = write_temp_file("patch_many.png", png_data);
+
+    std::vector<Chunk> chunks = {chunk_from_strings("TeSt", "one"), chunk_from_strings("TeSt", "two"), chunk_from_strings("ruSt", "")};
+    assert(PNGPatch::append_before_iend(path, chunks));
+
+    PNG expected(png_data);
+    expected.insert_before_iend(chunks);
+    PNGFile file(path);
+    auto bytes = expected.as_bytes();
+    assert(std::equal(file.bytes().begin(), file.bytes().end(), bytes.begin(), bytes.end()));
+    std::filesystem::remove(path);
+}
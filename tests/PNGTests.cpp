@@ -413,6 +413,121 @@ void test_as_bytes() {
     assert(bytes == png_data);
 }
 
+void test_png_arena_storage() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    std::optional<Chunk> copied;
+    std::optional<Chunk> removed;
+    {
+        PNG png(png_data, ChunkStorage::Arena);
+        assert(png.as_bytes() == png_data);
+
+        copied = png.chunk_by_type(ChunkType::fromStr("IDAT"));
+        removed = png.remove_first_chunk(ChunkType::fromStr("RuSt"));
+        png.append_chunk(Chunk(ChunkType::fromStr("ruSt"), {1, 2, 3}));
+        assert(png.chunks().size() == 7);
+        assert(png.chunks()[6].data_as_string() == "\x01\x02\x03");
+    }
+
+    // both outlive the arena they were parsed into
+    assert(copied->length() == 4681);
+    assert(copied->data_as_string() == PNG(png_data).chunk_by_type(ChunkType::fromStr("IDAT"))->data_as_string());
+    assert(removed->data_as_string() == "hey");
+}
+
+void test_png_lazy_validation() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    png_data[41] ^= 0xff; // sRGB data byte
+
+    bool threw = false;
+    try {
+        PNG eager(png_data, Validation::Eager);
+    } catch (const std::invalid_argument&) {
+        threw = true;
+    }
+    assert(threw);
+
+    // only the chunk whose data is read is checked
+    PNG lazy(png_data, Validation::Lazy);
+    std::stringstream printed;
+    printed << lazy;
+    auto idat = lazy.chunk_by_type(ChunkType::fromStr("IDAT"));
+    assert(!idat->crc_verified());
+    assert(idat->data().size() == 4681);
+    assert(idat->crc_verified());
+    assert(lazy.chunk_by_type(ChunkType::fromStr("RuSt"))->data_as_string() == "hey");
+
+    auto srgb = lazy.chunk_by_type(ChunkType::fromStr("sRGB"));
+    threw = false;
+    try {
+        srgb->data();
+    } catch (const std::invalid_argument&) {
+        threw = true;
+    }
+    assert(threw);
+    assert(!srgb->verify_crc());
+
+    // off never checks unless asked
+    PNG off(png_data, Validation::Off);
+    auto unchecked = off.chunk_by_type(ChunkType::fromStr("sRGB"));
+    assert(unchecked->data().size() == 1);
+    assert(!unchecked->verify_crc());
+    assert(off.as_bytes() == png_data);
+}
+
+void test_insert_before_iend() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    PNG png(png_data);
+    png.remove_first_chunk(ChunkType::fromStr("RuSt"));
+    png.insert_before_iend({chunk_from_strings("TeSt", "one"), chunk_from_strings("TeSt", "two")});
+
+    const auto& chunks = png.chunks();
+    assert(chunks.size() == 8);
+    assert(chunks[5].data_as_string() == "one");
+    assert(chunks[6].data_as_string() == "two");
+    assert(chunks[7].chunktype() == ChunkType::fromStr("IEND"));
+    assert(png.count_by_type(ChunkType::fromStr("TeSt")) == 2);
+}
+
+void test_remove_chunks() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    PNG png(png_data);
+    for (const char* message : {"a", "b", "c"}) {
+        png.append_chunk(chunk_from_strings("TeSt", message));
+        png.append_chunk(chunk_from_strings("RuSt", message));
+    }
+    size_t before = png.chunks().size();
+
+    // first of each type, a type named twice takes two, in file order
+    auto removed = png.remove_chunks({ChunkType::fromStr("TeSt"), ChunkType::fromStr("RuSt"), ChunkType::fromStr("TeSt")});
+    assert(removed.size() == 3);
+    assert(removed[0].data_as_string() == "hey");
+    assert(removed[1].data_as_string() == "a");
+    assert(removed[2].data_as_string() == "b");
+    assert(png.count_by_type(ChunkType::fromStr("TeSt")) == 1);
+
+    // every remaining chunk of a type
+    removed = png.remove_chunks({ChunkType::fromStr("RuSt"), ChunkType::fromStr("NoNe")}, true);
+    assert(removed.size() == 3);
+    assert(removed.back().data_as_string() == "c");
+    assert(png.count_by_type(ChunkType::fromStr("RuSt")) == 0);
+    assert(png.chunks().size() == before - 6);
+}
+
+void test_png_write_to() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    PNG png(png_data);
+    assert(png.serialized_size() == png_data.size());
+
+    std::vector<uint8_t> out(png.serialized_size());
+    assert(png.write_to(out) == png_data.size());
+    assert(out == png_data);
+
+    // Removed chunks are not serialized
+    png.remove_first_chunk(ChunkType::fromStr("RuSt"));
+    assert(png.serialized_size() == png_data.size() - 15);
+    assert(png.as_bytes().size() == png.serialized_size());
+}
+
 void test_png_trait_impls() {
     std::vector<Chunk> chunks;
     std::string message = "Test message";
@@ -424,3 +539,63 @@ void test_png_trait_impls() {
     ss << png;
     assert(true);
 }
+
+void test_chunks_by_type() {
+    std::vector<Chunk> chunks;
+    chunks.push_back(chunk_from_strings("FrSt", "first"));
+    chunks.push_back(chunk_from_strings("TeSt", "one"));
+    chunks.push_back(chunk_from_strings("miDl", "middle"));
+    chunks.push_back(chunk_from_strings("TeSt", "two"));
+
+    PNG png(chunks);
+    png.append_chunk(chunk_from_strings("TeSt", "three"));
+
+    auto test_type = ChunkType::fromStr("TeSt");
+    assert(png.count_by_type(test_type) == 3);
+    assert(png.count_by_type(ChunkType::fromStr("NoNe")) == 0);
+
+    auto all = png.chunks_by_type(test_type);
+    assert(all.size() == 3);
+    assert(all[0]->data_as_string() == "one");
+    assert(all[2]->data_as_string() == "three");
+
+    assert(png.nth_chunk_by_type(test_type, 1).value().data_as_string() == "two");
+    assert(!png.nth_chunk_by_type(test_type, 3).has_value());
+}
+
+void test_remove_leaves_order_intact() {
+    std::vector<Chunk> chunks;
+    for (int i = 0; i < 50; i++) {
+        chunks.push_back(chunk_from_strings(i % 2 ? "TeSt" : "KeEp", std::to_string(i)));
+    }
+    PNG png(chunks);
+    auto test_type = ChunkType::fromStr("TeSt");
+
+    // removal only tombstones, so the other chunks don't move
+    auto pointers = png.chunks_by_type(test_type);
+    assert(png.remove_first_chunk(test_type).data_as_string() == "1");
+    assert(png.remove_first_chunk(test_type).data_as_string() == "3");
+    assert(png.chunk_by_type(test_type).value().data_as_string() == "5");
+    assert(png.count_by_type(test_type) == 23);
+    assert(png.chunks_by_type(test_type).front() == pointers[2]);
+
+    // serialization skips the tombstones without compacting them
+    std::vector<uint8_t> expected(PNG::STANDARD_HEADER);
+    for (int i = 0; i < 50; i++) {
+        if (i == 1 || i == 3) continue;
+        auto bytes = chunks[i].as_bytes();
+        expected.insert(expected.end(), bytes.begin(), bytes.end());
+    }
+    assert(png.serialized_size() == expected.size());
+    assert(png.as_bytes() == expected);
+    assert(pointers[2]->data_as_string() == "5");
+
+    // chunks() compacts them away
+    assert(png.chunks().size() == 48);
+    assert(png.chunks_by_type(test_type).front() == &png.chunks()[3]);
+    assert(png.nth_chunk_by_type(test_type, 22).value().data_as_string() == "49");
+
+    // and removal keeps working after that
+    assert(png.remove_first_chunk(test_type).data_as_string() == "5");
+    assert(png.chunks().size() == 47);
+}
@@ -0,0 +1,76 @@
+#include "test_macro.hpp"
+
+// ParseCache tests
+IndexedChunk indexed_chunk(const char* type, uint64_t offset) {
+    return {ChunkType::fromStr(type), offset, 10, 0};
+}
+
+void test_parse_cache_lru_eviction() {
+    std::vector<IndexedChunk> index = {indexed_chunk("IHDR", 8), indexed_chunk("IEND", 33)};
+    ParseCache probe(1 << 20);
+    probe.insert(FileKey{1, 1, 100, 0}, index);
+    size_t one = probe.bytes();
+
+    // room for two indexes
+    ParseCache cache(2 * one);
+    FileKey a{1, 1, 100, 0};
+    FileKey b{1, 2, 100, 0};
+    FileKey c{1, 3, 100, 0};
+    cache.insert(a, index);
+    cache.insert(b, index);
+    assert(cache.lookup(a).has_value());
+    // b is now the least recently used
+    cache.insert(c, index);
+
+    assert(cache.entries() == 2);
+    assert(cache.evictions() == 1);
+    assert(!cache.lookup(b).has_value());
+    assert(cache.lookup(c).has_value());
+    // another version of a is another file
+    assert(!cache.lookup(FileKey{1, 1, 100, 1}).has_value());
+    assert(cache.hits() == 2);
+    assert(cache.misses() == 2);
+
+    cache.mark_verified(a, 1);
+    assert(!cache.lookup(a)->at(0).verified);
+    assert(cache.lookup(a)->at(1).verified);
+
+    cache.set_capacity(0);
+    assert(!cache.enabled());
+    assert(cache.entries() == 0);
+}
+
+void test_parse_cache_decode() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    auto path = write_temp_file("parse_cache.png", png_data);
+    ParseCache& cache = ParseCache::shared();
+    cache.set_capacity(1 << 20);
+    uint64_t hits = cache.hits();
+    uint64_t misses = cache.misses();
+
+    std::ostringstream out;
+    std::ostringstream err;
+    assert(run_command({"decode", path, "RuSt"}, out, err));
+    assert(run_command({"decode", path, "RuSt"}, out, err));
+    assert(out.str() == "Decoded: hey\nDecoded: hey\n");
+    assert(cache.misses() == misses + 1);
+    assert(cache.hits() == hits + 1);
+
+    std::ostringstream cached_print;
+    assert(run_command({"print", path, "--verify"}, cached_print, err));
+    cache.set_capacity(0);
+    std::ostringstream walked_print;
+    assert(run_command({"print", path}, walked_print, err));
+    assert(cached_print.str() == walked_print.str());
+
+    // rewriting the file makes it a different key
+    cache.set_capacity(1 << 20);
+    assert(run_command({"decode", path, "RuSt"}, out, err));
+    assert(run_command({"encode", path, "ruSt", "fresh"}, out, err));
+    std::ostringstream fresh;
+    assert(run_command({"decode", path, "ruSt"}, fresh, err));
+    assert(fresh.str() == "Decoded: fresh\n");
+
+    cache.set_capacity(0);
+    std::filesystem::remove(path);
+}
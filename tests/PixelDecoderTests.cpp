@@ -0,0 +1,161 @@
+#include "test_macro.hpp"
+#include <random>
+
+// PixelDecoder tests
+uint8_t reference_paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a);
+    int pb = std::abs(p - b);
+    int pc = std::abs(p - c);
+    return uint8_t(pa <= pb && pa <= pc ? a : pb <= pc ? b : c);
+}
+
+// The encoder side of every filter, straight from the PNG specification
+std::vector<uint8_t> filter_row(uint8_t filter, const std::vector<uint8_t>& row, const std::vector<uint8_t>& prev, size_t bpp) {
+    std::vector<uint8_t> out(row.size());
+    for (size_t i = 0; i < row.size(); i++) {
+        int a = i >= bpp ? row[i - bpp] : 0;
+        int b = prev[i];
+        int c = i >= bpp ? prev[i - bpp] : 0;
+        int predictor = filter == 1 ? a : filter == 2 ? b : filter == 3 ? (a + b) / 2 : filter == 4 ? reference_paeth(a, b, c) : 0;
+        out[i] = uint8_t(row[i] - predictor);
+    }
+    return out;
+}
+
+void test_unfilter_engines_match_scalar() {
+    std::mt19937 rng(11);
+    const UnfilterEngine engines[] = {UnfilterEngine::Scalar, UnfilterEngine::Sse2, UnfilterEngine::Avx2};
+
+    for (size_t bpp : {1, 2, 3, 4, 6, 8}) {
+        // lengths that are not a multiple of 16 or 32 exercise the tails
+        size_t length = bpp * 37;
+        std::vector<uint8_t> prev(length);
+        std::vector<uint8_t> row(length);
+        for (size_t i = 0; i < length; i++) {
+            prev[i] = uint8_t(rng());
+            row[i] = uint8_t(rng());
+        }
+        for (uint8_t filter = Unfilter::NONE; filter <= Unfilter::PAETH; filter++) {
+            auto filtered = filter_row(filter, row, prev, bpp);
+            auto first_row = filter_row(filter, row, std::vector<uint8_t>(length, 0), bpp);
+            for (auto engine : engines) {
+                if (!Unfilter::is_supported(engine)) {
+                    continue;
+                }
+                auto data = filtered;
+                Unfilter::row_with(engine, filter, data.data(), prev.data(), length, bpp);
+                assert(data == row);
+
+                data = first_row;
+                Unfilter::row_with(engine, filter, data.data(), nullptr, length, bpp);
+                assert(data == row);
+            }
+        }
+    }
+
+    uint8_t byte = 0;
+    try {
+        Unfilter::row(5, &byte, nullptr, 1, 1);
+        assert(false);
+    } catch (const std::invalid_argument&) {
+    }
+}
+
+void test_pixel_decoder_png_file() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    PNG png(png_data);
+    PixelDecoder decoder(png);
+
+    assert(decoder.header().width == 50);
+    assert(decoder.header().height == 50);
+    assert(decoder.header().bytes_per_pixel() == 4);
+    assert(decoder.output_size() == 50 * 50 * 4);
+
+    std::vector<uint8_t> pixels(decoder.output_size());
+    decoder.decode(pixels);
+    // checked against an independent decode
+    assert(Crc32::compute(pixels.data(), pixels.size()) == 0xe42234a7);
+}
+
+void test_pixel_decoder_split_idat() {
+    // 16-bit RGB rows using every filter, deflated into one stream and cut
+    // into uneven IDAT chunks
+    const uint32_t width = 33;
+    const uint32_t height = 20;
+    const size_t bpp = 6;
+    std::mt19937 rng(4);
+    std::vector<uint8_t> pixels;
+    std::vector<uint8_t> filtered;
+    std::vector<uint8_t> prev(width * bpp, 0);
+    for (uint32_t y = 0; y < height; y++) {
+        std::vector<uint8_t> row(width * bpp);
+        for (size_t i = 0; i < row.size(); i++) {
+            row[i] = uint8_t(i * 3 + y * 7 + rng() % 4);
+        }
+        uint8_t filter = uint8_t(y % 5);
+        auto encoded = filter_row(filter, row, prev, bpp);
+        filtered.push_back(filter);
+        filtered.insert(filtered.end(), encoded.begin(), encoded.end());
+        pixels.insert(pixels.end(), row.begin(), row.end());
+        prev = row;
+    }
+    auto stream = Deflate::compress(filtered, 6);
+
+    std::vector<Chunk> chunks;
+    chunks.emplace_back(ChunkType::fromStr("IHDR"), std::vector<uint8_t>{0, 0, 0, width, 0, 0, 0, height, 16, 2, 0, 0, 0});
+    for (size_t at = 0; at < stream.size(); at += 97) {
+        size_t end = std::min(stream.size(), at + 97);
+        chunks.emplace_back(ChunkType::fromStr("IDAT"), std::vector<uint8_t>(stream.begin() + at, stream.begin() + end));
+    }
+    chunks.emplace_back(ChunkType::fromStr("IEND"), std::vector<uint8_t>{});
+    PNG png(std::move(chunks));
+
+    PixelDecoder decoder(png);
+    std::vector<uint8_t> out(decoder.output_size());
+    assert(out.size() == pixels.size());
+    decoder.decode(out);
+    assert(out == pixels);
+
+    // too small a buffer is refused before anything is written
+    std::vector<uint8_t> small(out.size() - 1);
+    try {
+        decoder.decode(small);
+        assert(false);
+    } catch (const std::invalid_argument&) {
+    }
+}
+
+void test_pixel_decoder_rejects_bad_images() {
+    auto expect_invalid = [](std::vector<Chunk> chunks) {
+        try {
+            PNG png(std::move(chunks));
+            PixelDecoder decoder(png);
+            std::vector<uint8_t> out(decoder.output_size());
+            decoder.decode(out);
+            assert(false);
+        } catch (const std::invalid_argument&) {
+        }
+    };
+    auto ihdr = [](uint8_t bit_depth, uint8_t color_type, uint8_t interlace) {
+        return Chunk(ChunkType::fromStr("IHDR"), std::vector<uint8_t>{0, 0, 0, 2, 0, 0, 0, 2, bit_depth, color_type, 0, 0, interlace});
+    };
+    auto idat = [](std::vector<uint8_t> filtered) {
+        return Chunk(ChunkType::fromStr("IDAT"), Deflate::compress(filtered));
+    };
+
+    // 2x2 8-bit grayscale is two rows of a filter byte and two samples
+    std::vector<uint8_t> good = {0, 1, 2, 0, 3, 4};
+    expect_invalid({ihdr(8, 0, 1), idat(good)});
+    expect_invalid({ihdr(3, 0, 0), idat(good)});
+    expect_invalid({ihdr(8, 0, 0)});
+    expect_invalid({ihdr(8, 0, 0), idat({0, 1, 2, 0, 3})});
+    expect_invalid({ihdr(8, 0, 0), idat({0, 1, 2, 0, 3, 4, 0})});
+    expect_invalid({ihdr(8, 0, 0), idat({0, 1, 2, 7, 3, 4})});
+
+    PNG png(std::vector<Chunk>{ihdr(8, 0, 0), idat(good)});
+    PixelDecoder decoder(png);
+    std::vector<uint8_t> out(decoder.output_size());
+    decoder.decode(out);
+    assert((out == std::vector<uint8_t>{1, 2, 3, 4}));
+}
@@ -0,0 +1,180 @@
+#include "test_macro.hpp"
+#include <random>
+
+// PixelEncoder tests
+void test_filter_row_matches_reference() {
+    std::mt19937 rng(21);
+    for (size_t bpp : {1, 2, 3, 4, 6, 8}) {
+        // lengths that are not a multiple of 16 exercise the tails
+        size_t length = bpp * 37;
+        std::vector<uint8_t> prev(length);
+        std::vector<uint8_t> row(length);
+        for (size_t i = 0; i < length; i++) {
+            prev[i] = uint8_t(rng());
+            row[i] = uint8_t(rng());
+        }
+        for (uint8_t filter = Unfilter::NONE; filter <= Unfilter::PAETH; filter++) {
+            std::vector<uint8_t> out(length);
+            PixelEncoder::filter_row(filter, row.data(), prev.data(), length, bpp, out.data());
+            assert(out == filter_row(filter, row, prev, bpp));
+
+            PixelEncoder::filter_row(filter, row.data(), nullptr, length, bpp, out.data());
+            assert(out == filter_row(filter, row, std::vector<uint8_t>(length, 0), bpp));
+        }
+    }
+
+    uint8_t byte = 0;
+    try {
+        PixelEncoder::filter_row(5, &byte, nullptr, 1, 1, &byte);
+        assert(false);
+    } catch (const std::invalid_argument&) {
+    }
+}
+
+void test_encode_row_adaptive() {
+    // a horizontal gradient is all zeros after Sub, a copy of the row above
+    // all zeros after Up
+    const size_t length = 60;
+    std::vector<uint8_t> prev(length);
+    std::vector<uint8_t> row(length);
+    for (size_t i = 0; i < length; i++) {
+        prev[i] = uint8_t(i * 40);
+        row[i] = uint8_t(i * 9);
+    }
+    std::vector<uint8_t> out(length + 1);
+    assert(PixelEncoder::encode_row(FilterStrategy::Adaptive, row.data(), nullptr, length, 1, out.data()) == Unfilter::SUB);
+    assert(PixelEncoder::encode_row(FilterStrategy::Adaptive, prev.data(), prev.data(), length, 1, out.data()) == Unfilter::UP);
+    assert(out[0] == Unfilter::UP);
+    assert(std::all_of(out.begin() + 1, out.end(), [](uint8_t byte) { return byte == 0; }));
+
+    // whatever the pick, unfiltering gives the row back
+    for (auto strategy : {FilterStrategy::None, FilterStrategy::Paeth, FilterStrategy::Adaptive}) {
+        uint8_t filter = PixelEncoder::encode_row(strategy, row.data(), prev.data(), length, 3, out.data());
+        assert(out[0] == filter);
+        Unfilter::row(filter, out.data() + 1, prev.data(), length, 3);
+        assert(std::equal(row.begin(), row.end(), out.begin() + 1));
+    }
+}
+
+void test_pixel_encoder_round_trip() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    PNG png(png_data);
+    PixelDecoder decoder(png);
+    std::vector<uint8_t> pixels(decoder.output_size());
+    decoder.decode(pixels);
+
+    for (auto strategy : {FilterStrategy::None, FilterStrategy::Sub, FilterStrategy::Up, FilterStrategy::Average,
+                          FilterStrategy::Paeth, FilterStrategy::Adaptive}) {
+        for (int level : {0, 1, 6}) {
+            EncoderOptions options;
+            options.filter = strategy;
+            options.level = level;
+            options.idat_size = 1000;
+            auto idat = PixelEncoder::encode_idat(decoder.header(), pixels, options);
+            assert(!idat.empty());
+            for (size_t i = 0; i < idat.size(); i++) {
+                assert(idat[i].chunktype().toString() == "IDAT");
+                assert(i + 1 == idat.size() ? idat[i].length() <= 1000 : idat[i].length() == 1000);
+            }
+
+            PNG encoded = PixelEncoder::replace_idat(png, idat);
+            // every other chunk keeps its place, the IDATs replace the old one
+            std::vector<std::string> types;
+            for (const auto& chunk : encoded.chunks()) {
+                if (chunk.chunktype().toString() != "IDAT" || types.back() != "IDAT") {
+                    types.push_back(chunk.chunktype().toString());
+                }
+            }
+            std::vector<std::string> original;
+            for (const auto& chunk : png.chunks()) {
+                original.push_back(chunk.chunktype().toString());
+            }
+            assert(types == original);
+            assert(encoded.count_by_type(ChunkType::fromStr("IDAT")) == idat.size());
+
+            PixelDecoder round_trip(encoded);
+            std::vector<uint8_t> decoded(round_trip.output_size());
+            round_trip.decode(decoded);
+            assert(decoded == pixels);
+        }
+    }
+}
+
+void test_pixel_encoder_stripes() {
+    // 8-bit RGB, 97 pixels wide: 292 filtered bytes a row
+    ImageHeader header;
+    header.width = 97;
+    header.height = 300;
+    header.bit_depth = 8;
+    header.color_type = ImageHeader::TRUECOLOR;
+    std::mt19937 rng(12);
+    std::vector<uint8_t> pixels(header.height * header.row_bytes());
+    for (size_t i = 0; i < pixels.size(); i++) {
+        pixels[i] = uint8_t(i / 7 + rng() % 3);
+    }
+
+    ThreadPool pool(4);
+    for (int level : {0, 1, 6}) {
+        EncoderOptions options;
+        options.level = level;
+        auto serial = PixelEncoder::encode(header, pixels, options);
+
+        // a stripe of 3 rows, with the window reaching back over dozens
+        options.stripe_size = 1000;
+        auto striped = PixelEncoder::encode(header, pixels, options, pool);
+        assert(striped != serial || level == 0);
+        assert(Deflate::decompress(striped) == Deflate::decompress(serial));
+
+        // chunks are cut from the assembled stream as it is written
+        options.idat_size = 333;
+        auto idat = PixelEncoder::encode_idat(header, pixels, options, pool);
+        std::vector<uint8_t> joined;
+        for (size_t i = 0; i < idat.size(); i++) {
+            assert(i + 1 == idat.size() ? idat[i].length() <= 333 : idat[i].length() == 333);
+            joined.insert(joined.end(), idat[i].data().begin(), idat[i].data().end());
+        }
+        assert(joined == striped);
+
+        // one stripe covering the image is the serial stream
+        options.stripe_size = 1 << 20;
+        assert(PixelEncoder::encode(header, pixels, options, pool) == serial);
+    }
+}
+
+void test_pixel_encoder_options() {
+    for (auto name : {"none", "sub", "up", "average", "paeth", "adaptive"}) {
+        auto strategy = PixelEncoder::parse_strategy(name);
+        assert(strategy.has_value());
+        assert(std::string(PixelEncoder::strategy_name(*strategy)) == name);
+    }
+    assert(!PixelEncoder::parse_strategy("fast").has_value());
+
+    ImageHeader header;
+    header.width = 4;
+    header.height = 2;
+    header.bit_depth = 8;
+    header.color_type = ImageHeader::GRAYSCALE;
+    std::vector<uint8_t> pixels(8);
+    auto expect_invalid = [&](std::span<const uint8_t> data, EncoderOptions options) {
+        try {
+            PixelEncoder::encode_idat(header, data, options);
+            assert(false);
+        } catch (const std::invalid_argument&) {
+        }
+    };
+    EncoderOptions options;
+    expect_invalid(std::span<const uint8_t>(pixels).first(7), options);
+    options.level = 10;
+    expect_invalid(pixels, options);
+    options.level = 1;
+    options.idat_size = 0;
+    expect_invalid(pixels, options);
+
+    // an image without IDAT has nothing to replace
+    PNG empty(std::vector<Chunk>{chunk_from_strings("IEND", "")});
+    try {
+        PixelEncoder::replace_idat(empty, {});
+        assert(false);
+    } catch (const std::invalid_argument&) {
+    }
+}
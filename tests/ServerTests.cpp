@@ -0,0 +1,188 @@
+#include "test_macro.hpp"
+#include <thread>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Server tests
+void test_server_protocol_round_trip() {
+    auto request = ServerProtocol::encode_request({"decode", "/tmp/a b.png", "", "TeSt"});
+    assert(ServerProtocol::frame_length(request) == request.size() - 4);
+    assert(!ServerProtocol::frame_length(std::span<const uint8_t>(request).first(3)).has_value());
+    auto args = ServerProtocol::decode_request(std::span<const uint8_t>(request).subspan(4));
+    assert(args == std::vector<std::string>({"decode", "/tmp/a b.png", "", "TeSt"}));
+
+    auto response = ServerProtocol::encode_response({false, "Decoded: hey\n", "Error: nope\n"});
+    auto decoded = ServerProtocol::decode_response(std::span<const uint8_t>(response).subspan(4));
+    assert(!decoded.ok);
+    assert(decoded.out == "Decoded: hey\n");
+    assert(decoded.err == "Error: nope\n");
+
+    std::vector<uint8_t> unterminated = {'p', 'r', 'i', 'n', 't'};
+    try {
+        ServerProtocol::decode_request(unterminated);
+        assert(false);
+    } catch (const std::invalid_argument&) {
+    }
+}
+
+void test_latency_histogram() {
+    LatencyHistogram histogram;
+    assert(histogram.quantile_us(0.5) == 0);
+    for (int i = 0; i < 98; i++) {
+        histogram.record(100);
+    }
+    histogram.record(5000);
+    histogram.record(70000);
+
+    assert(histogram.count() == 100);
+    // 100 us lands in [64, 128)
+    assert(histogram.quantile_us(0.5) == 128);
+    assert(histogram.quantile_us(0.99) == 8192);
+    assert(histogram.quantile_us(1.0) == 70000);
+
+    std::ostringstream json;
+    histogram.write_json(json);
+    assert(json.str().starts_with("{\"count\": 100, \"mean_us\": 848, \"p50_us\": 128,"));
+}
+
+void test_server_requests() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    auto path = write_temp_file("server.png", png_data);
+    auto socket_path = (std::filesystem::temp_directory_path() / "pngre_server_test.sock").string();
+
+    ServerOptions options;
+    options.jobs = 2;
+    // one request at a time, everyone else waits on the queue
+    options.queue_limit = 1;
+    Server server(socket_path, options);
+    std::thread loop([&] { server.run(); });
+
+    {
+        ServerClient client(socket_path);
+        auto response = client.call({"decode", path, "RuSt"});
+        assert(response.ok);
+        assert(response.out == "Decoded: hey\n");
+
+        response = client.call({"resize", path});
+        assert(!response.ok);
+        assert(response.err == "Error: Unknown command 'resize'\n");
+        response = client.call({"decode", "-", "RuSt"});
+        assert(!response.ok);
+    }
+
+    std::vector<std::thread> clients;
+    std::atomic<int> decoded{0};
+    for (int i = 0; i < 4; i++) {
+        clients.emplace_back([&] {
+            ServerClient client(socket_path);
+            for (int j = 0; j < 10; j++) {
+                decoded += client.call({"decode", path, "RuSt"}).out == "Decoded: hey\n";
+            }
+        });
+    }
+    for (auto& thread : clients) {
+        thread.join();
+    }
+    assert(decoded == 40);
+
+    ServerClient client(socket_path);
+    std::string stats = client.stats();
+    assert(stats.find("\"queue_limit\": 1,") != std::string::npos);
+    assert(stats.find("\"decode\": {\"count\": 42,") != std::string::npos);
+    assert(stats.find("\"other\": {\"count\": 1,") != std::string::npos);
+
+    server.stop();
+    loop.join();
+    std::filesystem::remove(path);
+}
+
+void test_server_pipelined_requests() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    auto path = write_temp_file("server_pipelined.png", png_data);
+    auto socket_path = (std::filesystem::temp_directory_path() / "pngre_server_pipelined.sock").string();
+
+    Server server(socket_path);
+    std::thread loop([&] { server.run(); });
+
+    // three requests in one write, answered in order
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    socket_path.copy(address.sun_path, socket_path.size());
+    assert(connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0);
+
+    std::vector<uint8_t> requests;
+    for (const auto& args : std::vector<std::vector<std::string>>{{"decode", path, "RuSt"}, {"stats"}, {"print", path}}) {
+        auto frame = ServerProtocol::encode_request(args);
+        requests.insert(requests.end(), frame.begin(), frame.end());
+    }
+    assert(write(fd, requests.data(), requests.size()) == static_cast<ssize_t>(requests.size()));
+    shutdown(fd, SHUT_WR);
+
+    // the server closes once the last response has gone out
+    std::vector<uint8_t> received;
+    uint8_t buffer[4096];
+    ssize_t count;
+    while ((count = read(fd, buffer, sizeof(buffer))) > 0) {
+        received.insert(received.end(), buffer, buffer + count);
+    }
+    close(fd);
+
+    std::vector<ServerResponse> responses;
+    std::span<const uint8_t> rest(received);
+    while (auto length = ServerProtocol::frame_length(rest)) {
+        responses.push_back(ServerProtocol::decode_response(rest.subspan(4, *length)));
+        rest = rest.subspan(4 + *length);
+    }
+    assert(responses.size() == 3);
+    assert(responses[0].out == "Decoded: hey\n");
+    assert(responses[1].out.starts_with("{\"connections\": 1,"));
+    assert(responses[2].out.starts_with("Chunk [0]: Chunk { length: 13, type: IHDR"));
+
+    server.stop();
+    loop.join();
+    std::filesystem::remove(path);
+}
+
+void test_server_concurrent_encodes() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    auto path = write_temp_file("server_encodes.png", png_data);
+    auto socket_path = (std::filesystem::temp_directory_path() / "pngre_server_encodes.sock").string();
+
+    ServerOptions options;
+    options.jobs = 8;
+    Server server(socket_path, options);
+    std::thread loop([&] { server.run(); });
+
+    // writers to one file take turns, readers run alongside each other
+    std::vector<std::thread> clients;
+    std::atomic<int> failed{0};
+    for (int i = 0; i < 8; i++) {
+        clients.emplace_back([&, i] {
+            ServerClient client(socket_path);
+            for (int j = 0; j < 5; j++) {
+                failed += !client.call({"encode", path, "TeSt", "message" + std::to_string(i * 5 + j)}).ok;
+                failed += !client.call({"print", path}).ok;
+            }
+        });
+    }
+    for (auto& thread : clients) {
+        thread.join();
+    }
+    assert(failed == 0);
+
+    server.stop();
+    loop.join();
+
+    PNG png{PNGFile(path)};
+    auto chunks = png.chunks_by_type(ChunkType::fromStr("TeSt"));
+    assert(chunks.size() == 40);
+    std::vector<std::string> messages;
+    for (const Chunk* chunk : chunks) {
+        messages.push_back(chunk->data_as_string());
+    }
+    std::sort(messages.begin(), messages.end());
+    assert(std::unique(messages.begin(), messages.end()) == messages.end());
+    std::filesystem::remove(path);
+}
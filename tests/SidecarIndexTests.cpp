@@ -0,0 +1,137 @@
+#include "test_macro.hpp"
+
+// SidecarIndex tests
+void test_sidecar_index_round_trip() {
+    FileKey key{1, 2, 1000, 1234567890123};
+    std::vector<IndexedChunk> chunks = {
+        {ChunkType::fromStr("IHDR"), 8, 13, 0xdeadbeef, true},
+        {ChunkType::fromStr("IEND"), 500, 0, 0xae426082, false},
+    };
+    auto bytes = SidecarIndex::encode(key, chunks);
+    assert(bytes.size() == SidecarIndex::HEADER_SIZE + 2 * SidecarIndex::ENTRY_SIZE + 4);
+
+    auto decoded = SidecarIndex::decode(bytes, key);
+    assert(decoded.has_value() && decoded->size() == 2);
+    assert((*decoded)[0].chunktype == ChunkType::fromStr("IHDR"));
+    assert((*decoded)[0].crc == 0xdeadbeef && (*decoded)[0].verified);
+    assert((*decoded)[1].offset == 500 && !(*decoded)[1].verified);
+
+    // only the size and mtime have to match, the sidecar follows the path
+    assert(SidecarIndex::decode(bytes, FileKey{9, 9, 1000, 1234567890123}).has_value());
+    assert(!SidecarIndex::decode(bytes, FileKey{1, 2, 1001, 1234567890123}).has_value());
+    assert(!SidecarIndex::decode(bytes, FileKey{1, 2, 1000, 1234567890124}).has_value());
+
+    auto corrupt = bytes;
+    corrupt[SidecarIndex::HEADER_SIZE + 5] ^= 1;
+    assert(!SidecarIndex::decode(corrupt, key).has_value());
+    assert(!SidecarIndex::decode(std::span<const uint8_t>(bytes).first(bytes.size() - 1), key).has_value());
+
+    // an entry past the end of the image
+    chunks[1].offset = 990;
+    assert(!SidecarIndex::decode(SidecarIndex::encode(key, chunks), key).has_value());
+}
+
+void test_sidecar_index_command() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    auto path = write_temp_file("sidecar.png", png_data);
+    std::ostringstream out;
+    std::ostringstream err;
+
+    assert(run_command({"index", path, "--verify"}, out, err));
+    assert(out.str() == "Indexed 7 chunks of " + path + " into " + path + ".pngidx\n");
+    assert(std::filesystem::exists(path + ".pngidx"));
+
+    // headers come from the sidecar, the walker never runs
+    Stats::reset();
+    Stats::enable(true);
+    std::ostringstream decoded;
+    assert(run_command({"decode", path, "RuSt"}, decoded, err));
+    assert(decoded.str() == "Decoded: hey\n");
+    assert(Stats::count(Counter::ChunksParsed) == 0);
+    std::ostringstream printed;
+    assert(run_command({"print", path, "--verify"}, printed, err));
+    assert(Stats::count(Counter::ChunksParsed) == 0);
+
+    // bit rot with the size and mtime unchanged: the sidecar still matches
+    // and says verified, print --verify reads the data again anyway
+    auto mtime = std::filesystem::last_write_time(path);
+    auto rotten = png_data;
+    auto hey = std::search(rotten.begin(), rotten.end(), std::begin("hey"), std::end("hey") - 1);
+    *hey ^= 1;
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.write(reinterpret_cast<const char*>(rotten.data()), rotten.size());
+    }
+    std::filesystem::last_write_time(path, mtime);
+    bool threw = false;
+    try {
+        std::ostringstream ignored;
+        run_command({"print", path, "--verify"}, ignored, err);
+    } catch (const std::invalid_argument& e) {
+        threw = std::string(e.what()).starts_with("CRC mismatch");
+    }
+    assert(threw);
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.write(reinterpret_cast<const char*>(png_data.data()), png_data.size());
+    }
+
+    // encoding changes the image, so the sidecar is stale and ignored
+    assert(run_command({"encode", path, "ruSt", "fresh"}, out, err));
+    Stats::reset();
+    std::ostringstream fresh;
+    assert(run_command({"decode", path, "ruSt"}, fresh, err));
+    assert(fresh.str() == "Decoded: fresh\n");
+    assert(Stats::count(Counter::ChunksParsed) > 0);
+    Stats::enable(false);
+    Stats::reset();
+
+    std::filesystem::remove(path + ".pngidx");
+    std::filesystem::remove(path);
+}
+
+void test_sidecar_index_same_size_rewrite() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    auto path = write_temp_file("sidecar_rewrite.png", png_data);
+    std::ostringstream out;
+    std::ostringstream err;
+    assert(run_command({"index", path}, out, err));
+
+    // same size, with the mtime put back: the sidecar still matches the key
+    // but not the chunks, so decode walks the file instead
+    PNG png(png_data);
+    png.remove_first_chunk(ChunkType::fromStr("RuSt"));
+    png.insert_before_iend({Chunk(ChunkType::fromStr("RuSt"), {'b', 'y', 'e'})});
+    auto rewritten = png.as_bytes();
+    assert(rewritten.size() == png_data.size());
+    auto mtime = std::filesystem::last_write_time(path);
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.write(reinterpret_cast<const char*>(rewritten.data()), rewritten.size());
+    }
+    std::filesystem::last_write_time(path, mtime);
+
+    std::ostringstream decoded;
+    assert(run_command({"decode", path, "RuSt"}, decoded, err));
+    assert(decoded.str() == "Decoded: bye\n");
+    assert(!std::filesystem::exists(path + ".pngidx"));
+
+    // print --verify likewise, with a chunk moved under the index
+    assert(run_command({"index", path}, out, err));
+    png.remove_first_chunk(ChunkType::fromStr("RuSt"));
+    png.insert_before_iend({Chunk(ChunkType::fromStr("ruSt"), {'b', 'y', 'e'})});
+    rewritten = png.as_bytes();
+    mtime = std::filesystem::last_write_time(path);
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.write(reinterpret_cast<const char*>(rewritten.data()), rewritten.size());
+    }
+    std::filesystem::last_write_time(path, mtime);
+
+    std::ostringstream printed;
+    assert(run_command({"print", path, "--verify"}, printed, err));
+    assert(printed.str().find("type: ruSt") != std::string::npos);
+    assert(!std::filesystem::exists(path + ".pngidx"));
+
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,101 @@
+#include "test_macro.hpp"
+#include <thread>
+
+// Stats tests
+void test_stats_disabled_by_default() {
+    Stats::reset();
+    assert(!Stats::enabled());
+    Stats::add(Counter::Syscalls, 5);
+    {
+        ScopedTimer timer(Phase::Read);
+    }
+    assert(Stats::count(Counter::Syscalls) == 0);
+    assert(Stats::calls(Phase::Read) == 0);
+}
+
+void test_stats_nested_timers_are_exclusive() {
+    Stats::reset();
+    Stats::enable(true);
+    {
+        ScopedTimer outer(Phase::Serialize);
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        {
+            ScopedTimer inner(Phase::Write);
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+    Stats::enable(false);
+
+    assert(Stats::calls(Phase::Serialize) == 1);
+    assert(Stats::calls(Phase::Write) == 1);
+    assert(Stats::nanoseconds(Phase::Write) >= 20'000'000);
+    // the outer phase keeps its own 5 ms, not the 20 ms write inside it
+    assert(Stats::nanoseconds(Phase::Serialize) >= 5'000'000);
+    assert(Stats::nanoseconds(Phase::Serialize) < 20'000'000);
+    Stats::reset();
+}
+
+void test_stats_count_a_command() {
+    std::vector<uint8_t> png_data(PNG_FILE, PNG_FILE + sizeof(PNG_FILE));
+    auto path = write_temp_file("stats.png", png_data);
+    std::ostringstream out;
+    std::ostringstream err;
+
+    Stats::reset();
+    Stats::enable(true);
+    assert(run_command({"encode", path, "ruSt", "counted"}, out, err));
+    Stats::enable(false);
+
+    assert(Stats::count(Counter::ChunksParsed) > 0);
+    // encode patches the file in place: the new chunk, then IEND again
+    assert(Stats::count(Counter::BytesWritten) == 12 + 7 + 12);
+    assert(Stats::count(Counter::CrcBytes) > 0);
+    assert(Stats::count(Counter::Syscalls) > 0);
+    assert(Stats::count(Counter::Allocations) > 0);
+    assert(Stats::calls(Phase::Write) > 0);
+
+    // nothing moves once disabled
+    uint64_t chunks = Stats::count(Counter::ChunksParsed);
+    assert(run_command({"decode", path, "ruSt"}, out, err));
+    assert(Stats::count(Counter::ChunksParsed) == chunks);
+    Stats::reset();
+    std::filesystem::remove(path);
+}
+
+void test_stats_formats() {
+    Stats::reset();
+    Stats::enable(true);
+    Stats::add(Counter::BytesRead, 1234);
+    Stats::add_time(Phase::Parse, 1'500'000'000);
+    Stats::enable(false);
+
+    std::ostringstream text;
+    Stats::report(text, StatsFormat::Text, "print", 2.5);
+    assert(text.str().starts_with("Stats: print in 2.5 s\n"));
+    assert(text.str().find("bytes_read") != std::string::npos);
+
+    std::ostringstream json;
+    Stats::report(json, StatsFormat::Json, "print", 2.5);
+    assert(json.str().starts_with("{\"command\": \"print\", \"wall_seconds\": 2.5, \"phases\": {\"read\": "));
+    assert(json.str().find("\"parse\": {\"seconds\": 1.5, \"calls\": 1}") != std::string::npos);
+    assert(json.str().find("\"bytes_read\": 1234,") != std::string::npos);
+
+    std::ostringstream prometheus;
+    Stats::report(prometheus, StatsFormat::Prometheus, "print", 2.5);
+    assert(prometheus.str().find("pngre_phase_seconds_total{command=\"print\",phase=\"parse\"} 1.5\n") != std::string::npos);
+    assert(prometheus.str().find("# TYPE pngre_bytes_read_total counter\npngre_bytes_read_total{command=\"print\"} 1234\n") != std::string::npos);
+    Stats::reset();
+
+    std::vector<std::string_view> args = {"print", "--stats=json", "image.png"};
+    assert(take_stats(args) == StatsFormat::Json);
+    assert(args == std::vector<std::string_view>({"print", "image.png"}));
+    args = {"--stats", "print"};
+    assert(take_stats(args) == StatsFormat::Text);
+    assert(!take_stats(args).has_value());
+    args = {"print", "--stats=xml"};
+    try {
+        take_stats(args);
+        assert(false);
+    } catch (const std::invalid_argument&) {
+    }
+}
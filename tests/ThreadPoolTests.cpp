@@ -0,0 +1,39 @@
+#include "test_macro.hpp"
+#include <atomic>
+
+// ThreadPool tests
+void test_thread_pool_runs_all_tasks() {
+    ThreadPool pool(4);
+    std::atomic<int> count{0};
+    for (int i = 0; i < 1000; i++) {
+        pool.submit([&] { count++; });
+    }
+    pool.wait();
+    assert(count == 1000);
+}
+
+void test_thread_pool_nested_submit() {
+    ThreadPool pool(3);
+    std::atomic<int> count{0};
+    for (int i = 0; i < 10; i++) {
+        pool.submit([&] {
+            for (int j = 0; j < 10; j++) {
+                pool.submit([&] { count++; });
+            }
+        });
+    }
+    pool.wait();
+    assert(count == 100);
+}
+
+void test_thread_pool_rethrows() {
+    ThreadPool pool(2);
+    pool.submit([] { throw std::runtime_error("task failed"); });
+    bool exception_thrown = false;
+    try {
+        pool.wait();
+    } catch (const std::runtime_error&) {
+        exception_thrown = true;
+    }
+    assert(exception_thrown);
+}
@@ -2,7 +2,31 @@
 #include <iostream>
 #include "../src/Chunk.hpp"
 #include "../src/ChunkType.hpp"
+#include "../src/Crc32.hpp"
 #include "../src/PNG.hpp"
+#include "../src/PNGFile.hpp"
+#include "../src/ChunkStream.hpp"
+#include "../src/ChunkWalker.hpp"
+#include "../src/PNGPatch.hpp"
+#include "../src/ByteSink.hpp"
+#include "../src/AtomicFile.hpp"
+#include "../src/ThreadPool.hpp"
+#include "../src/Batch.hpp"
+#include "../src/ChunkValidator.hpp"
+#include "../src/Deflate.hpp"
+#include "../src/CompressedPayload.hpp"
+#include "../src/Unfilter.hpp"
+#include "../src/PixelDecoder.hpp"
+#include "../src/PixelEncoder.hpp"
+#include "../src/LsbCodec.hpp"
+#include "../src/Stats.hpp"
+#include "../src/ServerProtocol.hpp"
+#include "../src/Server.hpp"
+#include "../src/ServerClient.hpp"
+#include "../src/ChunkIndex.hpp"
+#include "../src/ParseCache.hpp"
+#include "../src/SidecarIndex.hpp"
+#include "../src/Commands.hpp"
 #include <cassert>
 #include <sstream>
 #include <optional>
@@ -2,6 +2,24 @@
 #include "ChunkTypeTests.cpp"
 #include "ChunkTests.cpp"
 #include "PNGTests.cpp"
+#include "Crc32Tests.cpp"
+#include "PNGFileTests.cpp"
+#include "ChunkStreamTests.cpp"
+#include "ChunkWalkerTests.cpp"
+#include "PNGPatchTests.cpp"
+#include "AtomicFileTests.cpp"
+#include "ByteSinkTests.cpp"
+#include "ThreadPoolTests.cpp"
+#include "BatchTests.cpp"
+#include "ChunkValidatorTests.cpp"
+#include "DeflateTests.cpp"
+#include "PixelDecoderTests.cpp"
+#include "PixelEncoderTests.cpp"
+#include "LsbCodecTests.cpp"
+#include "StatsTests.cpp"
+#include "ServerTests.cpp"
+#include "ParseCacheTests.cpp"
+#include "SidecarIndexTests.cpp"
 
 int main() {
     std::cout << "===== ChunkType tests started =====" << std::endl;
@@ -38,6 +56,8 @@ int main() {
         RUN_TEST(test_chunk_string);
         RUN_TEST(test_chunk_crc);
         RUN_TEST(test_chunk_trait_impls);
+        RUN_TEST(test_chunk_write_to);
+        RUN_TEST(test_chunk_copy_and_move);
     } catch(const std::exception& e) {
         std::cerr << "Chunk Test failed: " << e.what() << std::endl;
         return 1;
@@ -58,11 +78,258 @@ int main() {
         RUN_TEST(test_png_from_image_file);
         RUN_TEST(test_as_bytes);
         RUN_TEST(test_png_trait_impls);
+        RUN_TEST(test_chunks_by_type);
+        RUN_TEST(test_remove_leaves_order_intact);
+        RUN_TEST(test_png_write_to);
+        RUN_TEST(test_png_arena_storage);
+        RUN_TEST(test_png_lazy_validation);
+        RUN_TEST(test_insert_before_iend);
+        RUN_TEST(test_remove_chunks);
     } catch(const std::exception& e) {
         std::cerr << "PNG Test failed: " << e.what() << std::endl;
         return 1;
     }
     std::cout << "===== PNG tests passed =====\n" << std::endl;
+
+    std::cout << "===== Crc32 tests started =====" << std::endl;
+    try {
+        // Crc32 tests
+        RUN_TEST(test_crc_check_value);
+        RUN_TEST(test_crc_engines_match_table);
+        RUN_TEST(test_crc_update_continues);
+        RUN_TEST(test_crc_set_engine);
+        RUN_TEST(test_crc_combine);
+        RUN_TEST(test_crc_hasher_pieces);
+        RUN_TEST(test_crc_hasher_threads);
+    } catch(const std::exception& e) {
+        std::cerr << "Crc32 Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "===== Crc32 tests passed =====\n" << std::endl;
+
+    std::cout << "===== PNGFile tests started =====" << std::endl;
+    try {
+        // PNGFile tests
+        RUN_TEST(test_png_file_chunks_match_png);
+        RUN_TEST(test_png_file_views_are_zero_copy);
+        RUN_TEST(test_png_from_png_file);
+        RUN_TEST(test_png_file_invalid);
+        RUN_TEST(test_png_lazy_from_file);
+    } catch(const std::exception& e) {
+        std::cerr << "PNGFile Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "===== PNGFile tests passed =====\n" << std::endl;
+
+    std::cout << "===== ChunkStream tests started =====" << std::endl;
+    try {
+        // ChunkStream tests
+        RUN_TEST(test_stream_round_trip);
+        RUN_TEST(test_stream_read_chunk);
+        RUN_TEST(test_stream_large_chunk);
+        RUN_TEST(test_stream_crc_mismatch);
+        RUN_TEST(test_stream_rejects_oversized_length);
+        RUN_TEST(test_stream_write_payload);
+    } catch(const std::exception& e) {
+        std::cerr << "ChunkStream Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "===== ChunkStream tests passed =====\n" << std::endl;
+
+    std::cout << "===== ChunkWalker tests started =====" << std::endl;
+    try {
+        // ChunkWalker tests
+        RUN_TEST(test_chunk_walker_matches_scan);
+        RUN_TEST(test_chunk_walker_reads_and_verifies);
+        RUN_TEST(test_chunk_walker_truncated);
+    } catch(const std::exception& e) {
+        std::cerr << "ChunkWalker Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "===== ChunkWalker tests passed =====\n" << std::endl;
+
+    std::cout << "===== PNGPatch tests started =====" << std::endl;
+    try {
+        // PNGPatch tests
+        RUN_TEST(test_append_before_iend_in_place);
+        RUN_TEST(test_append_before_iend_trailing_bytes);
+        RUN_TEST(test_state_after_tail_write_parses);
+        RUN_TEST(test_append_many_before_iend);
+    } catch(const std::exception& e) {
+        std::cerr << "PNGPatch Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "===== PNGPatch tests passed =====\n" << std::endl;
+
+    std::cout << "===== AtomicFile tests started =====" << std::endl;
+    try {
+        // AtomicFile tests
+        RUN_TEST(test_atomic_file_commit);
+        RUN_TEST(test_atomic_file_discard);
+        RUN_TEST(test_atomic_file_permissions);
+        RUN_TEST(test_atomic_file_through_symlink);
+        RUN_TEST(test_atomic_file_non_regular);
+    } catch(const std::exception& e) {
+        std::cerr << "AtomicFile Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "===== AtomicFile tests passed =====\n" << std::endl;
+
+    std::cout << "===== ByteSink tests started =====" << std::endl;
+    try {
+        // ByteSink tests
+        RUN_TEST(test_fd_sink_batches_pieces);
+        RUN_TEST(test_png_write_to_fd);
+    } catch(const std::exception& e) {
+        std::cerr << "ByteSink Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "===== ByteSink tests passed =====\n" << std::endl;
+
+    std::cout << "===== ThreadPool tests started =====" << std::endl;
+    try {
+        // ThreadPool tests
+        RUN_TEST(test_thread_pool_runs_all_tasks);
+        RUN_TEST(test_thread_pool_nested_submit);
+        RUN_TEST(test_thread_pool_rethrows);
+    } catch(const std::exception& e) {
+        std::cerr << "ThreadPool Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "===== ThreadPool tests passed =====\n" << std::endl;
+
+    std::cout << "===== Batch tests started =====" << std::endl;
+    try {
+        // Batch tests
+        RUN_TEST(test_batch_split_line);
+        RUN_TEST(test_batch_run_ordered);
+        RUN_TEST(test_batch_op_template);
+        RUN_TEST(test_batch_same_file_in_order);
+        RUN_TEST(test_batch_new_output_in_order);
+    } catch(const std::exception& e) {
+        std::cerr << "Batch Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "===== Batch tests passed =====\n" << std::endl;
+
+    std::cout << "===== ChunkValidator tests started =====" << std::endl;
+    try {
+        // ChunkValidator tests
+        RUN_TEST(test_validator_parallel_matches_serial);
+        RUN_TEST(test_validator_reports_first_failure);
+    } catch(const std::exception& e) {
+        std::cerr << "ChunkValidator Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "===== ChunkValidator tests passed =====\n" << std::endl;
+
+    std::cout << "===== Deflate tests started =====" << std::endl;
+    try {
+        // Deflate tests
+        RUN_TEST(test_deflate_round_trip_all_levels);
+        RUN_TEST(test_inflate_zlib_stream);
+        RUN_TEST(test_deflate_parallel_matches_serial);
+        RUN_TEST(test_adler32_combine);
+        RUN_TEST(test_inflate_rejects_corrupt_input);
+        RUN_TEST(test_compressed_payload);
+        RUN_TEST(test_from_file_payload_round_trip);
+        RUN_TEST(test_foreign_chunks_pass_through);
+    } catch(const std::exception& e) {
+        std::cerr << "Deflate Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "===== Deflate tests passed =====\n" << std::endl;
+
+    std::cout << "===== PixelDecoder tests started =====" << std::endl;
+    try {
+        // PixelDecoder tests
+        RUN_TEST(test_unfilter_engines_match_scalar);
+        RUN_TEST(test_pixel_decoder_png_file);
+        RUN_TEST(test_pixel_decoder_split_idat);
+        RUN_TEST(test_pixel_decoder_rejects_bad_images);
+    } catch(const std::exception& e) {
+        std::cerr << "PixelDecoder Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "===== PixelDecoder tests passed =====\n" << std::endl;
+
+    std::cout << "===== PixelEncoder tests started =====" << std::endl;
+    try {
+        // PixelEncoder tests
+        RUN_TEST(test_filter_row_matches_reference);
+        RUN_TEST(test_encode_row_adaptive);
+        RUN_TEST(test_pixel_encoder_round_trip);
+        RUN_TEST(test_pixel_encoder_stripes);
+        RUN_TEST(test_pixel_encoder_options);
+    } catch(const std::exception& e) {
+        std::cerr << "PixelEncoder Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "===== PixelEncoder tests passed =====\n" << std::endl;
+
+    std::cout << "===== LsbCodec tests started =====" << std::endl;
+    try {
+        // LsbCodec tests
+        RUN_TEST(test_lsb_engines_match_reference);
+        RUN_TEST(test_lsb_embed_extract);
+        RUN_TEST(test_lsb_16_bit);
+        RUN_TEST(test_lsb_rejects_unsupported_images);
+        RUN_TEST(test_encode_lsb_command);
+    } catch(const std::exception& e) {
+        std::cerr << "LsbCodec Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "===== LsbCodec tests passed =====\n" << std::endl;
+
+    std::cout << "===== Stats tests started =====" << std::endl;
+    try {
+        // Stats tests
+        RUN_TEST(test_stats_disabled_by_default);
+        RUN_TEST(test_stats_nested_timers_are_exclusive);
+        RUN_TEST(test_stats_count_a_command);
+        RUN_TEST(test_stats_formats);
+    } catch(const std::exception& e) {
+        std::cerr << "Stats Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "===== Stats tests passed =====\n" << std::endl;
+
+    std::cout << "===== Server tests started =====" << std::endl;
+    try {
+        // Server tests
+        RUN_TEST(test_server_protocol_round_trip);
+        RUN_TEST(test_latency_histogram);
+        RUN_TEST(test_server_requests);
+        RUN_TEST(test_server_pipelined_requests);
+        RUN_TEST(test_server_concurrent_encodes);
+    } catch(const std::exception& e) {
+        std::cerr << "Server Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "===== Server tests passed =====\n" << std::endl;
+
+    std::cout << "===== ParseCache tests started =====" << std::endl;
+    try {
+        // ParseCache tests
+        RUN_TEST(test_parse_cache_lru_eviction);
+        RUN_TEST(test_parse_cache_decode);
+    } catch(const std::exception& e) {
+        std::cerr << "ParseCache Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "===== ParseCache tests passed =====\n" << std::endl;
+
+    std::cout << "===== SidecarIndex tests started =====" << std::endl;
+    try {
+        // SidecarIndex tests
+        RUN_TEST(test_sidecar_index_round_trip);
+        RUN_TEST(test_sidecar_index_command);
+        RUN_TEST(test_sidecar_index_same_size_rewrite);
+    } catch(const std::exception& e) {
+        std::cerr << "SidecarIndex Test failed: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "===== SidecarIndex tests passed =====\n" << std::endl;
     
     std::cout << "===================================\n"
           << "All tests passed\n"